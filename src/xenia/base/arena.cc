@@ -70,7 +70,7 @@ void Arena::Rewind(size_t size) {
   active_chunk_->offset -= size;
 }
 
-void* Arena::CloneContents() {
+size_t Arena::QuerySize() {
   size_t total_length = 0;
   Chunk* chunk = head_chunk_;
   while (chunk) {
@@ -80,9 +80,14 @@ void* Arena::CloneContents() {
     }
     chunk = chunk->next;
   }
+  return total_length;
+}
+
+void* Arena::CloneContents() {
+  size_t total_length = QuerySize();
   void* result = malloc(total_length);
   uint8_t* p = (uint8_t*)result;
-  chunk = head_chunk_;
+  Chunk* chunk = head_chunk_;
   while (chunk) {
     std::memcpy(p, chunk->buffer, chunk->offset);
     p += chunk->offset;
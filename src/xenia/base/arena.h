@@ -30,6 +30,8 @@ class Arena {
   }
   void Rewind(size_t size);
 
+  // Total bytes allocated since the last Reset.
+  size_t QuerySize();
   void* CloneContents();
 
  private:
@@ -28,6 +28,12 @@ void* Backend::AllocThreadData() { return nullptr; }
 
 void Backend::FreeThreadData(void* thread_data) {}
 
+bool Backend::LoadCachedFunction(FunctionInfo* symbol_info,
+                                 uint32_t debug_info_flags,
+                                 Function** out_function) {
+  return false;
+}
+
 }  // namespace backend
 }  // namespace cpu
 }  // namespace xe
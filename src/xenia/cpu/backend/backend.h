@@ -10,12 +10,16 @@
 #ifndef XENIA_BACKEND_BACKEND_H_
 #define XENIA_BACKEND_BACKEND_H_
 
+#include <cstdint>
 #include <memory>
 
 #include "xenia/cpu/backend/machine_info.h"
 
 namespace xe {
 namespace cpu {
+class Function;
+class FunctionInfo;
+class Module;
 class Processor;
 }  // namespace cpu
 }  // namespace xe
@@ -27,6 +31,18 @@ namespace backend {
 class Assembler;
 class CodeCache;
 
+// Runs an interpreted function; see Backend::PlaceInterpreterEntry.
+typedef uint64_t (*InterpreterEntry)(void* context, void* function,
+                                     void* return_address);
+
+// A guest function on a host stack, as found by Backend::UnwindGuestStack.
+struct GuestStackFrame {
+  // Host address being executed within the function's code: the sampled
+  // instruction for the innermost frame, return addresses for the others.
+  uint64_t host_pc;
+  uint32_t guest_address;
+};
+
 class Backend {
  public:
   Backend(Processor* processor);
@@ -46,6 +62,40 @@ class Backend {
 
   virtual std::unique_ptr<Assembler> CreateAssembler() = 0;
 
+  // Attempts to define the function from code persisted by a previous run.
+  // Returns false if the function must be translated.
+  virtual bool LoadCachedFunction(FunctionInfo* symbol_info,
+                                  uint32_t debug_info_flags,
+                                  Function** out_function);
+
+  // Releases the code of a function that can no longer be reached through
+  // the entry table. Other threads may still be running it.
+  virtual void FreeFunctionCode(Function* function) {}
+  // Drops anything kept for a module that is being removed.
+  virtual void ReleaseModule(Module* module) {}
+
+  // Places code that calls entry(context, function, return_address) when
+  // called as the generated code for the function, so that generated code
+  // can call functions that are interpreted. Returns the code, or nullptr if
+  // the backend doesn't generate code.
+  virtual void* PlaceInterpreterEntry(FunctionInfo* symbol_info,
+                                      InterpreterEntry entry, void* function,
+                                      size_t* out_code_size) {
+    return nullptr;
+  }
+
+  // Walks the guest frames of a host thread stopped at host_pc/host_sp.
+  // stack_data is a copy of its stack starting at host_sp, as the thread may
+  // have moved on. Frames are written innermost first, and the walk stops at
+  // the first one not in generated code. Returns the number of frames.
+  virtual size_t UnwindGuestStack(uint64_t host_pc, uint64_t host_sp,
+                                  const uint8_t* stack_data,
+                                  size_t stack_data_size,
+                                  GuestStackFrame* out_frames,
+                                  size_t max_frames) {
+    return 0;
+  }
+
  protected:
   Processor* processor_;
   MachineInfo machine_info_;
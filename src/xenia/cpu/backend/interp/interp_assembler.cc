@@ -0,0 +1,293 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/interp/interp_assembler.h"
+
+#include <cstring>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/reset_scope.h"
+#include "xenia/cpu/backend/backend.h"
+#include "xenia/cpu/block_counters.h"
+#include "xenia/cpu/hir/block.h"
+#include "xenia/cpu/hir/hir_builder.h"
+#include "xenia/cpu/hir/instr.h"
+#include "xenia/cpu/hir/label.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/profiling.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace interp {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::HIRBuilder;
+
+namespace {
+
+// The PACK and UNPACK variants the x64 backend implements, and so the ones
+// the frontend emits.
+bool IsPackSupported(uint32_t flags) {
+  switch (flags & PACK_TYPE_MODE) {
+    case PACK_TYPE_D3DCOLOR:
+    case PACK_TYPE_FLOAT16_2:
+    case PACK_TYPE_FLOAT16_4:
+    case PACK_TYPE_SHORT_2:
+    case PACK_TYPE_UINT_2101010:
+      return true;
+    case PACK_TYPE_8_IN_16:
+      if (IsPackInUnsigned(flags)) {
+        return IsPackOutUnsigned(flags) && IsPackOutSaturate(flags);
+      }
+      return IsPackOutSaturate(flags);
+    case PACK_TYPE_16_IN_32:
+      return !IsPackInUnsigned(flags) && IsPackOutSaturate(flags);
+    default:
+      return false;
+  }
+}
+
+bool IsUnpackSupported(uint32_t flags) {
+  switch (flags & PACK_TYPE_MODE) {
+    case PACK_TYPE_D3DCOLOR:
+    case PACK_TYPE_FLOAT16_2:
+    case PACK_TYPE_FLOAT16_4:
+    case PACK_TYPE_SHORT_2:
+      return true;
+    case PACK_TYPE_8_IN_16:
+    case PACK_TYPE_16_IN_32:
+      return !IsPackInUnsigned(flags) && !IsPackOutUnsigned(flags);
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+InterpAssembler::InterpAssembler(Backend* backend)
+    : Assembler(backend), slot_count_(0) {}
+
+InterpAssembler::~InterpAssembler() = default;
+
+void InterpAssembler::Reset() {
+  value_slots_.clear();
+  constants_.clear();
+  slot_count_ = 0;
+  code_.clear();
+  block_starts_.clear();
+  label_fixups_.clear();
+  Assembler::Reset();
+}
+
+bool InterpAssembler::Assemble(FunctionInfo* symbol_info, HIRBuilder* builder,
+                               uint32_t debug_info_flags,
+                               std::unique_ptr<DebugInfo> debug_info,
+                               Function** out_function) {
+  SCOPE_profile_cpu_f("cpu");
+
+  // Reset when we leave.
+  xe::make_reset_scope(this);
+
+  value_slots_.resize(builder->max_value_ordinal(), kInvalidSlot);
+  AssignConstantSlots(builder);
+
+  auto block_counters = backend_->processor()->block_counters();
+  for (auto block = builder->first_block(); block; block = block->next) {
+    // Ordinals are sequential after finalization.
+    if (block->ordinal >= block_starts_.size()) {
+      block_starts_.resize(block->ordinal + 1, 0);
+    }
+    block_starts_[block->ordinal] = static_cast<uint32_t>(code_.size());
+    if (block_counters) {
+      EmitBlockCounter(symbol_info, block);
+    }
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      if (!LowerInstr(instr)) {
+        return false;
+      }
+    }
+  }
+
+  // Running off the end of the last block returns.
+  InterpInstr ret;
+  std::memset(&ret, 0, sizeof(ret));
+  ret.opcode = OPCODE_RETURN;
+  code_.push_back(ret);
+
+  for (auto& fixup : label_fixups_) {
+    auto& instr = code_[fixup.first];
+    InterpOperand* operands[] = {&instr.src1, &instr.src2, &instr.src3};
+    auto operand = operands[fixup.second];
+    operand->target = block_starts_[operand->target];
+  }
+
+  auto fn = new InterpFunction(symbol_info);
+  fn->set_debug_info(std::move(debug_info));
+  fn->Setup(std::vector<InterpInstr>(code_.begin(), code_.end()),
+            std::vector<InterpValue>(constants_.begin(), constants_.end()),
+            slot_count_,
+            !!(builder->attributes() & FUNCTION_ATTRIB_BASELINE));
+
+  // Code generated by the backend calls functions through their machine
+  // code, so it needs a way in to the interpreter.
+  if (backend_->code_cache()) {
+    size_t code_size = 0;
+    void* machine_code = backend_->PlaceInterpreterEntry(
+        symbol_info, InterpFunction::Enter, fn, &code_size);
+    if (!machine_code) {
+      XELOGE("Unable to place interpreter entry for %.8X",
+             symbol_info->address());
+      delete fn;
+      return false;
+    }
+    fn->SetupEntry(reinterpret_cast<uint8_t*>(machine_code), code_size);
+  }
+
+  *out_function = fn;
+
+  return true;
+}
+
+void InterpAssembler::AssignConstantSlots(HIRBuilder* builder) {
+  // Constants take the first slots, so that the function can start from a
+  // copy of them.
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      uint32_t signature = instr->opcode->signature;
+      const Instr::Op* sources[] = {&instr->src1, &instr->src2, &instr->src3};
+      OpcodeSignatureType sig_types[] = {
+          GET_OPCODE_SIG_TYPE_SRC1(signature),
+          GET_OPCODE_SIG_TYPE_SRC2(signature),
+          GET_OPCODE_SIG_TYPE_SRC3(signature),
+      };
+      for (size_t n = 0; n < 3; ++n) {
+        if (sig_types[n] != OPCODE_SIG_TYPE_V) {
+          continue;
+        }
+        auto value = sources[n]->value;
+        if (!value->IsConstant() ||
+            value_slots_[value->ordinal] != kInvalidSlot) {
+          continue;
+        }
+        InterpValue constant;
+        static_assert(sizeof(constant) == sizeof(value->constant),
+                      "slots must hold any constant");
+        std::memcpy(&constant, &value->constant, sizeof(constant));
+        value_slots_[value->ordinal] = slot_count_++;
+        constants_.push_back(constant);
+      }
+    }
+  }
+}
+
+uint32_t InterpAssembler::GetSlot(const Value* value) {
+  assert_true(value->ordinal < value_slots_.size());
+  uint32_t& slot = value_slots_[value->ordinal];
+  if (slot == kInvalidSlot) {
+    slot = slot_count_++;
+  }
+  return slot;
+}
+
+bool InterpAssembler::LowerInstr(const Instr* instr) {
+  auto opcode = instr->opcode->num;
+  switch (opcode) {
+    case OPCODE_COMMENT:
+    case OPCODE_NOP:
+    case OPCODE_SOURCE_OFFSET:
+      return true;
+    case OPCODE_PACK:
+      if (!IsPackSupported(instr->flags)) {
+        XELOGE("Unsupported PACK type %.4X", instr->flags);
+        return false;
+      }
+      break;
+    case OPCODE_UNPACK:
+      if (!IsUnpackSupported(instr->flags)) {
+        XELOGE("Unsupported UNPACK type %.4X", instr->flags);
+        return false;
+      }
+      break;
+    default:
+      break;
+  }
+
+  InterpInstr result;
+  std::memset(&result, 0, sizeof(result));
+  result.opcode = static_cast<uint16_t>(opcode);
+  result.flags = instr->flags;
+  if (instr->dest) {
+    result.dest = GetSlot(instr->dest);
+    result.dest_type = static_cast<uint8_t>(instr->dest->type);
+  }
+
+  uint32_t signature = instr->opcode->signature;
+  const Instr::Op* sources[] = {&instr->src1, &instr->src2, &instr->src3};
+  OpcodeSignatureType sig_types[] = {
+      GET_OPCODE_SIG_TYPE_SRC1(signature),
+      GET_OPCODE_SIG_TYPE_SRC2(signature),
+      GET_OPCODE_SIG_TYPE_SRC3(signature),
+  };
+  InterpOperand* operands[] = {&result.src1, &result.src2, &result.src3};
+  for (size_t n = 0; n < 3; ++n) {
+    switch (sig_types[n]) {
+      case OPCODE_SIG_TYPE_L:
+        operands[n]->target = sources[n]->label->block->ordinal;
+        label_fixups_.emplace_back(code_.size(), static_cast<int>(n));
+        break;
+      case OPCODE_SIG_TYPE_O:
+        operands[n]->offset = sources[n]->offset;
+        break;
+      case OPCODE_SIG_TYPE_S:
+        operands[n]->symbol_info = sources[n]->symbol_info;
+        break;
+      case OPCODE_SIG_TYPE_V:
+        operands[n]->slot = GetSlot(sources[n]->value);
+        result.src_types[n] = static_cast<uint8_t>(sources[n]->value->type);
+        break;
+      default:
+        break;
+    }
+  }
+
+  code_.push_back(result);
+  return true;
+}
+
+void InterpAssembler::EmitBlockCounter(FunctionInfo* symbol_info,
+                                       const Block* block) {
+  // Same blocks as the x64 backend counts: named by their first guest
+  // instruction, if they have one.
+  const Instr* i = block->instr_head;
+  while (i && i->opcode != &OPCODE_SOURCE_OFFSET_info) {
+    i = i->next;
+  }
+  if (!i) {
+    return;
+  }
+  uint32_t index = backend_->processor()->block_counters()->AllocateCounter(
+      symbol_info->address(), static_cast<uint32_t>(i->src1.offset));
+  if (index == BlockCounters::kInvalidIndex) {
+    return;
+  }
+  InterpInstr counter;
+  std::memset(&counter, 0, sizeof(counter));
+  counter.opcode = INTERP_OPCODE_BLOCK_COUNTER;
+  counter.src1.offset = index;
+  code_.push_back(counter);
+}
+
+}  // namespace interp
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,76 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BACKEND_INTERP_INTERP_ASSEMBLER_H_
+#define XENIA_BACKEND_INTERP_INTERP_ASSEMBLER_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "xenia/cpu/backend/assembler.h"
+#include "xenia/cpu/backend/interp/interp_function.h"
+
+namespace xe {
+namespace cpu {
+namespace hir {
+class Block;
+class Instr;
+class Value;
+}  // namespace hir
+}  // namespace cpu
+}  // namespace xe
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace interp {
+
+// Lowers finalized HIR to InterpInstrs. May be created on any backend: when
+// that one generates code, it is asked for an entry stub so that its code can
+// call the interpreted function.
+class InterpAssembler : public Assembler {
+ public:
+  InterpAssembler(Backend* backend);
+  ~InterpAssembler() override;
+
+  void Reset() override;
+
+  bool Assemble(FunctionInfo* symbol_info, hir::HIRBuilder* builder,
+                uint32_t debug_info_flags,
+                std::unique_ptr<DebugInfo> debug_info,
+                Function** out_function) override;
+
+ private:
+  static const uint32_t kInvalidSlot = ~0u;
+
+  void AssignConstantSlots(hir::HIRBuilder* builder);
+  uint32_t GetSlot(const hir::Value* value);
+  bool LowerInstr(const hir::Instr* instr);
+  void EmitBlockCounter(FunctionInfo* symbol_info, const hir::Block* block);
+
+  // Slot of each value by ordinal, or kInvalidSlot.
+  std::vector<uint32_t> value_slots_;
+  std::vector<InterpValue> constants_;
+  uint32_t slot_count_;
+
+  std::vector<InterpInstr> code_;
+  // Index of the first instruction of each block, by block ordinal.
+  std::vector<uint32_t> block_starts_;
+  // Instructions with a label operand, and which source it is (0-2). The
+  // operand holds the block ordinal until the code is complete.
+  std::vector<std::pair<size_t, int>> label_fixups_;
+};
+
+}  // namespace interp
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_BACKEND_INTERP_INTERP_ASSEMBLER_H_
@@ -0,0 +1,49 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/interp/interp_backend.h"
+
+#include "xenia/cpu/backend/interp/interp_assembler.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace interp {
+
+InterpBackend::InterpBackend(Processor* processor) : Backend(processor) {}
+
+InterpBackend::~InterpBackend() = default;
+
+bool InterpBackend::Initialize() {
+  if (!Backend::Initialize()) {
+    return false;
+  }
+
+  // Byte swapping loads and stores cost nothing extra here.
+  machine_info_.supports_extended_load_store = true;
+
+  // No register sets: values live in slots of their own, so the HIR is
+  // interpreted without register allocation.
+
+  return true;
+}
+
+void InterpBackend::CommitExecutableRange(uint32_t guest_low,
+                                          uint32_t guest_high) {
+  // Functions are found through the processor, not an indirection table.
+}
+
+std::unique_ptr<Assembler> InterpBackend::CreateAssembler() {
+  return std::make_unique<InterpAssembler>(this);
+}
+
+}  // namespace interp
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,44 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BACKEND_INTERP_INTERP_BACKEND_H_
+#define XENIA_BACKEND_INTERP_INTERP_BACKEND_H_
+
+#include <memory>
+
+#include "xenia/cpu/backend/backend.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace interp {
+
+// Runs finalized HIR directly, without generating any code. Slow, but quick
+// to translate for and portable, which makes it a reference for the other
+// backends (--cpu=interp). Its assembler can also be used on top of another
+// backend for code that hasn't run enough to be worth compiling; see
+// --baseline_interpreter.
+class InterpBackend : public Backend {
+ public:
+  InterpBackend(Processor* processor);
+  ~InterpBackend() override;
+
+  bool Initialize() override;
+
+  void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high) override;
+
+  std::unique_ptr<Assembler> CreateAssembler() override;
+};
+
+}  // namespace interp
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_BACKEND_INTERP_INTERP_BACKEND_H_
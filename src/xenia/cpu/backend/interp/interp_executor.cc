@@ -0,0 +1,1633 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/interp/interp_executor.h"
+
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/debugging.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/cpu/backend/interp/interp_function.h"
+#include "xenia/cpu/cpu-private.h"
+#include "xenia/cpu/frontend/ppc_context.h"
+#include "xenia/cpu/frontend/ppc_frontend.h"
+#include "xenia/cpu/hir/opcodes.h"
+#include "xenia/cpu/hir/value.h"
+#include "xenia/cpu/mmio_handler.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/symbol_info.h"
+#include "xenia/cpu/thread_state.h"
+
+#include "third_party/half/include/half.hpp"
+
+DECLARE_bool(enable_debugprint_log);
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace interp {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::frontend::PPCContext;
+
+namespace {
+
+// Slots that fit on the stack; larger functions allocate theirs.
+const uint32_t kStackSlotCount = 64;
+
+// Integer values, zero or sign extended from their type.
+uint64_t GetU(uint8_t type, const InterpValue& v) {
+  switch (type) {
+    case INT8_TYPE:
+      return uint8_t(v.i8);
+    case INT16_TYPE:
+      return uint16_t(v.i16);
+    case INT32_TYPE:
+      return uint32_t(v.i32);
+    default:
+      return uint64_t(v.i64);
+  }
+}
+
+int64_t GetS(uint8_t type, const InterpValue& v) {
+  switch (type) {
+    case INT8_TYPE:
+      return v.i8;
+    case INT16_TYPE:
+      return v.i16;
+    case INT32_TYPE:
+      return v.i32;
+    default:
+      return v.i64;
+  }
+}
+
+void SetI(uint8_t type, InterpValue& v, uint64_t value) {
+  switch (type) {
+    case INT8_TYPE:
+      v.i8 = int8_t(value);
+      break;
+    case INT16_TYPE:
+      v.i16 = int16_t(value);
+      break;
+    case INT32_TYPE:
+      v.i32 = int32_t(value);
+      break;
+    default:
+      v.i64 = int64_t(value);
+      break;
+  }
+}
+
+uint32_t TypeBits(uint8_t type) {
+  return uint32_t(GetTypeSize(TypeName(type))) * 8;
+}
+
+// Truth of a condition is any bit set, whatever its type.
+bool IsNonZero(uint8_t type, const InterpValue& v) {
+  switch (type) {
+    case FLOAT32_TYPE: {
+      uint32_t bits;
+      std::memcpy(&bits, &v.f32, sizeof(bits));
+      return bits != 0;
+    }
+    case FLOAT64_TYPE: {
+      uint64_t bits;
+      std::memcpy(&bits, &v.f64, sizeof(bits));
+      return bits != 0;
+    }
+    case VEC128_TYPE:
+      return (v.v128.low | v.v128.high) != 0;
+    default:
+      return GetU(type, v) != 0;
+  }
+}
+
+void LoadValue(uint8_t type, InterpValue& v, const void* p, bool swap) {
+  std::memcpy(&v, p, GetTypeSize(TypeName(type)));
+  if (!swap) {
+    return;
+  }
+  switch (type) {
+    case INT16_TYPE:
+      v.i16 = xe::byte_swap(v.i16);
+      break;
+    case INT32_TYPE:
+    case FLOAT32_TYPE:
+      v.i32 = xe::byte_swap(v.i32);
+      break;
+    case INT64_TYPE:
+    case FLOAT64_TYPE:
+      v.i64 = xe::byte_swap(v.i64);
+      break;
+    case VEC128_TYPE:
+      for (int i = 0; i < 4; ++i) {
+        v.v128.u32[i] = xe::byte_swap(v.v128.u32[i]);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void StoreValue(uint8_t type, void* p, const InterpValue& v, bool swap) {
+  InterpValue swapped = v;
+  LoadValue(type, swapped, &v, swap);
+  std::memcpy(p, &swapped, GetTypeSize(TypeName(type)));
+}
+
+// Converts between an MMIO register value and its guest memory image, with
+// the same byte order MMIOHandler::HandleAccessFault gives faulting moves.
+uint64_t SwapMMIOValue(size_t size, uint64_t value) {
+  switch (size) {
+    case 1:
+      return uint8_t(value);
+    case 2:
+      return xe::byte_swap(uint16_t(value));
+    case 4:
+      return xe::byte_swap(uint32_t(value));
+    default:
+      return xe::byte_swap(value);
+  }
+}
+
+// Mapped ranges are committed no-access, so guest loads and stores must be
+// checked against them before touching membase; a fault inside memcpy can't
+// be emulated by the MMIO handler.
+bool LoadMMIOValue(uint8_t type, InterpValue& v, uint32_t address, bool swap) {
+  auto mmio_handler = MMIOHandler::global_handler();
+  size_t size = GetTypeSize(TypeName(type));
+  uint64_t value;
+  if (!mmio_handler || size > sizeof(value) ||
+      !mmio_handler->CheckLoad(address, &value)) {
+    return false;
+  }
+  value = SwapMMIOValue(size, value);
+  LoadValue(type, v, &value, swap);
+  return true;
+}
+
+bool StoreMMIOValue(uint8_t type, uint32_t address, const InterpValue& v,
+                    bool swap) {
+  auto mmio_handler = MMIOHandler::global_handler();
+  size_t size = GetTypeSize(TypeName(type));
+  uint64_t value = 0;
+  if (!mmio_handler || size > sizeof(value)) {
+    return false;
+  }
+  StoreValue(type, &value, v, swap);
+  return mmio_handler->CheckStore(address, SwapMMIOValue(size, value));
+}
+
+template <typename T>
+T RotateLeft(T v, uint32_t sh) {
+  sh &= sizeof(T) * 8 - 1;
+  return sh ? T((v << sh) | (v >> (sizeof(T) * 8 - sh))) : v;
+}
+
+uint64_t RotateLeftI(uint8_t type, uint64_t v, uint32_t sh) {
+  switch (type) {
+    case INT8_TYPE:
+      return RotateLeft(uint8_t(v), sh);
+    case INT16_TYPE:
+      return RotateLeft(uint16_t(v), sh);
+    case INT32_TYPE:
+      return RotateLeft(uint32_t(v), sh);
+    default:
+      return RotateLeft(uint64_t(v), sh);
+  }
+}
+
+uint64_t UMulHi64(uint64_t a, uint64_t b) {
+  uint64_t a_lo = uint32_t(a), a_hi = a >> 32;
+  uint64_t b_lo = uint32_t(b), b_hi = b >> 32;
+  uint64_t lo_lo = a_lo * b_lo;
+  uint64_t hi_lo = a_hi * b_lo;
+  uint64_t lo_hi = a_lo * b_hi;
+  uint64_t hi_hi = a_hi * b_hi;
+  uint64_t cross = (lo_lo >> 32) + uint32_t(hi_lo) + lo_hi;
+  return hi_hi + (hi_lo >> 32) + (cross >> 32);
+}
+
+struct AddOp {
+  template <typename T>
+  static T Apply(T a, T b) {
+    return a + b;
+  }
+};
+struct SubOp {
+  template <typename T>
+  static T Apply(T a, T b) {
+    return a - b;
+  }
+};
+struct MulOp {
+  template <typename T>
+  static T Apply(T a, T b) {
+    return a * b;
+  }
+};
+struct DivOp {
+  template <typename T>
+  static T Apply(T a, T b) {
+    return a / b;
+  }
+};
+// maxss/minss: the second operand when unordered.
+struct MaxOp {
+  template <typename T>
+  static T Apply(T a, T b) {
+    return a > b ? a : b;
+  }
+};
+struct MinOp {
+  template <typename T>
+  static T Apply(T a, T b) {
+    return a < b ? a : b;
+  }
+};
+
+template <typename Op>
+void FloatBinary(uint8_t type, InterpValue& d, const InterpValue& a,
+                 const InterpValue& b) {
+  switch (type) {
+    case FLOAT32_TYPE:
+      d.f32 = Op::Apply(a.f32, b.f32);
+      break;
+    case FLOAT64_TYPE:
+      d.f64 = Op::Apply(a.f64, b.f64);
+      break;
+    case VEC128_TYPE:
+      for (int i = 0; i < 4; ++i) {
+        d.v128.f32[i] = Op::Apply(a.v128.f32[i], b.v128.f32[i]);
+      }
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+bool IsFloatType(uint8_t type) {
+  return type == FLOAT32_TYPE || type == FLOAT64_TYPE || type == VEC128_TYPE;
+}
+
+bool CompareInt(uint16_t opcode, uint8_t type, const InterpValue& a,
+                const InterpValue& b) {
+  switch (opcode) {
+    case OPCODE_COMPARE_EQ:
+      return GetU(type, a) == GetU(type, b);
+    case OPCODE_COMPARE_NE:
+      return GetU(type, a) != GetU(type, b);
+    case OPCODE_COMPARE_SLT:
+      return GetS(type, a) < GetS(type, b);
+    case OPCODE_COMPARE_SLE:
+      return GetS(type, a) <= GetS(type, b);
+    case OPCODE_COMPARE_SGT:
+      return GetS(type, a) > GetS(type, b);
+    case OPCODE_COMPARE_SGE:
+      return GetS(type, a) >= GetS(type, b);
+    case OPCODE_COMPARE_ULT:
+      return GetU(type, a) < GetU(type, b);
+    case OPCODE_COMPARE_ULE:
+      return GetU(type, a) <= GetU(type, b);
+    case OPCODE_COMPARE_UGT:
+      return GetU(type, a) > GetU(type, b);
+    case OPCODE_COMPARE_UGE:
+      return GetU(type, a) >= GetU(type, b);
+    default:
+      assert_unhandled_case(opcode);
+      return false;
+  }
+}
+
+// As comiss/comisd and the flags the x64 backend tests after them: unordered
+// operands compare equal, and less than.
+template <typename T>
+bool CompareFloat(uint16_t opcode, T a, T b) {
+  bool unordered = std::isnan(a) || std::isnan(b);
+  switch (opcode) {
+    case OPCODE_COMPARE_EQ:
+      return unordered || a == b;
+    case OPCODE_COMPARE_NE:
+      return !unordered && a != b;
+    case OPCODE_COMPARE_SLT:
+    case OPCODE_COMPARE_ULT:
+      return unordered || a < b;
+    case OPCODE_COMPARE_SLE:
+    case OPCODE_COMPARE_ULE:
+      return unordered || a <= b;
+    case OPCODE_COMPARE_SGT:
+    case OPCODE_COMPARE_UGT:
+      return !unordered && a > b;
+    case OPCODE_COMPARE_SGE:
+    case OPCODE_COMPARE_UGE:
+      return !unordered && a >= b;
+    default:
+      assert_unhandled_case(opcode);
+      return false;
+  }
+}
+
+template <typename T>
+T RoundFloat(uint32_t mode, T v) {
+  switch (mode) {
+    case ROUND_TO_ZERO:
+      return std::trunc(v);
+    case ROUND_TO_NEAREST:
+      return std::nearbyint(v);
+    case ROUND_TO_MINUS_INFINITY:
+      return std::floor(v);
+    case ROUND_TO_POSITIVE_INFINITY:
+      return std::ceil(v);
+    default:
+      assert_unhandled_case(mode);
+      return v;
+  }
+}
+
+// cvtss2si/cvttsd2si: the "integer indefinite" value when out of range.
+template <typename I, typename F>
+I ConvertToInt(F v, bool round) {
+  if (round) {
+    v = std::nearbyint(v);
+  }
+  if (!(v >= F(std::numeric_limits<I>::min()) &&
+        v < -F(std::numeric_limits<I>::min()))) {
+    return std::numeric_limits<I>::min();
+  }
+  return I(v);
+}
+
+template <typename T>
+T Saturate(int64_t v) {
+  return T(std::min(std::max(v, int64_t(std::numeric_limits<T>::min())),
+                    int64_t(std::numeric_limits<T>::max())));
+}
+
+vec128_t Pshufb(const vec128_t& s, const vec128_t& m) {
+  vec128_t d;
+  for (int j = 0; j < 16; ++j) {
+    d.u8[j] = (m.u8[j] & 0x80) ? 0 : s.u8[m.u8[j] & 0xF];
+  }
+  return d;
+}
+
+// minps/maxps: the second operand when unordered.
+vec128_t MinPs(const vec128_t& a, const vec128_t& b) {
+  vec128_t d;
+  for (int i = 0; i < 4; ++i) {
+    d.f32[i] = MinOp::Apply(a.f32[i], b.f32[i]);
+  }
+  return d;
+}
+
+vec128_t MaxPs(const vec128_t& a, const vec128_t& b) {
+  vec128_t d;
+  for (int i = 0; i < 4; ++i) {
+    d.f32[i] = MaxOp::Apply(a.f32[i], b.f32[i]);
+  }
+  return d;
+}
+
+// pack*: a fills the low half of the result and b the high half.
+template <typename In, typename Out>
+vec128_t PackSaturate(const In* a, const In* b) {
+  const int count = 16 / sizeof(In);
+  vec128_t d;
+  Out* out = reinterpret_cast<Out*>(&d);
+  for (int i = 0; i < count; ++i) {
+    out[i] = Saturate<Out>(a[i]);
+    out[i + count] = Saturate<Out>(b[i]);
+  }
+  return d;
+}
+
+vec128_t Pack(uint32_t flags, const vec128_t& a, const vec128_t& b) {
+  switch (flags & PACK_TYPE_MODE) {
+    case PACK_TYPE_D3DCOLOR: {
+      // Saturate to 3.0f + [0, 0xFF] / (1 << 22) and take the low byte.
+      vec128_t d = MaxPs(MinPs(a, vec128i(0x404000FF)), vec128f(3.0f));
+      return Pshufb(d, vec128i(0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF,
+                               0x0C000408));
+    }
+    case PACK_TYPE_FLOAT16_2:
+    case PACK_TYPE_FLOAT16_4: {
+      int count = (flags & PACK_TYPE_MODE) == PACK_TYPE_FLOAT16_2 ? 2 : 4;
+      vec128_t d;
+      d.low = d.high = 0;
+      for (int i = 0; i < count; ++i) {
+        d.u16[7 - i] =
+            half_float::detail::float2half<std::round_toward_zero>(a.f32[i]);
+      }
+      return d;
+    }
+    case PACK_TYPE_SHORT_2: {
+      // Saturate to 3.0f + [-0x7FFF, 0x7FFF] / (1 << 22).
+      vec128_t d = MinPs(MaxPs(a, vec128i(0x403F8001)), vec128i(0x40407FFF));
+      return Pshufb(d, vec128i(0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF,
+                               0x01000504));
+    }
+    case PACK_TYPE_UINT_2101010: {
+      uint32_t c[4];
+      for (int i = 0; i < 3; ++i) {
+        // XYZ are 10 bits, signed and saturated.
+        uint32_t exponent = (a.u32[i] >> 23) & 0xFF;
+        uint32_t fractional = a.u32[i] & 0x007FFFFF;
+        if (exponent == 0xFF && fractional) {
+          c[i] = 0x200;
+        } else if (a.i32[i] > 0x404001FF) {
+          c[i] = 0x1FF;
+        } else if (a.i32[i] < 0x403FFE01) {
+          c[i] = 0x201;
+        } else {
+          c[i] = a.u32[i] & 0x3FF;
+        }
+      }
+      // W is 2 bits, unsigned and saturated.
+      uint32_t w_exponent = (a.u32[3] >> 23) & 0xFF;
+      uint32_t w_fractional = a.u32[3] & 0x007FFFFF;
+      if (w_exponent == 0xFF && w_fractional) {
+        c[3] = 0;
+      } else if (a.i32[3] > 0x40400003) {
+        c[3] = 3;
+      } else if (a.i32[3] < 0x40400000) {
+        c[3] = 0;
+      } else {
+        c[3] = a.u32[3] & 0x3;
+      }
+      return vec128i(0, 0, 0, (c[3] << 30) | ((c[2] & 0x3FF) << 20) |
+                                  ((c[1] & 0x3FF) << 10) | (c[0] & 0x3FF));
+    }
+    case PACK_TYPE_8_IN_16: {
+      if (IsPackInUnsigned(flags)) {
+        vec128_t d;
+        for (int i = 0; i < 8; ++i) {
+          d.u8[i] = uint8_t(std::min(uint16_t(255), a.u16[i]));
+          d.u8[i + 8] = uint8_t(std::min(uint16_t(255), b.u16[i]));
+        }
+        return d;
+      }
+      vec128_t d = IsPackOutUnsigned(flags)
+                       ? PackSaturate<int16_t, uint8_t>(a.i16, b.i16)
+                       : PackSaturate<int16_t, int8_t>(a.i16, b.i16);
+      return Pshufb(d, vec128i(0x01000302, 0x05040706, 0x09080B0A,
+                               0x0D0C0F0E));
+    }
+    case PACK_TYPE_16_IN_32: {
+      vec128_t d = IsPackOutUnsigned(flags)
+                       ? PackSaturate<int32_t, uint16_t>(a.i32, b.i32)
+                       : PackSaturate<int32_t, int16_t>(a.i32, b.i32);
+      for (int i = 0; i < 8; i += 2) {
+        std::swap(d.u16[i], d.u16[i + 1]);
+      }
+      return d;
+    }
+    default:
+      assert_unhandled_case(flags);
+      return a;
+  }
+}
+
+vec128_t Unpack(uint32_t flags, const vec128_t& a) {
+  switch (flags & PACK_TYPE_MODE) {
+    case PACK_TYPE_D3DCOLOR: {
+      if (!a.low && !a.high) {
+        return vec128f(1.0f);
+      }
+      vec128_t d = Pshufb(a, vec128i(0xFFFFFF0E, 0xFFFFFF0D, 0xFFFFFF0C,
+                                     0xFFFFFF0F));
+      for (int i = 0; i < 4; ++i) {
+        d.u32[i] |= 0x3F800000;
+      }
+      return d;
+    }
+    case PACK_TYPE_FLOAT16_2: {
+      vec128_t d;
+      for (int i = 0; i < 2; ++i) {
+        d.f32[i] = half_float::detail::half2float(a.u16[7 - i]);
+      }
+      d.f32[2] = 0.0f;
+      d.f32[3] = 1.0f;
+      return d;
+    }
+    case PACK_TYPE_FLOAT16_4: {
+      // The halves come in swapped in pairs.
+      vec128_t s = a;
+      std::swap(s.u16[7], s.u16[6]);
+      std::swap(s.u16[5], s.u16[4]);
+      vec128_t d;
+      for (int i = 0; i < 4; ++i) {
+        d.f32[3 - i] = half_float::detail::half2float(s.u16[7 - i]);
+      }
+      return d;
+    }
+    case PACK_TYPE_SHORT_2: {
+      vec128_t bias = vec128f(3.0f, 3.0f, 0.0f, 1.0f);
+      if (!a.low && !a.high) {
+        return bias;
+      }
+      vec128_t d = Pshufb(a, vec128i(0xFFFF0F0E, 0xFFFF0D0C, 0xFFFFFFFF,
+                                     0xFFFFFFFF));
+      for (int i = 0; i < 4; ++i) {
+        d.i32[i] = int32_t(int16_t(d.u32[i])) + bias.i32[i];
+      }
+      return d;
+    }
+    case PACK_TYPE_8_IN_16: {
+      // punpck*bw with itself, then psrad as the x64 backend does.
+      int base = IsPackToHi(flags) ? 0 : 8;
+      vec128_t d;
+      for (int i = 0; i < 8; ++i) {
+        d.u8[i * 2] = d.u8[i * 2 + 1] = a.u8[base + i];
+      }
+      for (int i = 0; i < 4; ++i) {
+        d.i32[i] = d.i32[i] >> 8;
+      }
+      return d;
+    }
+    case PACK_TYPE_16_IN_32: {
+      int base = IsPackToHi(flags) ? 0 : 4;
+      vec128_t d;
+      for (int i = 0; i < 4; ++i) {
+        d.i32[i] = a.i16[base + i];
+      }
+      for (int i = 0; i < 4; i += 2) {
+        std::swap(d.i32[i], d.i32[i + 1]);
+      }
+      return d;
+    }
+    default:
+      assert_unhandled_case(flags);
+      return a;
+  }
+}
+
+template <typename T>
+T VectorAddSub(bool is_sub, uint32_t arithmetic_flags, T a, T b) {
+  typedef typename std::make_unsigned<T>::type U;
+  if (!(arithmetic_flags & ARITHMETIC_SATURATE)) {
+    return T(is_sub ? U(a) - U(b) : U(a) + U(b));
+  }
+  if (arithmetic_flags & ARITHMETIC_UNSIGNED) {
+    int64_t v = is_sub ? int64_t(U(a)) - int64_t(U(b))
+                       : int64_t(U(a)) + int64_t(U(b));
+    return T(Saturate<U>(v));
+  }
+  int64_t v = is_sub ? int64_t(a) - int64_t(b) : int64_t(a) + int64_t(b);
+  return Saturate<T>(v);
+}
+
+template <typename T>
+void VectorAddSubLanes(bool is_sub, uint32_t arithmetic_flags, T* d,
+                       const T* a, const T* b) {
+  for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+    d[i] = VectorAddSub(is_sub, arithmetic_flags, a[i], b[i]);
+  }
+}
+
+template <typename T>
+void VectorMaxMinLanes(bool is_max, T* d, const T* a, const T* b) {
+  for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+    d[i] = is_max ? std::max(a[i], b[i]) : std::min(a[i], b[i]);
+  }
+}
+
+template <typename T>
+void VectorCompareLanes(uint16_t opcode, T* d, const T* a, const T* b) {
+  typedef typename std::make_unsigned<T>::type U;
+  for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+    bool result;
+    switch (opcode) {
+      case OPCODE_VECTOR_COMPARE_EQ:
+        result = a[i] == b[i];
+        break;
+      case OPCODE_VECTOR_COMPARE_SGT:
+        result = a[i] > b[i];
+        break;
+      case OPCODE_VECTOR_COMPARE_SGE:
+        result = a[i] >= b[i];
+        break;
+      case OPCODE_VECTOR_COMPARE_UGT:
+        result = U(a[i]) > U(b[i]);
+        break;
+      case OPCODE_VECTOR_COMPARE_UGE:
+        result = U(a[i]) >= U(b[i]);
+        break;
+      default:
+        assert_unhandled_case(opcode);
+        result = false;
+        break;
+    }
+    d[i] = result ? T(-1) : T(0);
+  }
+}
+
+template <typename T>
+void VectorShiftLanes(uint16_t opcode, T* d, const T* a, const T* b) {
+  typedef typename std::make_unsigned<T>::type U;
+  typedef typename std::make_signed<T>::type S;
+  const uint32_t mask = sizeof(T) * 8 - 1;
+  for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+    uint32_t sh = U(b[i]) & mask;
+    switch (opcode) {
+      case OPCODE_VECTOR_SHL:
+        d[i] = T(U(a[i]) << sh);
+        break;
+      case OPCODE_VECTOR_SHR:
+        d[i] = T(U(a[i]) >> sh);
+        break;
+      case OPCODE_VECTOR_SHA:
+        d[i] = T(S(a[i]) >> sh);
+        break;
+      case OPCODE_VECTOR_ROTATE_LEFT:
+        d[i] = T(RotateLeft(U(a[i]), sh));
+        break;
+      default:
+        assert_unhandled_case(opcode);
+        break;
+    }
+  }
+}
+
+template <typename T>
+void VectorAverageLanes(bool is_unsigned, T* d, const T* a, const T* b) {
+  typedef typename std::make_unsigned<T>::type U;
+  for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+    int64_t sum = is_unsigned ? int64_t(U(a[i])) + int64_t(U(b[i])) + 1
+                              : int64_t(a[i]) + int64_t(b[i]) + 1;
+    d[i] = T(sum >> 1);
+  }
+}
+
+void CallFunction(ThreadState* thread_state, uint32_t address,
+                  FunctionInfo* symbol_info, uint32_t return_address) {
+  Function* fn = symbol_info ? symbol_info->function() : nullptr;
+  if (!fn) {
+    thread_state->processor()->ResolveFunction(address, &fn);
+  }
+  assert_not_null(fn);
+  if (fn) {
+    fn->Call(thread_state, return_address);
+  }
+}
+
+void Trap(ThreadState* thread_state, uint16_t trap_type) {
+  switch (trap_type) {
+    case 20:
+    case 26: {
+      // 0x0FE00014 is a 'debug print' where r3 = buffer r4 = length
+      auto context = thread_state->context();
+      auto str = reinterpret_cast<const char*>(
+          context->virtual_membase + uint32_t(context->r[3]));
+      // TODO(benvanik): truncate to length?
+      XELOGD("(DebugPrint) %s", str);
+      if (FLAGS_enable_debugprint_log) {
+        debugging::DebugPrint("(DebugPrint) %s\n", str);
+      }
+      break;
+    }
+    case 0:
+    case 22:
+      // Always trap?
+      if (FLAGS_break_on_debugbreak) {
+        xe::debugging::Break();
+      }
+      break;
+    case 25:
+      // ?
+      break;
+    default:
+      XELOGW("Unknown trap type %d", trap_type);
+      xe::debugging::Break();
+      break;
+  }
+}
+
+}  // namespace
+
+void Execute(ThreadState* thread_state, InterpFunction* function,
+             uint32_t return_address) {
+  auto context = thread_state->context();
+  auto symbol_info = function->symbol_info();
+
+  // As the prolog of generated baseline code.
+  if (function->is_baseline() && --*symbol_info->call_countdown() == 0) {
+    thread_state->processor()->frontend()->recompiler()->Enqueue(symbol_info);
+  }
+
+  InterpValue stack_slots[kStackSlotCount];
+  std::unique_ptr<InterpValue[]> heap_slots;
+  InterpValue* slots = stack_slots;
+  if (function->slot_count() > kStackSlotCount) {
+    heap_slots.reset(new InterpValue[function->slot_count()]);
+    slots = heap_slots.get();
+  }
+  const auto& constants = function->constants();
+  if (!constants.empty()) {
+    std::memcpy(slots, constants.data(),
+                constants.size() * sizeof(InterpValue));
+  }
+
+  uint8_t* membase = context->virtual_membase;
+  uint32_t call_return_address = 0;
+
+  const InterpInstr* code = function->code().data();
+  const InterpInstr* instr = code;
+  while (true) {
+    InterpValue& dest = slots[instr->dest];
+    const uint8_t type = instr->dest_type;
+    const uint8_t src_type = instr->src_types[0];
+#define SRC1 slots[instr->src1.slot]
+#define SRC2 slots[instr->src2.slot]
+#define SRC3 slots[instr->src3.slot]
+    const InterpInstr* next = instr + 1;
+    switch (instr->opcode) {
+      case INTERP_OPCODE_BLOCK_COUNTER:
+        ++context->block_counters[instr->src1.offset];
+        break;
+
+      case OPCODE_DEBUG_BREAK:
+        xe::debugging::Break();
+        break;
+      case OPCODE_DEBUG_BREAK_TRUE:
+        if (IsNonZero(src_type, SRC1)) {
+          xe::debugging::Break();
+        }
+        break;
+      case OPCODE_TRAP:
+        Trap(thread_state, instr->flags);
+        break;
+      case OPCODE_TRAP_TRUE:
+        if (IsNonZero(src_type, SRC1)) {
+          Trap(thread_state, instr->flags);
+        }
+        break;
+
+      case OPCODE_CALL:
+      case OPCODE_CALL_TRUE: {
+        const InterpOperand& target =
+            instr->opcode == OPCODE_CALL ? instr->src1 : instr->src2;
+        if (instr->opcode == OPCODE_CALL_TRUE &&
+            !IsNonZero(src_type, SRC1)) {
+          break;
+        }
+        auto callee = target.symbol_info;
+        if (instr->flags & CALL_TAIL) {
+          CallFunction(thread_state, callee->address(), callee,
+                       return_address);
+          return;
+        }
+        CallFunction(thread_state, callee->address(), callee,
+                     call_return_address);
+        break;
+      }
+      case OPCODE_CALL_INDIRECT:
+      case OPCODE_CALL_INDIRECT_TRUE: {
+        uint32_t target;
+        if (instr->opcode == OPCODE_CALL_INDIRECT) {
+          target = uint32_t(GetU(src_type, SRC1));
+        } else {
+          if (!IsNonZero(src_type, SRC1)) {
+            break;
+          }
+          target = uint32_t(GetU(instr->src_types[1], SRC2));
+        }
+        if ((instr->flags & CALL_POSSIBLE_RETURN) &&
+            target == return_address) {
+          return;
+        }
+        if (instr->flags & CALL_TAIL) {
+          CallFunction(thread_state, target, nullptr, return_address);
+          return;
+        }
+        CallFunction(thread_state, target, nullptr, call_return_address);
+        break;
+      }
+      case OPCODE_CALL_EXTERN: {
+        auto callee = instr->src1.symbol_info;
+        if (callee->behavior() == FunctionBehavior::kBuiltin) {
+          callee->builtin_handler()(context, callee->builtin_arg0(),
+                                    callee->builtin_arg1());
+        } else if (callee->behavior() == FunctionBehavior::kExtern &&
+                   callee->extern_handler()) {
+          callee->extern_handler()(context, context->kernel_state);
+        } else {
+          XELOGW("undefined extern call to %.8X %s", callee->address(),
+                 callee->name().c_str());
+        }
+        break;
+      }
+      case OPCODE_RETURN:
+        return;
+      case OPCODE_RETURN_TRUE:
+        if (IsNonZero(src_type, SRC1)) {
+          return;
+        }
+        break;
+      case OPCODE_SET_RETURN_ADDRESS:
+        call_return_address = uint32_t(GetU(src_type, SRC1));
+        break;
+
+      case OPCODE_BRANCH:
+        next = code + instr->src1.target;
+        break;
+      case OPCODE_BRANCH_TRUE:
+        if (IsNonZero(src_type, SRC1)) {
+          next = code + instr->src2.target;
+        }
+        break;
+      case OPCODE_BRANCH_FALSE:
+        if (!IsNonZero(src_type, SRC1)) {
+          next = code + instr->src2.target;
+        }
+        break;
+
+      case OPCODE_ASSIGN:
+      case OPCODE_LOAD_LOCAL:
+        dest = SRC1;
+        break;
+      case OPCODE_STORE_LOCAL:
+        SRC1 = SRC2;
+        break;
+      case OPCODE_CAST: {
+        InterpValue value = SRC1;
+        std::memcpy(&dest, &value, GetTypeSize(TypeName(type)));
+        break;
+      }
+      case OPCODE_ZERO_EXTEND:
+      case OPCODE_TRUNCATE:
+        SetI(type, dest, GetU(src_type, SRC1));
+        break;
+      case OPCODE_SIGN_EXTEND:
+        SetI(type, dest, uint64_t(GetS(src_type, SRC1)));
+        break;
+      case OPCODE_CONVERT: {
+        const InterpValue& value = SRC1;
+        if (type == INT32_TYPE && src_type == FLOAT32_TYPE) {
+          dest.i32 = ConvertToInt<int32_t>(value.f32, true);
+        } else if (type == INT32_TYPE && src_type == FLOAT64_TYPE) {
+          dest.i32 = ConvertToInt<int32_t>(value.f64, false);
+        } else if (type == INT64_TYPE && src_type == FLOAT64_TYPE) {
+          dest.i64 = ConvertToInt<int64_t>(value.f64, false);
+        } else if (type == FLOAT32_TYPE && src_type == INT32_TYPE) {
+          dest.f32 = float(value.i32);
+        } else if (type == FLOAT32_TYPE && src_type == FLOAT64_TYPE) {
+          dest.f32 = float(value.f64);
+        } else if (type == FLOAT64_TYPE && src_type == INT64_TYPE) {
+          dest.f64 = double(value.i64);
+        } else if (type == FLOAT64_TYPE && src_type == FLOAT32_TYPE) {
+          dest.f64 = double(value.f32);
+        } else {
+          assert_always();
+        }
+        break;
+      }
+      case OPCODE_ROUND:
+        switch (type) {
+          case FLOAT32_TYPE:
+            dest.f32 = RoundFloat(instr->flags, SRC1.f32);
+            break;
+          case FLOAT64_TYPE:
+            dest.f64 = RoundFloat(instr->flags, SRC1.f64);
+            break;
+          default:
+            for (int i = 0; i < 4; ++i) {
+              dest.v128.f32[i] = RoundFloat(instr->flags, SRC1.v128.f32[i]);
+            }
+            break;
+        }
+        break;
+      case OPCODE_VECTOR_CONVERT_I2F:
+        for (int i = 0; i < 4; ++i) {
+          dest.v128.f32[i] = float(SRC1.v128.i32[i]);
+        }
+        break;
+      case OPCODE_VECTOR_CONVERT_F2I:
+        for (int i = 0; i < 4; ++i) {
+          dest.v128.i32[i] = ConvertToInt<int32_t>(SRC1.v128.f32[i], false);
+        }
+        break;
+      case OPCODE_LOAD_VECTOR_SHL:
+      case OPCODE_LOAD_VECTOR_SHR: {
+        uint32_t sh = uint32_t(GetU(src_type, SRC1)) & 0xF;
+        uint32_t base = instr->opcode == OPCODE_LOAD_VECTOR_SHL ? sh : 16 - sh;
+        for (uint32_t i = 0; i < 16; ++i) {
+          dest.v128.u8[i ^ 3] = uint8_t(base + i);
+        }
+        break;
+      }
+      case OPCODE_LOAD_CLOCK:
+        dest.i64 = int64_t(Clock::QueryGuestTickCount());
+        break;
+
+      case OPCODE_LOAD_CONTEXT:
+        LoadValue(type, dest,
+                  reinterpret_cast<uint8_t*>(context) + instr->src1.offset,
+                  false);
+        break;
+      case OPCODE_STORE_CONTEXT:
+        StoreValue(instr->src_types[1],
+                   reinterpret_cast<uint8_t*>(context) + instr->src1.offset,
+                   SRC2, false);
+        break;
+      case OPCODE_LOAD_MMIO: {
+        auto range = reinterpret_cast<MMIORange*>(instr->src1.offset);
+        uint32_t value = uint32_t(range->read(
+            context, range->callback_context, uint32_t(instr->src2.offset)));
+        dest.i32 = int32_t(xe::byte_swap(value));
+        break;
+      }
+      case OPCODE_STORE_MMIO: {
+        auto range = reinterpret_cast<MMIORange*>(instr->src1.offset);
+        uint32_t value = uint32_t(GetU(instr->src_types[2], SRC3));
+        range->write(context, range->callback_context,
+                     uint32_t(instr->src2.offset), xe::byte_swap(value));
+        break;
+      }
+      case OPCODE_LOAD: {
+        uint32_t address = uint32_t(GetU(src_type, SRC1));
+        bool swap = !!(instr->flags & LOAD_STORE_BYTE_SWAP);
+        if (!LoadMMIOValue(type, dest, address, swap)) {
+          LoadValue(type, dest, membase + address, swap);
+        }
+        break;
+      }
+      case OPCODE_STORE: {
+        uint32_t address = uint32_t(GetU(src_type, SRC1));
+        bool swap = !!(instr->flags & LOAD_STORE_BYTE_SWAP);
+        if (!StoreMMIOValue(instr->src_types[1], address, SRC2, swap)) {
+          StoreValue(instr->src_types[1], membase + address, SRC2, swap);
+        }
+        break;
+      }
+      case OPCODE_MEMSET:
+        std::memset(membase + uint32_t(GetU(src_type, SRC1)),
+                    int(GetU(instr->src_types[1], SRC2)),
+                    size_t(GetU(instr->src_types[2], SRC3)));
+        break;
+      case OPCODE_PREFETCH:
+        break;
+
+      case OPCODE_MAX:
+        FloatBinary<MaxOp>(type, dest, SRC1, SRC2);
+        break;
+      case OPCODE_MIN:
+        if (IsFloatType(type)) {
+          FloatBinary<MinOp>(type, dest, SRC1, SRC2);
+        } else {
+          SetI(type, dest, uint64_t(std::min(GetS(type, SRC1),
+                                             GetS(type, SRC2))));
+        }
+        break;
+      case OPCODE_VECTOR_MAX:
+      case OPCODE_VECTOR_MIN: {
+        bool is_max = instr->opcode == OPCODE_VECTOR_MAX;
+        bool is_unsigned = !!(instr->flags & ARITHMETIC_UNSIGNED);
+        const vec128_t& a = SRC1.v128;
+        const vec128_t& b = SRC2.v128;
+        vec128_t& d = dest.v128;
+        switch (instr->flags >> 8) {
+          case INT8_TYPE:
+            if (is_unsigned) {
+              VectorMaxMinLanes(is_max, d.u8, a.u8, b.u8);
+            } else {
+              VectorMaxMinLanes(is_max, d.i8, a.i8, b.i8);
+            }
+            break;
+          case INT16_TYPE:
+            if (is_unsigned) {
+              VectorMaxMinLanes(is_max, d.u16, a.u16, b.u16);
+            } else {
+              VectorMaxMinLanes(is_max, d.i16, a.i16, b.i16);
+            }
+            break;
+          case INT32_TYPE:
+            if (is_unsigned) {
+              VectorMaxMinLanes(is_max, d.u32, a.u32, b.u32);
+            } else {
+              VectorMaxMinLanes(is_max, d.i32, a.i32, b.i32);
+            }
+            break;
+          default:
+            assert_unhandled_case(instr->flags >> 8);
+            break;
+        }
+        break;
+      }
+      case OPCODE_SELECT:
+        if (src_type == VEC128_TYPE) {
+          const vec128_t& c = SRC1.v128;
+          vec128_t result;
+          result.low = (~c.low & SRC2.v128.low) | (c.low & SRC3.v128.low);
+          result.high = (~c.high & SRC2.v128.high) | (c.high & SRC3.v128.high);
+          dest.v128 = result;
+        } else {
+          dest = IsNonZero(src_type, SRC1) ? SRC2 : SRC3;
+        }
+        break;
+      case OPCODE_IS_TRUE:
+        dest.i8 = IsNonZero(src_type, SRC1) ? 1 : 0;
+        break;
+      case OPCODE_IS_FALSE:
+        dest.i8 = IsNonZero(src_type, SRC1) ? 0 : 1;
+        break;
+      case OPCODE_COMPARE_EQ:
+      case OPCODE_COMPARE_NE:
+      case OPCODE_COMPARE_SLT:
+      case OPCODE_COMPARE_SLE:
+      case OPCODE_COMPARE_SGT:
+      case OPCODE_COMPARE_SGE:
+      case OPCODE_COMPARE_ULT:
+      case OPCODE_COMPARE_ULE:
+      case OPCODE_COMPARE_UGT:
+      case OPCODE_COMPARE_UGE: {
+        bool result;
+        if (src_type == FLOAT32_TYPE) {
+          result = CompareFloat(instr->opcode, SRC1.f32, SRC2.f32);
+        } else if (src_type == FLOAT64_TYPE) {
+          result = CompareFloat(instr->opcode, SRC1.f64, SRC2.f64);
+        } else {
+          result = CompareInt(instr->opcode, src_type, SRC1, SRC2);
+        }
+        dest.i8 = result ? 1 : 0;
+        break;
+      }
+      case OPCODE_DID_SATURATE:
+        // TODO(benvanik): implement saturation check (VECTOR_ADD, etc).
+        dest.i8 = 0;
+        break;
+      case OPCODE_VECTOR_COMPARE_EQ:
+      case OPCODE_VECTOR_COMPARE_SGT:
+      case OPCODE_VECTOR_COMPARE_SGE:
+      case OPCODE_VECTOR_COMPARE_UGT:
+      case OPCODE_VECTOR_COMPARE_UGE: {
+        const vec128_t& a = SRC1.v128;
+        const vec128_t& b = SRC2.v128;
+        vec128_t& d = dest.v128;
+        switch (instr->flags) {
+          case INT8_TYPE:
+            VectorCompareLanes(instr->opcode, d.i8, a.i8, b.i8);
+            break;
+          case INT16_TYPE:
+            VectorCompareLanes(instr->opcode, d.i16, a.i16, b.i16);
+            break;
+          case INT32_TYPE:
+            VectorCompareLanes(instr->opcode, d.i32, a.i32, b.i32);
+            break;
+          case FLOAT32_TYPE:
+            for (int i = 0; i < 4; ++i) {
+              bool result;
+              switch (instr->opcode) {
+                case OPCODE_VECTOR_COMPARE_EQ:
+                  result = a.f32[i] == b.f32[i];
+                  break;
+                case OPCODE_VECTOR_COMPARE_SGT:
+                case OPCODE_VECTOR_COMPARE_UGT:
+                  result = a.f32[i] > b.f32[i];
+                  break;
+                default:
+                  result = a.f32[i] >= b.f32[i];
+                  break;
+              }
+              d.u32[i] = result ? 0xFFFFFFFF : 0;
+            }
+            break;
+          default:
+            assert_unhandled_case(instr->flags);
+            break;
+        }
+        break;
+      }
+
+      case OPCODE_ADD:
+        if (IsFloatType(type)) {
+          FloatBinary<AddOp>(type, dest, SRC1, SRC2);
+        } else {
+          SetI(type, dest, GetU(type, SRC1) + GetU(type, SRC2));
+        }
+        break;
+      case OPCODE_ADD_CARRY:
+        SetI(type, dest, GetU(type, SRC1) + GetU(type, SRC2) +
+                             (GetU(instr->src_types[2], SRC3) & 1));
+        break;
+      case OPCODE_SUB:
+        if (IsFloatType(type)) {
+          FloatBinary<SubOp>(type, dest, SRC1, SRC2);
+        } else {
+          SetI(type, dest, GetU(type, SRC1) - GetU(type, SRC2));
+        }
+        break;
+      case OPCODE_VECTOR_ADD:
+      case OPCODE_VECTOR_SUB: {
+        bool is_sub = instr->opcode == OPCODE_VECTOR_SUB;
+        uint32_t arithmetic_flags = instr->flags >> 8;
+        const vec128_t& a = SRC1.v128;
+        const vec128_t& b = SRC2.v128;
+        vec128_t& d = dest.v128;
+        switch (instr->flags & 0xFF) {
+          case INT8_TYPE:
+            VectorAddSubLanes(is_sub, arithmetic_flags, d.i8, a.i8, b.i8);
+            break;
+          case INT16_TYPE:
+            VectorAddSubLanes(is_sub, arithmetic_flags, d.i16, a.i16, b.i16);
+            break;
+          case INT32_TYPE:
+            VectorAddSubLanes(is_sub, arithmetic_flags, d.i32, a.i32, b.i32);
+            break;
+          case FLOAT32_TYPE:
+            for (int i = 0; i < 4; ++i) {
+              d.f32[i] = is_sub ? a.f32[i] - b.f32[i] : a.f32[i] + b.f32[i];
+            }
+            break;
+          default:
+            assert_unhandled_case(instr->flags & 0xFF);
+            break;
+        }
+        break;
+      }
+      case OPCODE_MUL:
+        if (IsFloatType(type)) {
+          FloatBinary<MulOp>(type, dest, SRC1, SRC2);
+        } else {
+          SetI(type, dest, GetU(type, SRC1) * GetU(type, SRC2));
+        }
+        break;
+      case OPCODE_MUL_HI: {
+        bool is_unsigned = !!(instr->flags & ARITHMETIC_UNSIGNED);
+        if (type == INT64_TYPE) {
+          uint64_t a = uint64_t(SRC1.i64);
+          uint64_t b = uint64_t(SRC2.i64);
+          uint64_t hi = UMulHi64(a, b);
+          if (!is_unsigned) {
+            hi -= SRC1.i64 < 0 ? b : 0;
+            hi -= SRC2.i64 < 0 ? a : 0;
+          }
+          dest.i64 = int64_t(hi);
+        } else {
+          uint64_t product =
+              is_unsigned ? GetU(type, SRC1) * GetU(type, SRC2)
+                          : uint64_t(GetS(type, SRC1) * GetS(type, SRC2));
+          SetI(type, dest, product >> TypeBits(type));
+        }
+        break;
+      }
+      case OPCODE_DIV:
+        if (IsFloatType(type)) {
+          FloatBinary<DivOp>(type, dest, SRC1, SRC2);
+        } else if (!GetU(type, SRC2)) {
+          SetI(type, dest, 0);
+        } else if (instr->flags & ARITHMETIC_UNSIGNED) {
+          SetI(type, dest, GetU(type, SRC1) / GetU(type, SRC2));
+        } else if (type == INT64_TYPE && SRC2.i64 == -1) {
+          dest.i64 = int64_t(0 - uint64_t(SRC1.i64));
+        } else {
+          SetI(type, dest, uint64_t(GetS(type, SRC1) / GetS(type, SRC2)));
+        }
+        break;
+      case OPCODE_MUL_ADD:
+      case OPCODE_MUL_SUB: {
+        bool is_sub = instr->opcode == OPCODE_MUL_SUB;
+        switch (type) {
+          case FLOAT32_TYPE:
+            dest.f32 = std::fma(SRC1.f32, SRC2.f32,
+                                is_sub ? -SRC3.f32 : SRC3.f32);
+            break;
+          case FLOAT64_TYPE:
+            dest.f64 = std::fma(SRC1.f64, SRC2.f64,
+                                is_sub ? -SRC3.f64 : SRC3.f64);
+            break;
+          default:
+            for (int i = 0; i < 4; ++i) {
+              float c = SRC3.v128.f32[i];
+              dest.v128.f32[i] = std::fma(SRC1.v128.f32[i], SRC2.v128.f32[i],
+                                          is_sub ? -c : c);
+            }
+            break;
+        }
+        break;
+      }
+      case OPCODE_NEG:
+        switch (type) {
+          case FLOAT32_TYPE:
+            dest.f32 = -SRC1.f32;
+            break;
+          case FLOAT64_TYPE:
+            dest.f64 = -SRC1.f64;
+            break;
+          case VEC128_TYPE:
+            for (int i = 0; i < 4; ++i) {
+              dest.v128.f32[i] = -SRC1.v128.f32[i];
+            }
+            break;
+          default:
+            SetI(type, dest, 0 - GetU(type, SRC1));
+            break;
+        }
+        break;
+      case OPCODE_ABS:
+        switch (type) {
+          case FLOAT32_TYPE:
+            dest.i32 = SRC1.i32 & 0x7FFFFFFF;
+            break;
+          case FLOAT64_TYPE:
+            dest.i64 = SRC1.i64 & 0x7FFFFFFFFFFFFFFFull;
+            break;
+          default:
+            for (int i = 0; i < 4; ++i) {
+              dest.v128.u32[i] = SRC1.v128.u32[i] & 0x7FFFFFFF;
+            }
+            break;
+        }
+        break;
+      case OPCODE_SQRT:
+      case OPCODE_RSQRT:
+      case OPCODE_POW2:
+      case OPCODE_LOG2: {
+        auto opcode = instr->opcode;
+        auto apply = [opcode](double v) {
+          switch (opcode) {
+            case OPCODE_SQRT:
+              return std::sqrt(v);
+            case OPCODE_RSQRT:
+              return 1.0 / std::sqrt(v);
+            case OPCODE_POW2:
+              return std::exp2(v);
+            default:
+              return std::log2(v);
+          }
+        };
+        switch (type) {
+          case FLOAT32_TYPE:
+            dest.f32 = float(apply(SRC1.f32));
+            break;
+          case FLOAT64_TYPE:
+            dest.f64 = apply(SRC1.f64);
+            break;
+          default:
+            for (int i = 0; i < 4; ++i) {
+              dest.v128.f32[i] = float(apply(SRC1.v128.f32[i]));
+            }
+            break;
+        }
+        break;
+      }
+      case OPCODE_DOT_PRODUCT_3:
+      case OPCODE_DOT_PRODUCT_4: {
+        // Summed pairwise, as dpps does.
+        const vec128_t& a = SRC1.v128;
+        const vec128_t& b = SRC2.v128;
+        float w = instr->opcode == OPCODE_DOT_PRODUCT_4 ? a.f32[3] * b.f32[3]
+                                                        : 0.0f;
+        dest.f32 = (a.f32[0] * b.f32[0] + a.f32[1] * b.f32[1]) +
+                   (a.f32[2] * b.f32[2] + w);
+        break;
+      }
+
+      case OPCODE_AND:
+        if (type == VEC128_TYPE) {
+          dest.v128.low = SRC1.v128.low & SRC2.v128.low;
+          dest.v128.high = SRC1.v128.high & SRC2.v128.high;
+        } else {
+          SetI(type, dest, GetU(type, SRC1) & GetU(type, SRC2));
+        }
+        break;
+      case OPCODE_OR:
+        if (type == VEC128_TYPE) {
+          dest.v128.low = SRC1.v128.low | SRC2.v128.low;
+          dest.v128.high = SRC1.v128.high | SRC2.v128.high;
+        } else {
+          SetI(type, dest, GetU(type, SRC1) | GetU(type, SRC2));
+        }
+        break;
+      case OPCODE_XOR:
+        if (type == VEC128_TYPE) {
+          dest.v128.low = SRC1.v128.low ^ SRC2.v128.low;
+          dest.v128.high = SRC1.v128.high ^ SRC2.v128.high;
+        } else {
+          SetI(type, dest, GetU(type, SRC1) ^ GetU(type, SRC2));
+        }
+        break;
+      case OPCODE_NOT:
+        if (type == VEC128_TYPE) {
+          dest.v128.low = ~SRC1.v128.low;
+          dest.v128.high = ~SRC1.v128.high;
+        } else {
+          SetI(type, dest, ~GetU(type, SRC1));
+        }
+        break;
+      case OPCODE_SHL:
+      case OPCODE_SHR: {
+        uint32_t count = uint32_t(GetU(instr->src_types[1], SRC2));
+        if (type == VEC128_TYPE) {
+          // Shifts the whole vector by up to 7 bits, as a big-endian value.
+          uint32_t sh = count & 7;
+          vec128_t v = SRC1.v128;
+          if (sh && instr->opcode == OPCODE_SHL) {
+            for (int i = 0; i < 15; ++i) {
+              v.u8[i ^ 3] = uint8_t((v.u8[i ^ 3] << sh) |
+                                    (v.u8[(i + 1) ^ 3] >> (8 - sh)));
+            }
+            v.u8[15 ^ 3] = uint8_t(v.u8[15 ^ 3] << sh);
+          } else if (sh) {
+            for (int i = 15; i > 0; --i) {
+              v.u8[i ^ 3] = uint8_t((v.u8[i ^ 3] >> sh) |
+                                    (v.u8[(i - 1) ^ 3] << (8 - sh)));
+            }
+            v.u8[0 ^ 3] = uint8_t(v.u8[0 ^ 3] >> sh);
+          }
+          dest.v128 = v;
+        } else {
+          count &= type == INT64_TYPE ? 63 : 31;
+          uint64_t value = GetU(type, SRC1);
+          if (count >= 64) {
+            value = 0;
+          } else if (instr->opcode == OPCODE_SHL) {
+            value <<= count;
+          } else {
+            value >>= count;
+          }
+          SetI(type, dest, value);
+        }
+        break;
+      }
+      case OPCODE_SHA: {
+        uint32_t count = uint32_t(GetU(instr->src_types[1], SRC2));
+        count &= type == INT64_TYPE ? 63 : 31;
+        SetI(type, dest, uint64_t(GetS(type, SRC1) >> count));
+        break;
+      }
+      case OPCODE_ROTATE_LEFT:
+        SetI(type, dest,
+             RotateLeftI(type, GetU(type, SRC1),
+                         uint32_t(GetU(instr->src_types[1], SRC2))));
+        break;
+      case OPCODE_VECTOR_SHL:
+      case OPCODE_VECTOR_SHR:
+      case OPCODE_VECTOR_SHA:
+      case OPCODE_VECTOR_ROTATE_LEFT: {
+        const vec128_t& a = SRC1.v128;
+        const vec128_t& b = SRC2.v128;
+        vec128_t& d = dest.v128;
+        switch (instr->flags) {
+          case INT8_TYPE:
+            VectorShiftLanes(instr->opcode, d.i8, a.i8, b.i8);
+            break;
+          case INT16_TYPE:
+            VectorShiftLanes(instr->opcode, d.i16, a.i16, b.i16);
+            break;
+          case INT32_TYPE:
+            VectorShiftLanes(instr->opcode, d.i32, a.i32, b.i32);
+            break;
+          default:
+            assert_unhandled_case(instr->flags);
+            break;
+        }
+        break;
+      }
+      case OPCODE_VECTOR_AVERAGE: {
+        bool is_unsigned = !!((instr->flags >> 8) & ARITHMETIC_UNSIGNED);
+        const vec128_t& a = SRC1.v128;
+        const vec128_t& b = SRC2.v128;
+        vec128_t& d = dest.v128;
+        switch (instr->flags & 0xFF) {
+          case INT8_TYPE:
+            VectorAverageLanes(is_unsigned, d.i8, a.i8, b.i8);
+            break;
+          case INT16_TYPE:
+            VectorAverageLanes(is_unsigned, d.i16, a.i16, b.i16);
+            break;
+          case INT32_TYPE:
+            VectorAverageLanes(is_unsigned, d.i32, a.i32, b.i32);
+            break;
+          default:
+            assert_unhandled_case(instr->flags & 0xFF);
+            break;
+        }
+        break;
+      }
+      case OPCODE_BYTE_SWAP:
+        switch (type) {
+          case INT16_TYPE:
+            dest.i16 = xe::byte_swap(SRC1.i16);
+            break;
+          case INT32_TYPE:
+            dest.i32 = xe::byte_swap(SRC1.i32);
+            break;
+          case INT64_TYPE:
+            dest.i64 = xe::byte_swap(SRC1.i64);
+            break;
+          default:
+            for (int i = 0; i < 4; ++i) {
+              dest.v128.u32[i] = xe::byte_swap(SRC1.v128.u32[i]);
+            }
+            break;
+        }
+        break;
+      case OPCODE_CNTLZ: {
+        uint64_t value = GetU(src_type, SRC1);
+        uint8_t bits = uint8_t(TypeBits(src_type));
+        uint8_t count;
+        switch (src_type) {
+          case INT8_TYPE:
+            count = value ? xe::lzcnt(uint8_t(value)) : bits;
+            break;
+          case INT16_TYPE:
+            count = value ? xe::lzcnt(uint16_t(value)) : bits;
+            break;
+          case INT32_TYPE:
+            count = value ? xe::lzcnt(uint32_t(value)) : bits;
+            break;
+          default:
+            count = value ? xe::lzcnt(uint64_t(value)) : bits;
+            break;
+        }
+        dest.i8 = int8_t(count);
+        break;
+      }
+      case OPCODE_INSERT: {
+        vec128_t v = SRC1.v128;
+        uint64_t index = GetU(instr->src_types[1], SRC2);
+        uint64_t value = GetU(instr->src_types[2], SRC3);
+        switch (instr->src_types[2]) {
+          case INT8_TYPE:
+            v.u8[(index & 0xF) ^ 3] = uint8_t(value);
+            break;
+          case INT16_TYPE:
+            v.u16[(index & 0x7) ^ 1] = uint16_t(value);
+            break;
+          default:
+            v.u32[index & 0x3] = uint32_t(value);
+            break;
+        }
+        dest.v128 = v;
+        break;
+      }
+      case OPCODE_EXTRACT: {
+        const vec128_t& v = SRC1.v128;
+        uint64_t index = GetU(instr->src_types[1], SRC2);
+        switch (type) {
+          case INT8_TYPE:
+            dest.i8 = int8_t(v.u8[(index & 0xF) ^ 3]);
+            break;
+          case INT16_TYPE:
+            dest.i16 = int16_t(v.u16[(index & 0x7) ^ 1]);
+            break;
+          case FLOAT32_TYPE:
+            dest.f32 = v.f32[index & 0x3];
+            break;
+          default:
+            dest.i32 = int32_t(v.u32[index & 0x3]);
+            break;
+        }
+        break;
+      }
+      case OPCODE_SPLAT: {
+        vec128_t v;
+        switch (src_type) {
+          case INT8_TYPE:
+            v = vec128b(uint8_t(SRC1.i8));
+            break;
+          case INT16_TYPE:
+            v = vec128s(uint16_t(SRC1.i16));
+            break;
+          case FLOAT32_TYPE:
+            v = vec128f(SRC1.f32);
+            break;
+          default:
+            v = vec128i(uint32_t(SRC1.i32));
+            break;
+        }
+        dest.v128 = v;
+        break;
+      }
+      case OPCODE_PERMUTE: {
+        const vec128_t& a = SRC2.v128;
+        const vec128_t& b = SRC3.v128;
+        vec128_t v;
+        if (src_type == INT32_TYPE) {
+          uint32_t control = uint32_t(SRC1.i32);
+          for (int n = 0; n < 4; ++n) {
+            uint32_t select = control >> (8 * n);
+            v.u32[n] = (select & 0x4) ? b.u32[select & 0x3]
+                                      : a.u32[select & 0x3];
+          }
+        } else if (instr->flags == INT8_TYPE) {
+          const vec128_t& control = SRC1.v128;
+          for (int j = 0; j < 16; ++j) {
+            uint32_t k = (control.u8[j] ^ 3) & 0x1F;
+            v.u8[j] = k > 15 ? b.u8[k & 0xF] : a.u8[k & 0xF];
+          }
+        } else {
+          const vec128_t& control = SRC1.v128;
+          for (int i = 0; i < 8; ++i) {
+            uint32_t k = (control.u16[i] & 0xF) ^ 1;
+            v.u16[i] = k >= 8 ? b.u16[k - 8] : a.u16[k];
+          }
+        }
+        dest.v128 = v;
+        break;
+      }
+      case OPCODE_SWIZZLE: {
+        const vec128_t& a = SRC1.v128;
+        uint8_t mask = uint8_t(instr->src2.offset);
+        vec128_t v;
+        for (int n = 0; n < 4; ++n) {
+          v.u32[n] = a.u32[(mask >> (2 * n)) & 0x3];
+        }
+        dest.v128 = v;
+        break;
+      }
+      case OPCODE_PACK:
+        dest.v128 = Pack(instr->flags, SRC1.v128, SRC2.v128);
+        break;
+      case OPCODE_UNPACK:
+        dest.v128 = Unpack(instr->flags, SRC1.v128);
+        break;
+
+      case OPCODE_COMPARE_EXCHANGE: {
+        void* address = reinterpret_cast<void*>(SRC1.i64);
+        if (type == INT32_TYPE) {
+          auto value = reinterpret_cast<std::atomic<int32_t>*>(address);
+          int32_t expected = SRC2.i32;
+          value->compare_exchange_strong(expected, SRC3.i32);
+          dest.i32 = expected;
+        } else {
+          auto value = reinterpret_cast<std::atomic<int64_t>*>(address);
+          int64_t expected = SRC2.i64;
+          value->compare_exchange_strong(expected, SRC3.i64);
+          dest.i64 = expected;
+        }
+        break;
+      }
+      case OPCODE_ATOMIC_EXCHANGE:
+      case OPCODE_ATOMIC_ADD:
+      case OPCODE_ATOMIC_SUB: {
+        void* address = reinterpret_cast<void*>(SRC1.i64);
+        uint64_t value = GetU(type, SRC2);
+        uint64_t old_value;
+        switch (type) {
+#define XE_INTERP_ATOMIC(T)                                                  \
+  {                                                                          \
+    auto target = reinterpret_cast<std::atomic<T>*>(address);               \
+    if (instr->opcode == OPCODE_ATOMIC_EXCHANGE) {                           \
+      old_value = target->exchange(T(value));                                \
+    } else if (instr->opcode == OPCODE_ATOMIC_ADD) {                         \
+      old_value = target->fetch_add(T(value));                               \
+    } else {                                                                 \
+      old_value = target->fetch_sub(T(value));                               \
+    }                                                                        \
+  }
+          case INT8_TYPE:
+            XE_INTERP_ATOMIC(uint8_t);
+            break;
+          case INT16_TYPE:
+            XE_INTERP_ATOMIC(uint16_t);
+            break;
+          case INT32_TYPE:
+            XE_INTERP_ATOMIC(uint32_t);
+            break;
+          default:
+            XE_INTERP_ATOMIC(uint64_t);
+            break;
+#undef XE_INTERP_ATOMIC
+        }
+        SetI(type, dest, old_value);
+        break;
+      }
+
+      default:
+        XELOGE("Interpreter: unhandled opcode %d", instr->opcode);
+        assert_always();
+        break;
+    }
+#undef SRC1
+#undef SRC2
+#undef SRC3
+    instr = next;
+  }
+}
+
+}  // namespace interp
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,39 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BACKEND_INTERP_INTERP_EXECUTOR_H_
+#define XENIA_BACKEND_INTERP_INTERP_EXECUTOR_H_
+
+#include <cstdint>
+
+namespace xe {
+namespace cpu {
+class ThreadState;
+}  // namespace cpu
+}  // namespace xe
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace interp {
+
+class InterpFunction;
+
+// Runs the function on the calling thread until it returns to
+// return_address. Calls out of the function go through the processor, so
+// callees may be interpreted or generated code alike.
+void Execute(ThreadState* thread_state, InterpFunction* function,
+             uint32_t return_address);
+
+}  // namespace interp
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_BACKEND_INTERP_INTERP_EXECUTOR_H_
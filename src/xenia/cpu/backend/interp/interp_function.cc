@@ -0,0 +1,63 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/interp/interp_function.h"
+
+#include "xenia/cpu/backend/interp/interp_executor.h"
+#include "xenia/cpu/thread_state.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace interp {
+
+InterpFunction::InterpFunction(FunctionInfo* symbol_info)
+    : Function(symbol_info),
+      machine_code_(nullptr),
+      machine_code_length_(0),
+      slot_count_(0),
+      is_baseline_(false) {}
+
+InterpFunction::~InterpFunction() {
+  // machine_code_ is freed by the host backend's code cache.
+}
+
+void InterpFunction::Setup(std::vector<InterpInstr> code,
+                           std::vector<InterpValue> constants,
+                           uint32_t slot_count, bool is_baseline) {
+  code_ = std::move(code);
+  constants_ = std::move(constants);
+  slot_count_ = slot_count;
+  is_baseline_ = is_baseline;
+}
+
+void InterpFunction::SetupEntry(uint8_t* machine_code,
+                                size_t machine_code_length) {
+  machine_code_ = machine_code;
+  machine_code_length_ = machine_code_length;
+}
+
+uint64_t InterpFunction::Enter(void* raw_context, void* function,
+                               void* return_address) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  Execute(thread_state, reinterpret_cast<InterpFunction*>(function),
+          static_cast<uint32_t>(reinterpret_cast<uintptr_t>(return_address)));
+  return 0;
+}
+
+bool InterpFunction::CallImpl(ThreadState* thread_state,
+                              uint32_t return_address) {
+  Execute(thread_state, this, return_address);
+  return true;
+}
+
+}  // namespace interp
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,109 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BACKEND_INTERP_INTERP_FUNCTION_H_
+#define XENIA_BACKEND_INTERP_INTERP_FUNCTION_H_
+
+#include <vector>
+
+#include "xenia/base/vec128.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/hir/opcodes.h"
+#include "xenia/cpu/symbol_info.h"
+#include "xenia/cpu/thread_state.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace interp {
+
+// Opcodes past the HIR ones, only found in interpreted code.
+enum InterpOpcode : uint16_t {
+  // Bumps block counter src1.offset of the running thread.
+  INTERP_OPCODE_BLOCK_COUNTER = hir::__OPCODE_MAX_VALUE,
+};
+
+// Storage for one HIR value. Values are only ever read as the type they were
+// written as, so the rest of the slot is undefined.
+union InterpValue {
+  int8_t i8;
+  int16_t i16;
+  int32_t i32;
+  int64_t i64;
+  float f32;
+  double f64;
+  vec128_t v128;
+};
+
+union InterpOperand {
+  // Value operands.
+  uint32_t slot;
+  // Label operands, as the index of the instruction to continue at.
+  uint32_t target;
+  uint64_t offset;
+  FunctionInfo* symbol_info;
+};
+
+// A finalized HIR instruction with its values replaced by slot indices.
+struct InterpInstr {
+  uint16_t opcode;
+  uint16_t flags;
+  // hir::TypeName of the dest and value sources, when they have one.
+  uint8_t dest_type;
+  uint8_t src_types[3];
+  uint32_t dest;
+  InterpOperand src1;
+  InterpOperand src2;
+  InterpOperand src3;
+};
+
+class InterpFunction : public Function {
+ public:
+  InterpFunction(FunctionInfo* symbol_info);
+  ~InterpFunction() override;
+
+  // Entry stub placed by the host backend, so that its generated code can
+  // call into the function. Null when there's no host backend.
+  uint8_t* machine_code() const override { return machine_code_; }
+  size_t machine_code_length() const override { return machine_code_length_; }
+
+  const std::vector<InterpInstr>& code() const { return code_; }
+  // Initial contents of the first slots. Constants are never written.
+  const std::vector<InterpValue>& constants() const { return constants_; }
+  uint32_t slot_count() const { return slot_count_; }
+  // Baseline functions count their calls down to their recompile.
+  bool is_baseline() const { return is_baseline_; }
+
+  void Setup(std::vector<InterpInstr> code, std::vector<InterpValue> constants,
+             uint32_t slot_count, bool is_baseline);
+  void SetupEntry(uint8_t* machine_code, size_t machine_code_length);
+
+  // Called by the entry stub, through the host backend's guest-to-host thunk.
+  static uint64_t Enter(void* raw_context, void* function,
+                        void* return_address);
+
+ protected:
+  bool CallImpl(ThreadState* thread_state, uint32_t return_address) override;
+
+ private:
+  uint8_t* machine_code_;
+  size_t machine_code_length_;
+
+  std::vector<InterpInstr> code_;
+  std::vector<InterpValue> constants_;
+  uint32_t slot_count_;
+  bool is_baseline_;
+};
+
+}  // namespace interp
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_BACKEND_INTERP_INTERP_FUNCTION_H_
@@ -13,6 +13,7 @@
 #include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/backend/x64/x64_persistent_cache.h"
 #include "xenia/cpu/cpu-private.h"
 #include "xenia/cpu/hir/hir_builder.h"
 #include "xenia/cpu/hir/label.h"
@@ -93,11 +94,22 @@ bool X64Assembler::Assemble(FunctionInfo* symbol_info, HIRBuilder* builder,
   // Lower HIR -> x64.
   void* machine_code = nullptr;
   size_t code_size = 0;
-  if (!emitter_->Emit(symbol_info->address(), builder, debug_info_flags,
-                      debug_info.get(), machine_code, code_size)) {
+  if (!emitter_->Emit(symbol_info, builder, debug_info_flags, debug_info.get(),
+                      machine_code, code_size)) {
     return false;
   }
 
+  // Keep the code around for later runs.
+  if (emitter_->cacheable() && !symbol_info->is_modified()) {
+    auto persistent_cache =
+        x64_backend_->GetPersistentCache(symbol_info->module());
+    if (persistent_cache) {
+      persistent_cache->Store(symbol_info, machine_code, code_size,
+                              emitter_->stack_size(), emitter_->relocations(),
+                              debug_info.get(), builder->inlined_ranges());
+    }
+  }
+
   // Stash generated machine code.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmMachineCode) {
     DumpMachineCode(debug_info.get(), machine_code, code_size, &string_buffer_);
@@ -9,16 +9,53 @@
 
 #include "xenia/cpu/backend/x64/x64_backend.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
 #include "xenia/cpu/backend/x64/x64_assembler.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/string.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/backend/x64/x64_persistent_cache.h"
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_thunk_emitter.h"
+#include "xenia/cpu/cpu-private.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/module.h"
 #include "xenia/cpu/processor.h"
+#include "xenia/debug/debugger.h"
 #include "third_party/xbyak/xbyak/xbyak_util.h"
 
 DEFINE_bool(
     enable_haswell_instructions, true,
     "Uses the AVX2/FMA/etc instructions on Haswell processors, if available.");
+DEFINE_string(persistent_code_cache_path, "",
+              "Directory to keep generated code in between runs. Empty to "
+              "disable.");
+DEFINE_bool(patch_call_sites, true,
+            "Rewrite direct guest calls to jump straight to their targets once "
+            "the targets have been compiled.");
+DEFINE_bool(inline_call_caches, true,
+            "Cache the targets seen at each indirect call site and call them "
+            "directly when they come up again.");
+DEFINE_bool(inline_cache_statistics, false,
+            "Count hits and misses at each indirect call site and log the "
+            "busiest ones on exit.");
+DEFINE_string(pinned_guest_registers, "r1,r13",
+              "Comma-separated guest GPRs (up to 3) to keep in host registers "
+              "instead of the context while guest code runs.");
+DEFINE_bool(perf_map, false,
+            "Write /tmp/perf-<pid>.map naming generated code for perf.");
+DEFINE_string(perf_jitdump_path, "",
+              "Directory to write a perf jitdump (jit-<pid>.dump) of generated "
+              "code and its unwind info to, for perf inject --jit. Empty to "
+              "disable.");
+DEFINE_bool(gdb_jit_interface, false,
+            "Register generated code and its unwind info with gdb through its "
+            "JIT interface.");
 
 namespace xe {
 namespace cpu {
@@ -26,13 +63,27 @@ namespace backend {
 namespace x64 {
 
 X64Backend::X64Backend(Processor* processor)
-    : Backend(processor), code_cache_(nullptr), emitter_data_(0) {}
+    : Backend(processor),
+      code_cache_(nullptr),
+      emitter_data_(0),
+      emitter_feature_flags_(0),
+      layout_function_count_(0),
+      layout_code_size_(0),
+      layout_hot_code_size_(0),
+      layout_code_lines_(0),
+      layout_hot_code_lines_(0) {}
 
 X64Backend::~X64Backend() {
+  if (layout_function_count_) {
+    DumpBlockLayoutStatistics();
+  }
+  persistent_caches_.clear();
   if (emitter_data_) {
     processor()->memory()->SystemHeapFree(emitter_data_);
     emitter_data_ = 0;
   }
+  thunk_emitter_.reset();
+  thunk_allocator_.reset();
   delete code_cache_;
 }
 
@@ -42,6 +93,7 @@ bool X64Backend::Initialize() {
   }
 
   RegisterSequences();
+  ParsePinnedRegisters();
 
   // Need movbe to do advanced LOAD/STORE tricks.
   if (FLAGS_enable_haswell_instructions) {
@@ -68,11 +120,13 @@ bool X64Backend::Initialize() {
   }
 
   // Generate thunks used to transition between jitted code and host code.
-  auto allocator = std::make_unique<XbyakAllocator>();
-  auto thunk_emitter = std::make_unique<X64ThunkEmitter>(this, allocator.get());
-  host_to_guest_thunk_ = thunk_emitter->EmitHostToGuestThunk();
-  guest_to_host_thunk_ = thunk_emitter->EmitGuestToHostThunk();
-  resolve_function_thunk_ = thunk_emitter->EmitResolveFunctionThunk();
+  thunk_allocator_ = std::make_unique<XbyakAllocator>();
+  thunk_emitter_ =
+      std::make_unique<X64ThunkEmitter>(this, thunk_allocator_.get());
+  host_to_guest_thunk_ = thunk_emitter_->EmitHostToGuestThunk();
+  guest_to_host_thunk_ = thunk_emitter_->EmitGuestToHostThunk();
+  resolve_function_thunk_ = thunk_emitter_->EmitResolveFunctionThunk();
+  emitter_feature_flags_ = thunk_emitter_->feature_flags();
 
   // Set the code cache to use the ResolveFunction thunk for default
   // indirections.
@@ -89,6 +143,42 @@ bool X64Backend::Initialize() {
   return true;
 }
 
+void X64Backend::ParsePinnedRegisters() {
+  std::istringstream names(FLAGS_pinned_guest_registers);
+  std::string name;
+  while (std::getline(names, name, ',')) {
+    if (name.empty()) {
+      continue;
+    }
+    const char* digits = name.c_str();
+    if (digits[0] == 'r' || digits[0] == 'R') {
+      ++digits;
+    }
+    char* end = nullptr;
+    unsigned long reg = std::strtoul(digits, &end, 10);
+    if (end == digits || *end || reg >= 32) {
+      XELOGW("Ignoring invalid pinned guest register '%s'", name.c_str());
+      continue;
+    }
+    if (std::find(pinned_registers_.begin(), pinned_registers_.end(),
+                  uint32_t(reg)) != pinned_registers_.end()) {
+      continue;
+    }
+    if (pinned_registers_.size() == size_t(X64Emitter::PINNED_GPR_COUNT)) {
+      XELOGW("Too many pinned guest registers, ignoring r%d", int(reg));
+      continue;
+    }
+    pinned_registers_.push_back(uint32_t(reg));
+  }
+}
+
+void* X64Backend::AllocThreadData() { return code_cache_->RegisterThread(); }
+
+void X64Backend::FreeThreadData(void* thread_data) {
+  code_cache_->UnregisterThread(
+      reinterpret_cast<X64CodeCache::ThreadEpoch*>(thread_data));
+}
+
 void X64Backend::CommitExecutableRange(uint32_t guest_low,
                                        uint32_t guest_high) {
   code_cache_->CommitExecutableRange(guest_low, guest_high);
@@ -98,6 +188,132 @@ std::unique_ptr<Assembler> X64Backend::CreateAssembler() {
   return std::make_unique<X64Assembler>(this);
 }
 
+bool X64Backend::LoadCachedFunction(FunctionInfo* symbol_info,
+                                    uint32_t debug_info_flags,
+                                    Function** out_function) {
+  // Cached code carries no disassembly or tracing, so anyone wanting those
+  // gets a fresh translation.
+  if (FLAGS_disassemble_functions || FLAGS_trace_functions ||
+      FLAGS_trace_function_coverage || FLAGS_trace_function_references ||
+      FLAGS_trace_function_data) {
+    return false;
+  }
+  auto debugger = processor()->debugger();
+  if (debugger && debugger->is_attached()) {
+    return false;
+  }
+  // Nor the block counters.
+  if (processor()->block_counters()) {
+    return false;
+  }
+
+  // The cache holds the code as loaded.
+  if (symbol_info->is_modified()) {
+    return false;
+  }
+
+  auto persistent_cache = GetPersistentCache(symbol_info->module());
+  if (!persistent_cache) {
+    return false;
+  }
+  return persistent_cache->Load(symbol_info, debug_info_flags, out_function);
+}
+
+void* X64Backend::PlaceInterpreterEntry(FunctionInfo* symbol_info,
+                                        InterpreterEntry entry,
+                                        void* function,
+                                        size_t* out_code_size) {
+  std::lock_guard<xe::mutex> guard(thunk_emitter_lock_);
+  return thunk_emitter_->EmitInterpreterEntry(symbol_info, entry, function,
+                                              out_code_size);
+}
+
+void X64Backend::FreeFunctionCode(Function* function) {
+  if (function->machine_code()) {
+    code_cache_->FreeCode(function->address(), function->machine_code());
+  }
+}
+
+void X64Backend::ReleaseModule(Module* module) {
+  std::lock_guard<xe::mutex> guard(persistent_caches_lock_);
+  persistent_caches_.erase(module);
+}
+
+size_t X64Backend::UnwindGuestStack(uint64_t host_pc, uint64_t host_sp,
+                                    const uint8_t* stack_data,
+                                    size_t stack_data_size,
+                                    GuestStackFrame* out_frames,
+                                    size_t max_frames) {
+  // All generated code (thunks included) has the same frame layout: a
+  // `sub rsp, stack_size` prolog with the return address right above it.
+  size_t frame_count = 0;
+  uint64_t pc = host_pc;
+  uint64_t sp = host_sp;
+  X64CodeCache::CodeInfo code_info;
+  while (frame_count < max_frames && code_cache_->LookupCode(pc, &code_info)) {
+    if (code_info.guest_address) {
+      out_frames[frame_count++] = {pc, code_info.guest_address};
+    }
+    // Before the prolog and at the final ret the frame isn't allocated.
+    size_t frame_size = code_info.stack_size;
+    size_t prolog_size = frame_size <= 128 ? 4 : 7;
+    if (pc - reinterpret_cast<uint64_t>(code_info.code_address) <
+            prolog_size ||
+        *reinterpret_cast<const uint8_t*>(pc) == 0xC3) {
+      frame_size = 0;
+    }
+    uint64_t return_address_offset = sp + frame_size - host_sp;
+    if (return_address_offset + 8 > stack_data_size) {
+      break;
+    }
+    std::memcpy(&pc, stack_data + return_address_offset, 8);
+    sp += frame_size + 8;
+  }
+  return frame_count;
+}
+
+X64PersistentCache* X64Backend::GetPersistentCache(Module* module) {
+  if (FLAGS_persistent_code_cache_path.empty() || !module->code_hash()) {
+    return nullptr;
+  }
+
+  std::lock_guard<xe::mutex> guard(persistent_caches_lock_);
+  auto it = persistent_caches_.find(module);
+  if (it != persistent_caches_.end()) {
+    return it->second.get();
+  }
+
+  // Failures are remembered as null entries so we only try once.
+  auto persistent_cache = std::make_unique<X64PersistentCache>(this, module);
+  if (!persistent_cache->Initialize(
+          xe::to_wstring(FLAGS_persistent_code_cache_path))) {
+    persistent_cache.reset();
+  }
+  auto result = persistent_cache.get();
+  persistent_caches_[module] = std::move(persistent_cache);
+  return result;
+}
+
+void X64Backend::RecordBlockLayout(size_t code_size, size_t hot_code_size) {
+  // Without the layout all of the code would be on the hot path.
+  ++layout_function_count_;
+  layout_code_size_ += code_size;
+  layout_hot_code_size_ += hot_code_size;
+  layout_code_lines_ += xe::round_up(code_size, 64) / 64;
+  layout_hot_code_lines_ += xe::round_up(hot_code_size, 64) / 64;
+}
+
+void X64Backend::DumpBlockLayoutStatistics() {
+  uint64_t code_lines = layout_code_lines_;
+  uint64_t hot_code_lines = layout_hot_code_lines_;
+  XELOGI("Block layout: %lld functions, hot path %lld/%lld bytes",
+         uint64_t(layout_function_count_), uint64_t(layout_hot_code_size_),
+         uint64_t(layout_code_size_));
+  XELOGI("Block layout: hot path %lld/%lld cache lines (%.1f%%)",
+         hot_code_lines, code_lines,
+         code_lines ? 100.0 * hot_code_lines / code_lines : 0.0);
+}
+
 }  // namespace x64
 }  // namespace backend
 }  // namespace cpu
@@ -12,9 +12,29 @@
 
 #include <gflags/gflags.h>
 
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/mutex.h"
 #include "xenia/cpu/backend/backend.h"
 
 DECLARE_bool(enable_haswell_instructions);
+DECLARE_string(persistent_code_cache_path);
+DECLARE_bool(patch_call_sites);
+DECLARE_bool(inline_call_caches);
+DECLARE_bool(inline_cache_statistics);
+DECLARE_string(pinned_guest_registers);
+DECLARE_bool(perf_map);
+DECLARE_string(perf_jitdump_path);
+DECLARE_bool(gdb_jit_interface);
+
+namespace xe {
+namespace cpu {
+class Module;
+}  // namespace cpu
+}  // namespace xe
 
 namespace xe {
 namespace cpu {
@@ -22,6 +42,9 @@ namespace backend {
 namespace x64 {
 
 class X64CodeCache;
+class X64PersistentCache;
+class X64ThunkEmitter;
+class XbyakAllocator;
 
 #define XENIA_HAS_X64_BACKEND 1
 
@@ -38,26 +61,78 @@ class X64Backend : public Backend {
 
   X64CodeCache* code_cache() const { return code_cache_; }
   uint32_t emitter_data() const { return emitter_data_; }
+  uint32_t emitter_feature_flags() const { return emitter_feature_flags_; }
   HostToGuestThunk host_to_guest_thunk() const { return host_to_guest_thunk_; }
   GuestToHostThunk guest_to_host_thunk() const { return guest_to_host_thunk_; }
   ResolveFunctionThunk resolve_function_thunk() const {
     return resolve_function_thunk_;
   }
+  // Guest GPRs kept in host registers while guest code runs, in the order
+  // given by --pinned_guest_registers. See X64Emitter::GetPinnedRegister.
+  const std::vector<uint32_t>& pinned_registers() const {
+    return pinned_registers_;
+  }
 
   bool Initialize() override;
 
+  // An X64CodeCache::ThreadEpoch.
+  void* AllocThreadData() override;
+  void FreeThreadData(void* thread_data) override;
+
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high) override;
 
   std::unique_ptr<Assembler> CreateAssembler() override;
 
+  bool LoadCachedFunction(FunctionInfo* symbol_info, uint32_t debug_info_flags,
+                          Function** out_function) override;
+  void* PlaceInterpreterEntry(FunctionInfo* symbol_info,
+                              InterpreterEntry entry, void* function,
+                              size_t* out_code_size) override;
+  void FreeFunctionCode(Function* function) override;
+  void ReleaseModule(Module* module) override;
+  size_t UnwindGuestStack(uint64_t host_pc, uint64_t host_sp,
+                          const uint8_t* stack_data, size_t stack_data_size,
+                          GuestStackFrame* out_frames,
+                          size_t max_frames) override;
+
+  // Returns the persistent cache for the module, or nullptr if disabled or
+  // not possible for the module.
+  X64PersistentCache* GetPersistentCache(Module* module);
+
+  // Records a function emitted with --hot_cold_layout, where only the first
+  // hot_code_size bytes of its code are on the hot path.
+  void RecordBlockLayout(size_t code_size, size_t hot_code_size);
+  void DumpBlockLayoutStatistics();
+
  private:
+  void ParsePinnedRegisters();
+
   X64CodeCache* code_cache_;
 
   uint32_t emitter_data_;
+  uint32_t emitter_feature_flags_;
+
+  xe::mutex persistent_caches_lock_;
+  std::unordered_map<Module*, std::unique_ptr<X64PersistentCache>>
+      persistent_caches_;
 
   HostToGuestThunk host_to_guest_thunk_;
   GuestToHostThunk guest_to_host_thunk_;
   ResolveFunctionThunk resolve_function_thunk_;
+
+  // Kept around for interpreter entries, which are placed as functions are
+  // translated on any thread.
+  xe::mutex thunk_emitter_lock_;
+  std::unique_ptr<XbyakAllocator> thunk_allocator_;
+  std::unique_ptr<X64ThunkEmitter> thunk_emitter_;
+
+  std::vector<uint32_t> pinned_registers_;
+
+  std::atomic<uint64_t> layout_function_count_;
+  std::atomic<uint64_t> layout_code_size_;
+  std::atomic<uint64_t> layout_hot_code_size_;
+  std::atomic<uint64_t> layout_code_lines_;
+  std::atomic<uint64_t> layout_hot_code_lines_;
 };
 
 }  // namespace x64
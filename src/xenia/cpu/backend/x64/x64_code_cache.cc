@@ -9,13 +9,18 @@
 
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 
+#include <algorithm>
 #include <cstring>
+#include <iterator>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/atomic.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_emitter.h"
 
 namespace xe {
 namespace cpu {
@@ -32,11 +37,26 @@ X64CodeCache::X64CodeCache()
       indirection_table_base_(nullptr),
       generated_code_base_(nullptr),
       generated_code_offset_(0),
+      freed_code_size_(0),
+      epoch_(1),
       generated_code_commit_mark_(0),
       unwind_table_handle_(nullptr),
-      unwind_table_count_(0) {}
+      unwind_table_count_(0),
+      call_site_count_(0),
+      patched_call_site_count_(0) {}
 
 X64CodeCache::~X64CodeCache() {
+  if (call_site_count_) {
+    DumpCallSiteStatistics();
+  }
+  if (freed_code_size_) {
+    XELOGI("Code cache: %lld/%lld bytes in use, %lld freed",
+           uint64_t(generated_code_offset_ - freed_code_size_),
+           uint64_t(generated_code_offset_), uint64_t(freed_code_size_));
+  }
+  if (FLAGS_inline_cache_statistics && !inline_caches_.empty()) {
+    DumpInlineCacheStatistics();
+  }
   if (unwind_table_handle_) {
     RtlDeleteGrowableFunctionTable(unwind_table_handle_);
   }
@@ -89,8 +109,8 @@ bool X64CodeCache::Initialize() {
     return false;
   }
 
-  // Compute total number of unwind entries we should allocate.
-  // We don't support reallocing right now, so this should be high.
+  // Start with room for a typical title's worth of functions. The table is
+  // replaced with a larger one when it fills up.
   unwind_table_.resize(30000);
 
   // Create table and register with the system. It's empty now, but we'll grow
@@ -105,6 +125,13 @@ bool X64CodeCache::Initialize() {
     return false;
   }
 
+  if (X64CodeListener::is_enabled()) {
+    listener_.reset(new X64CodeListener());
+    if (!listener_->Initialize()) {
+      return false;
+    }
+  }
+
   return true;
 }
 
@@ -117,6 +144,13 @@ void X64CodeCache::AddIndirection(uint32_t guest_address,
   uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
       indirection_table_base_ + (guest_address - kIndirectionTableBase));
   *indirection_slot = host_address;
+  PatchCallSites(guest_address, host_address);
+}
+
+bool X64CodeCache::HasIndirection(uint32_t guest_address) {
+  uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
+      indirection_table_base_ + (guest_address - kIndirectionTableBase));
+  return *indirection_slot != indirection_default_value_;
 }
 
 void X64CodeCache::CommitExecutableRange(uint32_t guest_low,
@@ -132,33 +166,37 @@ void X64CodeCache::CommitExecutableRange(uint32_t guest_low,
   }
 }
 
-void* X64CodeCache::PlaceCode(uint32_t guest_address, void* machine_code,
-                              size_t code_size, size_t stack_size) {
-  // Hold a lock while we bump the pointers up. This is important as the
-  // unwind table requires entries AND code to be sorted in order.
-  size_t low_mark;
+void* X64CodeCache::PlaceCode(uint32_t guest_address, const std::string& name,
+                              void* machine_code, size_t code_size,
+                              size_t stack_size) {
+  // Hold a lock while we reserve space. This is important as the unwind table
+  // requires entries to be sorted in order.
   size_t high_mark;
   uint8_t* code_address = nullptr;
   uint8_t* unwind_entry_address = nullptr;
-  size_t unwind_table_slot = 0;
   {
     std::lock_guard<xe::mutex> allocation_lock(allocation_mutex_);
 
-    low_mark = generated_code_offset_;
-
-    // Reserve code.
+    // Reserve code, followed by its unwind info.
     // Always move the code to land on 16b alignment.
-    code_address = generated_code_base_ + generated_code_offset_;
-    generated_code_offset_ += xe::round_up(code_size, 16);
-
-    // Reserve unwind info.
     // We go on the high size of the unwind info as we don't know how big we
     // need it, and a few extra bytes of padding isn't the worst thing.
-    unwind_entry_address = generated_code_base_ + generated_code_offset_;
-    generated_code_offset_ += xe::round_up(kUnwindInfoSize, 16);
-    unwind_table_slot = ++unwind_table_count_;
-
-    high_mark = generated_code_offset_;
+    size_t block_size =
+        xe::round_up(code_size, 16) + xe::round_up(kUnwindInfoSize, 16);
+    size_t offset = AllocateCode(block_size);
+    code_address = generated_code_base_ + offset;
+    code_blocks_[offset] = {
+        block_size, {code_address, code_size, stack_size, guest_address}};
+    unwind_entry_address = code_address + xe::round_up(code_size, 16);
+    high_mark = offset + block_size;
+
+    // The entry can go in before the code and unwind info are written, as
+    // nothing runs the code until the indirection table points at it.
+    RUNTIME_FUNCTION fn_entry;
+    fn_entry.BeginAddress = DWORD(code_address - generated_code_base_);
+    fn_entry.EndAddress = DWORD(fn_entry.BeginAddress + code_size);
+    fn_entry.UnwindData = DWORD(unwind_entry_address - generated_code_base_);
+    AddUnwindEntry(fn_entry);
   }
 
   // If we are going above the high water mark of committed memory, commit some
@@ -177,16 +215,17 @@ void* X64CodeCache::PlaceCode(uint32_t guest_address, void* machine_code,
   std::memcpy(code_address, machine_code, code_size);
 
   // Add unwind info.
-  InitializeUnwindEntry(unwind_entry_address, unwind_table_slot, code_address,
-                        code_size, stack_size);
-
-  // Notify that the unwind table has grown.
-  // We do this outside of the lock, but with the latest total count.
-  RtlGrowFunctionTable(unwind_table_handle_, unwind_table_count_);
+  InitializeUnwindEntry(unwind_entry_address, code_address, code_size,
+                        stack_size);
 
   // This isn't needed on x64 (probably), but is convention.
   FlushInstructionCache(GetCurrentProcess(), code_address, code_size);
 
+  if (listener_) {
+    listener_->OnCodePlaced(guest_address, name, code_address, code_size,
+                            stack_size);
+  }
+
   // Now that everything is ready, fix up the indirection table.
   // Note that we do support code that doesn't have an indirection fixup, so
   // ignore those when we see them.
@@ -194,11 +233,438 @@ void* X64CodeCache::PlaceCode(uint32_t guest_address, void* machine_code,
     uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
         indirection_table_base_ + (guest_address - kIndirectionTableBase));
     *indirection_slot = uint32_t(reinterpret_cast<uint64_t>(code_address));
+    PatchCallSites(guest_address,
+                   uint32_t(reinterpret_cast<uint64_t>(code_address)));
   }
 
   return code_address;
 }
 
+size_t X64CodeCache::AllocateCode(size_t size) {
+  // First fit from freed space, falling back to the end.
+  ReclaimRetiredBlocks();
+  for (auto it = free_blocks_.begin(); it != free_blocks_.end(); ++it) {
+    if (it->second < size) {
+      continue;
+    }
+    size_t offset = it->first;
+    size_t remaining_size = it->second - size;
+    free_blocks_.erase(it);
+    if (remaining_size) {
+      free_blocks_[offset + size] = remaining_size;
+    }
+    freed_code_size_ -= size;
+    return offset;
+  }
+  size_t offset = generated_code_offset_;
+  generated_code_offset_ += size;
+  return offset;
+}
+
+void X64CodeCache::ReclaimRetiredBlocks() {
+  if (retired_blocks_.empty()) {
+    return;
+  }
+  // Blocks retired at or before the oldest epoch a thread still in guest code
+  // has published were unreachable, and not on its stack, when it did.
+  uint64_t oldest_entry_epoch = UINT64_MAX;
+  {
+    std::lock_guard<xe::mutex> guard(thread_epochs_mutex_);
+    for (auto& thread_epoch : thread_epochs_) {
+      uint64_t entry_epoch = thread_epoch->entry_epoch;
+      if (entry_epoch) {
+        oldest_entry_epoch = std::min(oldest_entry_epoch, entry_epoch);
+      }
+    }
+  }
+  while (!retired_blocks_.empty() &&
+         retired_blocks_.front().retire_epoch <= oldest_entry_epoch) {
+    size_t offset = retired_blocks_.front().offset;
+    size_t size = retired_blocks_.front().size;
+    retired_blocks_.pop_front();
+    // Kept until now so exceptions can still unwind through the code.
+    RemoveUnwindEntry(generated_code_base_ + offset);
+
+    // Merge with the free neighbors on either side.
+    auto next_it = free_blocks_.lower_bound(offset);
+    if (next_it != free_blocks_.end() && offset + size == next_it->first) {
+      size += next_it->second;
+      next_it = free_blocks_.erase(next_it);
+    }
+    if (next_it != free_blocks_.begin()) {
+      auto prev_it = std::prev(next_it);
+      if (prev_it->first + prev_it->second == offset) {
+        prev_it->second += size;
+        continue;
+      }
+    }
+    free_blocks_[offset] = size;
+  }
+}
+
+void X64CodeCache::FreeCode(uint32_t guest_address, void* code_address) {
+  size_t offset =
+      reinterpret_cast<uint8_t*>(code_address) - generated_code_base_;
+  size_t size;
+  {
+    std::lock_guard<xe::mutex> allocation_lock(allocation_mutex_);
+    auto it = code_blocks_.find(offset);
+    if (it == code_blocks_.end()) {
+      assert_always("Freeing code that was never placed");
+      return;
+    }
+    size = it->second.size;
+    code_blocks_.erase(it);
+  }
+  uint8_t* block_begin = generated_code_base_ + offset;
+  uint8_t* block_end = block_begin + size;
+
+  // Stop new calls from reaching the code.
+  if (guest_address) {
+    uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
+        indirection_table_base_ + (guest_address - kIndirectionTableBase));
+    uint32_t host_address = uint32_t(reinterpret_cast<uint64_t>(block_begin));
+    if (*indirection_slot == host_address) {
+      *indirection_slot = indirection_default_value_;
+    }
+  }
+  {
+    // Threads missing in the code may still try to fill its caches. Done
+    // first, as filling one adds a call site.
+    std::lock_guard<xe::mutex> guard(inline_cache_mutex_);
+    for (auto& cache : inline_caches_) {
+      uint8_t* cache_code_address = cache->code_address;
+      if (cache_code_address >= block_begin && cache_code_address < block_end) {
+        cache->code_address = nullptr;
+      }
+    }
+  }
+  FreeCallSites(guest_address, block_begin, block_end);
+  if (listener_) {
+    listener_->OnCodeFreed(block_begin);
+  }
+
+  // Only threads that enter guest code from here on are sure not to reach the
+  // code. Epochs are taken under the lock to keep retired_blocks_ in order.
+  std::lock_guard<xe::mutex> allocation_lock(allocation_mutex_);
+  retired_blocks_.push_back({offset, size, ++epoch_});
+  freed_code_size_ += size;
+}
+
+X64CodeCache::ThreadEpoch* X64CodeCache::RegisterThread() {
+  auto thread_epoch = std::make_unique<ThreadEpoch>();
+  thread_epoch->call_depth = 0;
+  thread_epoch->entry_epoch = 0;
+  std::lock_guard<xe::mutex> guard(thread_epochs_mutex_);
+  thread_epochs_.push_back(std::move(thread_epoch));
+  return thread_epochs_.back().get();
+}
+
+void X64CodeCache::UnregisterThread(ThreadEpoch* thread_epoch) {
+  std::lock_guard<xe::mutex> guard(thread_epochs_mutex_);
+  for (auto it = thread_epochs_.begin(); it != thread_epochs_.end(); ++it) {
+    if (it->get() == thread_epoch) {
+      thread_epochs_.erase(it);
+      break;
+    }
+  }
+}
+
+void X64CodeCache::EnterGuestCode(ThreadEpoch* thread_epoch) {
+  if (thread_epoch->call_depth) {
+    PassQuiescentPoint(thread_epoch);
+    ++thread_epoch->call_depth;
+    return;
+  }
+  ++thread_epoch->call_depth;
+  // Publish the epoch and check it is still current, so that code freed
+  // while it was being published is waited on.
+  uint64_t epoch;
+  do {
+    epoch = epoch_;
+    thread_epoch->entry_epoch = epoch;
+  } while (epoch_ != epoch);
+}
+
+void X64CodeCache::LeaveGuestCode(ThreadEpoch* thread_epoch) {
+  if (!--thread_epoch->call_depth) {
+    thread_epoch->entry_epoch = 0;
+  } else {
+    PassQuiescentPoint(thread_epoch);
+  }
+}
+
+void X64CodeCache::EnterExternCall(ThreadEpoch* thread_epoch,
+                                   uint64_t guest_sp) {
+  thread_epoch->extern_call_sps.push_back(guest_sp);
+  PassQuiescentPoint(thread_epoch);
+}
+
+void X64CodeCache::LeaveExternCall(ThreadEpoch* thread_epoch) {
+  PassQuiescentPoint(thread_epoch);
+  thread_epoch->extern_call_sps.pop_back();
+}
+
+void X64CodeCache::PassQuiescentPoint(ThreadEpoch* thread_epoch) {
+  // Each guest call on the stack must have left through an extern call for
+  // all of its frames to be found. Ones that left some other way (through the
+  // interpreter, say) keep the epoch the thread has.
+  if (thread_epoch->extern_call_sps.size() != thread_epoch->call_depth) {
+    return;
+  }
+  uint64_t epoch = epoch_;
+  if (epoch == thread_epoch->entry_epoch) {
+    return;
+  }
+  // Code is removed from code_blocks_ before its retire epoch is taken, so
+  // any retired at or before epoch is seen as freed here.
+  for (uint64_t guest_sp : thread_epoch->extern_call_sps) {
+    if (!IsStackSegmentLive(guest_sp)) {
+      return;
+    }
+  }
+  thread_epoch->entry_epoch = epoch;
+}
+
+bool X64CodeCache::IsStackSegmentLive(uint64_t guest_sp) {
+  // Same frame layout as X64Backend::UnwindGuestStack: the return address
+  // sits right above each frame. The call out left its return address just
+  // below guest_sp.
+  uint64_t sp = guest_sp;
+  uint64_t pc = *reinterpret_cast<const uint64_t*>(sp - 8);
+  CodeInfo code_info;
+  while (LookupCode(pc, &code_info)) {
+    sp += code_info.stack_size;
+    pc = *reinterpret_cast<const uint64_t*>(sp);
+    sp += 8;
+  }
+  // The walk ends in the host code that called into guest code, unless it
+  // stopped at freed code.
+  uint64_t base_address = reinterpret_cast<uint64_t>(generated_code_base_);
+  return pc < base_address || pc >= base_address + kGeneratedCodeSize;
+}
+
+bool X64CodeCache::LookupCode(uint64_t host_address, CodeInfo* out_info) {
+  uint64_t base_address = reinterpret_cast<uint64_t>(generated_code_base_);
+  if (host_address < base_address ||
+      host_address >= base_address + kGeneratedCodeSize) {
+    return false;
+  }
+  size_t offset = size_t(host_address - base_address);
+  std::lock_guard<xe::mutex> allocation_lock(allocation_mutex_);
+  auto it = code_blocks_.upper_bound(offset);
+  if (it == code_blocks_.begin()) {
+    return false;
+  }
+  --it;
+  if (offset >= it->first + it->second.info.code_size) {
+    return false;
+  }
+  *out_info = it->second.info;
+  return true;
+}
+
+void X64CodeCache::AddCallSites(uint8_t* code_address,
+                                const X64Relocation* relocations,
+                                size_t relocation_count) {
+  std::lock_guard<xe::mutex> guard(call_site_mutex_);
+  for (size_t i = 0; i < relocation_count; ++i) {
+    const auto& relocation = relocations[i];
+    if (relocation.type != X64RelocationType::kCallSite) {
+      continue;
+    }
+    uint32_t target_address = uint32_t(relocation.value);
+    if (target_address < kIndirectionTableBase ||
+        target_address - kIndirectionTableBase >= kIndirectionTableSize) {
+      continue;
+    }
+    ++call_site_count_;
+    auto& call_sites = call_sites_[target_address];
+    uint8_t* rel32_address = code_address + relocation.code_offset;
+    call_sites.push_back(
+        {rel32_address, *reinterpret_cast<int32_t*>(rel32_address), false});
+    if (HasIndirection(target_address)) {
+      // Target is already placed; the indirection slot holds its code.
+      uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
+          indirection_table_base_ + (target_address - kIndirectionTableBase));
+      PatchCallSite(&call_sites.back(), *indirection_slot);
+    }
+  }
+}
+
+void X64CodeCache::PatchCallSites(uint32_t guest_address,
+                                  uint32_t host_address) {
+  // The indirection slot is written before taking the lock, so any site
+  // added after this point sees the code and patches itself.
+  std::lock_guard<xe::mutex> guard(call_site_mutex_);
+  auto it = call_sites_.find(guest_address);
+  if (it == call_sites_.end()) {
+    return;
+  }
+  for (auto& call_site : it->second) {
+    PatchCallSite(&call_site, host_address);
+  }
+}
+
+void X64CodeCache::FreeCallSites(uint32_t guest_address, uint8_t* block_begin,
+                                 uint8_t* block_end) {
+  std::lock_guard<xe::mutex> guard(call_site_mutex_);
+
+  // Sites calling the code go back to their stubs. Some may already call
+  // newer code placed for the same function.
+  auto it = call_sites_.find(guest_address);
+  if (it != call_sites_.end()) {
+    for (auto& call_site : it->second) {
+      uint8_t* rel32_address = call_site.rel32_address;
+      uint8_t* target = rel32_address + 4 +
+                        *reinterpret_cast<int32_t*>(rel32_address);
+      if (!call_site.is_patched || target < block_begin ||
+          target >= block_end) {
+        continue;
+      }
+      xe::atomic_exchange(call_site.stub_disp,
+                          reinterpret_cast<volatile int32_t*>(rel32_address));
+      FlushInstructionCache(GetCurrentProcess(), rel32_address, 4);
+      call_site.is_patched = false;
+      --patched_call_site_count_;
+    }
+  }
+
+  // Sites within the code must never be patched again, as the space will be
+  // reused.
+  for (auto& it : call_sites_) {
+    auto& call_sites = it.second;
+    auto end_it = std::remove_if(
+        call_sites.begin(), call_sites.end(),
+        [this, block_begin, block_end](const CallSite& call_site) {
+          if (call_site.rel32_address < block_begin ||
+              call_site.rel32_address >= block_end) {
+            return false;
+          }
+          --call_site_count_;
+          if (call_site.is_patched) {
+            --patched_call_site_count_;
+          }
+          return true;
+        });
+    call_sites.erase(end_it, call_sites.end());
+  }
+}
+
+void X64CodeCache::PatchCallSite(CallSite* call_site, uint32_t host_address) {
+  // Other threads may be executing the call as we patch it. The rel32 is 4b
+  // aligned (see X64Emitter::EmitPatchableCall) so it is replaced with a
+  // single store and they see either the old or the new target.
+  uint8_t* rel32_address = call_site->rel32_address;
+  uint64_t next_instr_address = uint64_t(rel32_address) + 4;
+  int32_t disp = int32_t(int64_t(host_address) - int64_t(next_instr_address));
+  assert_zero(uint64_t(rel32_address) & 3);
+  xe::atomic_exchange(disp, reinterpret_cast<volatile int32_t*>(rel32_address));
+  FlushInstructionCache(GetCurrentProcess(), rel32_address, 4);
+  if (!call_site->is_patched) {
+    call_site->is_patched = true;
+    ++patched_call_site_count_;
+  }
+}
+
+void X64CodeCache::DumpCallSiteStatistics() {
+  uint64_t call_site_count = call_site_count_;
+  uint64_t patched_count = patched_call_site_count_;
+  XELOGI("Code cache: %lld/%lld direct call sites patched (%.1f%%)",
+         patched_count, call_site_count,
+         call_site_count ? 100.0 * patched_count / call_site_count : 0.0);
+}
+
+X64InlineCache* X64CodeCache::AllocateInlineCache(uint32_t guest_address) {
+  auto cache = std::make_unique<X64InlineCache>();
+  cache->guest_address = guest_address;
+  for (uint32_t i = 0; i < X64InlineCache::kEntryCount; ++i) {
+    cache->target_offsets[i] = 0;
+    cache->call_offsets[i] = 0;
+  }
+  cache->code_address = nullptr;
+  cache->entry_count = 0;
+  cache->hit_count = 0;
+  cache->miss_count = 0;
+  std::lock_guard<xe::mutex> guard(inline_cache_mutex_);
+  inline_caches_.push_back(std::move(cache));
+  return inline_caches_.back().get();
+}
+
+void X64CodeCache::FillInlineCache(X64InlineCache* cache,
+                                   uint32_t target_address) {
+  if (target_address < kIndirectionTableBase ||
+      target_address - kIndirectionTableBase >= kIndirectionTableSize) {
+    return;
+  }
+  if (!cache->code_address) {
+    return;
+  }
+  std::lock_guard<xe::mutex> guard(inline_cache_mutex_);
+  // Checked again now that the code can't be freed under us.
+  uint8_t* code_address = cache->code_address;
+  if (!code_address) {
+    return;
+  }
+  uint32_t entry = cache->entry_count;
+  if (entry >= X64InlineCache::kEntryCount) {
+    return;
+  }
+  for (uint32_t i = 0; i < entry; ++i) {
+    // Another thread missed on the same target first.
+    if (*reinterpret_cast<uint32_t*>(code_address + cache->target_offsets[i]) ==
+        target_address) {
+      return;
+    }
+  }
+
+  // Point the call at the target before publishing the target: until then
+  // the entry can't match and the call is never reached.
+  X64Relocation relocation = {cache->call_offsets[entry],
+                              X64RelocationType::kCallSite, target_address};
+  AddCallSites(code_address, &relocation, 1);
+  // Like call sites, the imm32 is 4b aligned so it is replaced atomically.
+  uint8_t* target_imm32 = code_address + cache->target_offsets[entry];
+  assert_zero(uint64_t(target_imm32) & 3);
+  xe::atomic_exchange(int32_t(target_address),
+                      reinterpret_cast<volatile int32_t*>(target_imm32));
+  FlushInstructionCache(GetCurrentProcess(), target_imm32, 4);
+  cache->entry_count = entry + 1;
+}
+
+void X64CodeCache::DumpInlineCacheStatistics() {
+  std::lock_guard<xe::mutex> guard(inline_cache_mutex_);
+  std::vector<const X64InlineCache*> caches;
+  uint64_t hit_count = 0;
+  uint64_t miss_count = 0;
+  for (auto& cache : inline_caches_) {
+    hit_count += cache->hit_count;
+    miss_count += cache->miss_count;
+    if (cache->hit_count + cache->miss_count) {
+      caches.push_back(cache.get());
+    }
+  }
+  uint64_t call_count = hit_count + miss_count;
+  XELOGI("Code cache: %lld inline caches, %lld/%lld calls hit (%.1f%%)",
+         uint64_t(inline_caches_.size()), hit_count, call_count,
+         call_count ? 100.0 * hit_count / call_count : 0.0);
+
+  // Busiest sites first.
+  std::sort(caches.begin(), caches.end(),
+            [](const X64InlineCache* a, const X64InlineCache* b) {
+              return a->hit_count + a->miss_count >
+                     b->hit_count + b->miss_count;
+            });
+  const size_t kMaxSiteCount = 32;
+  for (size_t i = 0; i < caches.size() && i < kMaxSiteCount; ++i) {
+    auto cache = caches[i];
+    uint64_t site_call_count = cache->hit_count + cache->miss_count;
+    XELOGI("  %.8X: %lld calls, %.1f%% hit, %d targets", cache->guest_address,
+           site_call_count, 100.0 * cache->hit_count / site_call_count,
+           uint32_t(cache->entry_count));
+  }
+}
+
 // http://msdn.microsoft.com/en-us/library/ssa62fwe.aspx
 typedef enum _UNWIND_OP_CODES {
   UWOP_PUSH_NONVOL = 0, /* info == register number */
@@ -259,7 +725,6 @@ typedef struct _UNWIND_INFO {
 } UNWIND_INFO, *PUNWIND_INFO;
 
 void X64CodeCache::InitializeUnwindEntry(uint8_t* unwind_entry_address,
-                                         size_t unwind_table_slot,
                                          uint8_t* code_address,
                                          size_t code_size, size_t stack_size) {
   auto unwind_info = reinterpret_cast<UNWIND_INFO*>(unwind_entry_address);
@@ -312,12 +777,82 @@ void X64CodeCache::InitializeUnwindEntry(uint8_t* unwind_entry_address,
     unwind_code = unwind_info->UnwindCode[co++];
     unwind_code.FrameOffset = (USHORT)(stack_size) / 8;
   }
+}
 
-  // Add entry.
-  auto& fn_entry = unwind_table_[unwind_table_slot];
-  fn_entry.BeginAddress = (DWORD)(code_address - generated_code_base_);
-  fn_entry.EndAddress = (DWORD)(fn_entry.BeginAddress + code_size);
-  fn_entry.UnwindData = (DWORD)(unwind_entry_address - generated_code_base_);
+void X64CodeCache::AddUnwindEntry(const RUNTIME_FUNCTION& entry) {
+  auto begin_it = unwind_table_.begin();
+  auto end_it = begin_it + unwind_table_count_;
+  auto it = std::lower_bound(begin_it, end_it, entry,
+                             [](const RUNTIME_FUNCTION& a,
+                                const RUNTIME_FUNCTION& b) {
+                               return a.BeginAddress < b.BeginAddress;
+                             });
+  if (it != end_it && it->BeginAddress == entry.BeginAddress &&
+      (it + 1 == end_it || (it + 1)->BeginAddress >= entry.EndAddress)) {
+    // Reusing the start of freed code, whose entry was emptied, without
+    // covering any other emptied entries (lookups expect no overlap). Write
+    // the end last so the entry never covers code it doesn't describe.
+    it->UnwindData = entry.UnwindData;
+    it->EndAddress = entry.EndAddress;
+    return;
+  }
+  if (it == end_it && unwind_table_count_ < unwind_table_.size()) {
+    *it = entry;
+    ++unwind_table_count_;
+    // Notify that the unwind table has grown.
+    RtlGrowFunctionTable(unwind_table_handle_, unwind_table_count_);
+    return;
+  }
+
+  // Out of order or out of room.
+  std::vector<RUNTIME_FUNCTION> table;
+  table.reserve(std::max(unwind_table_.size(),
+                         size_t(unwind_table_count_) * 2));
+  for (auto copy_it = begin_it; copy_it != end_it; ++copy_it) {
+    if (copy_it == it) {
+      table.push_back(entry);
+    }
+    if (copy_it->EndAddress != copy_it->BeginAddress) {
+      table.push_back(*copy_it);
+    }
+  }
+  if (it == end_it) {
+    table.push_back(entry);
+  }
+  ReplaceUnwindTable(std::move(table));
+}
+
+void X64CodeCache::RemoveUnwindEntry(uint8_t* code_address) {
+  DWORD begin_address = DWORD(code_address - generated_code_base_);
+  auto begin_it = unwind_table_.begin();
+  auto end_it = begin_it + unwind_table_count_;
+  auto it = std::lower_bound(begin_it, end_it, begin_address,
+                             [](const RUNTIME_FUNCTION& a, DWORD b) {
+                               return a.BeginAddress < b;
+                             });
+  if (it != end_it && it->BeginAddress == begin_address) {
+    it->EndAddress = it->BeginAddress;
+  }
+}
+
+bool X64CodeCache::ReplaceUnwindTable(std::vector<RUNTIME_FUNCTION> table) {
+  // Register the new table before dropping the old so there's always one.
+  uint32_t count = uint32_t(table.size());
+  table.resize(table.capacity());
+  void* table_handle = nullptr;
+  if (RtlAddGrowableFunctionTable(
+          &table_handle, table.data(), count, DWORD(table.size()),
+          reinterpret_cast<ULONG_PTR>(generated_code_base_),
+          reinterpret_cast<ULONG_PTR>(generated_code_base_ +
+                                      kGeneratedCodeSize))) {
+    XELOGE("Unable to replace unwind function table");
+    return false;
+  }
+  RtlDeleteGrowableFunctionTable(unwind_table_handle_);
+  unwind_table_handle_ = table_handle;
+  unwind_table_ = std::move(table);
+  unwind_table_count_ = count;
+  return true;
 }
 
 uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
@@ -11,19 +11,48 @@
 #define XENIA_BACKEND_X64_X64_CODE_CACHE_H_
 
 #include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "xenia/base/mutex.h"
 #include "xenia/base/platform.h"
 #include "xenia/cpu/backend/code_cache.h"
+#include "xenia/cpu/backend/x64/x64_code_listener.h"
 
 namespace xe {
 namespace cpu {
 namespace backend {
 namespace x64 {
 
+struct X64Relocation;
+
+// Inline cache of an indirect call site, holding the first few targets seen
+// there. The generated code compares against each entry's target and calls
+// it directly on a match (see X64Emitter::CallIndirect); misses go through
+// the indirection table and fill in the next free entry.
+struct X64InlineCache {
+  static const uint32_t kEntryCount = 2;
+  // Guest address of the call, for statistics.
+  uint32_t guest_address;
+  // Offsets in the code of each entry's cmp imm32 and call rel32.
+  uint32_t target_offsets[kEntryCount];
+  uint32_t call_offsets[kEntryCount];
+  // Set once the code is placed; misses before that aren't cached.
+  std::atomic<uint8_t*> code_address;
+  // Entries filled in. Read by the generated code to stop calling out once
+  // the cache is full.
+  std::atomic<uint32_t> entry_count;
+  // Only counted with --inline_cache_statistics. Incremented without a lock
+  // prefix, so approximate when several threads share the site.
+  uint64_t hit_count;
+  uint64_t miss_count;
+};
+
 class X64CodeCache : public CodeCache {
  public:
   X64CodeCache();
@@ -36,7 +65,6 @@ class X64CodeCache : public CodeCache {
   uint32_t total_size() const override { return kGeneratedCodeSize; }
 
   // TODO(benvanik): ELF serialization/etc
-  // TODO(benvanik): keep track of code blocks
   // TODO(benvanik): padding/guards/etc
 
   void set_indirection_default(uint32_t default_value);
@@ -44,20 +72,109 @@ class X64CodeCache : public CodeCache {
 
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high);
 
-  void* PlaceCode(uint32_t guest_address, void* machine_code, size_t code_size,
-                  size_t stack_size);
+  // The name is only for host profilers and debuggers (see
+  // X64CodeListener), and may be empty for guest functions.
+  void* PlaceCode(uint32_t guest_address, const std::string& name,
+                  void* machine_code, size_t code_size, size_t stack_size);
 
   uint32_t PlaceData(const void* data, size_t length);
 
+  // Frees code placed for guest_address. Its indirection slot and any call
+  // sites pointing at it are reset so callers go back through the resolve
+  // thunk. Threads may still be running the code, or have returns into it on
+  // their stacks, so the space is only reused once every thread that was in
+  // guest code at the time has left it, or has reached a quiescent point
+  // without the code on its stack (see EnterExternCall).
+  void FreeCode(uint32_t guest_address, void* code_address);
+
+  // Per-thread state for deciding when freed code can be reused, one for
+  // each ThreadState.
+  struct ThreadEpoch {
+    // Nested guest calls, counting calls back in from the host. Only touched
+    // by the thread itself.
+    uint32_t call_depth;
+    // Oldest epoch whose freed code the thread may still have on its stack,
+    // or 0 when it isn't in guest code.
+    std::atomic<uint64_t> entry_epoch;
+    // rsp of each extern call the thread is in, outermost first. Only touched
+    // by the thread itself.
+    std::vector<uint64_t> extern_call_sps;
+  };
+  ThreadEpoch* RegisterThread();
+  void UnregisterThread(ThreadEpoch* thread_epoch);
+  // Brackets every call from the host into guest code. Leaving the outermost
+  // call is the point at which a thread can no longer be in freed code.
+  void EnterGuestCode(ThreadEpoch* thread_epoch);
+  void LeaveGuestCode(ThreadEpoch* thread_epoch);
+  // Brackets every extern (kernel) call from guest code, with the rsp of the
+  // guest function making it. Threads spend their lives in guest code, but
+  // regularly call out to the kernel, so these are where they catch up with
+  // the current epoch. Calls back into guest code made from there (APCs and
+  // interrupts) are as well.
+  void EnterExternCall(ThreadEpoch* thread_epoch, uint64_t guest_sp);
+  void LeaveExternCall(ThreadEpoch* thread_epoch);
+
+  struct CodeInfo {
+    uint8_t* code_address;
+    size_t code_size;
+    size_t stack_size;
+    // 0 for thunks.
+    uint32_t guest_address;
+  };
+  // Finds the placed code containing host_address, if any.
+  bool LookupCode(uint64_t host_address, CodeInfo* out_info);
+
+  // Registers the direct call sites (kCallSite relocations) in placed code.
+  // Each is pointed straight at its target as soon as the target has code,
+  // and until then goes through its stub and the indirection table. Sites are
+  // repointed whenever new code is placed for their target.
+  void AddCallSites(uint8_t* code_address, const X64Relocation* relocations,
+                    size_t relocation_count);
+
+  void DumpCallSiteStatistics();
+
+  // Allocates an empty inline cache. Caches live as long as the code cache.
+  X64InlineCache* AllocateInlineCache(uint32_t guest_address);
+  // Fills the next free entry of the cache with the target. The entry's call
+  // is registered like any other call site, so it goes straight to the
+  // target's code once that is placed.
+  void FillInlineCache(X64InlineCache* cache, uint32_t target_address);
+
+  void DumpInlineCacheStatistics();
+
  private:
   const static uint64_t kIndirectionTableBase = 0x80000000;
   const static uint64_t kIndirectionTableSize = 0x1FFFFFFF;
   const static uint64_t kGeneratedCodeBase = 0xA0000000;
   const static uint64_t kGeneratedCodeSize = 0x0FFFFFFF;
 
+  bool HasIndirection(uint32_t guest_address);
+  struct CallSite {
+    uint8_t* rel32_address;
+    // Displacement of the stub the site was emitted calling.
+    int32_t stub_disp;
+    bool is_patched;
+  };
+  void PatchCallSite(CallSite* call_site, uint32_t host_address);
+  void PatchCallSites(uint32_t guest_address, uint32_t host_address);
+
+  size_t AllocateCode(size_t size);
+  void ReclaimRetiredBlocks();
+  // Advances the thread's epoch if none of the guest code on its stack has
+  // been freed. Must be called from the host, between guest calls.
+  void PassQuiescentPoint(ThreadEpoch* thread_epoch);
+  // Whether the guest frames above an extern call made with guest_sp are all
+  // in placed code.
+  bool IsStackSegmentLive(uint64_t guest_sp);
+  void FreeCallSites(uint32_t guest_address, uint8_t* block_begin,
+                     uint8_t* block_end);
+
   void InitializeUnwindEntry(uint8_t* unwind_entry_address,
-                             size_t unwind_table_slot, uint8_t* code_address,
-                             size_t code_size, size_t stack_size);
+                             uint8_t* code_address, size_t code_size,
+                             size_t stack_size);
+  void AddUnwindEntry(const RUNTIME_FUNCTION& entry);
+  void RemoveUnwindEntry(uint8_t* code_address);
+  bool ReplaceUnwindTable(std::vector<RUNTIME_FUNCTION> table);
 
   std::wstring file_name_;
   HANDLE mapping_;
@@ -78,15 +195,53 @@ class X64CodeCache : public CodeCache {
   uint8_t* generated_code_base_;
   // Current offset to empty space in generated code.
   size_t generated_code_offset_;
+  // Placed code (with its unwind info) by offset.
+  struct CodeBlock {
+    size_t size;
+    CodeInfo info;
+  };
+  std::map<size_t, CodeBlock> code_blocks_;
+  // Freed space ready for reuse by offset, coalesced, and its size.
+  std::map<size_t, size_t> free_blocks_;
+  // Freed space that may still be running, oldest first.
+  struct RetiredBlock {
+    size_t offset;
+    size_t size;
+    uint64_t retire_epoch;
+  };
+  std::deque<RetiredBlock> retired_blocks_;
+  // Advanced each time code is freed. Starts at 1 so that 0 can mean a thread
+  // is outside guest code.
+  std::atomic<uint64_t> epoch_;
+  xe::mutex thread_epochs_mutex_;
+  std::vector<std::unique_ptr<ThreadEpoch>> thread_epochs_;
+  std::atomic<uint64_t> freed_code_size_;
   // Current high water mark of COMMITTED code.
   std::atomic<size_t> generated_code_commit_mark_;
 
   // Growable function table system handle.
   void* unwind_table_handle_;
-  // Actual unwind table entries.
+  // Actual unwind table entries, sorted by address. The system can only grow
+  // the table in place, so inserting anywhere but the end or running out of
+  // room registers a new table. Entries of freed code are emptied rather
+  // than removed and dropped the next time the table is replaced.
   std::vector<RUNTIME_FUNCTION> unwind_table_;
   // Current number of entries in the table.
-  std::atomic<uint32_t> unwind_table_count_;
+  uint32_t unwind_table_count_;
+
+  // Guards call_sites_ against targets being placed concurrently.
+  xe::mutex call_site_mutex_;
+  // All call sites targeting each guest function.
+  std::unordered_map<uint32_t, std::vector<CallSite>> call_sites_;
+  std::atomic<uint64_t> call_site_count_;
+  std::atomic<uint64_t> patched_call_site_count_;
+
+  // Guards filling inline caches, as threads may miss on the same site.
+  xe::mutex inline_cache_mutex_;
+  std::vector<std::unique_ptr<X64InlineCache>> inline_caches_;
+
+  // Only created when one of its flags is set.
+  std::unique_ptr<X64CodeListener> listener_;
 };
 
 }  // namespace x64
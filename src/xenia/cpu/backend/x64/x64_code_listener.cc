@@ -0,0 +1,627 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/x64/x64_code_listener.h"
+
+#include <cinttypes>
+#include <cstring>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/string.h"
+#include "xenia/base/threading.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
+
+#if XE_PLATFORM_LINUX
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif  // XE_PLATFORM_LINUX
+
+// GDB's JIT interface. gdb breaks on __jit_debug_register_code and walks the
+// descriptor each time it's called, so the names and layout are fixed.
+extern "C" {
+enum jit_actions_t { JIT_NOACTION = 0, JIT_REGISTER_FN, JIT_UNREGISTER_FN };
+struct jit_code_entry {
+  jit_code_entry* next_entry;
+  jit_code_entry* prev_entry;
+  const char* symfile_addr;
+  uint64_t symfile_size;
+};
+struct jit_descriptor {
+  uint32_t version;
+  uint32_t action_flag;
+  jit_code_entry* relevant_entry;
+  jit_code_entry* first_entry;
+};
+#if XE_COMPILER_MSVC
+__declspec(noinline) void __jit_debug_register_code() {}
+#else
+__attribute__((noinline)) void __jit_debug_register_code() {
+  __asm__ volatile("");
+}
+#endif  // XE_COMPILER_MSVC
+jit_descriptor __jit_debug_descriptor = {1, JIT_NOACTION, nullptr, nullptr};
+}
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+namespace {
+
+// DWARF call frame information, as used by .eh_frame.
+enum : uint8_t {
+  DW_EH_PE_absptr = 0x00,
+  DW_EH_PE_udata4 = 0x03,
+  DW_EH_PE_sdata4 = 0x0B,
+  DW_EH_PE_pcrel = 0x10,
+  DW_EH_PE_datarel = 0x30,
+  DW_CFA_nop = 0x00,
+  DW_CFA_def_cfa = 0x0C,
+  DW_CFA_def_cfa_offset = 0x0E,
+  DW_CFA_advance_loc = 0x40,
+  DW_CFA_offset = 0x80,
+};
+// DWARF x64 register numbers.
+const uint8_t kDwarfRegRsp = 7;
+const uint8_t kDwarfRegReturnAddress = 16;
+
+// perf jitdump records (tools/perf/Documentation/jitdump-specification.txt).
+const uint32_t kJitdumpMagic = 0x4A695444;
+const uint32_t kJitdumpVersion = 1;
+const uint32_t kElfMachineX64 = 62;
+enum : uint32_t {
+  JIT_CODE_LOAD = 0,
+  JIT_CODE_CLOSE = 3,
+  JIT_CODE_UNWINDING_INFO = 4,
+};
+struct JitdumpHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t total_size;
+  uint32_t elf_mach;
+  uint32_t pad1;
+  uint32_t pid;
+  uint64_t timestamp;
+  uint64_t flags;
+};
+struct JitdumpRecordHeader {
+  uint32_t id;
+  uint32_t total_size;
+  uint64_t timestamp;
+};
+struct JitdumpCodeLoad {
+  JitdumpRecordHeader header;
+  uint32_t pid;
+  uint32_t tid;
+  uint64_t vma;
+  uint64_t code_addr;
+  uint64_t code_size;
+  uint64_t code_index;
+  // Followed by the null-terminated name and the code.
+};
+struct JitdumpUnwindingInfo {
+  JitdumpRecordHeader header;
+  uint64_t unwinding_size;
+  uint64_t eh_frame_hdr_size;
+  uint64_t mapped_size;
+  // Followed by .eh_frame, .eh_frame_hdr and padding to 8b.
+};
+
+// Just enough ELF64 to hand gdb a symbol and unwind info.
+struct ElfHeader {
+  uint8_t ident[16];
+  uint16_t type;
+  uint16_t machine;
+  uint32_t version;
+  uint64_t entry;
+  uint64_t phoff;
+  uint64_t shoff;
+  uint32_t flags;
+  uint16_t ehsize;
+  uint16_t phentsize;
+  uint16_t phnum;
+  uint16_t shentsize;
+  uint16_t shnum;
+  uint16_t shstrndx;
+};
+struct ElfSectionHeader {
+  uint32_t name;
+  uint32_t type;
+  uint64_t flags;
+  uint64_t addr;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t link;
+  uint32_t info;
+  uint64_t addralign;
+  uint64_t entsize;
+};
+struct ElfSymbol {
+  uint32_t name;
+  uint8_t info;
+  uint8_t other;
+  uint16_t shndx;
+  uint64_t value;
+  uint64_t size;
+};
+enum : uint32_t {
+  SHT_PROGBITS = 1,
+  SHT_SYMTAB = 2,
+  SHT_STRTAB = 3,
+  SHT_NOBITS = 8,
+};
+enum : uint64_t {
+  SHF_ALLOC = 0x2,
+  SHF_EXECINSTR = 0x4,
+};
+enum ElfSection : uint16_t {
+  kSectionNull,
+  kSectionText,
+  kSectionEhFrame,
+  kSectionSymtab,
+  kSectionStrtab,
+  kSectionShstrtab,
+  kSectionCount,
+};
+// Names of the sections above, at the offsets used in the section headers.
+const char kSectionNames[] = "\0.text\0.eh_frame\0.symtab\0.strtab\0.shstrtab";
+const uint32_t kSectionNameOffsets[] = {0, 1, 7, 17, 25, 33};
+
+template <typename T>
+void Append(std::vector<uint8_t>* out, T value) {
+  auto p = reinterpret_cast<const uint8_t*>(&value);
+  out->insert(out->end(), p, p + sizeof(T));
+}
+
+void AppendUleb128(std::vector<uint8_t>* out, uint64_t value) {
+  do {
+    uint8_t b = value & 0x7F;
+    value >>= 7;
+    out->push_back(value ? b | 0x80 : b);
+  } while (value);
+}
+
+void AppendSleb128(std::vector<uint8_t>* out, int64_t value) {
+  while (true) {
+    uint8_t b = value & 0x7F;
+    value >>= 7;
+    if ((!value && !(b & 0x40)) || (value == -1 && (b & 0x40))) {
+      out->push_back(b);
+      return;
+    }
+    out->push_back(b | 0x80);
+  }
+}
+
+// Pads with DW_CFA_nop and fills in the length of the entry at entry_offset.
+void EndCfiEntry(std::vector<uint8_t>* out, size_t start, size_t entry_offset) {
+  while ((out->size() - start) % 8) {
+    out->push_back(DW_CFA_nop);
+  }
+  uint32_t length = uint32_t(out->size() - entry_offset - 4);
+  std::memcpy(out->data() + entry_offset, &length, sizeof(length));
+}
+
+// Appends .eh_frame for a function to out. Returns the offset of the FDE from
+// the start. With an eh_frame_address the function's address is encoded
+// relative to it, otherwise it is absolute. The former only works within 2GB
+// of the code.
+// The frame matches the Win32 unwind info: a `sub rsp, stack_size` prolog,
+// if any, and nothing else.
+size_t AppendEhFrame(std::vector<uint8_t>* out, uint64_t eh_frame_address,
+                     const uint8_t* code_address, size_t code_size,
+                     size_t stack_size) {
+  uint8_t pc_encoding =
+      eh_frame_address ? DW_EH_PE_pcrel | DW_EH_PE_sdata4 : DW_EH_PE_absptr;
+  size_t start = out->size();
+
+  // CIE: CFA = rsp + 8, return address at CFA - 8.
+  size_t cie_offset = out->size();
+  Append<uint32_t>(out, 0);  // length
+  Append<uint32_t>(out, 0);  // CIE id
+  out->push_back(1);         // version
+  out->insert(out->end(), {'z', 'R', 0});
+  AppendUleb128(out, 1);   // code alignment
+  AppendSleb128(out, -8);  // data alignment
+  AppendUleb128(out, kDwarfRegReturnAddress);
+  AppendUleb128(out, 1);  // augmentation data length
+  out->push_back(pc_encoding);
+  out->push_back(DW_CFA_def_cfa);
+  AppendUleb128(out, kDwarfRegRsp);
+  AppendUleb128(out, 8);
+  out->push_back(DW_CFA_offset | kDwarfRegReturnAddress);
+  AppendUleb128(out, 1);
+  EndCfiEntry(out, start, cie_offset);
+
+  // FDE.
+  size_t fde_offset = out->size();
+  Append<uint32_t>(out, 0);  // length
+  Append<uint32_t>(out, uint32_t(out->size() - cie_offset));
+  if (eh_frame_address) {
+    uint64_t pc_begin_address = eh_frame_address + (out->size() - start);
+    Append<int32_t>(out, int32_t(reinterpret_cast<uint64_t>(code_address) -
+                                 pc_begin_address));
+    Append<uint32_t>(out, uint32_t(code_size));
+  } else {
+    Append<uint64_t>(out, reinterpret_cast<uint64_t>(code_address));
+    Append<uint64_t>(out, code_size);
+  }
+  AppendUleb128(out, 0);  // augmentation data length
+  if (stack_size) {
+    uint8_t prolog_size = stack_size <= 128 ? 4 : 7;
+    out->push_back(DW_CFA_advance_loc | prolog_size);
+    out->push_back(DW_CFA_def_cfa_offset);
+    AppendUleb128(out, stack_size + 8);
+  }
+  EndCfiEntry(out, start, fde_offset);
+
+  // Terminator.
+  Append<uint32_t>(out, 0);
+  return fde_offset - start;
+}
+
+// Appends the .eh_frame_hdr (with its binary search table) perf expects to
+// follow .eh_frame.
+void AppendEhFrameHdr(std::vector<uint8_t>* out, uint64_t eh_frame_hdr_address,
+                      uint64_t eh_frame_address, size_t fde_offset,
+                      const uint8_t* code_address) {
+  out->push_back(1);  // version
+  out->push_back(DW_EH_PE_pcrel | DW_EH_PE_sdata4);
+  out->push_back(DW_EH_PE_udata4);
+  out->push_back(DW_EH_PE_datarel | DW_EH_PE_sdata4);
+  Append<int32_t>(out, int32_t(eh_frame_address - (eh_frame_hdr_address + 4)));
+  Append<uint32_t>(out, 1);  // FDE count
+  Append<int32_t>(out, int32_t(reinterpret_cast<uint64_t>(code_address) -
+                               eh_frame_hdr_address));
+  uint64_t fde_address = eh_frame_address + fde_offset;
+  Append<int32_t>(out, int32_t(fde_address - eh_frame_hdr_address));
+}
+
+uint32_t GetProcessId() {
+#if XE_PLATFORM_WIN32
+  return uint32_t(GetCurrentProcessId());
+#else
+  return uint32_t(getpid());
+#endif  // XE_PLATFORM_WIN32
+}
+
+uint32_t GetThreadId() {
+#if XE_PLATFORM_LINUX
+  return uint32_t(syscall(SYS_gettid));
+#else
+  return xe::threading::current_thread_id();
+#endif  // XE_PLATFORM_LINUX
+}
+
+// Nanoseconds on the clock perf record -k mono uses.
+uint64_t GetTimestamp() {
+#if XE_PLATFORM_LINUX
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+#else
+  return uint64_t(double(Clock::QueryHostTickCount()) * 1000000000.0 /
+                  Clock::host_tick_frequency());
+#endif  // XE_PLATFORM_LINUX
+}
+
+}  // namespace
+
+struct X64CodeListener::GdbJitEntry {
+  jit_code_entry entry;
+  std::vector<uint8_t> symfile;
+};
+
+X64CodeListener::X64CodeListener()
+    : perf_map_file_(nullptr),
+      jitdump_file_(nullptr),
+      jitdump_marker_(nullptr),
+      jitdump_code_index_(0) {}
+
+X64CodeListener::~X64CodeListener() {
+  for (auto& it : gdb_jit_entries_) {
+    UnregisterGdbJitEntry(it.second);
+  }
+  gdb_jit_entries_.clear();
+  CloseJitdump();
+  if (perf_map_file_) {
+    std::fclose(perf_map_file_);
+    perf_map_file_ = nullptr;
+  }
+}
+
+bool X64CodeListener::is_enabled() {
+  return FLAGS_perf_map || !FLAGS_perf_jitdump_path.empty() ||
+         FLAGS_gdb_jit_interface;
+}
+
+bool X64CodeListener::Initialize() {
+  if (FLAGS_perf_map) {
+    // perf only looks for the map under this name.
+    char path[64];
+    std::snprintf(path, xe::countof(path), "/tmp/perf-%u.map", GetProcessId());
+    perf_map_file_ = std::fopen(path, "w");
+    if (!perf_map_file_) {
+      XELOGE("Unable to open perf map %s", path);
+      return false;
+    }
+  }
+  if (!FLAGS_perf_jitdump_path.empty() && !OpenJitdump()) {
+    return false;
+  }
+  return true;
+}
+
+bool X64CodeListener::OpenJitdump() {
+  // perf inject only picks up files named like this.
+  char file_name[64];
+  std::snprintf(file_name, xe::countof(file_name), "jit-%u.dump",
+                GetProcessId());
+  auto path = xe::join_paths(FLAGS_perf_jitdump_path, file_name);
+  jitdump_file_ = std::fopen(path.c_str(), "w+b");
+  if (!jitdump_file_) {
+    XELOGE("Unable to open perf jitdump %s", path.c_str());
+    return false;
+  }
+
+#if XE_PLATFORM_LINUX
+  // perf record notices the file through this executable mapping of it.
+  long page_size = sysconf(_SC_PAGESIZE);
+  jitdump_marker_ = mmap(nullptr, page_size, PROT_READ | PROT_EXEC,
+                         MAP_PRIVATE, fileno(jitdump_file_), 0);
+  if (jitdump_marker_ == MAP_FAILED) {
+    jitdump_marker_ = nullptr;
+    XELOGE("Unable to map perf jitdump %s", path.c_str());
+    return false;
+  }
+#endif  // XE_PLATFORM_LINUX
+
+  JitdumpHeader header = {0};
+  header.magic = kJitdumpMagic;
+  header.version = kJitdumpVersion;
+  header.total_size = sizeof(header);
+  header.elf_mach = kElfMachineX64;
+  header.pid = GetProcessId();
+  header.timestamp = GetTimestamp();
+  std::fwrite(&header, sizeof(header), 1, jitdump_file_);
+  std::fflush(jitdump_file_);
+  return true;
+}
+
+void X64CodeListener::CloseJitdump() {
+  if (!jitdump_file_) {
+    return;
+  }
+  JitdumpRecordHeader record = {0};
+  record.id = JIT_CODE_CLOSE;
+  record.total_size = sizeof(record);
+  record.timestamp = GetTimestamp();
+  std::fwrite(&record, sizeof(record), 1, jitdump_file_);
+#if XE_PLATFORM_LINUX
+  if (jitdump_marker_) {
+    munmap(jitdump_marker_, sysconf(_SC_PAGESIZE));
+    jitdump_marker_ = nullptr;
+  }
+#endif  // XE_PLATFORM_LINUX
+  std::fclose(jitdump_file_);
+  jitdump_file_ = nullptr;
+}
+
+void X64CodeListener::OnCodePlaced(uint32_t guest_address,
+                                   const std::string& name,
+                                   const uint8_t* code_address,
+                                   size_t code_size, size_t stack_size) {
+  std::string symbol_name = name;
+  if (symbol_name.empty()) {
+    char default_name[16];
+    std::snprintf(default_name, xe::countof(default_name), "sub_%.8X",
+                  guest_address);
+    symbol_name = default_name;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (perf_map_file_) {
+    // Flushed as we go, as perf reads it after we've exited (or crashed).
+    std::fprintf(perf_map_file_, "%" PRIx64 " %" PRIx64 " %s\n",
+                 reinterpret_cast<uint64_t>(code_address), uint64_t(code_size),
+                 symbol_name.c_str());
+    std::fflush(perf_map_file_);
+  }
+  if (jitdump_file_) {
+    WriteJitdumpLoad(symbol_name, code_address, code_size, stack_size);
+  }
+  if (FLAGS_gdb_jit_interface) {
+    RegisterGdbJitEntry(symbol_name, code_address, code_size, stack_size);
+  }
+}
+
+void X64CodeListener::OnCodeFreed(const uint8_t* code_address) {
+  // perf has no notion of unloading; a later load over the same range wins.
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = gdb_jit_entries_.find(code_address);
+  if (it != gdb_jit_entries_.end()) {
+    UnregisterGdbJitEntry(it->second);
+    gdb_jit_entries_.erase(it);
+  }
+}
+
+void X64CodeListener::WriteJitdumpLoad(const std::string& name,
+                                       const uint8_t* code_address,
+                                       size_t code_size, size_t stack_size) {
+  uint64_t timestamp = GetTimestamp();
+
+  // Unwind info goes first and applies to the next load. perf places it in
+  // its object after the code, aligned to 8b.
+  std::vector<uint8_t> unwinding_data;
+  uint64_t eh_frame_address =
+      reinterpret_cast<uint64_t>(code_address) + xe::round_up(code_size, 8);
+  size_t fde_offset = AppendEhFrame(&unwinding_data, eh_frame_address,
+                                    code_address, code_size, stack_size);
+  size_t eh_frame_size = unwinding_data.size();
+  AppendEhFrameHdr(&unwinding_data, eh_frame_address + eh_frame_size,
+                   eh_frame_address, fde_offset, code_address);
+  size_t unwinding_size = unwinding_data.size();
+  unwinding_data.resize(xe::round_up(unwinding_size, 8));
+
+  JitdumpUnwindingInfo unwinding_info = {0};
+  unwinding_info.header.id = JIT_CODE_UNWINDING_INFO;
+  unwinding_info.header.total_size =
+      uint32_t(sizeof(unwinding_info) + unwinding_data.size());
+  unwinding_info.header.timestamp = timestamp;
+  unwinding_info.unwinding_size = unwinding_size;
+  unwinding_info.eh_frame_hdr_size = unwinding_size - eh_frame_size;
+  unwinding_info.mapped_size = unwinding_size;
+  std::fwrite(&unwinding_info, sizeof(unwinding_info), 1, jitdump_file_);
+  std::fwrite(unwinding_data.data(), 1, unwinding_data.size(), jitdump_file_);
+
+  JitdumpCodeLoad code_load = {0};
+  code_load.header.id = JIT_CODE_LOAD;
+  code_load.header.total_size =
+      uint32_t(sizeof(code_load) + name.size() + 1 + code_size);
+  code_load.header.timestamp = timestamp;
+  code_load.pid = GetProcessId();
+  code_load.tid = GetThreadId();
+  code_load.vma = reinterpret_cast<uint64_t>(code_address);
+  code_load.code_addr = code_load.vma;
+  code_load.code_size = code_size;
+  code_load.code_index = jitdump_code_index_++;
+  std::fwrite(&code_load, sizeof(code_load), 1, jitdump_file_);
+  std::fwrite(name.c_str(), 1, name.size() + 1, jitdump_file_);
+  std::fwrite(code_address, 1, code_size, jitdump_file_);
+  std::fflush(jitdump_file_);
+}
+
+void X64CodeListener::RegisterGdbJitEntry(const std::string& name,
+                                          const uint8_t* code_address,
+                                          size_t code_size,
+                                          size_t stack_size) {
+  // Lay out a relocatable object: header, symbols, string tables, .eh_frame
+  // and the section headers. .text is NOBITS, pointing at the placed code.
+  // The object lives on the heap, likely too far from the code for
+  // .eh_frame to refer to it relatively.
+  std::vector<uint8_t> eh_frame;
+  AppendEhFrame(&eh_frame, 0, code_address, code_size, stack_size);
+  size_t symtab_offset = sizeof(ElfHeader);
+  size_t strtab_offset = symtab_offset + 2 * sizeof(ElfSymbol);
+  size_t shstrtab_offset = strtab_offset + name.size() + 2;
+  size_t eh_frame_offset =
+      xe::round_up(shstrtab_offset + sizeof(kSectionNames), 8);
+  size_t section_headers_offset =
+      xe::round_up(eh_frame_offset + eh_frame.size(), 8);
+
+  auto entry = new GdbJitEntry();
+  auto& symfile = entry->symfile;
+  symfile.resize(section_headers_offset +
+                 kSectionCount * sizeof(ElfSectionHeader));
+  uint8_t* base = symfile.data();
+
+  auto header = reinterpret_cast<ElfHeader*>(base);
+  const uint8_t ident[] = {0x7F, 'E', 'L', 'F', 2, 1, 1};
+  std::memcpy(header->ident, ident, sizeof(ident));
+  header->type = 1;  // ET_REL
+  header->machine = kElfMachineX64;
+  header->version = 1;
+  header->shoff = section_headers_offset;
+  header->ehsize = sizeof(ElfHeader);
+  header->shentsize = sizeof(ElfSectionHeader);
+  header->shnum = kSectionCount;
+  header->shstrndx = kSectionShstrtab;
+
+  // Symbol 0 is reserved. Values are relative to their section.
+  auto symbols = reinterpret_cast<ElfSymbol*>(base + symtab_offset);
+  symbols[1].name = 1;
+  symbols[1].info = 0x12;  // STB_GLOBAL, STT_FUNC
+  symbols[1].shndx = kSectionText;
+  symbols[1].value = 0;
+  symbols[1].size = code_size;
+  std::memcpy(base + strtab_offset + 1, name.c_str(), name.size() + 1);
+  std::memcpy(base + shstrtab_offset, kSectionNames, sizeof(kSectionNames));
+
+  std::memcpy(base + eh_frame_offset, eh_frame.data(), eh_frame.size());
+
+  auto sections =
+      reinterpret_cast<ElfSectionHeader*>(base + section_headers_offset);
+  for (uint32_t i = 0; i < kSectionCount; ++i) {
+    sections[i].name = kSectionNameOffsets[i];
+  }
+  auto& text = sections[kSectionText];
+  text.type = SHT_NOBITS;
+  text.flags = SHF_ALLOC | SHF_EXECINSTR;
+  text.addr = reinterpret_cast<uint64_t>(code_address);
+  text.size = code_size;
+  text.addralign = 16;
+  auto& eh_frame_section = sections[kSectionEhFrame];
+  eh_frame_section.type = SHT_PROGBITS;
+  eh_frame_section.flags = SHF_ALLOC;
+  eh_frame_section.addr =
+      reinterpret_cast<uint64_t>(base) + eh_frame_offset;
+  eh_frame_section.offset = eh_frame_offset;
+  eh_frame_section.size = eh_frame.size();
+  eh_frame_section.addralign = 8;
+  auto& symtab = sections[kSectionSymtab];
+  symtab.type = SHT_SYMTAB;
+  symtab.offset = symtab_offset;
+  symtab.size = 2 * sizeof(ElfSymbol);
+  symtab.link = kSectionStrtab;
+  symtab.info = 1;  // first global symbol
+  symtab.addralign = 8;
+  symtab.entsize = sizeof(ElfSymbol);
+  auto& strtab = sections[kSectionStrtab];
+  strtab.type = SHT_STRTAB;
+  strtab.offset = strtab_offset;
+  strtab.size = name.size() + 2;
+  strtab.addralign = 1;
+  auto& shstrtab = sections[kSectionShstrtab];
+  shstrtab.type = SHT_STRTAB;
+  shstrtab.offset = shstrtab_offset;
+  shstrtab.size = sizeof(kSectionNames);
+  shstrtab.addralign = 1;
+
+  entry->entry.symfile_addr = reinterpret_cast<const char*>(base);
+  entry->entry.symfile_size = symfile.size();
+  entry->entry.prev_entry = nullptr;
+  entry->entry.next_entry = __jit_debug_descriptor.first_entry;
+  if (entry->entry.next_entry) {
+    entry->entry.next_entry->prev_entry = &entry->entry;
+  }
+  __jit_debug_descriptor.first_entry = &entry->entry;
+  __jit_debug_descriptor.relevant_entry = &entry->entry;
+  __jit_debug_descriptor.action_flag = JIT_REGISTER_FN;
+  __jit_debug_register_code();
+
+  // Placing code at an address only happens again after freeing it.
+  gdb_jit_entries_[code_address] = entry;
+}
+
+void X64CodeListener::UnregisterGdbJitEntry(GdbJitEntry* entry) {
+  auto code_entry = &entry->entry;
+  if (code_entry->prev_entry) {
+    code_entry->prev_entry->next_entry = code_entry->next_entry;
+  } else {
+    __jit_debug_descriptor.first_entry = code_entry->next_entry;
+  }
+  if (code_entry->next_entry) {
+    code_entry->next_entry->prev_entry = code_entry->prev_entry;
+  }
+  __jit_debug_descriptor.relevant_entry = code_entry;
+  __jit_debug_descriptor.action_flag = JIT_UNREGISTER_FN;
+  __jit_debug_register_code();
+  delete entry;
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,77 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BACKEND_X64_X64_CODE_LISTENER_H_
+#define XENIA_BACKEND_X64_X64_CODE_LISTENER_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+// Describes generated code to host profilers and debuggers, which otherwise
+// only see anonymous executable memory:
+//   --perf_map writes /tmp/perf-<pid>.map, naming the code in perf report.
+//   --perf_jitdump_path writes a jit-<pid>.dump with the code and its unwind
+//     info. perf inject --jit turns it into objects perf record -g can unwind
+//     through.
+//   --gdb_jit_interface registers an in-memory ELF object per function, with a
+//     symbol and .eh_frame, through GDB's JIT interface.
+// Like the Win32 unwind entries, the unwind info only describes the prolog.
+class X64CodeListener {
+ public:
+  X64CodeListener();
+  ~X64CodeListener();
+
+  // Whether any of the above are enabled.
+  static bool is_enabled();
+
+  bool Initialize();
+
+  // Called once the code and its unwind info have been written. Thunks have
+  // no guest address and pass their own name.
+  void OnCodePlaced(uint32_t guest_address, const std::string& name,
+                    const uint8_t* code_address, size_t code_size,
+                    size_t stack_size);
+  void OnCodeFreed(const uint8_t* code_address);
+
+ private:
+  struct GdbJitEntry;
+
+  bool OpenJitdump();
+  void CloseJitdump();
+  void WriteJitdumpLoad(const std::string& name, const uint8_t* code_address,
+                        size_t code_size, size_t stack_size);
+  void RegisterGdbJitEntry(const std::string& name,
+                           const uint8_t* code_address, size_t code_size,
+                           size_t stack_size);
+  void UnregisterGdbJitEntry(GdbJitEntry* entry);
+
+  std::mutex mutex_;
+  FILE* perf_map_file_;
+  FILE* jitdump_file_;
+  // The mapping of the jitdump perf record watches for to find the file.
+  void* jitdump_marker_;
+  uint64_t jitdump_code_index_;
+  std::unordered_map<const uint8_t*, GdbJitEntry*> gdb_jit_entries_;
+};
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_BACKEND_X64_X64_CODE_LISTENER_H_
@@ -9,7 +9,9 @@
 
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 
+#include <algorithm>
 #include <cstring>
+#include <string>
 
 #include <gflags/gflags.h>
 
@@ -25,6 +27,7 @@
 #include "xenia/cpu/backend/x64/x64_function.h"
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_thunk_emitter.h"
+#include "xenia/cpu/backend/x64/x64_tracers.h"
 #include "xenia/cpu/cpu-private.h"
 #include "xenia/cpu/debug_info.h"
 #include "xenia/cpu/hir/hir_builder.h"
@@ -46,6 +49,7 @@ using namespace xe::cpu::hir;
 using namespace xe::cpu;
 
 using namespace Xbyak;
+using xe::cpu::hir::Block;
 using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::Instr;
 
@@ -67,6 +71,10 @@ const uint32_t X64Emitter::xmm_reg_map_[X64Emitter::XMM_COUNT] = {
     6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
 };
 
+const uint32_t X64Emitter::pinned_reg_map_[X64Emitter::PINNED_GPR_COUNT] = {
+    Operand::RSI, Operand::RDI, Operand::RBP,
+};
+
 X64Emitter::X64Emitter(X64Backend* backend, XbyakAllocator* allocator)
     : CodeGenerator(MAX_CODE_SIZE, AutoGrow, allocator),
       processor_(backend->processor()),
@@ -75,10 +83,15 @@ X64Emitter::X64Emitter(X64Backend* backend, XbyakAllocator* allocator)
       allocator_(allocator),
       feature_flags_(0),
       current_instr_(0),
+      symbol_info_(nullptr),
       debug_info_(nullptr),
       debug_info_flags_(0),
       source_map_count_(0),
-      stack_size_(0) {
+      stack_size_(0),
+      is_laid_out_(false),
+      flags_compare_(nullptr),
+      cacheable_(true),
+      source_address_(0) {
   if (FLAGS_enable_haswell_instructions) {
     feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tAVX2) ? kX64EmitAVX2 : 0;
     feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tFMA) ? kX64EmitFMA : 0;
@@ -98,18 +111,29 @@ X64Emitter::X64Emitter(X64Backend* backend, XbyakAllocator* allocator)
 
 X64Emitter::~X64Emitter() = default;
 
-bool X64Emitter::Emit(uint32_t guest_address, HIRBuilder* builder,
+bool X64Emitter::Emit(FunctionInfo* symbol_info, HIRBuilder* builder,
                       uint32_t debug_info_flags, DebugInfo* debug_info,
                       void*& out_code_address, size_t& out_code_size) {
   SCOPE_profile_cpu_f("cpu");
 
   // Reset.
+  symbol_info_ = symbol_info;
   debug_info_ = debug_info;
   debug_info_flags_ = debug_info_flags;
   if (debug_info_flags_ & DebugInfoFlags::kDebugInfoSourceMap) {
     source_map_count_ = 0;
     source_map_arena_.Reset();
   }
+  relocations_.clear();
+  call_stubs_.clear();
+  inline_caches_.clear();
+  inline_cache_calls_.clear();
+  source_address_ = 0;
+  cacheable_ = (debug_info_flags_ & DebugInfoFlags::kDebugInfoAllTracing) == 0;
+  if (processor_->block_counters()) {
+    // Counter indices are only good for this run.
+    cacheable_ = false;
+  }
 
   // Fill the generator with code.
   size_t stack_size = 0;
@@ -119,7 +143,17 @@ bool X64Emitter::Emit(uint32_t guest_address, HIRBuilder* builder,
 
   // Copy the final code to the cache and relocate it.
   out_code_size = getSize();
-  out_code_address = Emplace(guest_address, stack_size);
+  out_code_address =
+      Emplace(symbol_info->address(), symbol_info->name(), stack_size);
+
+  // Now that the code has its final address, let direct calls in it be
+  // pointed at their targets.
+  code_cache_->AddCallSites(reinterpret_cast<uint8_t*>(out_code_address),
+                            relocations_.data(), relocations_.size());
+  // Inline caches can be filled from here on.
+  for (auto cache : inline_caches_) {
+    cache->code_address = reinterpret_cast<uint8_t*>(out_code_address);
+  }
 
   // Stash source map.
   if (debug_info_flags_ & DebugInfoFlags::kDebugInfoSourceMap) {
@@ -130,14 +164,15 @@ bool X64Emitter::Emit(uint32_t guest_address, HIRBuilder* builder,
   return true;
 }
 
-void* X64Emitter::Emplace(uint32_t guest_address, size_t stack_size) {
+void* X64Emitter::Emplace(uint32_t guest_address, const std::string& name,
+                          size_t stack_size) {
   // To avoid changing xbyak, we do a switcharoo here.
   // top_ points to the Xbyak buffer, and since we are in AutoGrow mode
   // it has pending relocations. We copy the top_ to our buffer, swap the
   // pointer, relocate, then return the original scratch pointer for use.
   uint8_t* old_address = top_;
   void* new_address =
-      code_cache_->PlaceCode(guest_address, top_, size_, stack_size);
+      code_cache_->PlaceCode(guest_address, name, top_, size_, stack_size);
   top_ = (uint8_t*)new_address;
   ready();
   top_ = old_address;
@@ -166,10 +201,9 @@ bool X64Emitter::Emit(HIRBuilder* builder, size_t& out_stack_size) {
   // Must be 16b aligned.
   // Windows is very strict about the form of this and the epilog:
   // http://msdn.microsoft.com/en-us/library/tawsa7cb.aspx
-  // TODO(benvanik): save off non-volatile registers so we can use them:
-  //     RBX, RBP, RDI, RSI, RSP, R12, R13, R14, R15
-  //     Only want to do this if we actually use them, though, otherwise
-  //     it just adds overhead.
+  // Non-volatile registers aren't saved here: the host-to-guest thunk saves
+  // and restores them around all guest code, which is what lets rsi, rdi and
+  // rbp hold pinned guest registers (see GetPinnedRegister).
   // IMPORTANT: any changes to the prolog must be kept in sync with
   //     X64CodeCache, which dynamically generates exception information.
   //     Adding or changing anything here must be matched!
@@ -213,30 +247,22 @@ bool X64Emitter::Emit(HIRBuilder* builder, size_t& out_stack_size) {
   // Load membase.
   mov(rdx, qword[rcx + 8]);
 
-  // Body.
-  auto block = builder->first_block();
-  while (block) {
-    // Mark block labels.
-    auto label = block->label_head;
-    while (label) {
-      L(label->name);
-      label = label->next;
-    }
-
-    // Process instructions.
-    const Instr* instr = block->instr_head;
-    while (instr) {
-      const Instr* new_tail = instr;
-      if (!SelectSequence(*this, instr, &new_tail)) {
-        // No sequence found!
-        assert_always();
-        XELOGE("Unable to process HIR opcode %s", instr->opcode->name);
-        break;
-      }
-      instr = new_tail;
-    }
+  if (builder->attributes() & hir::FUNCTION_ATTRIB_BASELINE) {
+    EmitCallCountdown();
+  }
 
-    block = block->next;
+  // Body.
+  // Blocks that ran rarely in the profiled baseline code are moved out past
+  // the epilog, so that the hot path is contiguous.
+  std::vector<Block*> hot_blocks;
+  std::vector<Block*> cold_blocks;
+  LayoutBlocks(builder, &hot_blocks, &cold_blocks);
+  is_laid_out_ = !cold_blocks.empty();
+  for (size_t n = 0; n < hot_blocks.size(); ++n) {
+    // The last hot block is followed by the epilog.
+    auto block = hot_blocks[n];
+    bool is_last = n + 1 == hot_blocks.size();
+    EmitBlock(block, is_last ? !block->next : block->next == hot_blocks[n + 1]);
   }
 
   // Function epilog.
@@ -254,10 +280,286 @@ bool X64Emitter::Emit(HIRBuilder* builder, size_t& out_stack_size) {
     nop();
   }
 
+  if (is_laid_out_) {
+    size_t hot_code_size = getSize();
+    for (size_t n = 0; n < cold_blocks.size(); ++n) {
+      auto block = cold_blocks[n];
+      bool is_last = n + 1 == cold_blocks.size();
+      EmitBlock(block, !is_last && block->next == cold_blocks[n + 1]);
+    }
+    backend_->RecordBlockLayout(getSize(), hot_code_size);
+  }
+
+  EmitCallStubs();
+
   return true;
 }
 
+void X64Emitter::LayoutBlocks(HIRBuilder* builder,
+                              std::vector<Block*>* hot_blocks,
+                              std::vector<Block*>* cold_blocks) {
+  // Only functions recompiled from baseline code have a profile, in the
+  // coverage counts of the code they are replacing.
+  const debug::FunctionTraceData* profile = nullptr;
+  if (FLAGS_hot_cold_layout &&
+      !(builder->attributes() & hir::FUNCTION_ATTRIB_BASELINE) &&
+      symbol_info_->function() && symbol_info_->function()->debug_info()) {
+    auto& trace_data = symbol_info_->function()->debug_info()->trace_data();
+    if (trace_data.is_valid() &&
+        trace_data.header()->data_size >=
+            debug::FunctionTraceData::SizeOfHeader() +
+                debug::FunctionTraceData::SizeOfInstructionCounts(
+                    trace_data.start_address(), trace_data.end_address()) &&
+        trace_data.header()->function_call_count) {
+      profile = &trace_data;
+    }
+  }
+  if (!profile) {
+    for (auto block = builder->first_block(); block; block = block->next) {
+      hot_blocks->push_back(block);
+    }
+    return;
+  }
+
+  // A block is cold if it ran less than once every kColdBlockRatio calls.
+  // Blocks with no guest instructions of their own (split off by the
+  // optimizer or inlining) go with the block before them.
+  const uint64_t kColdBlockRatio = 64;
+  uint64_t call_count = profile->header()->function_call_count;
+  auto counts =
+      reinterpret_cast<const uint64_t*>(profile->instruction_execute_counts());
+  uint64_t count = call_count;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    bool has_count = false;
+    uint64_t block_count = 0;
+    for (auto i = block->instr_head; i; i = i->next) {
+      if (i->opcode != &OPCODE_SOURCE_OFFSET_info) {
+        continue;
+      }
+      uint32_t address = static_cast<uint32_t>(i->src1.offset);
+      if (address < profile->start_address() ||
+          address > profile->end_address()) {
+        continue;
+      }
+      uint64_t instr_count = counts[(address - profile->start_address()) / 4];
+      block_count = std::max(block_count, instr_count);
+      has_count = true;
+    }
+    if (has_count) {
+      count = block_count;
+    }
+    if (block == builder->first_block() ||
+        count * kColdBlockRatio >= call_count) {
+      hot_blocks->push_back(block);
+    } else {
+      cold_blocks->push_back(block);
+    }
+  }
+}
+
+void X64Emitter::EmitBlock(Block* block, bool falls_through) {
+  // Mark block labels.
+  auto label = block->label_head;
+  while (label) {
+    L(label->name);
+    label = label->next;
+  }
+  if (is_laid_out_) {
+    L(GetBlockLabel(block));
+  }
+  if (processor_->block_counters()) {
+    EmitBlockCounter(block);
+  }
+
+  // Process instructions.
+  // Flags never carry over from another block.
+  flags_compare_ = nullptr;
+  const Instr* instr = block->instr_head;
+  while (instr) {
+    const Instr* new_tail = instr;
+    if (!SelectSequence(*this, instr, &new_tail)) {
+      // No sequence found!
+      assert_always();
+      XELOGE("Unable to process HIR opcode %s", instr->opcode->name);
+      break;
+    }
+    if (IsIntegerCompare(instr)) {
+      flags_compare_ = instr;
+    } else if (new_tail != instr->next || !PreservesFlags(instr)) {
+      flags_compare_ = nullptr;
+    }
+    instr = new_tail;
+  }
+
+  if (falls_through) {
+    return;
+  }
+  // The block that followed this one in the HIR was moved, so jump to it
+  // unless control never falls off the end. RETURN only jumps to the epilog
+  // itself if it's not in the last block.
+  auto tail = block->instr_tail;
+  if (tail && (tail->opcode == &OPCODE_BRANCH_info ||
+               (tail->opcode == &OPCODE_RETURN_info && block->next))) {
+    return;
+  }
+  if (block->next) {
+    jmp(GetBlockLabel(block->next), T_NEAR);
+  } else {
+    jmp("epilog", T_NEAR);
+  }
+}
+
+void X64Emitter::EmitBlockCounter(const Block* block) {
+  // Blocks are named by the first guest instruction in them. Ones without
+  // any (like the epilog) aren't worth counting.
+  const Instr* i = block->instr_head;
+  while (i && i->opcode != &OPCODE_SOURCE_OFFSET_info) {
+    i = i->next;
+  }
+  if (!i) {
+    return;
+  }
+  uint32_t index = processor_->block_counters()->AllocateCounter(
+      symbol_info_->address(), static_cast<uint32_t>(i->src1.offset));
+  if (index == BlockCounters::kInvalidIndex) {
+    return;
+  }
+  // No lock: the shard belongs to this thread. Flags are dead at block
+  // entry.
+  mov(rax, qword[rcx + offsetof(cpu::frontend::PPCContext, block_counters)]);
+  inc(qword[rax + index * 8]);
+}
+
+bool X64Emitter::IsIntegerCompare(const Instr* i) {
+  if (i->opcode->num < OPCODE_COMPARE_EQ ||
+      i->opcode->num > OPCODE_COMPARE_UGE) {
+    return false;
+  }
+  auto type = i->src1.value->type;
+  return type == INT8_TYPE || type == INT16_TYPE || type == INT32_TYPE ||
+         type == INT64_TYPE;
+}
+
+bool X64Emitter::PreservesFlags(const Instr* i) const {
+  switch (i->opcode->num) {
+    case OPCODE_COMMENT:
+      // Traced comments call out.
+      return !IsTracingInstr();
+    case OPCODE_NOP:
+      return true;
+    case OPCODE_SOURCE_OFFSET:
+      // Coverage counts are bumped with a lock inc.
+      return !(debug_info_flags_ &
+               DebugInfoFlags::kDebugInfoTraceFunctionCoverage);
+    case OPCODE_STORE_CONTEXT:
+      // Plain movs, unless the store is traced.
+      return !IsTracingData() && (i->src2.value->type == INT8_TYPE ||
+                                  i->src2.value->type == INT16_TYPE ||
+                                  i->src2.value->type == INT32_TYPE ||
+                                  i->src2.value->type == INT64_TYPE);
+    default:
+      return false;
+  }
+}
+
+bool X64Emitter::EmitFusedBranch(const Instr* i, bool branch_if_true) {
+  // The condition must be a compare of the same operands, in the same order,
+  // as the one whose flags are still live. Record forms and cmp instructions
+  // produce lt/gt/eq from one pair of operands, so this catches branches on
+  // any of those bits.
+  auto compare = i->src1.value->def;
+  if (!flags_compare_ || !compare || !IsIntegerCompare(compare)) {
+    return false;
+  }
+  auto is_same_operand = [](Value* a, Value* b) {
+    return a == b || (a->type == b->type && a->IsConstant() &&
+                      b->IsConstant() && a->IsConstantEQ(b));
+  };
+  if (!is_same_operand(compare->src1.value, flags_compare_->src1.value) ||
+      !is_same_operand(compare->src2.value, flags_compare_->src2.value)) {
+    return false;
+  }
+
+  // Compare sequences put a constant first operand on the right of the cmp.
+  bool is_swapped = flags_compare_->src1.value->IsConstant();
+  Opcode opcode = compare->opcode->num;
+  if (is_swapped) {
+    switch (opcode) {
+      case OPCODE_COMPARE_SLT:
+        opcode = OPCODE_COMPARE_SGT;
+        break;
+      case OPCODE_COMPARE_SLE:
+        opcode = OPCODE_COMPARE_SGE;
+        break;
+      case OPCODE_COMPARE_SGT:
+        opcode = OPCODE_COMPARE_SLT;
+        break;
+      case OPCODE_COMPARE_SGE:
+        opcode = OPCODE_COMPARE_SLE;
+        break;
+      case OPCODE_COMPARE_ULT:
+        opcode = OPCODE_COMPARE_UGT;
+        break;
+      case OPCODE_COMPARE_ULE:
+        opcode = OPCODE_COMPARE_UGE;
+        break;
+      case OPCODE_COMPARE_UGT:
+        opcode = OPCODE_COMPARE_ULT;
+        break;
+      case OPCODE_COMPARE_UGE:
+        opcode = OPCODE_COMPARE_ULE;
+        break;
+      default:
+        break;
+    }
+  }
+
+  auto label = i->src2.label->name;
+  switch (opcode) {
+    case OPCODE_COMPARE_EQ:
+      branch_if_true ? je(label, T_NEAR) : jne(label, T_NEAR);
+      break;
+    case OPCODE_COMPARE_NE:
+      branch_if_true ? jne(label, T_NEAR) : je(label, T_NEAR);
+      break;
+    case OPCODE_COMPARE_SLT:
+      branch_if_true ? jl(label, T_NEAR) : jge(label, T_NEAR);
+      break;
+    case OPCODE_COMPARE_SLE:
+      branch_if_true ? jle(label, T_NEAR) : jg(label, T_NEAR);
+      break;
+    case OPCODE_COMPARE_SGT:
+      branch_if_true ? jg(label, T_NEAR) : jle(label, T_NEAR);
+      break;
+    case OPCODE_COMPARE_SGE:
+      branch_if_true ? jge(label, T_NEAR) : jl(label, T_NEAR);
+      break;
+    case OPCODE_COMPARE_ULT:
+      branch_if_true ? jb(label, T_NEAR) : jae(label, T_NEAR);
+      break;
+    case OPCODE_COMPARE_ULE:
+      branch_if_true ? jbe(label, T_NEAR) : ja(label, T_NEAR);
+      break;
+    case OPCODE_COMPARE_UGT:
+      branch_if_true ? ja(label, T_NEAR) : jbe(label, T_NEAR);
+      break;
+    case OPCODE_COMPARE_UGE:
+      branch_if_true ? jae(label, T_NEAR) : jb(label, T_NEAR);
+      break;
+    default:
+      assert_unhandled_case(opcode);
+      return false;
+  }
+  return true;
+}
+
+std::string X64Emitter::GetBlockLabel(const Block* block) {
+  return "_block" + std::to_string(block->ordinal);
+}
+
 void X64Emitter::MarkSourceOffset(const Instr* i) {
+  source_address_ = static_cast<uint32_t>(i->src1.offset);
+
   auto entry = source_map_arena_.Alloc<SourceMapEntry>();
   entry->source_offset = static_cast<uint32_t>(i->src1.offset);
   entry->hir_offset = uint32_t(i->block->ordinal << 16) | i->ordinal;
@@ -352,17 +654,38 @@ extern "C" uint64_t ResolveFunction(void* raw_context,
   Function* fn = NULL;
   thread_state->processor()->ResolveFunction(target_address, &fn);
   assert_not_null(fn);
-  auto x64_fn = static_cast<X64Function*>(fn);
-  uint64_t addr = reinterpret_cast<uint64_t>(x64_fn->machine_code());
+  uint64_t addr = reinterpret_cast<uint64_t>(fn->machine_code());
 
   return addr;
 }
 
 void X64Emitter::Call(const hir::Instr* instr, FunctionInfo* symbol_info) {
   assert_not_null(symbol_info);
-  auto fn = reinterpret_cast<X64Function*>(symbol_info->function());
+  // May be an interpreted function, called through its entry.
+  auto fn = symbol_info->function();
+  if (FLAGS_patch_call_sites) {
+    if (instr->flags & CALL_TAIL) {
+      // Since we skip the prolog we need to mark the return here.
+      EmitTraceUserCallReturn();
+
+      // Pass the callers return address over.
+      mov(rdx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+
+      add(rsp, static_cast<uint32_t>(stack_size()));
+      EmitPatchableCall(symbol_info->address(), true);
+    } else {
+      // Return address is from the previous SET_RETURN_ADDRESS.
+      mov(rdx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+
+      EmitPatchableCall(symbol_info->address(), false);
+    }
+    return;
+  }
+
   // Resolve address to the function to call and store in rax.
-  if (fn) {
+  // Persisted code may be placed at a different address in a later run, so
+  // it always goes through the indirection table.
+  if (fn && FLAGS_persistent_code_cache_path.empty()) {
     // TODO(benvanik): is it worth it to do this? It removes the need for
     // a ResolveFunction call, but makes the table less useful.
     assert_zero(uint64_t(fn->machine_code()) & 0xFFFFFFFF00000000);
@@ -393,6 +716,153 @@ void X64Emitter::Call(const hir::Instr* instr, FunctionInfo* symbol_info) {
   }
 }
 
+uint64_t RequestRecompile(void* raw_context, uint64_t symbol_info_ptr) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  auto symbol_info = reinterpret_cast<FunctionInfo*>(symbol_info_ptr);
+  thread_state->processor()->frontend()->recompiler()->Enqueue(symbol_info);
+  return 0;
+}
+
+void X64Emitter::EmitCallCountdown() {
+  // Baseline code asks to be recompiled when the countdown hits zero. The
+  // decrement isn't atomic, so racing threads may report it more than once.
+  // The counter lives in the FunctionInfo, so the code can't be persisted.
+  MarkUncacheable();
+  Xbyak::Label skip;
+  mov(rax, reinterpret_cast<uint64_t>(symbol_info_->call_countdown()));
+  dec(dword[rax]);
+  jnz(skip, CodeGenerator::T_NEAR);
+  CallNative(RequestRecompile, reinterpret_cast<uint64_t>(symbol_info_));
+  L(skip);
+}
+
+void X64Emitter::EmitPatchableCall(uint32_t guest_address, bool is_tail) {
+  // The rel32 must be 4b aligned so that X64CodeCache can rewrite it with a
+  // single store while other threads may be executing it.
+  size_t padding = (4 - ((getSize() + 1) & 3)) & 3;
+  nop(padding);
+  db(is_tail ? 0xE9 : 0xE8);
+  call_stubs_.push_back({static_cast<uint32_t>(getSize()), guest_address});
+  dd(0);
+}
+
+void X64Emitter::EmitCallStubs() {
+  for (auto& call_stub : call_stubs_) {
+    // Until the target has code the call lands here and goes through the
+    // indirection table like any other, returning straight to the caller.
+    uint32_t stub_offset = static_cast<uint32_t>(getSize());
+    mov(ebx, call_stub.guest_address);
+    mov(eax, dword[ebx]);
+    jmp(rax);
+
+    int32_t disp = int32_t(stub_offset - (call_stub.code_offset + 4));
+    std::memcpy(top_ + call_stub.code_offset, &disp, sizeof(disp));
+    relocations_.push_back({call_stub.code_offset, X64RelocationType::kCallSite,
+                            (uint64_t(stub_offset) << 32) |
+                                call_stub.guest_address});
+  }
+  call_stubs_.clear();
+
+  if (!inline_cache_calls_.empty()) {
+    // Empty inline cache entries can't match, but to keep the code valid
+    // their calls point at a stub that goes through the indirection table.
+    uint32_t stub_offset = static_cast<uint32_t>(getSize());
+    mov(eax, dword[ebx]);
+    jmp(rax);
+    for (auto code_offset : inline_cache_calls_) {
+      int32_t disp = int32_t(stub_offset - (code_offset + 4));
+      std::memcpy(top_ + code_offset, &disp, sizeof(disp));
+    }
+    inline_cache_calls_.clear();
+  }
+}
+
+uint64_t HandleInlineCacheMiss(void* raw_context, uint64_t cache_ptr,
+                               uint64_t target_address) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  auto backend =
+      static_cast<X64Backend*>(thread_state->processor()->backend());
+  backend->code_cache()->FillInlineCache(
+      reinterpret_cast<X64InlineCache*>(cache_ptr),
+      static_cast<uint32_t>(target_address));
+  return 0;
+}
+
+void X64Emitter::EmitInlineCacheCall(const hir::Instr* instr) {
+  // The target is in ebx. Each entry compares it against a target seen here
+  // before and calls that target's code directly, through a call site that
+  // X64CodeCache patches like those of direct calls. Entries start out with
+  // a target of 0, which never matches.
+  // The cache is referenced by pointer, so the code can't be persisted.
+  MarkUncacheable();
+  auto cache = code_cache_->AllocateInlineCache(source_address_);
+  inline_caches_.push_back(cache);
+  bool is_tail = (instr->flags & CALL_TAIL) != 0;
+
+  Xbyak::Label hits[X64InlineCache::kEntryCount];
+  Xbyak::Label done;
+  for (uint32_t i = 0; i < X64InlineCache::kEntryCount; ++i) {
+    // cmp ebx, imm32, with the imm32 4b aligned so that it can be filled in
+    // with a single store while other threads execute it.
+    nop((4 - ((getSize() + 2) & 3)) & 3);
+    db(0x81);
+    db(0xFB);
+    cache->target_offsets[i] = static_cast<uint32_t>(getSize());
+    dd(0);
+    je(hits[i], CodeGenerator::T_NEAR);
+  }
+
+  // Miss: fill in the next entry if there's room, then go through the
+  // indirection table as usual.
+  if (FLAGS_inline_cache_statistics) {
+    mov(rax, reinterpret_cast<uint64_t>(&cache->miss_count));
+    inc(qword[rax]);
+  }
+  Xbyak::Label skip_fill;
+  mov(rax, reinterpret_cast<uint64_t>(&cache->entry_count));
+  cmp(dword[rax], X64InlineCache::kEntryCount);
+  jae(skip_fill, CodeGenerator::T_NEAR);
+  mov(rdx, reinterpret_cast<uint64_t>(cache));
+  mov(r8d, ebx);
+  CallNative(reinterpret_cast<void*>(HandleInlineCacheMiss));
+  L(skip_fill);
+  mov(eax, dword[ebx]);
+  if (is_tail) {
+    EmitTraceUserCallReturn();
+    mov(rdx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+    add(rsp, static_cast<uint32_t>(stack_size()));
+    jmp(rax);
+  } else {
+    mov(rdx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+    call(rax);
+    jmp(done, CodeGenerator::T_NEAR);
+  }
+
+  for (uint32_t i = 0; i < X64InlineCache::kEntryCount; ++i) {
+    L(hits[i]);
+    if (FLAGS_inline_cache_statistics) {
+      mov(rax, reinterpret_cast<uint64_t>(&cache->hit_count));
+      inc(qword[rax]);
+    }
+    if (is_tail) {
+      EmitTraceUserCallReturn();
+      mov(rdx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+      add(rsp, static_cast<uint32_t>(stack_size()));
+    } else {
+      mov(rdx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+    }
+    nop((4 - ((getSize() + 1) & 3)) & 3);
+    db(is_tail ? 0xE9 : 0xE8);
+    cache->call_offsets[i] = static_cast<uint32_t>(getSize());
+    inline_cache_calls_.push_back(cache->call_offsets[i]);
+    dd(0);
+    if (!is_tail && i + 1 < X64InlineCache::kEntryCount) {
+      jmp(done, CodeGenerator::T_NEAR);
+    }
+  }
+  L(done);
+}
+
 void X64Emitter::CallIndirect(const hir::Instr* instr, const Reg64& reg) {
   // Check if return.
   if (instr->flags & CALL_POSSIBLE_RETURN) {
@@ -406,6 +876,16 @@ void X64Emitter::CallIndirect(const hir::Instr* instr, const Reg64& reg) {
   if (reg.cvt32() != ebx) {
     mov(ebx, reg.cvt32());
   }
+
+  // Calls that aren't returns (bctrl, mostly virtual calls) tend to go to the
+  // same few targets. Call sites have to be patchable for the cache to be
+  // pointed at them, and persisted code can't reference the cache.
+  if (!(instr->flags & CALL_POSSIBLE_RETURN) && FLAGS_inline_call_caches &&
+      FLAGS_patch_call_sites && FLAGS_persistent_code_cache_path.empty()) {
+    EmitInlineCacheCall(instr);
+    return;
+  }
+
   mov(eax, dword[ebx]);
 
   // Actually jump/call to rax.
@@ -432,6 +912,20 @@ uint64_t UndefinedCallExtern(void* raw_context, uint64_t symbol_info_ptr) {
          symbol_info->name().c_str());
   return 0;
 }
+// Extern calls are where guest threads leave guest code, so they are the
+// quiescent points X64CodeCache uses to reclaim freed code.
+uint64_t CallExternHandler(void* raw_context, uint64_t handler_ptr,
+                           uint64_t guest_sp) {
+  auto context = reinterpret_cast<cpu::frontend::PPCContext*>(raw_context);
+  auto handler = reinterpret_cast<FunctionInfo::ExternHandler>(handler_ptr);
+  auto backend = reinterpret_cast<X64Backend*>(context->processor->backend());
+  auto thread_epoch = reinterpret_cast<X64CodeCache::ThreadEpoch*>(
+      context->thread_state->backend_data());
+  backend->code_cache()->EnterExternCall(thread_epoch, guest_sp);
+  handler(context, context->kernel_state);
+  backend->code_cache()->LeaveExternCall(thread_epoch);
+  return 0;
+}
 void X64Emitter::CallExtern(const hir::Instr* instr,
                             const FunctionInfo* symbol_info) {
   if (symbol_info->behavior() == FunctionBehavior::kBuiltin &&
@@ -440,11 +934,16 @@ void X64Emitter::CallExtern(const hir::Instr* instr,
     // rdx = target host function
     // r8  = arg0
     // r9  = arg1
-    mov(rdx, reinterpret_cast<uint64_t>(symbol_info->builtin_handler()));
-    mov(r8, reinterpret_cast<uint64_t>(symbol_info->builtin_arg0()));
-    mov(r9, reinterpret_cast<uint64_t>(symbol_info->builtin_arg1()));
+    MovRelocatable(rdx,
+                   reinterpret_cast<uint64_t>(symbol_info->builtin_handler()),
+                   X64RelocationType::kBuiltinHandler, symbol_info->address());
+    MovRelocatable(r8, reinterpret_cast<uint64_t>(symbol_info->builtin_arg0()),
+                   X64RelocationType::kBuiltinArg0, symbol_info->address());
+    MovRelocatable(r9, reinterpret_cast<uint64_t>(symbol_info->builtin_arg1()),
+                   X64RelocationType::kBuiltinArg1, symbol_info->address());
     auto thunk = backend()->guest_to_host_thunk();
-    mov(rax, reinterpret_cast<uint64_t>(thunk));
+    MovRelocatable(rax, reinterpret_cast<uint64_t>(thunk),
+                   X64RelocationType::kGuestToHostThunk, 0);
     call(rax);
     ReloadECX();
     ReloadEDX();
@@ -452,47 +951,63 @@ void X64Emitter::CallExtern(const hir::Instr* instr,
   } else if (symbol_info->behavior() == FunctionBehavior::kExtern &&
              symbol_info->extern_handler()) {
     // rcx = context
-    // rdx = target host function
-    mov(rdx, reinterpret_cast<uint64_t>(symbol_info->extern_handler()));
-    mov(r8, qword[rcx + offsetof(cpu::frontend::PPCContext, kernel_state)]);
+    // rdx = CallExternHandler
+    // r8  = target host function
+    // r9  = rsp, for walking the guest frames
+    MovHostPointer(rdx, reinterpret_cast<void*>(CallExternHandler));
+    MovRelocatable(r8,
+                   reinterpret_cast<uint64_t>(symbol_info->extern_handler()),
+                   X64RelocationType::kExternHandler, symbol_info->address());
+    mov(r9, rsp);
     auto thunk = backend()->guest_to_host_thunk();
-    mov(rax, reinterpret_cast<uint64_t>(thunk));
+    MovRelocatable(rax, reinterpret_cast<uint64_t>(thunk),
+                   X64RelocationType::kGuestToHostThunk, 0);
     call(rax);
     ReloadECX();
     ReloadEDX();
     // rax = host return
   } else {
-    CallNative(UndefinedCallExtern, reinterpret_cast<uint64_t>(symbol_info));
+    MovRelocatable(rdx, reinterpret_cast<uint64_t>(symbol_info),
+                   X64RelocationType::kFunctionInfo, symbol_info->address());
+    CallNative(UndefinedCallExtern);
   }
 }
 
 void X64Emitter::CallNative(void* fn) {
-  mov(rax, reinterpret_cast<uint64_t>(fn));
+  MovHostPointer(rax, fn);
+  StorePinnedRegisters(rcx);
   call(rax);
   ReloadECX();
+  LoadPinnedRegisters(rcx);
   ReloadEDX();
 }
 
 void X64Emitter::CallNative(uint64_t (*fn)(void* raw_context)) {
-  mov(rax, reinterpret_cast<uint64_t>(fn));
+  MovHostPointer(rax, reinterpret_cast<void*>(fn));
+  StorePinnedRegisters(rcx);
   call(rax);
   ReloadECX();
+  LoadPinnedRegisters(rcx);
   ReloadEDX();
 }
 
 void X64Emitter::CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0)) {
-  mov(rax, reinterpret_cast<uint64_t>(fn));
+  MovHostPointer(rax, reinterpret_cast<void*>(fn));
+  StorePinnedRegisters(rcx);
   call(rax);
   ReloadECX();
+  LoadPinnedRegisters(rcx);
   ReloadEDX();
 }
 
 void X64Emitter::CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0),
                             uint64_t arg0) {
   mov(rdx, arg0);
-  mov(rax, reinterpret_cast<uint64_t>(fn));
+  MovHostPointer(rax, reinterpret_cast<void*>(fn));
+  StorePinnedRegisters(rcx);
   call(rax);
   ReloadECX();
+  LoadPinnedRegisters(rcx);
   ReloadEDX();
 }
 
@@ -502,9 +1017,10 @@ void X64Emitter::CallNativeSafe(void* fn) {
   // r8  = arg0
   // r9  = arg1
   // r10 = arg2
-  mov(rdx, reinterpret_cast<uint64_t>(fn));
+  MovHostPointer(rdx, fn);
   auto thunk = backend()->guest_to_host_thunk();
-  mov(rax, reinterpret_cast<uint64_t>(thunk));
+  MovRelocatable(rax, reinterpret_cast<uint64_t>(thunk),
+                 X64RelocationType::kGuestToHostThunk, 0);
   call(rax);
   ReloadECX();
   ReloadEDX();
@@ -523,6 +1039,53 @@ void X64Emitter::ReloadEDX() {
   mov(rdx, qword[rcx + 8]);  // membase
 }
 
+bool X64Emitter::GetPinnedRegister(size_t context_offset,
+                                   Reg64* out_reg) const {
+  auto& pinned_registers = backend_->pinned_registers();
+  for (size_t n = 0; n < pinned_registers.size(); ++n) {
+    if (context_offset ==
+        offsetof(cpu::frontend::PPCContext, r) + pinned_registers[n] * 8) {
+      *out_reg = Reg64(pinned_reg_map_[n]);
+      return true;
+    }
+  }
+  return false;
+}
+
+void X64Emitter::LoadPinnedRegisters(const Reg64& context) {
+  auto& pinned_registers = backend_->pinned_registers();
+  for (size_t n = 0; n < pinned_registers.size(); ++n) {
+    mov(Reg64(pinned_reg_map_[n]),
+        qword[context + offsetof(cpu::frontend::PPCContext, r) +
+              pinned_registers[n] * 8]);
+  }
+}
+
+void X64Emitter::StorePinnedRegisters(const Reg64& context) {
+  auto& pinned_registers = backend_->pinned_registers();
+  for (size_t n = 0; n < pinned_registers.size(); ++n) {
+    mov(qword[context + offsetof(cpu::frontend::PPCContext, r) +
+              pinned_registers[n] * 8],
+        Reg64(pinned_reg_map_[n]));
+  }
+}
+
+void X64Emitter::MovHostPointer(const Reg64& dest, const void* ptr) {
+  MovRelocatable(dest, reinterpret_cast<uint64_t>(ptr),
+                 X64RelocationType::kHostImage,
+                 reinterpret_cast<uint64_t>(ptr));
+}
+
+void X64Emitter::MovRelocatable(const Reg64& dest, uint64_t imm,
+                                X64RelocationType type, uint64_t value) {
+  // xbyak picks the shortest encoding for the immediate, so emit the 10 byte
+  // mov r64, imm64 by hand to leave room for any relocated value.
+  db(0x48 | (dest.getIdx() >> 3));
+  db(0xB8 | (dest.getIdx() & 7));
+  relocations_.push_back({static_cast<uint32_t>(getSize()), type, value});
+  dq(imm);
+}
+
 // Len Assembly                                   Byte Sequence
 // ============================================================================
 // 2b  66 NOP                                     66 90H
@@ -13,6 +13,9 @@
 #include "third_party/xbyak/xbyak/xbyak.h"
 #include "third_party/xbyak/xbyak/xbyak_util.h"
 
+#include <string>
+#include <vector>
+
 #include "xenia/base/arena.h"
 #include "xenia/cpu/hir/value.h"
 #include "xenia/debug/function_trace_data.h"
@@ -25,6 +28,7 @@ class FunctionInfo;
 class Processor;
 class SymbolInfo;
 namespace hir {
+class Block;
 class HIRBuilder;
 class Instr;
 }  // namespace hir
@@ -38,6 +42,7 @@ namespace x64 {
 
 class X64Backend;
 class X64CodeCache;
+struct X64InlineCache;
 
 enum RegisterFlags {
   REG_DEST = (1 << 0),
@@ -107,6 +112,36 @@ enum X64EmitterFeatureFlags {
   kX64EmitMovbe = 1 << 6,
 };
 
+// Host values embedded in generated code that differ between processes.
+// Every one is emitted as a full 64-bit immediate and recorded so that the
+// code can be fixed up when reloaded by X64PersistentCache.
+enum class X64RelocationType : uint32_t {
+  // Pointer into the host executable image (functions and static tables).
+  kHostImage,
+  // X64Backend::guest_to_host_thunk.
+  kGuestToHostThunk,
+  // Builtin handler/args of the FunctionInfo at the guest address in value.
+  kBuiltinHandler,
+  kBuiltinArg0,
+  kBuiltinArg1,
+  // Extern handler of the FunctionInfo at the guest address in value.
+  kExternHandler,
+  // FunctionInfo* of the symbol at the guest address in value.
+  kFunctionInfo,
+  // rel32 of a direct call/jmp to the guest function at the low 32 bits of
+  // value. The high 32 bits are the offset of the stub it targets until it is
+  // patched by X64CodeCache.
+  kCallSite,
+};
+
+struct X64Relocation {
+  // Offset of the 64-bit immediate (or rel32, for call sites) from the start
+  // of the function.
+  uint32_t code_offset;
+  X64RelocationType type;
+  uint64_t value;
+};
+
 class X64Emitter : public Xbyak::CodeGenerator {
  public:
   X64Emitter(X64Backend* backend, XbyakAllocator* allocator);
@@ -115,7 +150,7 @@ class X64Emitter : public Xbyak::CodeGenerator {
   Processor* processor() const { return processor_; }
   X64Backend* backend() const { return backend_; }
 
-  bool Emit(uint32_t guest_address, hir::HIRBuilder* builder,
+  bool Emit(FunctionInfo* symbol_info, hir::HIRBuilder* builder,
             uint32_t debug_info_flags, DebugInfo* debug_info,
             void*& out_code_address, size_t& out_code_size);
 
@@ -127,8 +162,10 @@ class X64Emitter : public Xbyak::CodeGenerator {
   //            xmm0-2 (could be only xmm0 with some trickery)
   // Available: rbx, r12-r15 (save to get r8-r11, rbp, rsi, rdi?)
   //            xmm6-xmm15 (save to get xmm3-xmm5)
+  // Pinned:    rsi, rdi, rbp (see GetPinnedRegister)
   static const int GPR_COUNT = 5;
   static const int XMM_COUNT = 10;
+  static const int PINNED_GPR_COUNT = 3;
 
   static void SetupReg(const hir::Value* v, Xbyak::Reg8& r) {
     auto idx = gpr_reg_map_[v->reg.index];
@@ -153,6 +190,11 @@ class X64Emitter : public Xbyak::CodeGenerator {
 
   void MarkSourceOffset(const hir::Instr* i);
 
+  // Emits a BRANCH_TRUE/BRANCH_FALSE as a single jcc on the flags left by
+  // the last integer compare, if they still hold its condition. Returns false
+  // if the branch has to test its condition value instead.
+  bool EmitFusedBranch(const hir::Instr* i, bool branch_if_true);
+
   void DebugBreak();
   void Trap(uint16_t trap_type = 0);
   void UnimplementedInstr(const hir::Instr* i);
@@ -171,6 +213,23 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void ReloadECX();
   void ReloadEDX();
 
+  // Guest GPRs listed in --pinned_guest_registers live in host registers
+  // instead of the context for as long as guest code runs. Host code sees
+  // them in the context, as the thunks (and CallNative) store them there on
+  // the way out and load them on the way back in. GPRs are only ever
+  // accessed whole, as I64, in the context.
+  bool GetPinnedRegister(size_t context_offset, Xbyak::Reg64* out_reg) const;
+  void LoadPinnedRegisters(const Xbyak::Reg64& context);
+  void StorePinnedRegisters(const Xbyak::Reg64& context);
+
+  // Moves a host pointer into a register, recording a relocation for it.
+  void MovHostPointer(const Xbyak::Reg64& dest, const void* ptr);
+  void MovRelocatable(const Xbyak::Reg64& dest, uint64_t imm,
+                      X64RelocationType type, uint64_t value);
+  // Marks the current function as embedding values that cannot be relocated,
+  // preventing it from being persisted.
+  void MarkUncacheable() { cacheable_ = false; }
+
   void nop(size_t length = 1);
 
   // TODO(benvanik): Label for epilog (don't use strings).
@@ -188,6 +247,7 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void LoadConstantXmm(Xbyak::Xmm dest, const vec128_t& v);
   Xbyak::Address StashXmm(int index, const Xbyak::Xmm& r);
 
+  uint32_t feature_flags() const { return feature_flags_; }
   bool IsFeatureEnabled(uint32_t feature_flag) const {
     return (feature_flags_ & feature_flag) != 0;
   }
@@ -196,11 +256,35 @@ class X64Emitter : public Xbyak::CodeGenerator {
 
   size_t stack_size() const { return stack_size_; }
 
+  bool cacheable() const { return cacheable_; }
+  const std::vector<X64Relocation>& relocations() const {
+    return relocations_;
+  }
+
  protected:
-  void* Emplace(uint32_t guest_address, size_t stack_size);
+  void* Emplace(uint32_t guest_address, const std::string& name,
+                size_t stack_size);
   bool Emit(hir::HIRBuilder* builder, size_t& out_stack_size);
+  // Orders the blocks for emission. With --hot_cold_layout, blocks that are
+  // cold in the baseline code being replaced go after the epilog.
+  void LayoutBlocks(hir::HIRBuilder* builder,
+                    std::vector<hir::Block*>* hot_blocks,
+                    std::vector<hir::Block*>* cold_blocks);
+  // Emits a block, jumping to its HIR successor if it's not emitted next.
+  void EmitBlock(hir::Block* block, bool falls_through);
+  // Bumps the block's execution counter, with --block_counters.
+  void EmitBlockCounter(const hir::Block* block);
+  static std::string GetBlockLabel(const hir::Block* block);
+  static bool IsIntegerCompare(const hir::Instr* i);
+  // Whether the sequence for the instruction leaves EFLAGS untouched.
+  bool PreservesFlags(const hir::Instr* i) const;
   void EmitGetCurrentThreadId();
+  void EmitCallCountdown();
   void EmitTraceUserCallReturn();
+  void EmitPatchableCall(uint32_t guest_address, bool is_tail);
+  void EmitCallStubs();
+  // Emits an indirect call to ebx through an inline cache.
+  void EmitInlineCacheCall(const hir::Instr* instr);
 
  protected:
   Processor* processor_;
@@ -212,6 +296,8 @@ class X64Emitter : public Xbyak::CodeGenerator {
 
   hir::Instr* current_instr_;
 
+  FunctionInfo* symbol_info_;
+
   DebugInfo* debug_info_;
   uint32_t debug_info_flags_;
   size_t source_map_count_;
@@ -219,8 +305,33 @@ class X64Emitter : public Xbyak::CodeGenerator {
 
   size_t stack_size_;
 
+  // Whether blocks are emitted out of HIR order.
+  bool is_laid_out_;
+  // Integer compare whose cmp last set EFLAGS in the current block, if nothing
+  // since has changed them.
+  const hir::Instr* flags_compare_;
+
+  bool cacheable_;
+  std::vector<X64Relocation> relocations_;
+
+  // Direct calls emitted in the current function that still need their
+  // fallback stub.
+  struct CallStub {
+    uint32_t code_offset;
+    uint32_t guest_address;
+  };
+  std::vector<CallStub> call_stubs_;
+
+  // Guest address of the last SOURCE_OFFSET, for naming inline caches.
+  uint32_t source_address_;
+  // Inline caches used by the current function, and the offsets of their
+  // calls that still need pointing at the fallback stub.
+  std::vector<X64InlineCache*> inline_caches_;
+  std::vector<uint32_t> inline_cache_calls_;
+
   static const uint32_t gpr_reg_map_[GPR_COUNT];
   static const uint32_t xmm_reg_map_[XMM_COUNT];
+  static const uint32_t pinned_reg_map_[PINNED_GPR_COUNT];
 };
 
 }  // namespace x64
@@ -10,6 +10,7 @@
 #include "xenia/cpu/backend/x64/x64_function.h"
 
 #include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/thread_state.h"
 
@@ -42,8 +43,12 @@ bool X64Function::CallImpl(ThreadState* thread_state, uint32_t return_address) {
   auto backend =
       reinterpret_cast<X64Backend*>(thread_state->processor()->backend());
   auto thunk = backend->host_to_guest_thunk();
+  auto thread_epoch = reinterpret_cast<X64CodeCache::ThreadEpoch*>(
+      thread_state->backend_data());
+  backend->code_cache()->EnterGuestCode(thread_epoch);
   thunk(machine_code_, thread_state->context(),
         reinterpret_cast<void*>(uintptr_t(return_address)));
+  backend->code_cache()->LeaveGuestCode(thread_epoch);
   return true;
 }
 
@@ -0,0 +1,452 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/x64/x64_persistent_cache.h"
+
+#include <gflags/gflags.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "third_party/xxhash/xxhash.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/fs.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/string.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/backend/x64/x64_tracers.h"
+#include "xenia/cpu/cpu-private.h"
+#include "xenia/cpu/debug_info.h"
+#include "xenia/cpu/module.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/symbol_info.h"
+
+DECLARE_bool(eliminate_dead_guest_stores);
+DECLARE_bool(global_register_allocation);
+DECLARE_bool(store_all_context_values);
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+// 'XJIT'
+const static uint32_t kCacheMagic = 0x54494A58;
+// Bump whenever emitted code or the file layout changes in a way the other
+// header fields don't capture.
+const static uint32_t kCacheVersion = 4;
+
+namespace {
+
+// The range and code identity of the executable image we are running from.
+// Pointers into the image are stored relative to its base, and the code hash
+// invalidates caches produced by any other build.
+struct HostImage {
+  uintptr_t base;
+  size_t size;
+  uint64_t code_hash;
+};
+
+const HostImage& GetHostImage() {
+  static HostImage host_image = {0};
+  static bool has_initialized = false;
+  static xe::mutex host_image_lock;
+  std::lock_guard<xe::mutex> guard(host_image_lock);
+  if (has_initialized) {
+    return host_image;
+  }
+  has_initialized = true;
+
+  auto base = reinterpret_cast<uint8_t*>(GetModuleHandle(nullptr));
+  auto dos_header = reinterpret_cast<const IMAGE_DOS_HEADER*>(base);
+  auto nt_headers =
+      reinterpret_cast<const IMAGE_NT_HEADERS*>(base + dos_header->e_lfanew);
+  host_image.base = reinterpret_cast<uintptr_t>(base);
+  host_image.size = nt_headers->OptionalHeader.SizeOfImage;
+  auto section = IMAGE_FIRST_SECTION(nt_headers);
+  for (size_t i = 0; i < nt_headers->FileHeader.NumberOfSections;
+       ++i, ++section) {
+    if (section->Characteristics & IMAGE_SCN_CNT_CODE) {
+      host_image.code_hash =
+          XXH64(base + section->VirtualAddress, section->Misc.VirtualSize,
+                host_image.code_hash);
+    }
+  }
+  return host_image;
+}
+
+}  // namespace
+
+X64PersistentCache::X64PersistentCache(X64Backend* backend, Module* module)
+    : backend_(backend), module_(module), file_(nullptr) {}
+
+X64PersistentCache::~X64PersistentCache() {
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+void X64PersistentCache::FillHeader(Header* header) {
+  uint64_t pinned_registers = 0;
+  for (auto reg : backend_->pinned_registers()) {
+    pinned_registers = (pinned_registers << 8) | (reg + 1);
+  }
+  // Flags that change the generated code without being visible to us
+  // otherwise.
+  const uint64_t config[] = {
+      uint64_t(FLAGS_debug),
+      uint64_t(FLAGS_break_on_instruction),
+      uint64_t(FLAGS_break_on_debugbreak),
+      uint64_t(FLAGS_store_all_context_values),
+      uint64_t(GetTracingMode()),
+      uint64_t(FLAGS_patch_call_sites),
+      uint64_t(FLAGS_global_register_allocation),
+      uint64_t(FLAGS_eliminate_dead_guest_stores),
+      pinned_registers,
+  };
+
+  std::memset(header, 0, sizeof(Header));
+  header->magic = kCacheMagic;
+  header->version = kCacheVersion;
+  header->module_hash = module_->code_hash();
+  header->host_image_hash = GetHostImage().code_hash;
+  header->config_hash = XXH64(config, sizeof(config), 0);
+  header->feature_flags = backend_->emitter_feature_flags();
+  header->emitter_data = backend_->emitter_data();
+}
+
+bool X64PersistentCache::Initialize(const std::wstring& root_path) {
+  wchar_t file_name[64];
+  swprintf(file_name, xe::countof(file_name), L"%.16llX.xjit",
+           module_->code_hash());
+  path_ = xe::join_paths(xe::to_absolute_path(root_path), file_name);
+  xe::fs::CreateFolder(xe::find_base_path(path_));
+
+  // Anything we can't use is thrown away and the file started over.
+  bool valid = xe::fs::PathExists(path_) && ReadEntries();
+  if (valid) {
+    file_ = _wfopen(path_.c_str(), L"ab");
+  } else {
+    entries_.clear();
+    file_ = _wfopen(path_.c_str(), L"wb");
+    if (file_) {
+      Header header;
+      FillHeader(&header);
+      fwrite(&header, sizeof(header), 1, file_);
+      fflush(file_);
+    }
+  }
+  if (!file_) {
+    XELOGE("Unable to open persistent code cache %ls", path_.c_str());
+    return false;
+  }
+
+  XELOGI("Persistent code cache %ls: %d functions", path_.c_str(),
+         int(entries_.size()));
+  return true;
+}
+
+bool X64PersistentCache::ReadEntries() {
+  FILE* file = _wfopen(path_.c_str(), L"rb");
+  if (!file) {
+    return false;
+  }
+
+  Header expected_header;
+  FillHeader(&expected_header);
+  Header header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != kCacheMagic || header.version != kCacheVersion ||
+      header.module_hash != expected_header.module_hash) {
+    fclose(file);
+    return false;
+  }
+  if (header.feature_flags != expected_header.feature_flags) {
+    XELOGI("Persistent code cache built with different CPU features, "
+           "discarding");
+    fclose(file);
+    return false;
+  }
+  if (header.host_image_hash != expected_header.host_image_hash ||
+      header.config_hash != expected_header.config_hash ||
+      header.emitter_data != expected_header.emitter_data) {
+    XELOGI("Persistent code cache built by a different configuration, "
+           "discarding");
+    fclose(file);
+    return false;
+  }
+
+  // A crash may have left a partial entry at the end. We keep everything up
+  // to it and rewrite the file without it.
+  bool truncated = false;
+  while (true) {
+    EntryHeader entry_header;
+    size_t header_size = fread(&entry_header, 1, sizeof(entry_header), file);
+    if (header_size != sizeof(entry_header)) {
+      // Only a clean end if nothing at all was left. Part of a header is
+      // what a crash while appending leaves behind, and new entries must not
+      // be appended after it.
+      truncated = header_size != 0 || ferror(file);
+      break;
+    }
+    size_t payload_size =
+        entry_header.code_size +
+        entry_header.relocation_count * sizeof(X64Relocation) +
+        entry_header.source_map_count * sizeof(SourceMapEntry) +
+        entry_header.inlined_range_count * sizeof(InlinedRange);
+    std::vector<uint8_t> entry(sizeof(entry_header) + payload_size);
+    std::memcpy(entry.data(), &entry_header, sizeof(entry_header));
+    if (fread(entry.data() + sizeof(entry_header), 1, payload_size, file) !=
+            payload_size ||
+        XXH64(entry.data() + sizeof(entry_header), payload_size, 0) !=
+            entry_header.checksum) {
+      truncated = true;
+      break;
+    }
+    entries_[entry_header.address] = std::move(entry);
+  }
+  fclose(file);
+
+  if (truncated) {
+    XELOGW("Persistent code cache %ls is damaged, dropping the tail",
+           path_.c_str());
+    file = _wfopen(path_.c_str(), L"wb");
+    if (!file) {
+      return false;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    for (auto& it : entries_) {
+      fwrite(it.second.data(), 1, it.second.size(), file);
+    }
+    fclose(file);
+  }
+
+  return true;
+}
+
+bool X64PersistentCache::Relocate(uint8_t* code,
+                                  const X64Relocation* relocations,
+                                  size_t relocation_count) {
+  auto processor = backend_->processor();
+  for (size_t i = 0; i < relocation_count; ++i) {
+    const auto& relocation = relocations[i];
+    uint64_t value = 0;
+    switch (relocation.type) {
+      case X64RelocationType::kHostImage:
+        value = GetHostImage().base + relocation.value;
+        break;
+      case X64RelocationType::kGuestToHostThunk:
+        value = reinterpret_cast<uint64_t>(backend_->guest_to_host_thunk());
+        break;
+      case X64RelocationType::kCallSite: {
+        // The code was stored after it may have been patched; point it back
+        // at its stub and let the code cache patch it again once placed.
+        uint32_t stub_offset = uint32_t(relocation.value >> 32);
+        int32_t disp = int32_t(stub_offset - (relocation.code_offset + 4));
+        std::memcpy(code + relocation.code_offset, &disp, sizeof(disp));
+        continue;
+      }
+      default: {
+        // Symbols are matched by guest address. The code was emitted for a
+        // symbol of a particular kind, so it must still be that kind.
+        FunctionInfo* target = nullptr;
+        if (!processor->LookupFunctionInfo(uint32_t(relocation.value),
+                                           &target)) {
+          return false;
+        }
+        bool is_builtin = target->behavior() == FunctionBehavior::kBuiltin &&
+                          target->builtin_handler();
+        bool is_extern = target->behavior() == FunctionBehavior::kExtern &&
+                         target->extern_handler();
+        switch (relocation.type) {
+          case X64RelocationType::kBuiltinHandler:
+            if (!is_builtin) {
+              return false;
+            }
+            value = reinterpret_cast<uint64_t>(target->builtin_handler());
+            break;
+          case X64RelocationType::kBuiltinArg0:
+            if (!is_builtin) {
+              return false;
+            }
+            value = reinterpret_cast<uint64_t>(target->builtin_arg0());
+            break;
+          case X64RelocationType::kBuiltinArg1:
+            if (!is_builtin) {
+              return false;
+            }
+            value = reinterpret_cast<uint64_t>(target->builtin_arg1());
+            break;
+          case X64RelocationType::kExternHandler:
+            if (!is_extern) {
+              return false;
+            }
+            value = reinterpret_cast<uint64_t>(target->extern_handler());
+            break;
+          case X64RelocationType::kFunctionInfo:
+            if (is_builtin || is_extern) {
+              return false;
+            }
+            value = reinterpret_cast<uint64_t>(target);
+            break;
+          default:
+            assert_unhandled_case(relocation.type);
+            return false;
+        }
+        break;
+      }
+    }
+    std::memcpy(code + relocation.code_offset, &value, sizeof(value));
+  }
+  return true;
+}
+
+bool X64PersistentCache::Load(FunctionInfo* symbol_info,
+                              uint32_t debug_info_flags,
+                              Function** out_function) {
+  // entries_ is only modified during Initialize, so no lock is needed here.
+  auto it = entries_.find(symbol_info->address());
+  if (it == entries_.end()) {
+    return false;
+  }
+
+  const uint8_t* p = it->second.data();
+  EntryHeader entry_header;
+  std::memcpy(&entry_header, p, sizeof(entry_header));
+  p += sizeof(entry_header);
+  std::vector<uint8_t> code(p, p + entry_header.code_size);
+  p += entry_header.code_size;
+  auto relocations = reinterpret_cast<const X64Relocation*>(p);
+  p += entry_header.relocation_count * sizeof(X64Relocation);
+  auto source_map = reinterpret_cast<const SourceMapEntry*>(p);
+  p += entry_header.source_map_count * sizeof(SourceMapEntry);
+  std::vector<InlinedRange> inlined_ranges(entry_header.inlined_range_count);
+  if (!inlined_ranges.empty()) {
+    std::memcpy(inlined_ranges.data(), p,
+                inlined_ranges.size() * sizeof(InlinedRange));
+  }
+
+  // The inlined copies are of the callees as loaded.
+  auto processor = backend_->processor();
+  for (auto& range : inlined_ranges) {
+    FunctionInfo* callee_info = nullptr;
+    if (!processor->LookupFunctionInfo(range.first, &callee_info) ||
+        callee_info->is_modified()) {
+      return false;
+    }
+  }
+
+  if (!Relocate(code.data(), relocations, entry_header.relocation_count)) {
+    return false;
+  }
+
+  symbol_info->set_end_address(entry_header.end_address);
+
+  void* machine_code = backend_->code_cache()->PlaceCode(
+      entry_header.address, symbol_info->name(), code.data(),
+      entry_header.code_size, entry_header.stack_size);
+  backend_->code_cache()->AddCallSites(reinterpret_cast<uint8_t*>(machine_code),
+                                       relocations,
+                                       entry_header.relocation_count);
+
+  std::unique_ptr<DebugInfo> debug_info;
+  if (debug_info_flags) {
+    debug_info.reset(new DebugInfo());
+    if (debug_info_flags & DebugInfoFlags::kDebugInfoSourceMap) {
+      size_t source_map_size =
+          entry_header.source_map_count * sizeof(SourceMapEntry);
+      auto source_map_copy =
+          reinterpret_cast<SourceMapEntry*>(malloc(source_map_size));
+      std::memcpy(source_map_copy, source_map, source_map_size);
+      debug_info->InitializeSourceMap(entry_header.source_map_count,
+                                      source_map_copy);
+    }
+  }
+
+  X64Function* fn = new X64Function(symbol_info);
+  fn->set_debug_info(std::move(debug_info));
+  fn->Setup(reinterpret_cast<uint8_t*>(machine_code), entry_header.code_size);
+  fn->set_inlined_ranges(std::move(inlined_ranges));
+
+  *out_function = fn;
+  return true;
+}
+
+void X64PersistentCache::Store(
+    FunctionInfo* symbol_info, const void* machine_code, size_t code_size,
+    size_t stack_size, const std::vector<X64Relocation>& relocations,
+    const DebugInfo* debug_info,
+    const std::vector<InlinedRange>& inlined_ranges) {
+  // Host image pointers are stored as offsets. Anything outside of the image
+  // (such as a pointer into a system DLL) can't be relocated.
+  const auto& host_image = GetHostImage();
+  std::vector<X64Relocation> stored_relocations(relocations);
+  for (auto& relocation : stored_relocations) {
+    if (relocation.type == X64RelocationType::kHostImage) {
+      if (relocation.value < host_image.base ||
+          relocation.value >= host_image.base + host_image.size) {
+        return;
+      }
+      relocation.value -= host_image.base;
+    }
+  }
+
+  size_t source_map_count = 0;
+  const SourceMapEntry* source_map = nullptr;
+  if (debug_info) {
+    source_map_count = debug_info->source_map_count();
+    source_map = debug_info->source_map_entries();
+  }
+
+  size_t relocations_size = stored_relocations.size() * sizeof(X64Relocation);
+  size_t source_map_size = source_map_count * sizeof(SourceMapEntry);
+  size_t inlined_ranges_size = inlined_ranges.size() * sizeof(InlinedRange);
+  std::vector<uint8_t> payload(code_size + relocations_size + source_map_size +
+                               inlined_ranges_size);
+  uint8_t* p = payload.data();
+  std::memcpy(p, machine_code, code_size);
+  p += code_size;
+  if (relocations_size) {
+    std::memcpy(p, stored_relocations.data(), relocations_size);
+    p += relocations_size;
+  }
+  if (source_map_size) {
+    std::memcpy(p, source_map, source_map_size);
+    p += source_map_size;
+  }
+  if (inlined_ranges_size) {
+    std::memcpy(p, inlined_ranges.data(), inlined_ranges_size);
+  }
+
+  EntryHeader entry_header;
+  entry_header.address = symbol_info->address();
+  entry_header.end_address = symbol_info->end_address();
+  entry_header.code_size = uint32_t(code_size);
+  entry_header.stack_size = uint32_t(stack_size);
+  entry_header.relocation_count = uint32_t(stored_relocations.size());
+  entry_header.source_map_count = uint32_t(source_map_count);
+  entry_header.inlined_range_count = uint32_t(inlined_ranges.size());
+  entry_header.reserved = 0;
+  entry_header.checksum = XXH64(payload.data(), payload.size(), 0);
+
+  std::lock_guard<xe::mutex> guard(lock_);
+  fwrite(&entry_header, sizeof(entry_header), 1, file_);
+  fwrite(payload.data(), 1, payload.size(), file_);
+  fflush(file_);
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
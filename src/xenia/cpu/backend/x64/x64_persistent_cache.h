@@ -0,0 +1,110 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BACKEND_X64_X64_PERSISTENT_CACHE_H_
+#define XENIA_BACKEND_X64_X64_PERSISTENT_CACHE_H_
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/mutex.h"
+#include "xenia/cpu/backend/x64/x64_emitter.h"
+
+namespace xe {
+namespace cpu {
+class DebugInfo;
+class Function;
+class FunctionInfo;
+class Module;
+}  // namespace cpu
+}  // namespace xe
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+class X64Backend;
+
+// Persists generated functions for a single guest module so that later runs
+// can skip translation entirely.
+// Files are named by the module code hash and are invalidated wholesale if
+// the host executable, emitter feature flags, or codegen-affecting flags
+// change. Entries are appended as functions are assembled and hold the
+// machine code, the relocations needed to move it into another process, the
+// source map, the function extents, and the ranges of inlined callees.
+class X64PersistentCache {
+ public:
+  X64PersistentCache(X64Backend* backend, Module* module);
+  ~X64PersistentCache();
+
+  bool Initialize(const std::wstring& root_path);
+
+  // Start and end address of a callee inlined into a function.
+  typedef std::pair<uint32_t, uint32_t> InlinedRange;
+
+  // Places cached code for the function, returning false on a miss or if the
+  // code could not be relocated into this process.
+  bool Load(FunctionInfo* symbol_info, uint32_t debug_info_flags,
+            Function** out_function);
+
+  // Appends a freshly assembled function to the cache.
+  void Store(FunctionInfo* symbol_info, const void* machine_code,
+             size_t code_size, size_t stack_size,
+             const std::vector<X64Relocation>& relocations,
+             const DebugInfo* debug_info,
+             const std::vector<InlinedRange>& inlined_ranges);
+
+ private:
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t module_hash;
+    uint64_t host_image_hash;
+    uint64_t config_hash;
+    uint32_t feature_flags;
+    uint32_t emitter_data;
+  };
+  struct EntryHeader {
+    uint32_t address;
+    uint32_t end_address;
+    uint32_t code_size;
+    uint32_t stack_size;
+    uint32_t relocation_count;
+    uint32_t source_map_count;
+    uint32_t inlined_range_count;
+    uint32_t reserved;
+    uint64_t checksum;
+  };
+
+  void FillHeader(Header* header);
+  bool ReadEntries();
+  bool Relocate(uint8_t* code, const X64Relocation* relocations,
+                size_t relocation_count);
+
+  X64Backend* backend_;
+  Module* module_;
+  std::wstring path_;
+
+  xe::mutex lock_;
+  FILE* file_;
+  // Raw entries (header + payload) keyed by guest address.
+  std::unordered_map<uint32_t, std::vector<uint8_t>> entries_;
+};
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_BACKEND_X64_X64_PERSISTENT_CACHE_H_
@@ -73,6 +73,7 @@ EMITTER(COMMENT, MATCH(I<OPCODE_COMMENT, VoidOp, OffsetOp>)) {
       // TODO(benvanik): pass through.
       // TODO(benvanik): don't just leak this memory.
       auto str_copy = strdup(str);
+      e.MarkUncacheable();
       e.mov(e.rdx, reinterpret_cast<uint64_t>(str_copy));
       e.CallNative(reinterpret_cast<void*>(TraceString));
     }
@@ -539,6 +540,9 @@ EMITTER_OPCODE_TABLE(
 // ============================================================================
 EMITTER(BRANCH_TRUE_I8, MATCH(I<OPCODE_BRANCH_TRUE, VoidOp, I8<>, LabelOp>)) {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    if (e.EmitFusedBranch(i.instr, true)) {
+      return;
+    }
     e.test(i.src1, i.src1);
     e.jnz(i.src2.value->name, e.T_NEAR);
   }
@@ -588,6 +592,9 @@ EMITTER_OPCODE_TABLE(
 // ============================================================================
 EMITTER(BRANCH_FALSE_I8, MATCH(I<OPCODE_BRANCH_FALSE, VoidOp, I8<>, LabelOp>)) {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    if (e.EmitFusedBranch(i.instr, false)) {
+      return;
+    }
     e.test(i.src1, i.src1);
     e.jz(i.src2.value->name, e.T_NEAR);
   }
@@ -1020,14 +1027,14 @@ EMITTER(LOAD_VECTOR_SHL_I8, MATCH(I<OPCODE_LOAD_VECTOR_SHL, V128<>, I8<>>)) {
     if (i.src1.is_constant) {
       auto sh = i.src1.constant();
       assert_true(sh < xe::countof(lvsl_table));
-      e.mov(e.rax, (uintptr_t)&lvsl_table[sh]);
+      e.MovHostPointer(e.rax, &lvsl_table[sh]);
       e.vmovaps(i.dest, e.ptr[e.rax]);
     } else {
       // TODO(benvanik): find a cheaper way of doing this.
       e.movzx(e.rdx, i.src1);
       e.and(e.dx, 0xF);
       e.shl(e.dx, 4);
-      e.mov(e.rax, (uintptr_t)lvsl_table);
+      e.MovHostPointer(e.rax, lvsl_table);
       e.vmovaps(i.dest, e.ptr[e.rax + e.rdx]);
       e.ReloadEDX();
     }
@@ -1064,14 +1071,14 @@ EMITTER(LOAD_VECTOR_SHR_I8, MATCH(I<OPCODE_LOAD_VECTOR_SHR, V128<>, I8<>>)) {
     if (i.src1.is_constant) {
       auto sh = i.src1.constant();
       assert_true(sh < xe::countof(lvsr_table));
-      e.mov(e.rax, (uintptr_t)&lvsr_table[sh]);
+      e.MovHostPointer(e.rax, &lvsr_table[sh]);
       e.vmovaps(i.dest, e.ptr[e.rax]);
     } else {
       // TODO(benvanik): find a cheaper way of doing this.
       e.movzx(e.rdx, i.src1);
       e.and(e.dx, 0xF);
       e.shl(e.dx, 4);
-      e.mov(e.rax, (uintptr_t)lvsr_table);
+      e.MovHostPointer(e.rax, lvsr_table);
       e.vmovaps(i.dest, e.ptr[e.rax + e.rdx]);
       e.ReloadEDX();
     }
@@ -1256,6 +1263,16 @@ EMITTER(LOAD_CONTEXT_I32, MATCH(I<OPCODE_LOAD_CONTEXT, I32<>, OffsetOp>)) {
 };
 EMITTER(LOAD_CONTEXT_I64, MATCH(I<OPCODE_LOAD_CONTEXT, I64<>, OffsetOp>)) {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    Reg64 pinned;
+    if (e.GetPinnedRegister(i.src1.value, &pinned)) {
+      e.mov(i.dest, pinned);
+      if (IsTracingData()) {
+        e.mov(e.r8, pinned);
+        e.mov(e.rdx, i.src1.value);
+        e.CallNative(reinterpret_cast<void*>(TraceContextLoadI64));
+      }
+      return;
+    }
     auto addr = ComputeContextAddress(e, i.src1);
     e.mov(i.dest, e.qword[addr]);
     if (IsTracingData()) {
@@ -1360,6 +1377,20 @@ EMITTER(STORE_CONTEXT_I32, MATCH(I<OPCODE_STORE_CONTEXT, VoidOp, OffsetOp, I32<>
 };
 EMITTER(STORE_CONTEXT_I64, MATCH(I<OPCODE_STORE_CONTEXT, VoidOp, OffsetOp, I64<>>)) {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    Reg64 pinned;
+    if (e.GetPinnedRegister(i.src1.value, &pinned)) {
+      if (i.src2.is_constant) {
+        e.mov(pinned, i.src2.constant());
+      } else {
+        e.mov(pinned, i.src2);
+      }
+      if (IsTracingData()) {
+        e.mov(e.r8, pinned);
+        e.mov(e.rdx, i.src1.value);
+        e.CallNative(reinterpret_cast<void*>(TraceContextStoreI64));
+      }
+      return;
+    }
     auto addr = ComputeContextAddress(e, i.src1);
     if (i.src2.is_constant) {
       e.MovMem64(addr, i.src2.constant());
@@ -1441,6 +1472,7 @@ EMITTER(LOAD_MMIO_I32, MATCH(I<OPCODE_LOAD_MMIO, I32<>, OffsetOp, OffsetOp>)) {
     // uint64_t (context, addr)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto read_address = uint32_t(i.src2.value);
+    e.MarkUncacheable();
     e.mov(e.r8, uint64_t(mmio_range->callback_context));
     e.mov(e.r9d, read_address);
     e.CallNativeSafe(mmio_range->read);
@@ -1467,6 +1499,7 @@ EMITTER(STORE_MMIO_I32, MATCH(I<OPCODE_STORE_MMIO, VoidOp, OffsetOp, OffsetOp, I
     // void (context, addr, value)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto write_address = uint32_t(i.src2.value);
+    e.MarkUncacheable();
     e.mov(e.r8, uint64_t(mmio_range->callback_context));
     e.mov(e.r9d, write_address);
     if (i.src3.is_constant) {
@@ -4754,14 +4787,186 @@ EMITTER_OPCODE_TABLE(
 // ============================================================================
 // OPCODE_VECTOR_SHL
 // ============================================================================
+enum class VectorShiftOp {
+  kShl,
+  kShr,
+  kSha,
+};
+
+// Shifts every byte by the same count. x86 has no byte shifts, so words are
+// shifted and the bits that crossed over from the neighbouring byte masked
+// off. Arithmetic shifts widen each byte to a word instead to keep the sign.
+// Clobbers xmm3.
+void EmitVectorUniformShiftI8(X64Emitter& e, const Xmm& dest, const Xmm& src1,
+                              uint8_t shamt, VectorShiftOp op) {
+  shamt &= 0x7;
+  switch (op) {
+    case VectorShiftOp::kShl:
+      e.vpsllw(dest, src1, shamt);
+      e.LoadConstantXmm(e.xmm3, vec128b(uint8_t(0xFF << shamt)));
+      e.vpand(dest, dest, e.xmm3);
+      break;
+    case VectorShiftOp::kShr:
+      e.vpsrlw(dest, src1, shamt);
+      e.LoadConstantXmm(e.xmm3, vec128b(uint8_t(0xFF >> shamt)));
+      e.vpand(dest, dest, e.xmm3);
+      break;
+    case VectorShiftOp::kSha:
+      // Each word gets a copy of the byte in its high half.
+      e.vpunpckhbw(e.xmm3, src1, src1);
+      e.vpunpcklbw(dest, src1, src1);
+      e.vpsraw(e.xmm3, e.xmm3, 8 + shamt);
+      e.vpsraw(dest, dest, 8 + shamt);
+      e.vpacksswb(dest, dest, e.xmm3);
+      break;
+  }
+}
+
+// Shifts each byte by its own count. The value is shifted by 4, 2 and 1 in
+// turn, and each step blended in where the matching bit of the count is set.
+// The count bits are moved up into the sign bit of each byte for vpblendvb.
+// Clobbers xmm0-xmm3. src2 may be xmm0.
+void EmitVectorVariableShiftI8(X64Emitter& e, const Xmm& dest, const Xmm& src1,
+                               const Xmm& src2, VectorShiftOp op) {
+  e.vpsllw(e.xmm0, src2, 5);
+  e.vmovaps(e.xmm1, src1);
+  for (uint8_t shamt = 4; shamt; shamt >>= 1) {
+    EmitVectorUniformShiftI8(e, e.xmm2, e.xmm1, shamt, op);
+    e.vpblendvb(e.xmm1, e.xmm1, e.xmm2, e.xmm0);
+    if (shamt > 1) {
+      e.vpaddb(e.xmm0, e.xmm0, e.xmm0);
+    }
+  }
+  e.vmovaps(dest, e.xmm1);
+}
+
+template <typename ARGS>
+void EmitVectorShiftI8(X64Emitter& e, const ARGS& i, VectorShiftOp op) {
+  if (i.src2.is_constant) {
+    const auto& shamt = i.src2.constant();
+    bool all_same = true;
+    for (size_t n = 0; n < 15; ++n) {
+      if (shamt.u8[n] != shamt.u8[n + 1]) {
+        all_same = false;
+        break;
+      }
+    }
+    if (all_same) {
+      EmitVectorUniformShiftI8(e, i.dest, i.src1, shamt.u8[0], op);
+    } else {
+      e.LoadConstantXmm(e.xmm0, shamt);
+      EmitVectorVariableShiftI8(e, i.dest, i.src1, e.xmm0, op);
+    }
+  } else {
+    EmitVectorVariableShiftI8(e, i.dest, i.src1, i.src2, op);
+  }
+}
+
+// Shifts each word by its own count. There is no such instruction before
+// AVX-512, so the odd and even words of each dword are shifted separately
+// with the AVX2 variable dword shifts and merged.
+// Clobbers xmm0-xmm3. src2 may be xmm0.
+void EmitVectorVariableShiftI16(X64Emitter& e, const Xmm& dest,
+                                const Xmm& src1, const Xmm& src2,
+                                VectorShiftOp op) {
+  e.vpand(e.xmm1, src2, e.GetXmmConstPtr(XMMShiftMaskEvenPI16));
+  e.vpsrld(e.xmm2, src2, 16);
+  e.vpand(e.xmm2, e.xmm2, e.GetXmmConstPtr(XMMShiftMaskEvenPI16));
+  // Odd words are moved down, shifted and moved back up, which also drops
+  // anything shifted out of the word.
+  switch (op) {
+    case VectorShiftOp::kShl:
+      e.vpsrld(e.xmm3, src1, 16);
+      e.vpsllvd(e.xmm3, e.xmm3, e.xmm2);
+      break;
+    case VectorShiftOp::kShr:
+      e.vpsrld(e.xmm3, src1, 16);
+      e.vpsrlvd(e.xmm3, e.xmm3, e.xmm2);
+      break;
+    case VectorShiftOp::kSha:
+      e.vpsrad(e.xmm3, src1, 16);
+      e.vpsravd(e.xmm3, e.xmm3, e.xmm2);
+      break;
+  }
+  e.vpslld(e.xmm3, e.xmm3, 16);
+  // Even words are zero or sign extended to the dword first so that right
+  // shifts bring in the right bits.
+  switch (op) {
+    case VectorShiftOp::kShl:
+      e.vpsllvd(e.xmm1, src1, e.xmm1);
+      break;
+    case VectorShiftOp::kShr:
+      e.vpand(e.xmm0, src1, e.GetXmmConstPtr(XMMMaskEvenPI16));
+      e.vpsrlvd(e.xmm1, e.xmm0, e.xmm1);
+      break;
+    case VectorShiftOp::kSha:
+      e.vpslld(e.xmm0, src1, 16);
+      e.vpsrad(e.xmm0, e.xmm0, 16);
+      e.vpsravd(e.xmm1, e.xmm0, e.xmm1);
+      break;
+  }
+  e.vpand(e.xmm1, e.xmm1, e.GetXmmConstPtr(XMMMaskEvenPI16));
+  e.vpor(dest, e.xmm1, e.xmm3);
+}
+
+template <typename ARGS>
+void EmitVectorShiftI16(X64Emitter& e, const ARGS& i, VectorShiftOp op,
+                        void* emulate) {
+  if (i.src2.is_constant) {
+    const auto& shamt = i.src2.constant();
+    bool all_same = true;
+    for (size_t n = 0; n < 7; ++n) {
+      if (shamt.u16[n] != shamt.u16[n + 1]) {
+        all_same = false;
+        break;
+      }
+    }
+    if (all_same) {
+      // Every count is the same, so we can use a regular shift.
+      uint8_t count = shamt.u16[0] & 0xF;
+      switch (op) {
+        case VectorShiftOp::kShl:
+          e.vpsllw(i.dest, i.src1, count);
+          break;
+        case VectorShiftOp::kShr:
+          e.vpsrlw(i.dest, i.src1, count);
+          break;
+        case VectorShiftOp::kSha:
+          e.vpsraw(i.dest, i.src1, count);
+          break;
+      }
+      return;
+    }
+  }
+  if (e.IsFeatureEnabled(kX64EmitAVX2)) {
+    if (i.src2.is_constant) {
+      e.LoadConstantXmm(e.xmm0, i.src2.constant());
+      EmitVectorVariableShiftI16(e, i.dest, i.src1, e.xmm0, op);
+    } else {
+      EmitVectorVariableShiftI16(e, i.dest, i.src1, i.src2, op);
+    }
+    return;
+  }
+  if (i.src2.is_constant) {
+    e.LoadConstantXmm(e.xmm0, i.src2.constant());
+    e.lea(e.r9, e.StashXmm(1, e.xmm0));
+  } else {
+    e.lea(e.r9, e.StashXmm(1, i.src2));
+  }
+  e.lea(e.r8, e.StashXmm(0, i.src1));
+  e.CallNativeSafe(emulate);
+  e.vmovaps(i.dest, e.xmm0);
+}
+
 EMITTER(VECTOR_SHL_V128, MATCH(I<OPCODE_VECTOR_SHL, V128<>, V128<>, V128<>>)) {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     switch (i.instr->flags) {
     case INT8_TYPE:
-      EmitInt8(e, i);
+      EmitVectorShiftI8(e, i, VectorShiftOp::kShl);
       break;
     case INT16_TYPE:
-      EmitInt16(e, i);
+      EmitVectorShiftI16(e, i, VectorShiftOp::kShl,
+                         reinterpret_cast<void*>(EmulateVectorShlI16));
       break;
     case INT32_TYPE:
       EmitInt32(e, i);
@@ -4771,28 +4976,6 @@ EMITTER(VECTOR_SHL_V128, MATCH(I<OPCODE_VECTOR_SHL, V128<>, V128<>, V128<>>)) {
       break;
     }
   }
-  static __m128i EmulateVectorShlI8(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint8_t value[16];
-    alignas(16) uint8_t shamt[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 16; ++i) {
-      value[i] = value[i] << (shamt[i] & 0x7);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
-  static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
-    if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
-    } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
-    }
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShlI8));
-    e.vmovaps(i.dest, e.xmm0);
-  }
   static __m128i EmulateVectorShlI16(void*, __m128i src1, __m128i src2) {
     alignas(16) uint16_t value[8];
     alignas(16) uint16_t shamt[8];
@@ -4803,33 +4986,6 @@ EMITTER(VECTOR_SHL_V128, MATCH(I<OPCODE_VECTOR_SHL, V128<>, V128<>, V128<>>)) {
     }
     return _mm_load_si128(reinterpret_cast<__m128i*>(value));
   }
-  static void EmitInt16(X64Emitter& e, const EmitArgType& i) {
-    if (i.src2.is_constant) {
-      const auto& shamt = i.src2.constant();
-      bool all_same = true;
-      for (size_t n = 0; n < 8 - n; ++n) {
-        if (shamt.u16[n] != shamt.u16[n + 1]) {
-          all_same = false;
-          break;
-        }
-      }
-      if (all_same) {
-        // Every count is the same, so we can use vpsllw.
-        e.vpsllw(i.dest, i.src1, shamt.u16[0] & 0xF);
-        return;
-      }
-    }
-    // TODO(benvanik): native version (with shift magic).
-    if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
-    } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
-    }
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShlI16));
-    e.vmovaps(i.dest, e.xmm0);
-  }
   static __m128i EmulateVectorShlI32(void*, __m128i src1, __m128i src2) {
     alignas(16) uint32_t value[4];
     alignas(16) uint32_t shamt[4];
@@ -4845,7 +5001,7 @@ EMITTER(VECTOR_SHL_V128, MATCH(I<OPCODE_VECTOR_SHL, V128<>, V128<>, V128<>>)) {
       if (i.src2.is_constant) {
         const auto& shamt = i.src2.constant();
         bool all_same = true;
-        for (size_t n = 0; n < 4 - n; ++n) {
+        for (size_t n = 0; n < 3; ++n) {
           if (shamt.u32[n] != shamt.u32[n + 1]) {
             all_same = false;
             break;
@@ -4896,10 +5052,11 @@ EMITTER(VECTOR_SHR_V128, MATCH(I<OPCODE_VECTOR_SHR, V128<>, V128<>, V128<>>)) {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     switch (i.instr->flags) {
     case INT8_TYPE:
-      EmitInt8(e, i);
+      EmitVectorShiftI8(e, i, VectorShiftOp::kShr);
       break;
     case INT16_TYPE:
-      EmitInt16(e, i);
+      EmitVectorShiftI16(e, i, VectorShiftOp::kShr,
+                         reinterpret_cast<void*>(EmulateVectorShrI16));
       break;
     case INT32_TYPE:
       EmitInt32(e, i);
@@ -4909,28 +5066,6 @@ EMITTER(VECTOR_SHR_V128, MATCH(I<OPCODE_VECTOR_SHR, V128<>, V128<>, V128<>>)) {
       break;
     }
   }
-  static __m128i EmulateVectorShrI8(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint8_t value[16];
-    alignas(16) uint8_t shamt[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 16; ++i) {
-      value[i] = value[i] >> (shamt[i] & 0x7);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
-  static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
-    if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
-    } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
-    }
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShrI8));
-    e.vmovaps(i.dest, e.xmm0);
-  }
   static __m128i EmulateVectorShrI16(void*, __m128i src1, __m128i src2) {
     alignas(16) uint16_t value[8];
     alignas(16) uint16_t shamt[8];
@@ -4941,33 +5076,6 @@ EMITTER(VECTOR_SHR_V128, MATCH(I<OPCODE_VECTOR_SHR, V128<>, V128<>, V128<>>)) {
     }
     return _mm_load_si128(reinterpret_cast<__m128i*>(value));
   }
-  static void EmitInt16(X64Emitter& e, const EmitArgType& i) {
-    if (i.src2.is_constant) {
-      const auto& shamt = i.src2.constant();
-      bool all_same = true;
-      for (size_t n = 0; n < 8 - n; ++n) {
-        if (shamt.u16[n] != shamt.u16[n + 1]) {
-          all_same = false;
-          break;
-        }
-      }
-      if (all_same) {
-        // Every count is the same, so we can use vpsllw.
-        e.vpsrlw(i.dest, i.src1, shamt.u16[0] & 0xF);
-        return;
-      }
-    }
-    // TODO(benvanik): native version (with shift magic).
-    if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
-    } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
-    }
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShrI16));
-    e.vmovaps(i.dest, e.xmm0);
-  }
   static __m128i EmulateVectorShrI32(void*, __m128i src1, __m128i src2) {
     alignas(16) uint32_t value[4];
     alignas(16) uint32_t shamt[4];
@@ -4982,7 +5090,7 @@ EMITTER(VECTOR_SHR_V128, MATCH(I<OPCODE_VECTOR_SHR, V128<>, V128<>, V128<>>)) {
     if (i.src2.is_constant) {
       const auto& shamt = i.src2.constant();
       bool all_same = true;
-      for (size_t n = 0; n < 4 - n; ++n) {
+      for (size_t n = 0; n < 3; ++n) {
         if (shamt.u32[n] != shamt.u32[n + 1]) {
           all_same = false;
           break;
@@ -5037,16 +5145,6 @@ EMITTER_OPCODE_TABLE(
 // OPCODE_VECTOR_SHA
 // ============================================================================
 EMITTER(VECTOR_SHA_V128, MATCH(I<OPCODE_VECTOR_SHA, V128<>, V128<>, V128<>>)) {
-  static __m128i EmulateVectorShaI8(void*, __m128i src1, __m128i src2) {
-    alignas(16) int8_t value[16];
-    alignas(16) int8_t shamt[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 16; ++i) {
-      value[i] = value[i] >> (shamt[i] & 0x7);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
   static __m128i EmulateVectorShaI16(void*, __m128i src1, __m128i src2) {
     alignas(16) int16_t value[8];
     alignas(16) int16_t shamt[8];
@@ -5070,28 +5168,11 @@ EMITTER(VECTOR_SHA_V128, MATCH(I<OPCODE_VECTOR_SHA, V128<>, V128<>, V128<>>)) {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     switch (i.instr->flags) {
     case INT8_TYPE:
-      // TODO(benvanik): native version (with shift magic).
-      if (i.src2.is_constant) {
-        e.LoadConstantXmm(e.xmm0, i.src2.constant());
-        e.lea(e.r9, e.StashXmm(1, e.xmm0));
-      } else {
-        e.lea(e.r9, e.StashXmm(1, i.src2));
-      }
-      e.lea(e.r8, e.StashXmm(0, i.src1));
-      e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShaI8));
-      e.vmovaps(i.dest, e.xmm0);
+      EmitVectorShiftI8(e, i, VectorShiftOp::kSha);
       break;
     case INT16_TYPE:
-      // TODO(benvanik): native version (with shift magic).
-      if (i.src2.is_constant) {
-        e.LoadConstantXmm(e.xmm0, i.src2.constant());
-        e.lea(e.r9, e.StashXmm(1, e.xmm0));
-      } else {
-        e.lea(e.r9, e.StashXmm(1, i.src2));
-      }
-      e.lea(e.r8, e.StashXmm(0, i.src1));
-      e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShaI16));
-      e.vmovaps(i.dest, e.xmm0);
+      EmitVectorShiftI16(e, i, VectorShiftOp::kSha,
+                         reinterpret_cast<void*>(EmulateVectorShaI16));
       break;
     case INT32_TYPE:
       if (e.IsFeatureEnabled(kX64EmitAVX2)) {
@@ -5194,16 +5275,6 @@ EMITTER_OPCODE_TABLE(
 // ============================================================================
 // TODO(benvanik): AVX512 has a native variable rotate (rolv).
 EMITTER(VECTOR_ROTATE_LEFT_V128, MATCH(I<OPCODE_VECTOR_ROTATE_LEFT, V128<>, V128<>, V128<>>)) {
-  static __m128i EmulateVectorRotateLeftI8(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint8_t value[16];
-    alignas(16) uint8_t shamt[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
-    for (size_t i = 0; i < 16; ++i) {
-      value[i] = xe::rotate_left<uint8_t>(value[i], shamt[i] & 0x7);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
   static __m128i EmulateVectorRotateLeftI16(void*, __m128i src1, __m128i src2) {
     alignas(16) uint16_t value[8];
     alignas(16) uint16_t shamt[8];
@@ -5224,21 +5295,52 @@ EMITTER(VECTOR_ROTATE_LEFT_V128, MATCH(I<OPCODE_VECTOR_ROTATE_LEFT, V128<>, V128
     }
     return _mm_load_si128(reinterpret_cast<__m128i*>(value));
   }
+  // Rotates as (x << n) | (x >> -n), as the shifts only look at the low bits
+  // of each count.
+  static void EmitVariableRotate(X64Emitter& e, const EmitArgType& i,
+                                 TypeName part_type) {
+    auto shift = part_type == INT8_TYPE ? EmitVectorVariableShiftI8
+                                        : EmitVectorVariableShiftI16;
+    if (i.src2.is_constant) {
+      vec128_t negated = i.src2.constant();
+      if (part_type == INT8_TYPE) {
+        for (size_t n = 0; n < 16; ++n) {
+          negated.u8[n] = uint8_t(-negated.u8[n]);
+        }
+      } else {
+        for (size_t n = 0; n < 8; ++n) {
+          negated.u16[n] = uint16_t(-negated.u16[n]);
+        }
+      }
+      e.LoadConstantXmm(e.xmm4, negated);
+      e.LoadConstantXmm(e.xmm0, i.src2.constant());
+      shift(e, e.xmm5, i.src1, e.xmm0, VectorShiftOp::kShl);
+    } else {
+      e.vpxor(e.xmm4, e.xmm4, e.xmm4);
+      if (part_type == INT8_TYPE) {
+        e.vpsubb(e.xmm4, e.xmm4, i.src2);
+      } else {
+        e.vpsubw(e.xmm4, e.xmm4, i.src2);
+      }
+      shift(e, e.xmm5, i.src1, i.src2, VectorShiftOp::kShl);
+    }
+    shift(e, i.dest, i.src1, e.xmm4, VectorShiftOp::kShr);
+    e.vpor(i.dest, i.dest, e.xmm5);
+  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     switch (i.instr->flags) {
     case INT8_TYPE:
-      // TODO(benvanik): native version (with shift magic).
-      e.lea(e.r8, e.StashXmm(0, i.src1));
-      e.lea(e.r9, e.StashXmm(1, i.src2));
-      e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorRotateLeftI8));
-      e.vmovaps(i.dest, e.xmm0);
+      EmitVariableRotate(e, i, INT8_TYPE);
       break;
     case INT16_TYPE:
-      // TODO(benvanik): native version (with shift magic).
-      e.lea(e.r8, e.StashXmm(0, i.src1));
-      e.lea(e.r9, e.StashXmm(1, i.src2));
-      e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorRotateLeftI16));
-      e.vmovaps(i.dest, e.xmm0);
+      if (e.IsFeatureEnabled(kX64EmitAVX2)) {
+        EmitVariableRotate(e, i, INT16_TYPE);
+      } else {
+        e.lea(e.r8, e.StashXmm(0, i.src1));
+        e.lea(e.r9, e.StashXmm(1, i.src2));
+        e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorRotateLeftI16));
+        e.vmovaps(i.dest, e.xmm0);
+      }
       break;
     case INT32_TYPE: {
       if (e.IsFeatureEnabled(kX64EmitAVX2)) {
@@ -5279,30 +5381,6 @@ EMITTER_OPCODE_TABLE(
 // OPCODE_VECTOR_AVERAGE
 // ============================================================================
 EMITTER(VECTOR_AVERAGE, MATCH(I<OPCODE_VECTOR_AVERAGE, V128<>, V128<>, V128<>>)) {
-  static __m128i EmulateVectorAverageUnsignedI32(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint32_t src1v[4];
-    alignas(16) uint32_t src2v[4];
-    alignas(16) uint32_t value[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(src1v), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(src2v), src2);
-    for (size_t i = 0; i < 4; ++i) {
-      auto t = (uint64_t(src1v[i]) + uint64_t(src2v[i]) + 1) >> 1;
-      value[i] = uint32_t(t);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
-  static __m128i EmulateVectorAverageSignedI32(void*, __m128i src1, __m128i src2) {
-    alignas(16) int32_t src1v[4];
-    alignas(16) int32_t src2v[4];
-    alignas(16) int32_t value[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(src1v), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(src2v), src2);
-    for (size_t i = 0; i < 4; ++i) {
-      auto t = (int64_t(src1v[i]) + int64_t(src2v[i]) + 1) >> 1;
-      value[i] = int32_t(t);
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(value));
-  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     EmitCommutativeBinaryXmmOp(e, i, [&i](X64Emitter& e, const Xmm& dest,
                                           const Xmm& src1, const Xmm& src2) {
@@ -5325,20 +5403,20 @@ EMITTER(VECTOR_AVERAGE, MATCH(I<OPCODE_VECTOR_AVERAGE, V128<>, V128<>, V128<>>))
           }
           break;
         case INT32_TYPE:
-          // No 32bit averages in AVX.
+          // No 32bit averages in AVX, but (a >> 1) + (b >> 1) + ((a | b) & 1)
+          // is the same as (a + b + 1) >> 1 and can't overflow.
+          e.vpor(e.xmm1, src1, src2);
+          e.vpslld(e.xmm1, e.xmm1, 31);
+          e.vpsrld(e.xmm1, e.xmm1, 31);
           if (is_unsigned) {
-            e.lea(e.r8, e.StashXmm(0, i.src1));
-            e.lea(e.r9, e.StashXmm(1, i.src2));
-            e.CallNativeSafe(
-              reinterpret_cast<void*>(EmulateVectorAverageUnsignedI32));
-            e.vmovaps(i.dest, e.xmm0);
+            e.vpsrld(e.xmm2, src1, 1);
+            e.vpsrld(dest, src2, 1);
           } else {
-            e.lea(e.r8, e.StashXmm(0, i.src1));
-            e.lea(e.r9, e.StashXmm(1, i.src2));
-            e.CallNativeSafe(
-                reinterpret_cast<void*>(EmulateVectorAverageSignedI32));
-            e.vmovaps(i.dest, e.xmm0);
+            e.vpsrad(e.xmm2, src1, 1);
+            e.vpsrad(dest, src2, 1);
           }
+          e.vpaddd(dest, dest, e.xmm2);
+          e.vpaddd(dest, dest, e.xmm1);
           break;
         default:
           assert_unhandled_case(part_type);
@@ -5630,7 +5708,7 @@ EMITTER(EXTRACT_I32, MATCH(I<OPCODE_EXTRACT, I32<>, V128<>, I8<>>)) {
       e.mov(e.al, i.src2);
       e.and(e.al, 0x03);
       e.shl(e.al, 4);
-      e.mov(e.rdx, reinterpret_cast<uint64_t>(extract_table_32));
+      e.MovHostPointer(e.rdx, extract_table_32);
       e.vmovaps(e.xmm0, e.ptr[e.rdx + e.rax]);
       e.vpshufb(e.xmm0, i.src1, e.xmm0);
       e.vpextrd(i.dest, e.xmm0, 0);
@@ -6051,7 +6129,7 @@ EMITTER(PACK, MATCH(I<OPCODE_PACK, V128<>, V128<>, V128<>>)) {
 
     if (e.IsFeatureEnabled(kX64EmitF16C)) {
       // 0|0|0|0|W|Z|Y|X
-      e.vcvtps2ph(i.dest, i.dest, B00000011);
+      e.vcvtps2ph(i.dest, i.src1, B00000011);
       // Shuffle to X|Y|0|0|0|0|0|0
       e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMPackFLOAT16_2));
     } else {
@@ -6525,6 +6603,48 @@ EMITTER_OPCODE_TABLE(
 // ============================================================================
 // OPCODE_COMPARE_EXCHANGE
 // ============================================================================
+// Like ATOMIC_EXCHANGE, the address is a host address. The result is the
+// previous value, which equals the compare value if the exchange happened.
+// rcx/rdx are borrowed for the address and new value, as rax is taken by
+// cmpxchg itself.
+template <typename SEQ, typename REG, typename ARGS>
+void EmitCompareExchangeXX(X64Emitter& e, const ARGS& i, const REG& rax_reg,
+                           const REG& rcx_reg) {
+  if (i.src1.is_constant) {
+    e.mov(e.rdx, i.src1.constant());
+  } else {
+    e.mov(e.rdx, i.src1);
+  }
+  if (i.src2.is_constant) {
+    e.mov(rax_reg, i.src2.constant());
+  } else {
+    e.mov(rax_reg, i.src2);
+  }
+  if (i.src3.is_constant) {
+    e.mov(rcx_reg, i.src3.constant());
+  } else {
+    e.mov(rcx_reg, i.src3);
+  }
+  e.lock();
+  e.cmpxchg(e.ptr[e.rdx], rcx_reg);
+  e.mov(i.dest, rax_reg);
+  e.ReloadECX();
+  e.ReloadEDX();
+}
+EMITTER(COMPARE_EXCHANGE_I32, MATCH(I<OPCODE_COMPARE_EXCHANGE, I32<>, I64<>, I32<>, I32<>>)) {
+  static void Emit(X64Emitter& e, const EmitArgType& i) {
+    EmitCompareExchangeXX<COMPARE_EXCHANGE_I32, Reg32>(e, i, e.eax, e.ecx);
+  }
+};
+EMITTER(COMPARE_EXCHANGE_I64, MATCH(I<OPCODE_COMPARE_EXCHANGE, I64<>, I64<>, I64<>, I64<>>)) {
+  static void Emit(X64Emitter& e, const EmitArgType& i) {
+    EmitCompareExchangeXX<COMPARE_EXCHANGE_I64, Reg64>(e, i, e.rax, e.rcx);
+  }
+};
+EMITTER_OPCODE_TABLE(
+    OPCODE_COMPARE_EXCHANGE,
+    COMPARE_EXCHANGE_I32,
+    COMPARE_EXCHANGE_I64);
 
 
 // ============================================================================
@@ -6720,7 +6840,7 @@ void RegisterSequences() {
   REGISTER_EMITTER_OPCODE_TABLE(OPCODE_SWIZZLE);
   REGISTER_EMITTER_OPCODE_TABLE(OPCODE_PACK);
   REGISTER_EMITTER_OPCODE_TABLE(OPCODE_UNPACK);
-  //REGISTER_EMITTER_OPCODE_TABLE(OPCODE_COMPARE_EXCHANGE);
+  REGISTER_EMITTER_OPCODE_TABLE(OPCODE_COMPARE_EXCHANGE);
   REGISTER_EMITTER_OPCODE_TABLE(OPCODE_ATOMIC_EXCHANGE);
   //REGISTER_EMITTER_OPCODE_TABLE(OPCODE_ATOMIC_ADD);
   //REGISTER_EMITTER_OPCODE_TABLE(OPCODE_ATOMIC_SUB);
@@ -10,6 +10,7 @@
 #include "xenia/cpu/backend/x64/x64_thunk_emitter.h"
 
 #include "third_party/xbyak/xbyak/xbyak.h"
+#include "xenia/cpu/symbol_info.h"
 
 namespace xe {
 namespace cpu {
@@ -59,6 +60,7 @@ HostToGuestThunk X64ThunkEmitter::EmitHostToGuestThunk() {
   mov(rax, rcx);
   mov(rcx, rdx);
   mov(rdx, r8);
+  LoadPinnedRegisters(rcx);
   call(rax);
 
   /*movaps(xmm6, ptr[rsp + 128]);
@@ -72,6 +74,13 @@ HostToGuestThunk X64ThunkEmitter::EmitHostToGuestThunk() {
   movaps(xmm14, ptr[rsp + 256]);
   movaps(xmm15, ptr[rsp + 272]);*/
 
+  // Hand the pinned guest registers back to the context (arg0) before the
+  // host values are restored.
+  if (!backend()->pinned_registers().empty()) {
+    mov(rcx, qword[rsp + stack_size + 8 * 2]);
+    StorePinnedRegisters(rcx);
+  }
+
   mov(rbx, qword[rsp + 48]);
   mov(rcx, qword[rsp + 56]);
   mov(rbp, qword[rsp + 64]);
@@ -88,7 +97,7 @@ HostToGuestThunk X64ThunkEmitter::EmitHostToGuestThunk() {
   mov(r8, qword[rsp + 8 * 3]);
   ret();
 
-  void* fn = Emplace(0, stack_size);
+  void* fn = Emplace(0, "HostToGuestThunk", stack_size);
   return (HostToGuestThunk)fn;
 }
 
@@ -117,6 +126,9 @@ GuestToHostThunk X64ThunkEmitter::EmitGuestToHostThunk() {
 
   // TODO(benvanik): save things? XMM0-5?
 
+  // The host may read or write pinned guest registers in the context.
+  StorePinnedRegisters(rcx);
+
   mov(rax, rdx);
   mov(rdx, r8);
   mov(r8, r9);
@@ -133,12 +145,14 @@ GuestToHostThunk X64ThunkEmitter::EmitGuestToHostThunk() {
   mov(r14, qword[rsp + 104]);
   mov(r15, qword[rsp + 112]);
 
+  LoadPinnedRegisters(rcx);
+
   add(rsp, stack_size);
   mov(rcx, qword[rsp + 8 * 1]);
   mov(rdx, qword[rsp + 8 * 2]);
   ret();
 
-  void* fn = Emplace(0, stack_size);
+  void* fn = Emplace(0, "GuestToHostThunk", stack_size);
   return (HostToGuestThunk)fn;
 }
 
@@ -184,10 +198,36 @@ ResolveFunctionThunk X64ThunkEmitter::EmitResolveFunctionThunk() {
   mov(rdx, qword[rsp + 8 * 2]);
   jmp(rax);
 
-  void* fn = Emplace(0, stack_size);
+  void* fn = Emplace(0, "ResolveFunctionThunk", stack_size);
   return (ResolveFunctionThunk)fn;
 }
 
+void* X64ThunkEmitter::EmitInterpreterEntry(FunctionInfo* symbol_info,
+                                            InterpreterEntry entry,
+                                            void* function,
+                                            size_t* out_code_size) {
+  // rcx = context
+  // rdx = guest return address
+
+  const size_t stack_size = StackLayout::INTERPRETER_ENTRY_STACK_SIZE;
+  sub(rsp, stack_size);
+
+  // entry(context, function, return address)
+  mov(r9, rdx);
+  mov(r8, uint64_t(function));
+  mov(rdx, uint64_t(entry));
+  mov(rax, uint64_t(backend()->guest_to_host_thunk()));
+  call(rax);
+
+  // Callers expect the membase back in rdx, as the epilog leaves it.
+  ReloadEDX();
+  add(rsp, stack_size);
+  ret();
+
+  *out_code_size = getSize();
+  return Emplace(symbol_info->address(), symbol_info->name(), stack_size);
+}
+
 }  // namespace x64
 }  // namespace backend
 }  // namespace cpu
@@ -121,6 +121,9 @@ class StackLayout {
   const static size_t GUEST_RCX_HOME = 80;
   const static size_t GUEST_RET_ADDR = 88;
   const static size_t GUEST_CALL_RET_ADDR = 96;
+
+  // Home space for the GuestToHostThunk, keeping rsp 16b aligned.
+  const static size_t INTERPRETER_ENTRY_STACK_SIZE = 40;
 };
 
 class X64ThunkEmitter : public X64Emitter {
@@ -136,6 +139,11 @@ class X64ThunkEmitter : public X64Emitter {
 
   // Function that thunks to the ResolveFunction in X64Emitter.
   ResolveFunctionThunk EmitResolveFunctionThunk();
+
+  // Code standing in for an interpreted function, which passes calls from
+  // generated code on to entry through the GuestToHostThunk.
+  void* EmitInterpreterEntry(FunctionInfo* symbol_info, InterpreterEntry entry,
+                             void* function, size_t* out_code_size);
 };
 
 }  // namespace x64
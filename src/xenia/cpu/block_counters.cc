@@ -0,0 +1,142 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/block_counters.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "xenia/base/logging.h"
+#include "xenia/base/platform.h"
+#include "xenia/cpu/cpu-private.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/symbol_info.h"
+
+namespace xe {
+namespace cpu {
+
+// Counters committed at a time in each shard, as blocks get translated.
+const uint32_t kCommitCounterCount = 64 * 1024;
+
+BlockCounters::BlockCounters(Processor* processor)
+    : processor_(processor), committed_count_(0), next_shard_(0) {
+  std::memset(shards_, 0, sizeof(shards_));
+}
+
+BlockCounters::~BlockCounters() {
+  for (size_t i = 0; i < kShardCount; ++i) {
+    if (shards_[i]) {
+      VirtualFree(shards_[i], 0, MEM_RELEASE);
+      shards_[i] = nullptr;
+    }
+  }
+}
+
+bool BlockCounters::Initialize() {
+  // Each shard gets its own reservation, so no two threads ever write to the
+  // same cache line. Pages are committed as counters are allocated.
+  for (size_t i = 0; i < kShardCount; ++i) {
+    shards_[i] = reinterpret_cast<uint64_t*>(
+        VirtualAlloc(nullptr, kMaxCounterCount * sizeof(uint64_t),
+                     MEM_RESERVE, PAGE_NOACCESS));
+    if (!shards_[i]) {
+      XELOGE("Unable to reserve block counters");
+      return false;
+    }
+  }
+  counters_.reserve(kCommitCounterCount);
+  return true;
+}
+
+uint64_t* BlockCounters::AcquireShard() {
+  return shards_[next_shard_++ % kShardCount];
+}
+
+uint32_t BlockCounters::AllocateCounter(uint32_t function_address,
+                                        uint32_t block_address) {
+  std::lock_guard<std::mutex> lock(counters_mutex_);
+  if (counters_.size() >= kMaxCounterCount) {
+    return kInvalidIndex;
+  }
+  uint32_t index = static_cast<uint32_t>(counters_.size());
+  if (index >= committed_count_) {
+    // Committed memory reads as zero, so the new counters start out cleared.
+    for (size_t i = 0; i < kShardCount; ++i) {
+      if (!VirtualAlloc(shards_[i] + committed_count_,
+                        kCommitCounterCount * sizeof(uint64_t), MEM_COMMIT,
+                        PAGE_READWRITE)) {
+        XELOGE("Unable to commit block counters");
+        return kInvalidIndex;
+      }
+    }
+    committed_count_ += kCommitCounterCount;
+  }
+  counters_.push_back({function_address, block_address});
+  return index;
+}
+
+std::unordered_map<uint32_t, uint64_t> BlockCounters::CollectCounts() {
+  // Only blocks compilation; guest threads keep counting while we read and
+  // a torn total is no worse than one read a moment earlier.
+  std::lock_guard<std::mutex> lock(counters_mutex_);
+  std::unordered_map<uint32_t, uint64_t> counts;
+  for (uint32_t index = 0; index < counters_.size(); ++index) {
+    uint64_t count = 0;
+    for (size_t i = 0; i < kShardCount; ++i) {
+      count += reinterpret_cast<volatile uint64_t*>(shards_[i])[index];
+    }
+    counts[counters_[index].block_address] += count;
+  }
+  return counts;
+}
+
+bool BlockCounters::Dump() {
+  std::unordered_map<uint32_t, uint32_t> block_functions;
+  {
+    std::lock_guard<std::mutex> lock(counters_mutex_);
+    for (auto& counter : counters_) {
+      block_functions[counter.block_address] = counter.function_address;
+    }
+  }
+  auto counts = CollectCounts();
+  std::vector<std::pair<uint32_t, uint64_t>> sorted_counts(counts.begin(),
+                                                           counts.end());
+  std::sort(sorted_counts.begin(), sorted_counts.end(),
+            [](const std::pair<uint32_t, uint64_t>& a,
+               const std::pair<uint32_t, uint64_t>& b) {
+              return a.second != b.second ? a.second > b.second
+                                          : a.first < b.first;
+            });
+
+  auto& path = FLAGS_block_counters_output;
+  FILE* file = std::fopen(path.c_str(), "w");
+  if (!file) {
+    XELOGE("Unable to write block counts to %s", path.c_str());
+    return false;
+  }
+  std::fprintf(file, "# block function count name\n");
+  for (auto& it : sorted_counts) {
+    uint32_t function_address = block_functions[it.first];
+    FunctionInfo* symbol_info = nullptr;
+    const char* name = "";
+    if (processor_->LookupFunctionInfo(function_address, &symbol_info)) {
+      name = symbol_info->name().c_str();
+    }
+    std::fprintf(file, "%.8X %.8X %lld %s\n", it.first, function_address,
+                 it.second, name);
+  }
+  std::fclose(file);
+  XELOGI("Wrote counts of %d blocks to %s", int(sorted_counts.size()),
+         path.c_str());
+  return true;
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,79 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_BLOCK_COUNTERS_H_
+#define XENIA_CPU_BLOCK_COUNTERS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace xe {
+namespace cpu {
+
+class Processor;
+
+// Execution counts of guest blocks, enabled with --block_counters.
+// Generated code bumps a counter at the top of each block it translates,
+// without a lock: counters are split into shards, and each thread counts into
+// its own one (through PPCContext::block_counters), so threads don't fight
+// over cache lines. Only threads sharing a shard, when there are more threads
+// than shards, can lose the odd count.
+// Shards are summed whenever the counts are read, while the guest keeps
+// running.
+class BlockCounters {
+ public:
+  static const uint32_t kShardCount = 16;
+  static const uint32_t kMaxCounterCount = 1024 * 1024;
+  static const uint32_t kInvalidIndex = ~0u;
+
+  explicit BlockCounters(Processor* processor);
+  ~BlockCounters();
+
+  bool Initialize();
+
+  // Picks the shard a new thread counts into.
+  uint64_t* AcquireShard();
+
+  // Allocates a counter for a block of the function starting at the given
+  // guest address. Returns its index in each shard, or kInvalidIndex once
+  // out of counters.
+  uint32_t AllocateCounter(uint32_t function_address, uint32_t block_address);
+
+  // Current counts by block address, summed over all shards and
+  // translations of the block.
+  std::unordered_map<uint32_t, uint64_t> CollectCounts();
+
+  // Writes the counts to --block_counters_output, hottest block first.
+  bool Dump();
+
+ private:
+  struct Counter {
+    uint32_t function_address;
+    uint32_t block_address;
+  };
+
+  Processor* processor_;
+
+  std::mutex counters_mutex_;
+  std::vector<Counter> counters_;
+  // Counters backed by memory in every shard.
+  uint32_t committed_count_;
+
+  uint64_t* shards_[kShardCount];
+  std::atomic<uint32_t> next_shard_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_BLOCK_COUNTERS_H_
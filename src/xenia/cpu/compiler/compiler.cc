@@ -9,6 +9,7 @@
 
 #include "xenia/cpu/compiler/compiler.h"
 
+#include "xenia/base/clock.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
 #include "xenia/profiling.h"
 
@@ -16,7 +17,10 @@ namespace xe {
 namespace cpu {
 namespace compiler {
 
-Compiler::Compiler(Processor* processor) : processor_(processor) {}
+using xe::cpu::hir::HIRBuilder;
+
+Compiler::Compiler(Processor* processor)
+    : processor_(processor), collect_statistics_(false) {}
 
 Compiler::~Compiler() { Reset(); }
 
@@ -27,13 +31,52 @@ void Compiler::AddPass(std::unique_ptr<CompilerPass> pass) {
 
 void Compiler::Reset() {}
 
-bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder) {
+namespace {
+void CountHIR(HIRBuilder* builder, size_t* out_instr_count,
+              size_t* out_value_count) {
+  size_t instr_count = 0;
+  size_t value_count = 0;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      ++instr_count;
+      if (instr->dest) {
+        ++value_count;
+      }
+    }
+  }
+  *out_instr_count = instr_count;
+  *out_value_count = value_count;
+}
+}  // namespace
+
+bool Compiler::Compile(HIRBuilder* builder) {
+  pass_statistics_.clear();
+
   // TODO(benvanik): sophisticated stuff. Run passes in parallel, run until they
   //                 stop changing things, etc.
   for (size_t i = 0; i < passes_.size(); ++i) {
     auto& pass = passes_[i];
     scratch_arena_.Reset();
-    if (!pass->Run(builder)) {
+    if (!collect_statistics_) {
+      if (!pass->Run(builder)) {
+        return false;
+      }
+      continue;
+    }
+
+    PassStatistics statistics;
+    statistics.name = pass->name();
+    CountHIR(builder, &statistics.instr_count_before,
+             &statistics.value_count_before);
+    uint64_t start_ticks = Clock::QueryHostTickCount();
+    bool succeeded = pass->Run(builder);
+    statistics.ticks = Clock::QueryHostTickCount() - start_ticks;
+    CountHIR(builder, &statistics.instr_count_after,
+             &statistics.value_count_after);
+    statistics.arena_size =
+        builder->arena()->QuerySize() + scratch_arena_.QuerySize();
+    pass_statistics_.push_back(statistics);
+    if (!succeeded) {
       return false;
     }
   }
@@ -42,11 +42,31 @@ class Compiler {
 
   bool Compile(hir::HIRBuilder* builder);
 
+  // Measurements taken around each pass of the last Compile, for tooling.
+  // Off by default as counting the HIR walks it twice per pass.
+  struct PassStatistics {
+    const char* name;
+    uint64_t ticks;
+    size_t instr_count_before;
+    size_t instr_count_after;
+    size_t value_count_before;
+    size_t value_count_after;
+    // Bytes in use in the builder and scratch arenas once the pass is done.
+    size_t arena_size;
+  };
+  void set_collect_statistics(bool enabled) { collect_statistics_ = enabled; }
+  const std::vector<PassStatistics>& pass_statistics() const {
+    return pass_statistics_;
+  }
+
  private:
   Processor* processor_;
   Arena scratch_arena_;
 
   std::vector<std::unique_ptr<CompilerPass>> passes_;
+
+  bool collect_statistics_;
+  std::vector<PassStatistics> pass_statistics_;
 };
 
 }  // namespace compiler
@@ -16,7 +16,7 @@
 #include "xenia/cpu/compiler/passes/control_flow_simplification_pass.h"
 #include "xenia/cpu/compiler/passes/data_flow_analysis_pass.h"
 #include "xenia/cpu/compiler/passes/dead_code_elimination_pass.h"
-//#include "xenia/cpu/compiler/passes/dead_store_elimination_pass.h"
+#include "xenia/cpu/compiler/passes/dead_store_elimination_pass.h"
 #include "xenia/cpu/compiler/passes/finalization_pass.h"
 #include "xenia/cpu/compiler/passes/memory_sequence_combination_pass.h"
 #include "xenia/cpu/compiler/passes/register_allocation_pass.h"
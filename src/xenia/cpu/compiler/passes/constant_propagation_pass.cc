@@ -23,6 +23,7 @@ namespace passes {
 using namespace xe::cpu::hir;
 
 using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
 using xe::cpu::hir::TypeName;
 using xe::cpu::hir::Value;
 
@@ -174,6 +175,31 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder) {
           }
           break;
 
+        case OPCODE_LOAD_VECTOR_SHL:
+          if (i->src1.value->IsConstant()) {
+            // Same as the lvsl table: bytes sh, sh + 1, ..., sh + 15.
+            uint8_t sh = i->src1.value->constant.i8 & 0xF;
+            vec128_t result;
+            for (int n = 0; n < 16; n++) {
+              result.u8[n ^ 0x3] = uint8_t(sh + n);
+            }
+            v->set_constant(result);
+            i->Remove();
+          }
+          break;
+        case OPCODE_LOAD_VECTOR_SHR:
+          if (i->src1.value->IsConstant()) {
+            // Same as the lvsr table: bytes 16 - sh, ..., 31 - sh.
+            uint8_t sh = i->src1.value->constant.i8 & 0xF;
+            vec128_t result;
+            for (int n = 0; n < 16; n++) {
+              result.u8[n ^ 0x3] = uint8_t(16 - sh + n);
+            }
+            v->set_constant(result);
+            i->Remove();
+          }
+          break;
+
         case OPCODE_LOAD:
           if (i->src1.value->IsConstant()) {
             auto memory = processor_->memory();
@@ -327,6 +353,40 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder) {
           assert_true(!i->src1.value->IsConstant());
           break;
 
+        // Float lanes are left alone: the guest may be running with
+        // non-IEEE (denormal flushing) semantics we don't model here.
+        case OPCODE_VECTOR_COMPARE_EQ:
+        case OPCODE_VECTOR_COMPARE_SGT:
+        case OPCODE_VECTOR_COMPARE_SGE:
+        case OPCODE_VECTOR_COMPARE_UGT:
+        case OPCODE_VECTOR_COMPARE_UGE:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant() &&
+              i->flags != FLOAT32_TYPE) {
+            v->set_from(i->src1.value);
+            v->VectorCompare(i->opcode->num, i->src2.value,
+                             TypeName(i->flags));
+            i->Remove();
+          }
+          break;
+        case OPCODE_VECTOR_MAX:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant() &&
+              (i->flags >> 8) != FLOAT32_TYPE) {
+            v->set_from(i->src1.value);
+            v->VectorMax(i->src2.value, TypeName(i->flags >> 8),
+                         (i->flags & ARITHMETIC_UNSIGNED) != 0);
+            i->Remove();
+          }
+          break;
+        case OPCODE_VECTOR_MIN:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant() &&
+              (i->flags >> 8) != FLOAT32_TYPE) {
+            v->set_from(i->src1.value);
+            v->VectorMin(i->src2.value, TypeName(i->flags >> 8),
+                         (i->flags & ARITHMETIC_UNSIGNED) != 0);
+            i->Remove();
+          }
+          break;
+
         case OPCODE_ADD:
           if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
             v->set_from(i->src1.value);
@@ -382,6 +442,21 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder) {
             i->Remove();
           }
           break;
+        case OPCODE_VECTOR_ADD:
+        case OPCODE_VECTOR_SUB:
+          // Saturating forms feed DID_SATURATE, so they have to stay.
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant() &&
+              (i->flags & 0xFF) != FLOAT32_TYPE &&
+              !((i->flags >> 8) & ARITHMETIC_SATURATE)) {
+            v->set_from(i->src1.value);
+            if (i->opcode == &OPCODE_VECTOR_ADD_info) {
+              v->VectorAdd(i->src2.value, TypeName(i->flags & 0xFF));
+            } else {
+              v->VectorSub(i->src2.value, TypeName(i->flags & 0xFF));
+            }
+            i->Remove();
+          }
+          break;
         // case OPCODE_MUL_ADD:
         // case OPCODE_MUL_SUB
         case OPCODE_NEG:
@@ -453,7 +528,13 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder) {
             i->Remove();
           }
           break;
-        // TODO(benvanik): VECTOR_SHL
+        case OPCODE_VECTOR_SHL:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
+            v->set_from(i->src1.value);
+            v->VectorShl(i->src2.value, TypeName(i->flags));
+            i->Remove();
+          }
+          break;
         case OPCODE_SHR:
           if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
             v->set_from(i->src1.value);
@@ -461,6 +542,13 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder) {
             i->Remove();
           }
           break;
+        case OPCODE_VECTOR_SHR:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
+            v->set_from(i->src1.value);
+            v->VectorShr(i->src2.value, TypeName(i->flags));
+            i->Remove();
+          }
+          break;
         case OPCODE_SHA:
           if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
             v->set_from(i->src1.value);
@@ -468,7 +556,29 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder) {
             i->Remove();
           }
           break;
+        case OPCODE_VECTOR_SHA:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
+            v->set_from(i->src1.value);
+            v->VectorSha(i->src2.value, TypeName(i->flags));
+            i->Remove();
+          }
+          break;
         // TODO(benvanik): ROTATE_LEFT
+        case OPCODE_VECTOR_ROTATE_LEFT:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
+            v->set_from(i->src1.value);
+            v->VectorRotateLeft(i->src2.value, TypeName(i->flags));
+            i->Remove();
+          }
+          break;
+        case OPCODE_VECTOR_AVERAGE:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
+            v->set_from(i->src1.value);
+            v->VectorAverage(i->src2.value, TypeName(i->flags & 0xFF),
+                             ((i->flags >> 8) & ARITHMETIC_UNSIGNED) != 0);
+            i->Remove();
+          }
+          break;
         case OPCODE_BYTE_SWAP:
           if (i->src1.value->IsConstant()) {
             v->set_from(i->src1.value);
@@ -483,11 +593,36 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder) {
             i->Remove();
           }
           break;
-        // TODO(benvanik): INSERT/EXTRACT
-        // TODO(benvanik): SPLAT/PERMUTE/SWIZZLE
+        case OPCODE_INSERT:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant() &&
+              i->src3.value->IsConstant()) {
+            v->set_from(i->src1.value);
+            v->Insert(i->src2.value, i->src3.value);
+            i->Remove();
+          }
+          break;
+        case OPCODE_EXTRACT:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
+            v->set_zero(v->type);
+            v->Extract(i->src1.value, i->src2.value);
+            i->Remove();
+          }
+          break;
         case OPCODE_SPLAT:
+          // Quite a few of these, from building vec128s.
           if (i->src1.value->IsConstant()) {
-            // Quite a few of these, from building vec128s.
+            v->Splat(i->src1.value);
+            i->Remove();
+          }
+          break;
+        case OPCODE_PERMUTE:
+          PropagatePermute(builder, i);
+          break;
+        case OPCODE_SWIZZLE:
+          if (i->src1.value->IsConstant()) {
+            v->set_from(i->src1.value);
+            v->Swizzle(uint32_t(i->src2.offset));
+            i->Remove();
           }
           break;
 
@@ -504,6 +639,164 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder) {
   return true;
 }
 
+namespace {
+
+// Expands a constant permute control into the source byte of each result
+// byte, in guest order. 0-15 select from src2 and 16-31 from src3.
+bool ExpandPermuteControl(const Instr* i, uint8_t selects[16]) {
+  auto control = i->src1.value;
+  if (!control->IsConstant()) {
+    return false;
+  }
+  switch (i->flags) {
+    case INT8_TYPE:
+      if (control->type != VEC128_TYPE) {
+        return false;
+      }
+      for (int n = 0; n < 16; n++) {
+        selects[n] = control->constant.v128.u8[n ^ 0x3] & 0x1F;
+      }
+      return true;
+    case INT16_TYPE:
+      if (control->type != VEC128_TYPE) {
+        return false;
+      }
+      for (int n = 0; n < 8; n++) {
+        uint8_t k = control->constant.v128.u16[n ^ 0x1] & 0xF;
+        uint8_t s = (k & 0x8 ? 16 : 0) + (k & 0x7) * 2;
+        selects[n * 2 + 0] = s;
+        selects[n * 2 + 1] = s + 1;
+      }
+      return true;
+    case INT32_TYPE:
+      if (control->type != INT32_TYPE) {
+        return false;
+      }
+      for (int n = 0; n < 4; n++) {
+        uint8_t k = (uint32_t(control->constant.i32) >> (n * 8)) & 0x7;
+        uint8_t s = (k & 0x4 ? 16 : 0) + (k & 0x3) * 4;
+        for (int m = 0; m < 4; m++) {
+          selects[n * 4 + m] = s + m;
+        }
+      }
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Checks whether each result word comes from a whole source word and if so
+// returns those words (0-3 from src2, 4-7 from src3).
+bool GetPermuteWordSelects(const uint8_t selects[16], uint8_t words[4]) {
+  for (int n = 0; n < 4; n++) {
+    uint8_t s = selects[n * 4];
+    if (s & 0x3) {
+      return false;
+    }
+    for (int m = 1; m < 4; m++) {
+      if (selects[n * 4 + m] != s + m) {
+        return false;
+      }
+    }
+    words[n] = s / 4;
+  }
+  return true;
+}
+
+}  // namespace
+
+void ConstantPropagationPass::PropagatePermute(HIRBuilder* builder, Instr* i) {
+  // vperm with a constant control is common (vsldoi/vmrg* style shuffles and
+  // lvsl-derived masks), and the generic byte permute is the most expensive
+  // form the backend has. Fold it if we can, otherwise pick the cheapest
+  // equivalent: assign, swizzle (pshufd), word permute (pshufd + blend) or a
+  // single-source byte permute (pshufb).
+  uint8_t selects[16];
+  if (!ExpandPermuteControl(i, selects)) {
+    return;
+  }
+  auto src2 = i->src2.value;
+  auto src3 = i->src3.value;
+  if (src2 == src3) {
+    for (int n = 0; n < 16; n++) {
+      selects[n] &= 0xF;
+    }
+  }
+  bool uses_src2 = false;
+  bool uses_src3 = false;
+  for (int n = 0; n < 16; n++) {
+    if (selects[n] < 16) {
+      uses_src2 = true;
+    } else {
+      uses_src3 = true;
+    }
+  }
+
+  if ((!uses_src2 || src2->IsConstant()) &&
+      (!uses_src3 || src3->IsConstant())) {
+    vec128_t result;
+    for (int n = 0; n < 16; n++) {
+      uint8_t s = selects[n];
+      auto& src = s < 16 ? src2->constant.v128 : src3->constant.v128;
+      result.u8[n ^ 0x3] = src.u8[(s & 0xF) ^ 0x3];
+    }
+    i->dest->set_constant(result);
+    i->Remove();
+    return;
+  }
+
+  uint8_t words[4];
+  bool is_word_aligned = GetPermuteWordSelects(selects, words);
+  if (!uses_src2 || !uses_src3) {
+    auto src = uses_src2 ? src2 : src3;
+    if (is_word_aligned) {
+      uint32_t swizzle_mask =
+          SWIZZLE_MASK(words[0], words[1], words[2], words[3]);
+      if (swizzle_mask == SWIZZLE_XYZW_TO_XYZW) {
+        i->Replace(&OPCODE_ASSIGN_info, 0);
+        i->set_src1(src);
+      } else {
+        i->Replace(&OPCODE_SWIZZLE_info, INT32_TYPE);
+        i->set_src1(src);
+        i->src2.offset = swizzle_mask;
+      }
+      return;
+    }
+    if (i->flags == INT8_TYPE && src == src2 && src3->IsConstantZero()) {
+      // Already a shuffle against zero.
+      return;
+    }
+    vec128_t control;
+    for (int n = 0; n < 16; n++) {
+      control.u8[n ^ 0x3] = selects[n] & 0xF;
+    }
+    i->flags = INT8_TYPE;
+    i->set_src1(builder->LoadConstantVec128(control));
+    i->set_src2(src);
+    i->set_src3(builder->LoadZeroVec128());
+    return;
+  }
+
+  if (is_word_aligned) {
+    if (i->flags != INT32_TYPE) {
+      uint32_t control = 0;
+      for (int n = 0; n < 4; n++) {
+        control |= uint32_t(words[n]) << (n * 8);
+      }
+      i->flags = INT32_TYPE;
+      i->set_src1(builder->LoadConstantUint32(control));
+    }
+  } else if (i->flags == INT16_TYPE) {
+    // There's no native word permute, but a byte permute does the same.
+    vec128_t control;
+    for (int n = 0; n < 16; n++) {
+      control.u8[n ^ 0x3] = selects[n];
+    }
+    i->flags = INT8_TYPE;
+    i->set_src1(builder->LoadConstantVec128(control));
+  }
+}
+
 }  // namespace passes
 }  // namespace compiler
 }  // namespace cpu
@@ -23,8 +23,10 @@ class ConstantPropagationPass : public CompilerPass {
   ~ConstantPropagationPass() override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "constant_propagation"; }
 
  private:
+  void PropagatePermute(hir::HIRBuilder* builder, hir::Instr* i);
 };
 
 }  // namespace passes
@@ -11,7 +11,10 @@
 
 #include <gflags/gflags.h>
 
+#include <algorithm>
+
 #include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/compiler/passes/register_allocation_pass.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/profiling.h"
 
@@ -28,11 +31,13 @@ using namespace xe::cpu::hir;
 
 using xe::cpu::frontend::ContextInfo;
 using xe::cpu::hir::Block;
+using xe::cpu::hir::Edge;
 using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::Instr;
 using xe::cpu::hir::Value;
 
-ContextPromotionPass::ContextPromotionPass() : CompilerPass() {}
+ContextPromotionPass::ContextPromotionPass()
+    : CompilerPass(), forward_across_blocks_(false) {}
 
 ContextPromotionPass::~ContextPromotionPass() {}
 
@@ -45,6 +50,7 @@ bool ContextPromotionPass::Initialize(Compiler* compiler) {
   ContextInfo* context_info = processor_->frontend()->context_info();
   context_values_.resize(context_info->size());
   context_validity_.resize(static_cast<uint32_t>(context_info->size()));
+  context_match_.resize(static_cast<uint32_t>(context_info->size()));
 
   return true;
 }
@@ -64,40 +70,126 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   //   store_context +100, v1
   // This is more generally done by DSE, however if it could be done here
   // instead as it may be faster (at least on the block-level).
+  //
+  // Both work over the CFG from ControlFlowAnalysisPass, plus fall-through
+  // into the next block, which it doesn't include. Loads are forwarded into a
+  // block when all of its predecessors have been visited and agree on the
+  // value, which means the value dominates the block. Stores are removed if
+  // every path from them overwrites the offset before it can be read.
+
+  uint32_t block_ordinal = 0;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    block->ordinal = block_ordinal++;
+  }
 
   // Promote loads to values.
-  // Process each block independently, for now.
-  auto block = builder->first_block();
-  while (block) {
+  // Values only stay in registers across blocks with the global allocator, so
+  // blocks are processed independently otherwise.
+  forward_across_blocks_ = FLAGS_global_register_allocation;
+  block_values_.resize(block_ordinal);
+  block_reached_.assign(block_ordinal, false);
+  for (auto block = builder->first_block(); block; block = block->next) {
+    if (forward_across_blocks_) {
+      LoadIncomingValues(block);
+    } else {
+      context_validity_.reset();
+    }
     PromoteBlock(block);
-    block = block->next;
   }
 
   // Remove all dead stores.
   if (!FLAGS_store_all_context_values) {
-    block = builder->first_block();
-    while (block) {
-      RemoveDeadStoresBlock(block);
-      block = block->next;
-    }
+    RemoveDeadStores(builder);
   }
 
   return true;
 }
 
-void ContextPromotionPass::PromoteBlock(Block* block) {
+namespace {
+
+// Conditional branches are flagged volatile but leave the context alone.
+bool IsContextBarrier(const Instr* i) {
+  return (i->opcode->flags & OPCODE_FLAG_VOLATILE) &&
+         i->opcode != &OPCODE_BRANCH_TRUE_info &&
+         i->opcode != &OPCODE_BRANCH_FALSE_info;
+}
+
+bool FallsThrough(const Block* block) {
+  auto tail = block->instr_tail;
+  return !tail || (tail->opcode != &OPCODE_BRANCH_info &&
+                   tail->opcode != &OPCODE_RETURN_info);
+}
+
+}  // namespace
+
+void ContextPromotionPass::LoadIncomingValues(Block* block) {
   auto& validity = context_validity_;
   validity.reset();
 
+  // Blocks are visited in order, so any predecessor not seen yet is a back
+  // edge and there is nothing we can assume (without phis) on entry.
+  for (auto e = block->incoming_edge_head; e; e = e->incoming_next) {
+    if (e->src->ordinal >= block->ordinal) {
+      return;
+    }
+  }
+  if (!block_reached_[block->ordinal]) {
+    return;
+  }
+
+  for (auto& entry : block_values_[block->ordinal]) {
+    context_values_[entry.first] = entry.second;
+    validity.set(entry.first);
+  }
+}
+
+void ContextPromotionPass::MergeOutgoingValues(Block* block, Block* target) {
+  if (target->ordinal <= block->ordinal) {
+    // Back edge, already ruled out when the target was visited.
+    return;
+  }
+  auto& validity = context_validity_;
+  auto& values = block_values_[target->ordinal];
+  if (!block_reached_[target->ordinal]) {
+    block_reached_[target->ordinal] = true;
+    values.clear();
+    for (int offset = validity.find_first(); offset != -1;
+         offset = validity.find_next(offset)) {
+      values.emplace_back(offset, context_values_[offset]);
+    }
+    return;
+  }
+  // Keep only what this path agrees on.
+  values.erase(std::remove_if(values.begin(), values.end(),
+                              [&](const std::pair<uint32_t, Value*>& entry) {
+                                return !validity.test(entry.first) ||
+                                       context_values_[entry.first] !=
+                                           entry.second;
+                              }),
+               values.end());
+}
+
+void ContextPromotionPass::PromoteBlock(Block* block) {
+  auto& validity = context_validity_;
+
   Instr* i = block->instr_head;
   while (i) {
     auto next = i->next;
-    if (i->opcode->flags & OPCODE_FLAG_VOLATILE) {
+    if (forward_across_blocks_) {
+      if (i->opcode == &OPCODE_BRANCH_info) {
+        MergeOutgoingValues(block, i->src1.label->block);
+      } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+                 i->opcode == &OPCODE_BRANCH_FALSE_info) {
+        MergeOutgoingValues(block, i->src2.label->block);
+      }
+    }
+    if (IsContextBarrier(i)) {
       // Volatile instruction - requires all context values be flushed.
       validity.reset();
     } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
       size_t offset = i->src1.offset;
-      if (validity.test(static_cast<uint32_t>(offset))) {
+      if (validity.test(static_cast<uint32_t>(offset)) &&
+          context_values_[offset]->type == i->dest->type) {
         // Legit previous value, reuse.
         Value* previous_value = context_values_[offset];
         i->opcode = &hir::OPCODE_ASSIGN_info;
@@ -116,26 +208,63 @@ void ContextPromotionPass::PromoteBlock(Block* block) {
     }
     i = next;
   }
+  if (forward_across_blocks_ && block->next && FallsThrough(block)) {
+    MergeOutgoingValues(block, block->next);
+  }
+}
+
+void ContextPromotionPass::RemoveDeadStores(HIRBuilder* builder) {
+  // Solve for the offsets killed at the start of each block, starting from
+  // everything and iterating down to a fixed point, then remove the stores.
+  block_killed_.resize(block_values_.size());
+  for (auto& killed : block_killed_) {
+    killed.resize(context_validity_.size());
+    killed.set();
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto block = builder->last_block(); block; block = block->prev) {
+      RemoveDeadStoresBlock(block, false);
+      auto& killed = block_killed_[block->ordinal];
+      if (killed != context_validity_) {
+        killed = context_validity_;
+        changed = true;
+      }
+    }
+  }
+  for (auto block = builder->first_block(); block; block = block->next) {
+    RemoveDeadStoresBlock(block, true);
+  }
 }
 
-void ContextPromotionPass::RemoveDeadStoresBlock(Block* block) {
+void ContextPromotionPass::RemoveDeadStoresBlock(Block* block, bool remove) {
   auto& validity = context_validity_;
   validity.reset();
 
   // Walk backwards and mark offsets that are written to.
-  // If the offset was written to earlier, ignore the store.
+  // If the offset was written to later, ignore the store. Branches pick up
+  // whatever is written on all paths from their target.
   Instr* i = block->instr_tail;
   while (i) {
     Instr* prev = i->prev;
-    if (i->opcode->flags & (OPCODE_FLAG_VOLATILE | OPCODE_FLAG_BRANCH)) {
+    if (i->opcode == &OPCODE_BRANCH_info) {
+      validity = block_killed_[i->src1.label->block->ordinal];
+    } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+               i->opcode == &OPCODE_BRANCH_FALSE_info) {
+      validity &= block_killed_[i->src2.label->block->ordinal];
+    } else if (i->opcode->flags & (OPCODE_FLAG_VOLATILE | OPCODE_FLAG_BRANCH)) {
       // Volatile instruction - requires all context values be flushed.
       validity.reset();
+    } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+      // Loads that couldn't be promoted keep earlier stores alive.
+      validity.reset(static_cast<uint32_t>(i->src1.offset));
     } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
       size_t offset = i->src1.offset;
       if (!validity.test(static_cast<uint32_t>(offset))) {
         // Offset not yet written, mark and continue.
         validity.set(static_cast<uint32_t>(offset));
-      } else {
+      } else if (remove) {
         // Already written to. Remove this store.
         i->Remove();
       }
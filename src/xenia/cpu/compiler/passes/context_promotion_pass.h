@@ -10,6 +10,9 @@
 #ifndef XENIA_COMPILER_PASSES_CONTEXT_PROMOTION_PASS_H_
 #define XENIA_COMPILER_PASSES_CONTEXT_PROMOTION_PASS_H_
 
+#include <utility>
+#include <vector>
+
 #include "xenia/base/platform.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
 
@@ -37,14 +40,29 @@ class ContextPromotionPass : public CompilerPass {
   bool Initialize(Compiler* compiler) override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "context_promotion"; }
 
  private:
+  void LoadIncomingValues(hir::Block* block);
+  void MergeOutgoingValues(hir::Block* block, hir::Block* target);
   void PromoteBlock(hir::Block* block);
-  void RemoveDeadStoresBlock(hir::Block* block);
+  void RemoveDeadStores(hir::HIRBuilder* builder);
+  void RemoveDeadStoresBlock(hir::Block* block, bool remove);
 
  private:
   std::vector<hir::Value*> context_values_;
   llvm::BitVector context_validity_;
+  llvm::BitVector context_match_;
+  bool forward_across_blocks_;
+  // Context values every predecessor visited so far agrees on at the start of
+  // each block, by block ordinal. Taken at each branch and fall-through into
+  // the block rather than at the end of its predecessors, as branches can be
+  // anywhere in a block once blocks have been merged.
+  std::vector<std::vector<std::pair<uint32_t, hir::Value*>>> block_values_;
+  std::vector<bool> block_reached_;
+  // Offsets stored to before being read on every path from the start of each
+  // block, by block ordinal.
+  std::vector<llvm::BitVector> block_killed_;
 };
 
 }  // namespace passes
@@ -41,12 +41,13 @@ bool ControlFlowAnalysisPass::Run(HIRBuilder* builder) {
   }
 
   // Add edges.
+  // Branches may be anywhere in a block once blocks have been merged, not
+  // just at its tail.
   block = builder->first_block();
   while (block) {
-    auto instr = block->instr_tail;
-    while (instr) {
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
       if ((instr->opcode->flags & OPCODE_FLAG_BRANCH) == 0) {
-        break;
+        continue;
       }
       if (instr->opcode == &OPCODE_BRANCH_info) {
         auto label = instr->src1.label;
@@ -56,7 +57,6 @@ bool ControlFlowAnalysisPass::Run(HIRBuilder* builder) {
         auto label = instr->src2.label;
         builder->AddEdge(block, label->block, 0);
       }
-      instr = instr->prev;
     }
     block = block->next;
   }
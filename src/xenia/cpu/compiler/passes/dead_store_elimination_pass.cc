@@ -0,0 +1,160 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/dead_store_elimination_pass.h"
+
+#include "xenia/cpu/processor.h"
+#include "xenia/memory.h"
+#include "xenia/profiling.h"
+
+DEFINE_bool(eliminate_dead_guest_stores, false,
+            "Remove guest memory stores that are overwritten before they can "
+            "be read.");
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+DeadStoreEliminationPass::DeadStoreEliminationPass(
+    uint32_t stack_pointer_offset)
+    : CompilerPass(), stack_pointer_offset_(stack_pointer_offset) {}
+
+DeadStoreEliminationPass::~DeadStoreEliminationPass() {}
+
+bool DeadStoreEliminationPass::Access::MayAlias(const Access& other) const {
+  if (root != other.root) {
+    // Nothing is known about how different roots relate.
+    return true;
+  }
+  return offset < other.offset + other.size && other.offset < offset + size;
+}
+
+bool DeadStoreEliminationPass::Access::Covers(const Access& other) const {
+  return root == other.root && offset <= other.offset &&
+         other.offset + other.size <= offset + size;
+}
+
+bool DeadStoreEliminationPass::Run(HIRBuilder* builder) {
+  // Walks each block backwards tracking the bytes stored to later on:
+  //   store v0+10, v1.i32  <-- removed, fully overwritten below
+  //   store v0+8, v2.i64
+  // Loads that may alias drop what they read from the set, and anything that
+  // could observe memory (calls, atomics, MMIO, branches, etc) clears it.
+  // stwcx is a single compare_exchange rather than a store, and as it is
+  // volatile it also clears the set, so it is never removed or looked past.
+  auto block = builder->first_block();
+  while (block) {
+    RemoveDeadStoresBlock(block);
+    block = block->next;
+  }
+  return true;
+}
+
+DeadStoreEliminationPass::Access DeadStoreEliminationPass::DecomposeAddress(
+    Value* address, TypeName type) {
+  Access access;
+  access.root = address;
+  access.offset = 0;
+  access.size = GetTypeSize(type);
+  while (true) {
+    if (access.root->IsConstant()) {
+      access.offset += access.root->constant.i64;
+      access.root = nullptr;
+      break;
+    }
+    auto def = access.root->def;
+    if (!def) {
+      break;
+    }
+    if (def->opcode == &OPCODE_ASSIGN_info) {
+      access.root = def->src1.value;
+    } else if (def->opcode == &OPCODE_ADD_info &&
+               def->src2.value->IsConstant()) {
+      access.offset += def->src2.value->constant.i64;
+      access.root = def->src1.value;
+    } else if (def->opcode == &OPCODE_ADD_info &&
+               def->src1.value->IsConstant()) {
+      access.offset += def->src1.value->constant.i64;
+      access.root = def->src2.value;
+    } else if (def->opcode == &OPCODE_SUB_info &&
+               def->src2.value->IsConstant()) {
+      access.offset -= def->src2.value->constant.i64;
+      access.root = def->src1.value;
+    } else {
+      break;
+    }
+  }
+  return access;
+}
+
+bool DeadStoreEliminationPass::IsRemovable(const Access& access) {
+  if (!access.root) {
+    // Constant MMIO addresses have already become store_mmio, but be sure.
+    return !processor_->memory()->LookupVirtualMappedRange(
+        static_cast<uint32_t>(access.offset));
+  }
+  auto def = access.root->def;
+  return def && def->opcode == &OPCODE_LOAD_CONTEXT_info &&
+         def->src1.offset == stack_pointer_offset_;
+}
+
+void DeadStoreEliminationPass::RemoveDeadStoresBlock(Block* block) {
+  auto& overwritten = overwritten_;
+  overwritten.clear();
+
+  Instr* i = block->instr_tail;
+  while (i) {
+    Instr* prev = i->prev;
+    if (i->opcode == &OPCODE_STORE_info) {
+      auto access = DecomposeAddress(i->src1.value, i->src2.value->type);
+      bool is_dead = false;
+      for (auto& later : overwritten) {
+        if (later.Covers(access)) {
+          is_dead = true;
+          break;
+        }
+      }
+      if (is_dead && IsRemovable(access)) {
+        i->Remove();
+      } else {
+        overwritten.push_back(access);
+      }
+    } else if (i->opcode == &OPCODE_LOAD_info) {
+      auto access = DecomposeAddress(i->src1.value, i->dest->type);
+      for (size_t n = 0; n < overwritten.size();) {
+        if (overwritten[n].MayAlias(access)) {
+          overwritten[n] = overwritten.back();
+          overwritten.pop_back();
+        } else {
+          ++n;
+        }
+      }
+    } else if (i->opcode->flags & (OPCODE_FLAG_VOLATILE | OPCODE_FLAG_BRANCH |
+                                   OPCODE_FLAG_MEMORY) ||
+               i->opcode == &OPCODE_MEMSET_info) {
+      // Anything else touching memory, or leaving the block.
+      overwritten.clear();
+    }
+    i = prev;
+  }
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,63 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
+#define XENIA_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
+
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+DECLARE_bool(eliminate_dead_guest_stores);
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Removes guest memory stores that are overwritten before anything could
+// observe them. Only stores relative to the guest stack pointer (found by the
+// context offset it is loaded from) or to constant non-MMIO addresses are
+// removed, as anything else may be device memory.
+class DeadStoreEliminationPass : public CompilerPass {
+ public:
+  explicit DeadStoreEliminationPass(uint32_t stack_pointer_offset);
+  ~DeadStoreEliminationPass() override;
+
+  bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "dead_store_elimination"; }
+
+ private:
+  // Address split into an SSA root value (or null for constant addresses)
+  // and a constant byte offset from it.
+  struct Access {
+    hir::Value* root;
+    int64_t offset;
+    int64_t size;
+    bool MayAlias(const Access& other) const;
+    bool Covers(const Access& other) const;
+  };
+
+  Access DecomposeAddress(hir::Value* address, hir::TypeName type);
+  bool IsRemovable(const Access& access);
+  void RemoveDeadStoresBlock(hir::Block* block);
+
+  uint32_t stack_pointer_offset_;
+  // Accesses overwritten later in the block, walking backwards.
+  std::vector<Access> overwritten_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
@@ -23,6 +23,7 @@ class FinalizationPass : public CompilerPass {
   ~FinalizationPass() override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "finalization"; }
 
  private:
 };
@@ -15,8 +15,25 @@
 #include "xenia/base/assert.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/platform.h"
 #include "xenia/profiling.h"
 
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
+DEFINE_bool(global_register_allocation, true,
+            "Allocate registers over whole functions with a linear scan, "
+            "keeping values in registers across blocks.");
+DEFINE_bool(trace_register_allocation, false,
+            "Log the spills and reloads inserted for each function.");
+
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -26,6 +43,7 @@ namespace passes {
 using namespace xe::cpu::hir;
 
 using xe::cpu::backend::MachineInfo;
+using xe::cpu::hir::Block;
 using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::Instr;
 using xe::cpu::hir::OpcodeSignatureType;
@@ -71,6 +89,15 @@ RegisterAllocationPass::~RegisterAllocationPass() {
 }
 
 bool RegisterAllocationPass::Run(HIRBuilder* builder) {
+  spill_count_ = 0;
+  reload_count_ = 0;
+  if (FLAGS_global_register_allocation) {
+    return RunLinearScan(builder);
+  }
+  return RunBlockLocal(builder);
+}
+
+bool RegisterAllocationPass::RunBlockLocal(HIRBuilder* builder) {
   // Simple per-block allocator that operates on SSA form.
   // Registers do not move across blocks, though this could be
   // optimized with some intra-block analysis (dominators/etc).
@@ -377,6 +404,7 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
     // Add store.
     builder->StoreLocal(spill_value->local_slot, spill_value);
     auto spill_store = builder->last_instr();
+    ++spill_count_;
     auto spill_store_use = spill_store->src2_use;
     assert_null(spill_store_use->prev);
     if (prev_use && prev_use->instr->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
@@ -419,6 +447,7 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
   auto new_value = builder->LoadLocal(spill_value->local_slot);
   auto spill_load = builder->last_instr();
   spill_load->MoveBefore(next_use->instr);
+  ++reload_count_;
 // Note: implicit first use added.
 
 #if ASSERT_NO_CYCLES
@@ -470,6 +499,388 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
   return true;
 }
 
+namespace {
+
+// Allocation gives up rather than spinning forever if spilling somehow keeps
+// producing more pressure.
+const uint32_t kMaxLinearScanIterations = 16;
+
+bool IsAllocatedValue(const Value* value) {
+  return value->def && !value->IsConstant();
+}
+
+template <typename F>
+void ForEachAllocatedSource(Instr* instr, F fn) {
+  uint32_t signature = instr->opcode->signature;
+  if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+      IsAllocatedValue(instr->src1.value)) {
+    fn(instr->src1.value);
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V &&
+      IsAllocatedValue(instr->src2.value)) {
+    fn(instr->src2.value);
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V &&
+      IsAllocatedValue(instr->src3.value)) {
+    fn(instr->src3.value);
+  }
+}
+
+// Guest calls run generated code that uses the same registers without saving
+// them, and externs may call back into guest code.
+bool ClobbersRegisters(const Instr* instr) {
+  auto opcode = instr->opcode;
+  return opcode == &OPCODE_CALL_info || opcode == &OPCODE_CALL_TRUE_info ||
+         opcode == &OPCODE_CALL_INDIRECT_info ||
+         opcode == &OPCODE_CALL_INDIRECT_TRUE_info ||
+         opcode == &OPCODE_CALL_EXTERN_info;
+}
+
+// Unlike the CFG built by ControlFlowAnalysisPass this includes fall-through
+// edges, which liveness needs.
+void GetSuccessors(Block* block, std::vector<uint16_t>* out_successors) {
+  for (auto instr = block->instr_head; instr; instr = instr->next) {
+    if (instr->opcode == &OPCODE_BRANCH_info) {
+      out_successors->push_back(instr->src1.label->block->ordinal);
+    } else if (instr->opcode == &OPCODE_BRANCH_TRUE_info ||
+               instr->opcode == &OPCODE_BRANCH_FALSE_info) {
+      out_successors->push_back(instr->src2.label->block->ordinal);
+    }
+  }
+  auto tail = block->instr_tail;
+  bool falls_through = !tail || (tail->opcode != &OPCODE_BRANCH_info &&
+                                 tail->opcode != &OPCODE_RETURN_info);
+  if (falls_through && block->next) {
+    out_successors->push_back(block->next->ordinal);
+  }
+}
+
+}  // namespace
+
+bool RegisterAllocationPass::RunLinearScan(HIRBuilder* builder) {
+  // Whole-function linear scan over SSA values.
+  // Blocks are laid out in order and instruction n reads its sources at
+  // position 2n and writes its dest at 2n+1, so a dest can take the register
+  // of a source that dies at the same instruction. Intervals run from the
+  // first position a value is live to the last, holes included.
+  // Values live across a call, or that don't fit when we run out of
+  // registers, are spilled to locals. That rewrites the HIR, so everything is
+  // recomputed until all intervals fit.
+  spill_temps_.clear();
+  for (uint32_t iteration = 0; iteration < kMaxLinearScanIterations;
+       ++iteration) {
+    // Number blocks and instructions.
+    std::vector<Block*> blocks;
+    std::vector<uint32_t> block_begin;
+    std::vector<uint32_t> block_end;
+    std::vector<uint32_t> clobbers;
+    uint32_t block_ordinal = 0;
+    uint32_t instr_ordinal = 0;
+    for (auto block = builder->first_block(); block; block = block->next) {
+      block->ordinal = block_ordinal++;
+      blocks.push_back(block);
+      block_begin.push_back(instr_ordinal * 2);
+      for (auto instr = block->instr_head; instr; instr = instr->next) {
+        if (ClobbersRegisters(instr)) {
+          clobbers.push_back(instr_ordinal * 2);
+        }
+        instr->ordinal = instr_ordinal++;
+      }
+      block_end.push_back(instr_ordinal * 2);
+    }
+
+    // Local use/def sets, then iterate liveness to a fixed point. Back edges
+    // are included so values carried around loops stay live throughout.
+    unsigned value_count = builder->max_value_ordinal();
+    size_t block_count = blocks.size();
+    std::vector<llvm::BitVector> uses(block_count,
+                                      llvm::BitVector(value_count));
+    std::vector<llvm::BitVector> defs(block_count,
+                                      llvm::BitVector(value_count));
+    std::vector<llvm::BitVector> live_in(block_count,
+                                         llvm::BitVector(value_count));
+    std::vector<llvm::BitVector> live_out(block_count,
+                                          llvm::BitVector(value_count));
+    std::vector<std::vector<uint16_t>> successors(block_count);
+    for (size_t n = 0; n < block_count; ++n) {
+      auto& block_uses = uses[n];
+      auto& block_defs = defs[n];
+      for (auto instr = blocks[n]->instr_head; instr; instr = instr->next) {
+        ForEachAllocatedSource(instr, [&](Value* value) {
+          if (!block_defs.test(value->ordinal)) {
+            block_uses.set(value->ordinal);
+          }
+        });
+        if (GET_OPCODE_SIG_TYPE_DEST(instr->opcode->signature) ==
+            OPCODE_SIG_TYPE_V) {
+          block_defs.set(instr->dest->ordinal);
+        }
+      }
+      GetSuccessors(blocks[n], &successors[n]);
+    }
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (size_t n = block_count; n-- > 0;) {
+        auto& out = live_out[n];
+        for (auto successor : successors[n]) {
+          out |= live_in[successor];
+        }
+        llvm::BitVector in(out);
+        in.reset(defs[n]);
+        in |= uses[n];
+        if (in != live_in[n]) {
+          live_in[n] = in;
+          changed = true;
+        }
+      }
+    }
+
+    // Build intervals from defs and uses, then stretch them over the blocks
+    // they are live into and out of. Block order need not follow dominance,
+    // so all intervals are created before any uses are added.
+    std::vector<LiveInterval> intervals;
+    std::vector<int32_t> interval_index(value_count, -1);
+    for (auto block : blocks) {
+      for (auto instr = block->instr_head; instr; instr = instr->next) {
+        if (GET_OPCODE_SIG_TYPE_DEST(instr->opcode->signature) !=
+            OPCODE_SIG_TYPE_V) {
+          continue;
+        }
+        auto value = instr->dest;
+        interval_index[value->ordinal] = int32_t(intervals.size());
+        LiveInterval interval;
+        interval.value = value;
+        interval.start = interval.end = instr->ordinal * 2 + 1;
+        interval.hint = -1;
+        interval.usage_set = RegisterSetForValue(value);
+        interval.reg.set = nullptr;
+        interval.reg.index = -1;
+        interval.is_spillable = !spill_temps_.count(value);
+        interval.crosses_call = false;
+        intervals.push_back(interval);
+      }
+    }
+    for (auto block : blocks) {
+      for (auto instr = block->instr_head; instr; instr = instr->next) {
+        uint32_t use_position = instr->ordinal * 2;
+        ForEachAllocatedSource(instr, [&](Value* value) {
+          auto index = interval_index[value->ordinal];
+          if (index != -1) {
+            auto& interval = intervals[index];
+            interval.start = std::min(interval.start, use_position);
+            interval.end = std::max(interval.end, use_position);
+          }
+        });
+        uint32_t signature = instr->opcode->signature;
+        if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V &&
+            GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+            IsAllocatedValue(instr->src1.value)) {
+          intervals[interval_index[instr->dest->ordinal]].hint =
+              interval_index[instr->src1.value->ordinal];
+        }
+      }
+    }
+    for (size_t n = 0; n < block_count; ++n) {
+      for (int i = live_in[n].find_first(); i != -1;
+           i = live_in[n].find_next(i)) {
+        if (interval_index[i] == -1) {
+          continue;
+        }
+        auto& interval = intervals[interval_index[i]];
+        interval.start = std::min(interval.start, block_begin[n]);
+        interval.end = std::max(interval.end, block_begin[n]);
+      }
+      uint32_t last_position = std::max(block_end[n], block_begin[n] + 1) - 1;
+      for (int i = live_out[n].find_first(); i != -1;
+           i = live_out[n].find_next(i)) {
+        if (interval_index[i] == -1) {
+          continue;
+        }
+        auto& interval = intervals[interval_index[i]];
+        interval.end = std::max(interval.end, last_position);
+      }
+    }
+
+    std::vector<LiveInterval*> order;
+    order.reserve(intervals.size());
+    for (auto& interval : intervals) {
+      // Live across a call if one sits strictly inside the interval.
+      auto it = std::upper_bound(clobbers.begin(), clobbers.end(),
+                                 interval.start);
+      interval.crosses_call = it != clobbers.end() && *it < interval.end;
+      order.push_back(&interval);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const LiveInterval* a, const LiveInterval* b) {
+                       return a->start < b->start;
+                     });
+
+    // Scan.
+    for (auto usage_set : usage_sets_.all_sets) {
+      if (usage_set) {
+        usage_set->availability.set();
+      }
+    }
+    std::vector<LiveInterval*> active;
+    std::vector<Value*> spills;
+    for (auto interval : order) {
+      for (size_t i = 0; i < active.size();) {
+        if (active[i]->end < interval->start) {
+          active[i]->usage_set->availability.set(active[i]->reg.index, true);
+          active[i] = active.back();
+          active.pop_back();
+        } else {
+          ++i;
+        }
+      }
+      if (interval->crosses_call) {
+        if (!interval->is_spillable) {
+          XELOGE("Register allocation failed: spill temp live across call");
+          assert_always();
+          return false;
+        }
+        spills.push_back(interval->value);
+        continue;
+      }
+
+      auto usage_set = interval->usage_set;
+      int32_t reg_index = -1;
+      if (interval->hint != -1) {
+        // Try to reuse the register of a dying src1 to help along the X86 two
+        // operand instructions.
+        auto& hint = intervals[interval->hint];
+        if (hint.usage_set == usage_set && hint.reg.set &&
+            hint.end == interval->start - 1 &&
+            usage_set->availability.test(hint.reg.index)) {
+          reg_index = hint.reg.index;
+        }
+      }
+      uint32_t first_unused = 0;
+      if (reg_index == -1 &&
+          xe::bit_scan_forward(
+              static_cast<uint32_t>(usage_set->availability.to_ulong()),
+              &first_unused) &&
+          first_unused < usage_set->count) {
+        reg_index = int32_t(first_unused);
+      }
+      if (reg_index == -1) {
+        // Out of registers. Spill whichever interval ends furthest away.
+        LiveInterval* victim = interval->is_spillable ? interval : nullptr;
+        size_t victim_slot = 0;
+        for (size_t i = 0; i < active.size(); ++i) {
+          auto candidate = active[i];
+          if (candidate->usage_set == usage_set && candidate->is_spillable &&
+              (!victim || candidate->end > victim->end)) {
+            victim = candidate;
+            victim_slot = i;
+          }
+        }
+        if (!victim) {
+          XELOGE("Unable to spill any registers");
+          assert_always();
+          return false;
+        }
+        spills.push_back(victim->value);
+        if (victim == interval) {
+          continue;
+        }
+        reg_index = victim->reg.index;
+        victim->reg.set = nullptr;
+        active[victim_slot] = active.back();
+        active.pop_back();
+      }
+      interval->reg.set = usage_set->set;
+      interval->reg.index = reg_index;
+      usage_set->availability.set(reg_index, false);
+      active.push_back(interval);
+    }
+
+    if (!spills.empty()) {
+      for (auto value : spills) {
+        SpillValue(builder, value);
+      }
+      continue;
+    }
+
+    for (auto& interval : intervals) {
+      interval.value->reg = interval.reg;
+      SortUsageList(interval.value);
+    }
+    return true;
+  }
+
+  XELOGE("Register allocation did not converge");
+  assert_always();
+  return false;
+}
+
+void RegisterAllocationPass::SpillValue(HIRBuilder* builder, Value* value) {
+  auto slot = builder->AllocLocal(value->type);
+  value->local_slot = slot;
+
+  // Gather users up front as rewriting them edits the use list.
+  std::vector<Instr*> users;
+  for (auto use = value->use_head; use; use = use->next) {
+    if (std::find(users.begin(), users.end(), use->instr) == users.end()) {
+      users.push_back(use->instr);
+    }
+  }
+
+  // Store right after the define, keeping paired instructions together.
+  auto def = value->def;
+  builder->StoreLocal(slot, value);
+  auto store = builder->last_instr();
+  auto insert_point = def->next;
+  while (insert_point &&
+         insert_point->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
+    insert_point = insert_point->next;
+  }
+  if (insert_point) {
+    store->MoveBefore(insert_point);
+  } else {
+    // Defined by the last instruction in its block; swap the two around.
+    store->MoveBefore(def);
+    def->MoveBefore(store);
+  }
+  ++spill_count_;
+  spill_temps_.insert(value);
+
+  // Reload before every user. Paired instructions reload before the head of
+  // the pair, and those reading the head itself are left alone.
+  for (auto user : users) {
+    auto load_point = user;
+    bool reads_pair_head = false;
+    while (load_point->opcode->flags & OPCODE_FLAG_PAIRED_PREV &&
+           load_point->prev) {
+      load_point = load_point->prev;
+      reads_pair_head |= load_point == def;
+    }
+    if (reads_pair_head) {
+      continue;
+    }
+    auto new_value = builder->LoadLocal(slot);
+    builder->last_instr()->MoveBefore(load_point);
+    new_value->local_slot = slot;
+    spill_temps_.insert(new_value);
+    ++reload_count_;
+
+    uint32_t signature = user->opcode->signature;
+    if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+        user->src1.value == value) {
+      user->set_src1(new_value);
+    }
+    if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V &&
+        user->src2.value == value) {
+      user->set_src2(new_value);
+    }
+    if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V &&
+        user->src3.value == value) {
+      user->set_src3(new_value);
+    }
+  }
+}
+
 RegisterAllocationPass::RegisterSetUsage*
 RegisterAllocationPass::RegisterSetForValue(const Value* value) {
   if (value->type <= INT64_TYPE) {
@@ -12,11 +12,17 @@
 
 #include <algorithm>
 #include <bitset>
+#include <unordered_set>
 #include <vector>
 
+#include <gflags/gflags.h>
+
 #include "xenia/cpu/backend/machine_info.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
 
+DECLARE_bool(global_register_allocation);
+DECLARE_bool(trace_register_allocation);
+
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -28,6 +34,11 @@ class RegisterAllocationPass : public CompilerPass {
   ~RegisterAllocationPass() override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "register_allocation"; }
+
+  // Spill stores and reloads inserted by the last run.
+  uint32_t spill_count() const { return spill_count_; }
+  uint32_t reload_count() const { return reload_count_; }
 
  private:
   // TODO(benvanik): rewrite all this set shit -- too much indirection, the
@@ -51,6 +62,22 @@ class RegisterAllocationPass : public CompilerPass {
     // TODO(benvanik): another data type.
     std::vector<RegisterUsage> upcoming_uses;
   };
+  // Live range of a value over the linearized function, see RunLinearScan.
+  struct LiveInterval {
+    hir::Value* value;
+    uint32_t start;
+    uint32_t end;
+    // Interval of a src1 that dies where this one starts, or -1.
+    int32_t hint;
+    RegisterSetUsage* usage_set;
+    hir::RegAssignment reg;
+    bool is_spillable;
+    bool crosses_call;
+  };
+
+  bool RunBlockLocal(hir::HIRBuilder* builder);
+  bool RunLinearScan(hir::HIRBuilder* builder);
+  void SpillValue(hir::HIRBuilder* builder, hir::Value* value);
 
   void DumpUsage(const char* name);
   void PrepareBlockState();
@@ -77,6 +104,12 @@ class RegisterAllocationPass : public CompilerPass {
     RegisterSetUsage* vec_set = nullptr;
     RegisterSetUsage* all_sets[3];
   } usage_sets_;
+
+  uint32_t spill_count_ = 0;
+  uint32_t reload_count_ = 0;
+  // Values introduced or already rewritten by SpillValue. These only live for
+  // an instruction or two and are never spilled again.
+  std::unordered_set<const hir::Value*> spill_temps_;
 };
 
 }  // namespace passes
@@ -23,6 +23,7 @@ class SimplificationPass : public CompilerPass {
   ~SimplificationPass() override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "simplification"; }
 
  private:
   void EliminateConversions(hir::HIRBuilder* builder);
@@ -26,6 +26,26 @@ DECLARE_bool(trace_function_data);
 
 DECLARE_bool(validate_hir);
 
+DECLARE_int32(precompile_threads);
+DECLARE_int32(precompile_depth);
+
+DECLARE_bool(tiered_compilation);
+DECLARE_int32(tier_up_threshold);
+DECLARE_bool(baseline_interpreter);
+DECLARE_bool(hot_cold_layout);
+
+DECLARE_bool(invalidate_code_on_write);
+
+DECLARE_bool(inline_save_restore);
+DECLARE_int32(inline_max_instructions);
+DECLARE_int32(inline_function_budget);
+
+DECLARE_bool(sampling_profiler);
+DECLARE_int32(sampling_profiler_interval_ms);
+DECLARE_string(sampling_profiler_output);
+DECLARE_bool(block_counters);
+DECLARE_string(block_counters_output);
+
 DECLARE_uint64(break_on_instruction);
 DECLARE_int32(break_condition_gpr);
 DECLARE_uint64(break_condition_value);
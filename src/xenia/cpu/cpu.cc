@@ -9,7 +9,7 @@
 
 #include "xenia/cpu/cpu-private.h"
 
-DEFINE_string(cpu, "any", "CPU backend [any, x64].");
+DEFINE_string(cpu, "any", "CPU backend [any, x64, interp].");
 
 DEFINE_string(
     load_module_map, "",
@@ -39,6 +39,51 @@ DEFINE_bool(trace_function_data, false,
 DEFINE_bool(validate_hir, false,
             "Perform validation checks on the HIR during compilation.");
 
+DEFINE_int32(precompile_threads, 0,
+             "Number of background threads translating functions before they "
+             "are called. 0 to disable.");
+DEFINE_int32(precompile_depth, 2,
+             "How many calls deep to follow static call targets when "
+             "precompiling.");
+
+DEFINE_bool(tiered_compilation, false,
+            "Translate functions with a minimal pipeline first and recompile "
+            "them with full optimizations once they are hot.");
+DEFINE_int32(tier_up_threshold, 1000,
+             "Number of calls to a baseline function before it is recompiled.");
+DEFINE_bool(baseline_interpreter, false,
+            "With --tiered_compilation, interpret baseline functions instead "
+            "of generating code for them.");
+DEFINE_bool(hot_cold_layout, false,
+            "Profile baseline functions and move their rarely run blocks out "
+            "of the hot path when recompiling them.");
+
+DEFINE_bool(invalidate_code_on_write, false,
+            "Write-protect guest pages holding translated code and retranslate "
+            "their functions when the guest writes to them.");
+
+DEFINE_bool(inline_save_restore, true,
+            "Inline calls to the __savegprlr/__restgprlr/etc helpers.");
+DEFINE_int32(inline_max_instructions, 16,
+             "Largest leaf function inlined into its callers when optimizing. "
+             "0 to disable.");
+DEFINE_int32(inline_function_budget, 256,
+             "Total leaf function instructions inlined into any one function.");
+
+DEFINE_bool(sampling_profiler, false,
+            "Sample the guest code running on each thread from startup. Can be "
+            "toggled at runtime with F6.");
+DEFINE_int32(sampling_profiler_interval_ms, 1,
+             "Time between samples of each thread.");
+DEFINE_string(sampling_profiler_output, "xenia_profile",
+              "Path prefix of the reports (.txt and .folded for flame graphs) "
+              "written each time sampling stops.");
+DEFINE_bool(block_counters, false,
+            "Count executions of each guest block, without a debugger. Counts "
+            "are written on exit and with F7.");
+DEFINE_string(block_counters_output, "xenia_block_counts.txt",
+              "Path the block counts are written to.");
+
 // Breakpoints:
 DEFINE_uint64(break_on_instruction, 0,
               "int3 before the given guest address is executed.");
@@ -9,26 +9,70 @@
 
 #include "xenia/cpu/entry_table.h"
 
-#include "xenia/base/threading.h"
+#include <algorithm>
+
+#include "xenia/base/assert.h"
 #include "xenia/profiling.h"
 
 namespace xe {
 namespace cpu {
 
-EntryTable::EntryTable() = default;
+namespace {
+// Function addresses are word aligned and tend to be clustered, so spread
+// them out before masking.
+inline uint32_t HashAddress(uint32_t address) {
+  return (address >> 2) * 0x9E3779B1u;
+}
+}  // namespace
+
+EntryTable::Submap::Submap(uint32_t capacity)
+    : capacity_mask(capacity - 1), count(0), slots(new Slot[capacity]) {
+  for (uint32_t i = 0; i < capacity; ++i) {
+    slots[i].address.store(0, std::memory_order_relaxed);
+    slots[i].entry.store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+EntryTable::EntryTable() : submap_count_(0), max_interval_length_(0) {
+  for (size_t i = 0; i < kMaxSubmaps; ++i) {
+    submaps_[i].store(nullptr, std::memory_order_relaxed);
+  }
+  submaps_[0].store(new Submap(kFirstSubmapCapacity));
+  submap_count_.store(1);
+}
 
 EntryTable::~EntryTable() {
-  std::lock_guard<xe::mutex> guard(lock_);
-  for (auto it : map_) {
-    Entry* entry = it.second;
-    delete entry;
+  std::lock_guard<xe::mutex> guard(insert_lock_);
+  for (size_t i = 0; i < submap_count_; ++i) {
+    Submap* submap = submaps_[i];
+    for (uint32_t j = 0; j <= submap->capacity_mask; ++j) {
+      delete submap->slots[j].entry.load();
+    }
+    delete submap;
+  }
+}
+
+Entry* EntryTable::Find(uint32_t address) {
+  uint32_t hash = HashAddress(address);
+  size_t submap_count = submap_count_.load(std::memory_order_acquire);
+  for (size_t i = 0; i < submap_count; ++i) {
+    Submap* submap = submaps_[i].load(std::memory_order_acquire);
+    for (uint32_t index = hash & submap->capacity_mask;;
+         index = (index + 1) & submap->capacity_mask) {
+      auto& slot = submap->slots[index];
+      uint32_t slot_address = slot.address.load(std::memory_order_acquire);
+      if (slot_address == address) {
+        return slot.entry.load(std::memory_order_acquire);
+      } else if (!slot_address) {
+        break;
+      }
+    }
   }
+  return nullptr;
 }
 
 Entry* EntryTable::Get(uint32_t address) {
-  std::lock_guard<xe::mutex> guard(lock_);
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
+  Entry* entry = Find(address);
   if (entry) {
     // TODO(benvanik): wait if needed?
     if (entry->status != Entry::STATUS_READY) {
@@ -39,53 +83,162 @@ Entry* EntryTable::Get(uint32_t address) {
 }
 
 Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
-  // TODO(benvanik): replace with a map with wait-free for find.
-  // https://github.com/facebook/folly/blob/master/folly/AtomicHashMap.h
+  assert_not_zero(address);
 
-  lock_.lock();
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
-  Entry::Status status;
+  // Fast path: already exists.
+  Entry* entry = Find(address);
   if (entry) {
-    // If we aren't ready yet spin and wait.
-    if (entry->status == Entry::STATUS_COMPILING) {
-      // Still compiling, so spin.
-      do {
-        lock_.unlock();
-        // TODO(benvanik): sleep for less time?
-        xe::threading::Sleep(std::chrono::microseconds(10));
-        lock_.lock();
-      } while (entry->status == Entry::STATUS_COMPILING);
+    *out_entry = entry;
+    return Claim(entry);
+  }
+
+  {
+    std::lock_guard<xe::mutex> guard(insert_lock_);
+    entry = Find(address);
+    if (!entry) {
+      // Create and return for initialization.
+      entry = new Entry();
+      entry->address = address;
+      entry->end_address = 0;
+      entry->status = Entry::STATUS_COMPILING;
+      entry->function.store(nullptr, std::memory_order_relaxed);
+      Insert(entry);
+      *out_entry = entry;
+      return Entry::STATUS_NEW;
     }
-    status = entry->status;
-  } else {
-    // Create and return for initialization.
-    entry = new Entry();
-    entry->address = address;
-    entry->end_address = 0;
-    entry->status = Entry::STATUS_COMPILING;
-    entry->function = 0;
-    map_[address] = entry;
-    status = Entry::STATUS_NEW;
-  }
-  lock_.unlock();
+  }
+
+  // Added by another thread while we were waiting on the lock.
   *out_entry = entry;
+  return Claim(entry);
+}
+
+void EntryTable::Insert(Entry* entry) {
+  size_t submap_index = submap_count_ - 1;
+  Submap* submap = submaps_[submap_index];
+  if ((submap->count + 1) * 4 > (submap->capacity_mask + 1) * 3) {
+    assert_true(submap_index + 1 < kMaxSubmaps);
+    submap = new Submap((submap->capacity_mask + 1) * 2);
+    submaps_[submap_index + 1].store(submap, std::memory_order_release);
+    submap_count_.store(submap_index + 2, std::memory_order_release);
+  }
+  uint32_t index = HashAddress(entry->address) & submap->capacity_mask;
+  while (submap->slots[index].address.load(std::memory_order_relaxed)) {
+    index = (index + 1) & submap->capacity_mask;
+  }
+  // Publish the entry before the key so readers never see a null entry.
+  submap->slots[index].entry.store(entry, std::memory_order_release);
+  submap->slots[index].address.store(entry->address,
+                                     std::memory_order_release);
+  ++submap->count;
+}
+
+Entry::Status EntryTable::Wait(Entry* entry) {
+  Entry::Status status = entry->status.load(std::memory_order_acquire);
+  if (status != Entry::STATUS_COMPILING) {
+    return status;
+  }
+  SCOPE_profile_cpu_f("cpu");
+  auto& stripe = wait_stripe(entry->address);
+  std::unique_lock<std::mutex> lock(stripe.mutex);
+  while ((status = entry->status.load(std::memory_order_acquire)) ==
+         Entry::STATUS_COMPILING) {
+    stripe.cond.wait(lock);
+  }
   return status;
 }
 
+Entry::Status EntryTable::Claim(Entry* entry) {
+  while (true) {
+    Entry::Status status = Wait(entry);
+    if (status != Entry::STATUS_INVALID) {
+      return status;
+    }
+    // Whoever moves an invalidated entry back to compiling regenerates it.
+    if (entry->status.compare_exchange_strong(status,
+                                              Entry::STATUS_COMPILING)) {
+      entry->end_address = 0;
+      return Entry::STATUS_NEW;
+    }
+  }
+}
+
+void EntryTable::Finish(Entry* entry, Entry::Status status) {
+  assert_true(status == Entry::STATUS_READY ||
+              status == Entry::STATUS_FAILED);
+  if (status == Entry::STATUS_READY) {
+    std::lock_guard<xe::mutex> guard(interval_lock_);
+    intervals_[entry->address] = entry;
+    if (entry->end_address > entry->address) {
+      max_interval_length_ = std::max(max_interval_length_,
+                                      entry->end_address - entry->address);
+    }
+  }
+  auto& stripe = wait_stripe(entry->address);
+  {
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    entry->status.store(status, std::memory_order_release);
+  }
+  stripe.cond.notify_all();
+}
+
 std::vector<Function*> EntryTable::FindWithAddress(uint32_t address) {
-  std::lock_guard<xe::mutex> guard(lock_);
+  std::lock_guard<xe::mutex> guard(interval_lock_);
   std::vector<Function*> fns;
-  for (auto& it : map_) {
-    Entry* entry = it.second;
+  // Walk back from the last entry starting at or before the address.
+  auto it = intervals_.upper_bound(address);
+  while (it != intervals_.begin()) {
+    --it;
+    Entry* entry = it->second;
+    if (address - entry->address > max_interval_length_) {
+      break;
+    }
     if (address >= entry->address && address <= entry->end_address) {
-      if (entry->status == Entry::STATUS_READY) {
-        fns.push_back(entry->function);
-      }
+      fns.push_back(entry->function.load(std::memory_order_acquire));
+    }
+  }
+  return fns;
+}
+
+std::vector<Function*> EntryTable::Invalidate(
+    uint32_t low_address, uint32_t high_address,
+    std::function<void(Function*)> callback) {
+  std::lock_guard<xe::mutex> guard(interval_lock_);
+  std::vector<Function*> fns;
+  // Start far enough back to catch the longest function running into the
+  // range.
+  uint32_t scan_address = low_address > max_interval_length_
+                              ? low_address - max_interval_length_
+                              : 0;
+  auto it = intervals_.lower_bound(scan_address);
+  while (it != intervals_.end() && it->first < high_address) {
+    Entry* entry = it->second;
+    if (entry->end_address < low_address) {
+      ++it;
+      continue;
+    }
+    Function* function = entry->function.load(std::memory_order_acquire);
+    if (callback) {
+      callback(function);
     }
+    // Nobody waits on ready entries, so no need to wake anyone.
+    entry->status.store(Entry::STATUS_INVALID, std::memory_order_release);
+    fns.push_back(function);
+    it = intervals_.erase(it);
   }
   return fns;
 }
 
+bool EntryTable::Replace(uint32_t address, Function* function,
+                         std::function<bool()> callback) {
+  std::lock_guard<xe::mutex> guard(interval_lock_);
+  Entry* entry = Find(address);
+  if (!entry || entry->status != Entry::STATUS_READY || !callback()) {
+    return false;
+  }
+  entry->function.store(function, std::memory_order_release);
+  return true;
+}
+
 }  // namespace cpu
 }  // namespace xe
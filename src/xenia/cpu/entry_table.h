@@ -10,8 +10,12 @@
 #ifndef XENIA_CPU_ENTRY_TABLE_H_
 #define XENIA_CPU_ENTRY_TABLE_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
 #include <mutex>
-#include <unordered_map>
 #include <vector>
 
 #include "xenia/base/mutex.h"
@@ -27,14 +31,21 @@ typedef struct Entry_t {
     STATUS_COMPILING,
     STATUS_READY,
     STATUS_FAILED,
+    STATUS_INVALID,
   } Status;
 
   uint32_t address;
   uint32_t end_address;
-  Status status;
-  Function* function;
+  std::atomic<Status> status;
+  // Swapped by Replace while other threads call through it, so stored with
+  // release and loaded with acquire.
+  std::atomic<Function*> function;
 } Entry;
 
+// Maps guest function addresses to their generated functions.
+// Lookups are lock-free and only the creation of new entries is serialized.
+// Threads that find an entry still being compiled block until its owner calls
+// Finish, instead of polling.
 class EntryTable {
  public:
   EntryTable();
@@ -42,13 +53,70 @@ class EntryTable {
 
   Entry* Get(uint32_t address);
   Entry::Status GetOrCreate(uint32_t address, Entry** out_entry);
+  // Completes an entry returned as STATUS_NEW by GetOrCreate, waking anyone
+  // waiting on it. end_address and function must be set before READY.
+  void Finish(Entry* entry, Entry::Status status);
 
   std::vector<Function*> FindWithAddress(uint32_t address);
 
+  // Invalidates the ready entries of all functions overlapping
+  // [low_address, high_address), returning their functions. The next
+  // GetOrCreate of an invalidated address returns STATUS_NEW again, so
+  // anything that must be reset before then goes in the callback, which is
+  // called with each function just before its entry is invalidated.
+  std::vector<Function*> Invalidate(
+      uint32_t low_address, uint32_t high_address,
+      std::function<void(Function*)> callback = nullptr);
+  // Points the ready entry at address to a new function, unless the callback
+  // returns false. The callback runs under the same lock as Invalidate, so an
+  // invalidation either happens before it or is handed the new function.
+  bool Replace(uint32_t address, Function* function,
+               std::function<bool()> callback);
+
  private:
-  // TODO(benvanik): replace with a better data structure.
-  xe::mutex lock_;
-  std::unordered_map<uint32_t, Entry*> map_;
+  // Open-addressed table of entries. Slots are claimed only under
+  // insert_lock_ and never removed, so readers can probe without locking.
+  struct Slot {
+    std::atomic<uint32_t> address;
+    std::atomic<Entry*> entry;
+  };
+  struct Submap {
+    explicit Submap(uint32_t capacity);
+    uint32_t capacity_mask;
+    uint32_t count;
+    std::unique_ptr<Slot[]> slots;
+  };
+  // Each submap is twice the size of the previous. Once one is 3/4 full new
+  // entries go to the next, as done by folly's AtomicHashMap.
+  static const uint32_t kFirstSubmapCapacity = 64 * 1024;
+  static const size_t kMaxSubmaps = 12;
+
+  // Waiters block on one of a small set of condition variables picked by
+  // address rather than on one per entry.
+  static const size_t kWaitStripeCount = 64;
+  struct WaitStripe {
+    std::mutex mutex;
+    std::condition_variable cond;
+  };
+
+  Entry* Find(uint32_t address);
+  void Insert(Entry* entry);
+  Entry::Status Wait(Entry* entry);
+  Entry::Status Claim(Entry* entry);
+  WaitStripe& wait_stripe(uint32_t address) {
+    return wait_stripes_[(address >> 2) % kWaitStripeCount];
+  }
+
+  xe::mutex insert_lock_;
+  std::atomic<Submap*> submaps_[kMaxSubmaps];
+  std::atomic<size_t> submap_count_;
+  WaitStripe wait_stripes_[kWaitStripeCount];
+
+  // Ready entries by start address, for FindWithAddress. Entries can be
+  // nested, so we scan back at most the longest function seen.
+  xe::mutex interval_lock_;
+  std::map<uint32_t, Entry*> intervals_;
+  uint32_t max_interval_length_;
 };
 
 }  // namespace cpu
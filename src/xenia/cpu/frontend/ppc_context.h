@@ -201,8 +201,14 @@ typedef struct alignas(64) PPCContext_s {
   // Thread ID assigned to this context.
   uint32_t thread_id;
 
-  // Reserve address for load acquire/store release. Shared.
-  uint64_t* reserve_address;
+  // Reservation taken by the last lwarx/ldarx on this thread: the guest
+  // address (or ~0 if none) and the value loaded from it. The conditional
+  // store succeeds only if memory still holds that value.
+  uint64_t reserved_address;
+  uint64_t reserved_value;
+
+  // Word of the global lock taken by mtmsrd (see PPCGlobalLock). Shared.
+  uint64_t* global_lock_word;
 
   // Used to shuttle data into externs. Contents volatile.
   uint64_t scratch;
@@ -216,6 +222,10 @@ typedef struct alignas(64) PPCContext_s {
 
   uint8_t* physical_membase;
 
+  // Shard of the block execution counters this thread counts into, when
+  // --block_counters is set (see BlockCounters).
+  uint64_t* block_counters;
+
   void SetRegFromString(const char* name, const char* value);
   bool CompareRegWithString(const char* name, const char* value,
                             char* out_value, size_t out_value_size);
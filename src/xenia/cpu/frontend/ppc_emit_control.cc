@@ -77,10 +77,23 @@ int InstrEmit_branch(PPCHIRBuilder& f, const char* src, uint64_t cia,
           cond = f.IsFalse(cond);
         }
         f.CallTrue(cond, symbol_info, call_flags);
-      } else {
+      } else if (!f.TryInlineCall(symbol_info, !lk)) {
         f.Call(symbol_info, call_flags);
       }
     }
+  } else if (!lk && nia_is_lr && f.inline_return_label()) {
+    // Return from a function being inlined. LR is untouched by the callee, so
+    // this always lands right after the call site.
+    Label* label = f.inline_return_label();
+    if (cond) {
+      if (expect_true) {
+        f.BranchTrue(cond, label);
+      } else {
+        f.BranchFalse(cond, label);
+      }
+    } else {
+      f.Branch(label);
+    }
   } else {
 // Indirect branch to pointer.
 
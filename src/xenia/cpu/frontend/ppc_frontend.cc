@@ -9,6 +9,11 @@
 
 #include "xenia/cpu/frontend/ppc_frontend.h"
 
+#include "xenia/base/atomic.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/platform.h"
+#include "xenia/cpu/cpu-private.h"
 #include "xenia/cpu/frontend/ppc_context.h"
 #include "xenia/cpu/frontend/ppc_disasm.h"
 #include "xenia/cpu/frontend/ppc_emit.h"
@@ -40,7 +45,8 @@ void InitializeIfNeeded() {
 
 void CleanupOnShutdown() {}
 
-PPCFrontend::PPCFrontend(Processor* processor) : processor_(processor) {
+PPCFrontend::PPCFrontend(Processor* processor)
+    : processor_(processor), precompiler_(processor), recompiler_(this) {
   InitializeIfNeeded();
 
   std::unique_ptr<ContextInfo> context_info(
@@ -51,57 +57,177 @@ PPCFrontend::PPCFrontend(Processor* processor) : processor_(processor) {
 }
 
 PPCFrontend::~PPCFrontend() {
+  Shutdown();
+
   // Force cleanup now before we deinit.
   translator_pool_.Reset();
 }
 
 Memory* PPCFrontend::memory() const { return processor_->memory(); }
 
-void CheckGlobalLock(PPCContext* ppc_context, void* arg0, void* arg1) {
-  ppc_context->scratch = 0x8000;
+PPCGlobalLock::PPCGlobalLock() : contended_count_(0), wait_count_(0) {
+  // Keep the word to itself, as every guest thread hammers it.
+  word_ = reinterpret_cast<volatile uint64_t*>(_aligned_malloc(64, 64));
+  *word_ = 0;
 }
-void HandleGlobalLock(PPCContext* ppc_context, void* arg0, void* arg1) {
-  auto global_lock = reinterpret_cast<xe::mutex*>(arg0);
-  volatile bool* global_lock_taken = reinterpret_cast<bool*>(arg1);
-  uint64_t value = ppc_context->scratch;
-  if (value == 0x8000) {
-    global_lock->lock();
-    *global_lock_taken = false;
-    global_lock->unlock();
-  } else if (value == ppc_context->r[13]) {
-    global_lock->lock();
-    *global_lock_taken = true;
-    global_lock->unlock();
+
+PPCGlobalLock::~PPCGlobalLock() {
+  if (contended_count_) {
+    DumpStatistics();
   }
+  _aligned_free(const_cast<uint64_t*>(word_));
+}
+
+void PPCGlobalLock::Enter(uint32_t owner) {
+  const uint32_t kSpinCount = 1000;
+  uint32_t spin_count = 0;
+  bool contended = false;
+  while (true) {
+    uint64_t value = *word_;
+    if (!value) {
+      if (xe::atomic_cas(value, uint64_t(owner), word_)) {
+        break;
+      }
+      continue;
+    }
+    if ((value & kOwnerMask) == owner) {
+      if (xe::atomic_cas(value, value + kRecursionOne, word_)) {
+        break;
+      }
+      continue;
+    }
+    contended = true;
+    if (spin_count < kSpinCount) {
+      ++spin_count;
+      YieldProcessor();
+      continue;
+    }
+
+    // Sleep until the owner leaves. The flag is set with the mutex held, so
+    // Leave can't miss us between checking it and waking waiters.
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    value = *word_;
+    if (!value) {
+      continue;
+    }
+    if (!(value & kWaiterFlag) &&
+        !xe::atomic_cas(value, value | kWaiterFlag, word_)) {
+      continue;
+    }
+    ++wait_count_;
+    wait_cond_.wait(lock);
+    spin_count = 0;
+  }
+  if (contended) {
+    ++contended_count_;
+  }
+}
+
+void PPCGlobalLock::Leave(uint32_t owner) {
+  while (true) {
+    uint64_t value = *word_;
+    if ((value & kOwnerMask) != owner) {
+      // Not ours; interrupts enabled without being disabled first.
+      return;
+    }
+    if (value & ~(kOwnerMask | kWaiterFlag)) {
+      if (xe::atomic_cas(value, value - kRecursionOne, word_)) {
+        return;
+      }
+      continue;
+    }
+    if (xe::atomic_cas(value, uint64_t(0), word_)) {
+      if (value & kWaiterFlag) {
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        wait_cond_.notify_all();
+      }
+      return;
+    }
+  }
+}
+
+void PPCGlobalLock::DumpStatistics() {
+  XELOGI("Global lock: %lld contended enters, %lld slept",
+         uint64_t(contended_count_), uint64_t(wait_count_));
+}
+
+void EnterGlobalLock(PPCContext* ppc_context, void* arg0, void* arg1) {
+  auto global_lock = reinterpret_cast<PPCGlobalLock*>(arg0);
+  global_lock->Enter(uint32_t(ppc_context->r[13]));
+}
+
+void LeaveGlobalLock(PPCContext* ppc_context, void* arg0, void* arg1) {
+  auto global_lock = reinterpret_cast<PPCGlobalLock*>(arg0);
+  global_lock->Leave(uint32_t(ppc_context->r[13]));
 }
 
 bool PPCFrontend::Initialize() {
   void* arg0 = reinterpret_cast<void*>(&builtins_.global_lock);
-  void* arg1 = reinterpret_cast<void*>(&builtins_.global_lock_taken);
-  builtins_.check_global_lock =
-      processor_->DefineBuiltin("CheckGlobalLock", CheckGlobalLock, arg0, arg1);
-  builtins_.handle_global_lock = processor_->DefineBuiltin(
-      "HandleGlobalLock", HandleGlobalLock, arg0, arg1);
+  builtins_.enter_global_lock = processor_->DefineBuiltin(
+      "EnterGlobalLock", EnterGlobalLock, arg0, nullptr);
+  builtins_.leave_global_lock = processor_->DefineBuiltin(
+      "LeaveGlobalLock", LeaveGlobalLock, arg0, nullptr);
+
+  if (FLAGS_precompile_threads < 0 || FLAGS_precompile_depth < 0) {
+    XELOGE("--precompile_threads and --precompile_depth can't be negative");
+    return false;
+  }
+  if (!precompiler_.Initialize(uint32_t(FLAGS_precompile_threads),
+                               uint32_t(FLAGS_precompile_depth))) {
+    return false;
+  }
+  if (!recompiler_.Initialize(FLAGS_tiered_compilation,
+                              FLAGS_tier_up_threshold)) {
+    return false;
+  }
 
   return true;
 }
 
+void PPCFrontend::Shutdown() {
+  // Workers must stop before the modules they translate from go away.
+  precompiler_.Shutdown();
+  recompiler_.Shutdown();
+}
+
 bool PPCFrontend::DeclareFunction(FunctionInfo* symbol_info) {
   // Could scan or something here.
   // Could also check to see if it's a well-known function type and classify
   // for later.
-  // Could also kick off a precompiler, since we know it's likely the function
-  // will be demanded soon.
+  // Functions declared while translating another are its static call
+  // targets, so it's likely they will be demanded soon.
+  if (precompiler_.is_translating()) {
+    precompiler_.Enqueue(symbol_info->address());
+  }
   return true;
 }
 
 bool PPCFrontend::DefineFunction(FunctionInfo* symbol_info,
                                  uint32_t debug_info_flags,
                                  Function** out_function) {
+  auto tier = recompiler_.is_enabled() ? TranslationTier::kBaseline
+                                       : TranslationTier::kOptimized;
+  precompiler_.BeginTranslation();
+  bool result =
+      TranslateFunction(symbol_info, debug_info_flags, tier, out_function);
+  precompiler_.EndTranslation(result);
+  return result;
+}
+
+bool PPCFrontend::TranslateFunction(FunctionInfo* symbol_info,
+                                    uint32_t debug_info_flags,
+                                    TranslationTier tier,
+                                    Function** out_function) {
+  if (tier == TranslationTier::kBaseline) {
+    symbol_info->set_call_countdown(recompiler_.threshold());
+  }
+  uint64_t start_ticks = Clock::QueryHostTickCount();
   PPCTranslator* translator = translator_pool_.Allocate(this);
   bool result =
-      translator->Translate(symbol_info, debug_info_flags, out_function);
+      translator->Translate(symbol_info, debug_info_flags, tier, out_function);
   translator_pool_.Release(translator);
+  recompiler_.RecordTranslation(tier, result,
+                                Clock::QueryHostTickCount() - start_ticks);
   return result;
 }
 
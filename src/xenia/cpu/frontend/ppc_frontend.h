@@ -10,12 +10,15 @@
 #ifndef XENIA_FRONTEND_PPC_FRONTEND_H_
 #define XENIA_FRONTEND_PPC_FRONTEND_H_
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 
-#include "xenia/base/mutex.h"
 #include "xenia/base/type_pool.h"
 #include "xenia/cpu/frontend/context_info.h"
+#include "xenia/cpu/frontend/ppc_precompiler.h"
+#include "xenia/cpu/frontend/ppc_recompiler.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/symbol_info.h"
 #include "xenia/memory.h"
@@ -32,11 +35,45 @@ namespace frontend {
 
 class PPCTranslator;
 
+// Lock held by guest code while it has interrupts disabled, which a lot of
+// lock-free code relies on (see the MSR notes in ppc_emit_control.cc).
+// The lock word, alone on its cache line, holds the owner's r13 (its PCR,
+// unique per thread) in the low 32 bits, the recursion depth above that and a
+// waiter flag at the top. Uncontended enters and leaves are a single
+// compare-exchange emitted inline by PPCHIRBuilder::StoreMSR. Anything else
+// ends up in Enter/Leave, which spin for a while before sleeping.
+class PPCGlobalLock {
+ public:
+  static const uint64_t kOwnerMask = 0xFFFFFFFFull;
+  static const uint64_t kRecursionOne = 1ull << 32;
+  static const uint64_t kWaiterFlag = 1ull << 63;
+
+  PPCGlobalLock();
+  ~PPCGlobalLock();
+
+  // Host address of the lock word, stashed in each PPCContext.
+  uint64_t* word() const { return const_cast<uint64_t*>(word_); }
+
+  void Enter(uint32_t owner);
+  void Leave(uint32_t owner);
+
+  void DumpStatistics();
+
+ private:
+  volatile uint64_t* word_;
+  std::mutex wait_mutex_;
+  std::condition_variable wait_cond_;
+
+  // Enters that found the lock held by another thread, and how many of
+  // those had to sleep.
+  std::atomic<uint64_t> contended_count_;
+  std::atomic<uint64_t> wait_count_;
+};
+
 struct PPCBuiltins {
-  xe::mutex global_lock;
-  bool global_lock_taken;
-  FunctionInfo* check_global_lock;
-  FunctionInfo* handle_global_lock;
+  PPCGlobalLock global_lock;
+  FunctionInfo* enter_global_lock;
+  FunctionInfo* leave_global_lock;
 };
 
 class PPCFrontend {
@@ -45,21 +82,28 @@ class PPCFrontend {
   ~PPCFrontend();
 
   bool Initialize();
+  void Shutdown();
 
   Processor* processor() const { return processor_; }
   Memory* memory() const;
   ContextInfo* context_info() const { return context_info_.get(); }
   PPCBuiltins* builtins() { return &builtins_; }
+  PPCPrecompiler* precompiler() { return &precompiler_; }
+  PPCRecompiler* recompiler() { return &recompiler_; }
 
   bool DeclareFunction(FunctionInfo* symbol_info);
   bool DefineFunction(FunctionInfo* symbol_info, uint32_t debug_info_flags,
                       Function** out_function);
+  bool TranslateFunction(FunctionInfo* symbol_info, uint32_t debug_info_flags,
+                         TranslationTier tier, Function** out_function);
 
  private:
   Processor* processor_;
   std::unique_ptr<ContextInfo> context_info_;
   PPCBuiltins builtins_;
   TypePool<PPCTranslator, PPCFrontend*> translator_pool_;
+  PPCPrecompiler precompiler_;
+  PPCRecompiler recompiler_;
 };
 
 }  // namespace frontend
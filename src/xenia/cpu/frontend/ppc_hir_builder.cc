@@ -9,6 +9,7 @@
 
 #include "xenia/cpu/frontend/ppc_hir_builder.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include "xenia/base/byte_order.h"
@@ -44,19 +45,27 @@ void PPCHIRBuilder::Reset() {
   instr_offset_list_ = NULL;
   label_list_ = NULL;
   with_debug_info_ = false;
+  emit_flags_ = 0;
+  inline_budget_ = 0;
+  is_inlining_ = false;
+  inline_return_label_ = nullptr;
   HIRBuilder::Reset();
 }
 
-bool PPCHIRBuilder::Emit(FunctionInfo* symbol_info, uint32_t flags) {
+bool PPCHIRBuilder::Emit(FunctionInfo* symbol_info,
+                         const std::vector<InstrData>& instrs,
+                         uint32_t flags) {
   SCOPE_profile_cpu_f("cpu");
 
-  Memory* memory = frontend_->memory();
-
   symbol_info_ = symbol_info;
   start_address_ = symbol_info->address();
-  instr_count_ = (symbol_info->end_address() - symbol_info->address()) / 4 + 1;
+  instr_count_ = instrs.size();
+  assert_true(instr_count_ ==
+              (symbol_info->end_address() - symbol_info->address()) / 4 + 1);
 
   with_debug_info_ = (flags & EMIT_DEBUG_COMMENTS) == EMIT_DEBUG_COMMENTS;
+  emit_flags_ = flags;
+  inline_budget_ = uint32_t(std::max(FLAGS_inline_function_budget, 0));
   if (with_debug_info_) {
     CommentFormat("%s fn %.8X-%.8X %s", symbol_info->module()->name().c_str(),
                   symbol_info->address(), symbol_info->end_address(),
@@ -78,15 +87,10 @@ bool PPCHIRBuilder::Emit(FunctionInfo* symbol_info, uint32_t flags) {
   // Always mark entry with label.
   label_list_[0] = NewLabel();
 
-  uint32_t start_address = symbol_info->address();
-  uint32_t end_address = symbol_info->end_address();
-  InstrData i;
-  for (uint32_t address = start_address, offset = 0; address <= end_address;
-       address += 4, offset++) {
-    i.address = address;
-    i.code = xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
-    // TODO(benvanik): find a way to avoid using the opcode tables.
-    i.type = GetInstrType(i.code);
+  for (size_t offset = 0; offset < instrs.size(); ++offset) {
+    // Emitters take the instruction by reference, so give them a copy.
+    InstrData i = instrs[offset];
+    uint32_t address = i.address;
     trace_info_.dest_count = 0;
 
     // Mark label, if we were assigned one earlier on in the walk.
@@ -165,6 +169,197 @@ void PPCHIRBuilder::AnnotateLabel(uint32_t address, Label* label) {
   memcpy(label->name, name_buffer, sizeof(name_buffer));
 }
 
+bool PPCHIRBuilder::TryInlineCall(FunctionInfo* callee_info,
+                                  bool is_tail_call) {
+  if (!callee_info || callee_info == symbol_info_ || is_inlining_) {
+    return false;
+  }
+  uint32_t max_instr_count = 0;
+  bool is_save_restore = false;
+  switch (callee_info->behavior()) {
+    case FunctionBehavior::kProlog:
+    case FunctionBehavior::kEpilog:
+    case FunctionBehavior::kEpilogReturn:
+      // Straight runs of loads/stores, __savevmx_64 being the longest.
+      if (emit_flags_ & EMIT_INLINE_SAVE_RESTORE) {
+        max_instr_count = 160;
+        is_save_restore = true;
+      }
+      break;
+    case FunctionBehavior::kDefault:
+      if (emit_flags_ & EMIT_INLINE_LEAF_CALLS) {
+        max_instr_count = std::min(
+            uint32_t(std::max(FLAGS_inline_max_instructions, 0)),
+            inline_budget_);
+      }
+      break;
+    default:
+      break;
+  }
+  if (!max_instr_count) {
+    return false;
+  }
+
+  if (!ScanInlineCallee(callee_info->address(), max_instr_count,
+                        is_tail_call)) {
+    return false;
+  }
+  if (!is_save_restore) {
+    inline_budget_ -= static_cast<uint32_t>(inline_instrs_.size());
+  }
+  EmitInlineCallee(callee_info, is_tail_call);
+  return true;
+}
+
+bool PPCHIRBuilder::ScanInlineCallee(uint32_t start_address,
+                                     uint32_t max_instr_count,
+                                     bool is_tail_call) {
+  // Only simple leaf code is accepted: all branches stay within the callee,
+  // and it ends at the first blr nothing branches past.
+  // The instructions are kept in inline_instrs_ for EmitInlineCallee.
+  Memory* memory = frontend_->memory();
+  uint32_t furthest_target = start_address;
+  inline_instrs_.clear();
+  InstrData i;
+  for (uint32_t n = 0; n < max_instr_count; ++n) {
+    i.address = start_address + n * 4;
+    i.code = xe::load_and_swap<uint32_t>(memory->TranslateVirtual(i.address));
+    i.type = GetInstrType(i.code);
+    if (!i.code || !i.type || !i.type->emit) {
+      return false;
+    }
+    inline_instrs_.push_back(i);
+    if (i.code == 0x4E800020) {
+      // blr
+      if (furthest_target <= i.address) {
+        return true;
+      }
+      continue;
+    }
+    uint32_t target;
+    if (i.type->opcode == 0x48000000) {
+      // b/ba/bl/bla
+      if (i.I.LK) {
+        return false;
+      }
+      target =
+          (uint32_t)XEEXTS26(i.I.LI << 2) + (i.I.AA ? 0 : (int32_t)i.address);
+    } else if (i.type->opcode == 0x40000000) {
+      // bc/bca/bcl/bcla
+      if (i.B.LK) {
+        return false;
+      }
+      target =
+          (uint32_t)XEEXTS16(i.B.BD << 2) + (i.B.AA ? 0 : (int32_t)i.address);
+    } else if (i.type->opcode == 0x4C000020) {
+      // bclr/bclrl
+      if (i.XL.LK) {
+        return false;
+      }
+      continue;
+    } else if (i.type->opcode == 0x7C0003A6) {
+      // mtspr
+      // Unless the call is a tail call its returns must land back here.
+      if (!is_tail_call &&
+          (((i.XFX.spr & 0x1F) << 5) | ((i.XFX.spr >> 5) & 0x1F)) == 8) {
+        return false;
+      }
+      continue;
+    } else if (i.type->type &
+               (kXEPPCInstrTypeBranch | kXEPPCInstrTypeSyscall)) {
+      // bcctr, sc, etc.
+      return false;
+    } else {
+      continue;
+    }
+    if (target < start_address) {
+      return false;
+    }
+    furthest_target = std::max(furthest_target, target);
+  }
+  return false;
+}
+
+void PPCHIRBuilder::EmitInlineCallee(FunctionInfo* callee_info,
+                                     bool is_tail_call) {
+  uint32_t start_address = callee_info->address();
+  uint32_t end_address = inline_instrs_.back().address;
+  AddInlinedRange(start_address, end_address);
+
+  // Swap in the callee's range so LookupLabel resolves its branches.
+  auto caller_start_address = start_address_;
+  auto caller_instr_count = instr_count_;
+  auto caller_instr_offset_list = instr_offset_list_;
+  auto caller_label_list = label_list_;
+  auto caller_dest_count = trace_info_.dest_count;
+  start_address_ = start_address;
+  instr_count_ = inline_instrs_.size();
+  size_t list_size = instr_count_ * sizeof(void*);
+  instr_offset_list_ = (Instr**)arena_->Alloc(list_size);
+  label_list_ = (Label**)arena_->Alloc(list_size);
+  std::memset(instr_offset_list_, 0, list_size);
+  std::memset(label_list_, 0, list_size);
+
+  // No SOURCE_OFFSETs are emitted for the callee (they would confuse the
+  // source map and coverage tracing of the caller), so back branches have
+  // nothing to be inserted at. Create labels for all targets up front.
+  for (auto& i : inline_instrs_) {
+    if (i.type->opcode == 0x48000000) {
+      LookupLabel((uint32_t)XEEXTS26(i.I.LI << 2) +
+                  (i.I.AA ? 0 : (int32_t)i.address));
+    } else if (i.type->opcode == 0x40000000) {
+      LookupLabel((uint32_t)XEEXTS16(i.B.BD << 2) +
+                  (i.B.AA ? 0 : (int32_t)i.address));
+    }
+  }
+
+  is_inlining_ = true;
+  inline_return_label_ = is_tail_call ? nullptr : NewLabel();
+  if (with_debug_info_) {
+    CommentFormat("inlined %.8X-%.8X %s", start_address, end_address,
+                  callee_info->name().c_str());
+  }
+
+  for (size_t offset = 0; offset < inline_instrs_.size(); ++offset) {
+    InstrData i = inline_instrs_[offset];
+    uint32_t address = i.address;
+    trace_info_.dest_count = 0;
+
+    Label* label = label_list_[offset];
+    if (label) {
+      MarkLabel(label);
+    }
+    if (with_debug_info_) {
+      if (label) {
+        AnnotateLabel(address, label);
+      }
+      comment_buffer_.Reset();
+      comment_buffer_.AppendFormat("%.8X %.8X ", address, i.code);
+      DisasmPPC(i, &comment_buffer_);
+      Comment(comment_buffer_);
+    }
+
+    typedef int (*InstrEmitter)(PPCHIRBuilder& f, InstrData& i);
+    InstrEmitter emit = (InstrEmitter)i.type->emit;
+    if (emit(*this, i)) {
+      XELOGE("Unimplemented instr %.8llX %.8X %s", i.address, i.code,
+             i.type->name);
+      Comment("UNIMPLEMENTED!");
+    }
+  }
+
+  if (inline_return_label_) {
+    MarkLabel(inline_return_label_);
+  }
+  is_inlining_ = false;
+  inline_return_label_ = nullptr;
+  start_address_ = caller_start_address;
+  instr_count_ = caller_instr_count;
+  instr_offset_list_ = caller_instr_offset_list;
+  label_list_ = caller_label_list;
+  trace_info_.dest_count = caller_dest_count;
+}
+
 FunctionInfo* PPCHIRBuilder::LookupFunction(uint32_t address) {
   Processor* processor = frontend_->processor();
   FunctionInfo* symbol_info;
@@ -351,15 +546,41 @@ void PPCHIRBuilder::UpdateCR6(Value* src_value) {
 Value* PPCHIRBuilder::LoadMSR() {
   // bit 48 = EE; interrupt enabled
   // bit 62 = RI; recoverable interrupt
-  // return 8000h if unlocked, else 0
-  CallExtern(frontend_->builtins()->check_global_lock);
-  return LoadContext(offsetof(PPCContext, scratch), INT64_TYPE);
+  // Always reads as enabled, so that nested disable/enable pairs balance out
+  // in the global lock's recursion count.
+  return LoadConstantUint64(0x8000);
 }
 
 void PPCHIRBuilder::StoreMSR(Value* value) {
-  // if & 0x8000 == 0, lock, else unlock
-  StoreContext(offsetof(PPCContext, scratch), ZeroExtend(value, INT64_TYPE));
-  CallExtern(frontend_->builtins()->handle_global_lock);
+  // Writing r13 disables interrupts and takes the global lock, and writing
+  // 8000h (EE) enables them and leaves it. Anything but the uncontended
+  // compare-exchange goes to the builtins (see PPCGlobalLock).
+  // Values don't live across blocks, so the value is stashed for the second
+  // check.
+  auto builtins = frontend_->builtins();
+  auto leave_label = NewLabel();
+  auto done_label = NewLabel();
+  StoreContext(offsetof(PPCContext, scratch), value);
+  BranchFalse(CompareEQ(value, LoadGPR(13)), leave_label);
+  Value* owner = ZeroExtend(Truncate(LoadGPR(13), INT32_TYPE), INT64_TYPE);
+  Value* old_value = CompareExchange(
+      LoadContext(offsetof(PPCContext, global_lock_word), INT64_TYPE),
+      LoadZeroInt64(), owner);
+  BranchFalse(old_value, done_label, BRANCH_LIKELY);
+  CallExtern(builtins->enter_global_lock);
+  Branch(done_label);
+
+  MarkLabel(leave_label);
+  BranchFalse(CompareEQ(LoadContext(offsetof(PPCContext, scratch), INT64_TYPE),
+                        LoadConstantUint64(0x8000)),
+              done_label);
+  owner = ZeroExtend(Truncate(LoadGPR(13), INT32_TYPE), INT64_TYPE);
+  old_value = CompareExchange(
+      LoadContext(offsetof(PPCContext, global_lock_word), INT64_TYPE), owner,
+      LoadZeroInt64());
+  BranchTrue(CompareEQ(old_value, owner), done_label, BRANCH_LIKELY);
+  CallExtern(builtins->leave_global_lock);
+  MarkLabel(done_label);
 }
 
 Value* PPCHIRBuilder::LoadFPSCR() {
@@ -449,26 +670,53 @@ void PPCHIRBuilder::StoreVR(uint32_t reg, Value* value) {
 
 Value* PPCHIRBuilder::LoadAcquire(Value* address, TypeName type,
                                   uint32_t load_flags) {
-  AtomicExchange(LoadContext(offsetof(PPCContext, reserve_address), INT64_TYPE),
-                 Truncate(address, INT32_TYPE));
-  return Load(address, type, load_flags);
-}
-
-Value* PPCHIRBuilder::StoreRelease(Value* address, Value* value,
-                                   uint32_t store_flags) {
-  Value* old_address = AtomicExchange(
-      LoadContext(offsetof(PPCContext, reserve_address), INT64_TYPE),
-      LoadZeroInt32());
-  // Ensure the reservation addresses match.
-  Value* eq = CompareEQ(Truncate(address, INT32_TYPE), old_address);
-  StoreContext(offsetof(PPCContext, cr0.cr0_eq), eq);
+  // Reservations are per-thread; there's no reservation granule to snoop, so
+  // instead remember what was loaded and have the store compare against it.
+  Value* value = Load(address, type, load_flags);
+  StoreContext(offsetof(PPCContext, reserved_address), address);
+  StoreContext(offsetof(PPCContext, reserved_value),
+               type == INT64_TYPE ? value : ZeroExtend(value, INT64_TYPE));
+  return value;
+}
+
+void PPCHIRBuilder::StoreRelease(Value* address, Value* value) {
+  // The store is a host compare-exchange against the reserved value, so it
+  // fails if the word holds anything else by then. Unlike a real reservation
+  // it still succeeds if other threads changed the word and changed it back
+  // (ABA), or stored the same value. Guest code relying on LL/SC being immune
+  // to that, such as lock-free stack pops, can break.
+  TypeName type = value->type;
   StoreContext(offsetof(PPCContext, cr0.cr0_lt), LoadZeroInt8());
   StoreContext(offsetof(PPCContext, cr0.cr0_gt), LoadZeroInt8());
-  auto skip_label = NewLabel();
-  BranchFalse(eq, skip_label, BRANCH_UNLIKELY);
-  Store(address, value, store_flags);
-  MarkLabel(skip_label);
-  return eq;
+  StoreContext(offsetof(PPCContext, cr0.cr0_eq), LoadZeroInt8());
+  StoreContext(offsetof(PPCContext, scratch),
+               type == INT64_TYPE ? value : ZeroExtend(value, INT64_TYPE));
+  auto done_label = NewLabel();
+  BranchFalse(
+      CompareEQ(address, LoadContext(offsetof(PPCContext, reserved_address),
+                                     INT64_TYPE)),
+      done_label, BRANCH_UNLIKELY);
+  // Nothing is carried over the branch; reload what we stashed.
+  Value* guest_address = ZeroExtend(
+      Truncate(LoadContext(offsetof(PPCContext, reserved_address), INT64_TYPE),
+               INT32_TYPE),
+      INT64_TYPE);
+  Value* host_address = Add(
+      LoadContext(offsetof(PPCContext, virtual_membase), INT64_TYPE),
+      guest_address);
+  Value* expected =
+      LoadContext(offsetof(PPCContext, reserved_value), INT64_TYPE);
+  Value* new_value = LoadContext(offsetof(PPCContext, scratch), INT64_TYPE);
+  if (type != INT64_TYPE) {
+    expected = Truncate(expected, type);
+    new_value = Truncate(new_value, type);
+  }
+  Value* old_value = CompareExchange(host_address, expected, new_value);
+  StoreContext(offsetof(PPCContext, cr0.cr0_eq),
+               CompareEQ(old_value, expected));
+  MarkLabel(done_label);
+  StoreContext(offsetof(PPCContext, reserved_address),
+               LoadConstantUint64(~0ull));
 }
 
 }  // namespace frontend
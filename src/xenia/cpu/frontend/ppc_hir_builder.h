@@ -10,7 +10,10 @@
 #ifndef XENIA_FRONTEND_PPC_HIR_BUILDER_H_
 #define XENIA_FRONTEND_PPC_HIR_BUILDER_H_
 
+#include <vector>
+
 #include "xenia/base/string_buffer.h"
+#include "xenia/cpu/frontend/ppc_instr.h"
 #include "xenia/cpu/hir/hir_builder.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/symbol_info.h"
@@ -35,13 +38,28 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   enum EmitFlags {
     // Emit comment nodes.
     EMIT_DEBUG_COMMENTS = 1 << 0,
+    // Inline calls to the __savegprlr/__restgprlr/etc helpers.
+    EMIT_INLINE_SAVE_RESTORE = 1 << 1,
+    // Inline calls to small leaf functions, see --inline_max_instructions.
+    EMIT_INLINE_LEAF_CALLS = 1 << 2,
   };
-  bool Emit(FunctionInfo* symbol_info, uint32_t flags);
+  // Emits the function from its instructions as decoded by the scanner, one
+  // for each word from its start address to its end address.
+  bool Emit(FunctionInfo* symbol_info, const std::vector<InstrData>& instrs,
+            uint32_t flags);
 
   FunctionInfo* symbol_info() const { return symbol_info_; }
   FunctionInfo* LookupFunction(uint32_t address);
   Label* LookupLabel(uint32_t address);
 
+  // Emits the body of a statically known callee in place of a call to it.
+  // Returns false without emitting anything if the callee can't be inlined,
+  // in which case a regular call should be made.
+  bool TryInlineCall(FunctionInfo* callee_info, bool is_tail_call);
+  // Label returns from the callee being inlined should branch to, or null if
+  // returns should be emitted as usual.
+  Label* inline_return_label() const { return inline_return_label_; }
+
   Value* LoadLR();
   void StoreLR(Value* value);
   Value* LoadCTR();
@@ -78,10 +96,15 @@ class PPCHIRBuilder : public hir::HIRBuilder {
 
   Value* LoadAcquire(Value* address, hir::TypeName type,
                      uint32_t load_flags = 0);
-  Value* StoreRelease(Value* address, Value* value, uint32_t store_flags = 0);
+  // Stores only if the reserved word still holds the value loaded by
+  // LoadAcquire, setting cr0 accordingly.
+  void StoreRelease(Value* address, Value* value);
 
  private:
   void AnnotateLabel(uint32_t address, Label* label);
+  bool ScanInlineCallee(uint32_t start_address, uint32_t max_instr_count,
+                        bool is_tail_call);
+  void EmitInlineCallee(FunctionInfo* callee_info, bool is_tail_call);
 
  private:
   PPCFrontend* frontend_;
@@ -91,11 +114,18 @@ class PPCHIRBuilder : public hir::HIRBuilder {
 
   // Reset each Emit:
   bool with_debug_info_;
+  uint32_t emit_flags_;
   FunctionInfo* symbol_info_;
   uint64_t start_address_;
   uint64_t instr_count_;
   Instr** instr_offset_list_;
   Label** label_list_;
+  // Instructions that may still be inlined into the function.
+  uint32_t inline_budget_;
+  bool is_inlining_;
+  Label* inline_return_label_;
+  // Instructions of the callee being inlined, decoded by ScanInlineCallee.
+  std::vector<InstrData> inline_instrs_;
 
   // Reset each instruction.
   struct {
@@ -0,0 +1,181 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/frontend/ppc_precompiler.h"
+
+#include <string>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/threading.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/symbol_info.h"
+#include "xenia/profiling.h"
+
+namespace xe {
+namespace cpu {
+namespace frontend {
+
+// Set on precompiler worker threads.
+static thread_local bool is_worker_thread_ = false;
+// Speculation depth of the function being translated on this thread. Guest
+// threads always translate at depth 0.
+static thread_local uint32_t translation_depth_ = 0;
+// Whether a translation is in progress on this thread and when it started.
+static thread_local bool is_translating_ = false;
+static thread_local uint64_t translation_start_ticks_ = 0;
+
+PPCPrecompiler::PPCPrecompiler(Processor* processor)
+    : processor_(processor),
+      worker_count_(0),
+      max_depth_(0),
+      next_sequence_(0),
+      shutting_down_(false),
+      queued_count_(0),
+      worker_translation_count_(0),
+      worker_failure_count_(0),
+      skipped_count_(0),
+      ready_resolve_count_(0),
+      guest_translation_count_(0),
+      guest_translation_ticks_(0) {}
+
+PPCPrecompiler::~PPCPrecompiler() { Shutdown(); }
+
+bool PPCPrecompiler::Initialize(uint32_t worker_count, uint32_t max_depth) {
+  max_depth_ = max_depth;
+  if (!max_depth_) {
+    return true;
+  }
+  worker_count_ = worker_count;
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    workers_.emplace_back([this, i]() {
+      xe::threading::set_name("Precompiler " + std::to_string(i));
+      xe::Profiler::ThreadEnter("Precompiler");
+      is_worker_thread_ = true;
+      WorkerMain();
+      xe::Profiler::ThreadExit();
+    });
+  }
+  return true;
+}
+
+void PPCPrecompiler::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (shutting_down_) {
+      return;
+    }
+    shutting_down_ = true;
+  }
+  queue_cond_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+
+  if (queued_count_ || guest_translation_count_) {
+    DumpStatistics();
+  }
+}
+
+void PPCPrecompiler::Enqueue(uint32_t address) {
+  uint32_t depth = translation_depth_ + 1;
+  if (!worker_count_ || depth > max_depth_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (shutting_down_) {
+      return;
+    }
+    queue_.push({depth, next_sequence_++, address});
+  }
+  ++queued_count_;
+  queue_cond_.notify_one();
+}
+
+void PPCPrecompiler::BeginTranslation() {
+  is_translating_ = true;
+  translation_start_ticks_ = Clock::QueryHostTickCount();
+}
+
+void PPCPrecompiler::EndTranslation(bool succeeded) {
+  is_translating_ = false;
+  if (is_worker_thread_) {
+    if (succeeded) {
+      ++worker_translation_count_;
+    } else {
+      ++worker_failure_count_;
+    }
+  } else {
+    ++guest_translation_count_;
+    guest_translation_ticks_ +=
+        Clock::QueryHostTickCount() - translation_start_ticks_;
+  }
+}
+
+bool PPCPrecompiler::is_translating() const { return is_translating_; }
+
+void PPCPrecompiler::OnFunctionReady() {
+  if (worker_count_ && !is_worker_thread_) {
+    ++ready_resolve_count_;
+  }
+}
+
+void PPCPrecompiler::WorkerMain() {
+  while (true) {
+    WorkItem item;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      queue_cond_.wait(lock,
+                       [this]() { return shutting_down_ || !queue_.empty(); });
+      if (shutting_down_) {
+        return;
+      }
+      item = queue_.top();
+      queue_.pop();
+    }
+
+    // Skip anything a guest thread (or another worker) has already started
+    // on. Resolving it would only block us until that finishes.
+    FunctionInfo* symbol_info = nullptr;
+    if (!processor_->LookupFunctionInfo(item.address, &symbol_info) ||
+        symbol_info->status() != SymbolStatus::kDeclared) {
+      ++skipped_count_;
+      continue;
+    }
+
+    translation_depth_ = item.depth;
+    Function* function = nullptr;
+    processor_->ResolveFunction(item.address, &function);
+    translation_depth_ = 0;
+  }
+}
+
+void PPCPrecompiler::DumpStatistics() {
+  // Speculative translations that are never called don't count as hits; only
+  // guest resolves that found the function already translated do.
+  uint64_t ready_count = ready_resolve_count_;
+  uint64_t guest_count = guest_translation_count_;
+  uint64_t resolve_count = ready_count + guest_count;
+  XELOGI("Precompiler: %lld queued, %lld translated, %lld skipped, %lld failed",
+         uint64_t(queued_count_), uint64_t(worker_translation_count_),
+         uint64_t(skipped_count_), uint64_t(worker_failure_count_));
+  XELOGI("Precompiler: %lld/%lld guest resolves found the function ready "
+         "(%.1f%%)",
+         ready_count, resolve_count,
+         resolve_count ? 100.0 * ready_count / resolve_count : 0.0);
+  XELOGI("Precompiler: guest threads stalled %.3fs translating %lld functions",
+         double(guest_translation_ticks_) / Clock::host_tick_frequency(),
+         guest_count);
+}
+
+}  // namespace frontend
+}  // namespace cpu
+}  // namespace xe
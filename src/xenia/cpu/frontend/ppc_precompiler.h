@@ -0,0 +1,104 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_FRONTEND_PPC_PRECOMPILER_H_
+#define XENIA_FRONTEND_PPC_PRECOMPILER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace xe {
+namespace cpu {
+class Processor;
+}  // namespace cpu
+}  // namespace xe
+
+namespace xe {
+namespace cpu {
+namespace frontend {
+
+// Translates functions on background threads ahead of them being called.
+// Call targets that become visible while translating a function are queued
+// and resolved through the Processor as usual, so by the time a guest thread
+// reaches them they are (hopefully) already in the entry table.
+// Targets found while translating on behalf of a guest thread are preferred
+// over those found by the workers themselves, and the depth of speculation is
+// bounded.
+class PPCPrecompiler {
+ public:
+  explicit PPCPrecompiler(Processor* processor);
+  ~PPCPrecompiler();
+
+  bool Initialize(uint32_t worker_count, uint32_t max_depth);
+  void Shutdown();
+
+  // Queues a function discovered while translating on the current thread.
+  void Enqueue(uint32_t address);
+
+  // Called around each translation to attribute it to workers or guests.
+  void BeginTranslation();
+  void EndTranslation(bool succeeded);
+  bool is_translating() const;
+  // Called when a resolve finds the function already translated.
+  void OnFunctionReady();
+
+  void DumpStatistics();
+
+ private:
+  struct WorkItem {
+    uint32_t depth;
+    uint64_t sequence;
+    uint32_t address;
+    bool operator<(const WorkItem& other) const {
+      // std::priority_queue pops the largest, so invert to get the shallowest
+      // and then oldest item first.
+      if (depth != other.depth) {
+        return depth > other.depth;
+      }
+      return sequence > other.sequence;
+    }
+  };
+
+  void WorkerMain();
+
+  Processor* processor_;
+  uint32_t worker_count_;
+  uint32_t max_depth_;
+
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cond_;
+  std::priority_queue<WorkItem> queue_;
+  uint64_t next_sequence_;
+  bool shutting_down_;
+  std::vector<std::thread> workers_;
+
+  // Functions queued/translated by the workers.
+  std::atomic<uint64_t> queued_count_;
+  std::atomic<uint64_t> worker_translation_count_;
+  std::atomic<uint64_t> worker_failure_count_;
+  std::atomic<uint64_t> skipped_count_;
+  // Resolves on guest threads that found the function already translated,
+  // whether ahead of time or by an earlier resolve.
+  std::atomic<uint64_t> ready_resolve_count_;
+  // Functions guest threads still had to translate themselves, and how long
+  // they stalled doing so.
+  std::atomic<uint64_t> guest_translation_count_;
+  std::atomic<uint64_t> guest_translation_ticks_;
+};
+
+}  // namespace frontend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_FRONTEND_PPC_PRECOMPILER_H_
@@ -0,0 +1,160 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/frontend/ppc_recompiler.h"
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/threading.h"
+#include "xenia/cpu/frontend/ppc_frontend.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/symbol_info.h"
+#include "xenia/profiling.h"
+
+namespace xe {
+namespace cpu {
+namespace frontend {
+
+PPCRecompiler::PPCRecompiler(PPCFrontend* frontend)
+    : frontend_(frontend),
+      enabled_(false),
+      threshold_(0),
+      shutting_down_(false),
+      replaced_count_(0) {
+  for (auto& tier_statistics : tier_statistics_) {
+    tier_statistics.count = 0;
+    tier_statistics.failure_count = 0;
+    tier_statistics.ticks = 0;
+  }
+}
+
+PPCRecompiler::~PPCRecompiler() { Shutdown(); }
+
+bool PPCRecompiler::Initialize(bool enabled, uint32_t threshold) {
+  enabled_ = enabled && threshold > 0;
+  threshold_ = threshold;
+  if (!enabled_) {
+    return true;
+  }
+  // A single thread is plenty; only a small fraction of functions get hot.
+  worker_ = std::thread([this]() {
+    xe::threading::set_name("Recompiler");
+    xe::Profiler::ThreadEnter("Recompiler");
+    WorkerMain();
+    xe::Profiler::ThreadExit();
+  });
+  return true;
+}
+
+void PPCRecompiler::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (shutting_down_) {
+      return;
+    }
+    shutting_down_ = true;
+  }
+  queue_cond_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+
+  if (tier_statistics_[0].count || tier_statistics_[1].count) {
+    DumpStatistics();
+  }
+}
+
+void PPCRecompiler::Enqueue(FunctionInfo* symbol_info) {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (shutting_down_ || !requested_.insert(symbol_info).second) {
+      return;
+    }
+    queue_.push(symbol_info);
+  }
+  queue_cond_.notify_one();
+}
+
+void PPCRecompiler::Forget(FunctionInfo* symbol_info) {
+  std::lock_guard<std::mutex> lock(queue_mutex_);
+  requested_.erase(symbol_info);
+}
+
+void PPCRecompiler::RecordTranslation(TranslationTier tier, bool succeeded,
+                                      uint64_t ticks) {
+  auto& tier_statistics = tier_statistics_[uint32_t(tier)];
+  if (succeeded) {
+    ++tier_statistics.count;
+    tier_statistics.ticks += ticks;
+  } else {
+    ++tier_statistics.failure_count;
+  }
+}
+
+void PPCRecompiler::WorkerMain() {
+  auto processor = frontend_->processor();
+  while (true) {
+    FunctionInfo* symbol_info = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      queue_cond_.wait(lock,
+                       [this]() { return shutting_down_ || !queue_.empty(); });
+      if (shutting_down_) {
+        return;
+      }
+      symbol_info = queue_.front();
+      queue_.pop();
+    }
+
+    // Placing the new code updates the indirection table, so callers start
+    // using it right away; the rest is bookkeeping. The guest code may be
+    // written while we translate it, in which case the result is dropped
+    // (see PPCTranslator::Translate and Processor::ReplaceFunction).
+    uint32_t code_generation = symbol_info->code_generation();
+    Function* function = nullptr;
+    if (!frontend_->TranslateFunction(symbol_info,
+                                      processor->debug_info_flags(),
+                                      TranslationTier::kOptimized, &function)) {
+      if (symbol_info->code_generation() == code_generation) {
+        XELOGW("Recompiler: failed to recompile %.8X", symbol_info->address());
+      }
+      continue;
+    }
+    if (processor->ReplaceFunction(symbol_info, function, code_generation)) {
+      ++replaced_count_;
+    }
+  }
+}
+
+void PPCRecompiler::DumpStatistics() {
+  static const char* tier_names[] = {"baseline", "optimized"};
+  for (uint32_t i = 0; i < 2; ++i) {
+    auto& tier_statistics = tier_statistics_[i];
+    uint64_t count = tier_statistics.count;
+    double seconds =
+        double(tier_statistics.ticks) / Clock::host_tick_frequency();
+    XELOGI("Translation: %lld %s functions in %.3fs (%.1fus avg, %lld failed)",
+           count, tier_names[i], seconds,
+           count ? seconds * 1000000.0 / count : 0.0,
+           uint64_t(tier_statistics.failure_count));
+  }
+  if (enabled_) {
+    size_t requested_count;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      requested_count = requested_.size();
+    }
+    XELOGI("Recompiler: %lld/%lld hot functions recompiled",
+           uint64_t(replaced_count_), uint64_t(requested_count));
+  }
+}
+
+}  // namespace frontend
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,90 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_FRONTEND_PPC_RECOMPILER_H_
+#define XENIA_FRONTEND_PPC_RECOMPILER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_set>
+
+#include "xenia/cpu/frontend/ppc_translator.h"
+
+namespace xe {
+namespace cpu {
+class FunctionInfo;
+}  // namespace cpu
+}  // namespace xe
+
+namespace xe {
+namespace cpu {
+namespace frontend {
+
+class PPCFrontend;
+
+// Drives tiered compilation. When enabled, functions are first translated at
+// the baseline tier, with code that counts down calls and reports back here
+// once hot. Hot functions are then recompiled at the optimized tier on a
+// background thread and swapped in through the indirection table while the
+// baseline code keeps running.
+// Translation times for both tiers are tracked either way.
+class PPCRecompiler {
+ public:
+  explicit PPCRecompiler(PPCFrontend* frontend);
+  ~PPCRecompiler();
+
+  bool Initialize(bool enabled, uint32_t threshold);
+  void Shutdown();
+
+  bool is_enabled() const { return enabled_; }
+  uint32_t threshold() const { return threshold_; }
+
+  // Queues a baseline function for recompilation. Called from generated code
+  // when the function runs out of calls.
+  void Enqueue(FunctionInfo* symbol_info);
+  // Lets a function whose code was invalidated be queued again.
+  void Forget(FunctionInfo* symbol_info);
+
+  void RecordTranslation(TranslationTier tier, bool succeeded, uint64_t ticks);
+
+  void DumpStatistics();
+
+ private:
+  void WorkerMain();
+
+  PPCFrontend* frontend_;
+  bool enabled_;
+  uint32_t threshold_;
+
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cond_;
+  std::queue<FunctionInfo*> queue_;
+  // Functions already queued, as racing callers may report the same one.
+  std::unordered_set<FunctionInfo*> requested_;
+  bool shutting_down_;
+  std::thread worker_;
+
+  struct TierStatistics {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> failure_count;
+    std::atomic<uint64_t> ticks;
+  };
+  TierStatistics tier_statistics_[2];
+  std::atomic<uint64_t> replaced_count_;
+};
+
+}  // namespace frontend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_FRONTEND_PPC_RECOMPILER_H_
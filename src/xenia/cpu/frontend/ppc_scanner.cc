@@ -10,9 +10,9 @@
 #include "xenia/cpu/frontend/ppc_scanner.h"
 
 #include <algorithm>
-#include <map>
 
 #include "xenia/base/logging.h"
+#include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/cpu/frontend/ppc_frontend.h"
 #include "xenia/cpu/frontend/ppc_instr.h"
@@ -39,6 +39,23 @@ bool PPCScanner::IsRestGprLr(uint32_t address) {
          function->symbol_info()->behavior() == FunctionBehavior::kEpilogReturn;
 }
 
+void PPCScanner::DecodeInstr(uint32_t address, InstrData* i) {
+  Memory* memory = frontend_->memory();
+  i->address = address;
+  i->code = xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+  // This lookup is *expensive*, so it's done once here and the results are
+  // shared with everything else that walks the function.
+  i->type = i->code ? GetInstrType(i->code) : nullptr;
+}
+
+void PPCScanner::MarkBlockStart(uint32_t offset) {
+  size_t word = offset / 64;
+  if (word >= block_starts_.size()) {
+    block_starts_.resize(word + 1, 0);
+  }
+  block_starts_[word] |= uint64_t(1) << (offset % 64);
+}
+
 bool PPCScanner::Scan(FunctionInfo* symbol_info, DebugInfo* debug_info) {
   // This is a simple basic block analyizer. It walks the start address to the
   // end address looking for branches. Each span of instructions between
@@ -47,10 +64,12 @@ bool PPCScanner::Scan(FunctionInfo* symbol_info, DebugInfo* debug_info) {
   // is before the expected end address then the function address range is
   // split up and the second half is treated as another function.
 
-  Memory* memory = frontend_->memory();
-
   LOGPPC("Analyzing function %.8X...", symbol_info->address());
 
+  instrs_.clear();
+  block_starts_.clear();
+  branch_targets_.clear();
+
   // For debug info, only if needed.
   uint32_t address_reference_count = 0;
   uint32_t instruction_result_count = 0;
@@ -64,8 +83,7 @@ bool PPCScanner::Scan(FunctionInfo* symbol_info, DebugInfo* debug_info) {
   bool starts_with_mfspr_lr = false;
   InstrData i;
   while (true) {
-    i.address = address;
-    i.code = xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+    DecodeInstr(address, &i);
 
     // If we fetched 0 assume that we somehow hit one of the awesome
     // 'no really we meant to end after that bl' functions.
@@ -75,10 +93,7 @@ bool PPCScanner::Scan(FunctionInfo* symbol_info, DebugInfo* debug_info) {
       address -= 4;
       break;
     }
-
-    // TODO(benvanik): find a way to avoid using the opcode tables.
-    // This lookup is *expensive* and should be avoided when scanning.
-    i.type = GetInstrType(i.code);
+    instrs_.push_back(i);
 
     // TODO(benvanik): switch on instruction metadata.
     ++address_reference_count;
@@ -95,6 +110,7 @@ bool PPCScanner::Scan(FunctionInfo* symbol_info, DebugInfo* debug_info) {
     if (!in_block) {
       in_block = true;
       blocks_found++;
+      MarkBlockStart((address - start_address) / 4);
     }
 
     bool ends_fn = false;
@@ -141,6 +157,9 @@ bool PPCScanner::Scan(FunctionInfo* symbol_info, DebugInfo* debug_info) {
         // GetOrInsertFunction(target);
       } else {
         LOGPPC("b %.8X -> %.8X", address, target);
+        if (target >= start_address) {
+          branch_targets_.push_back((target - start_address) / 4);
+        }
 
         // If the target is back into the function and there's no further target
         // we are at the end of a function.
@@ -221,6 +240,9 @@ bool PPCScanner::Scan(FunctionInfo* symbol_info, DebugInfo* debug_info) {
         // GetOrInsertFunction(target);
       } else {
         LOGPPC("bc %.8X -> %.8X", address, target);
+        if (target >= start_address) {
+          branch_targets_.push_back((target - start_address) / 4);
+        }
 
         // TODO(benvanik): GetOrInsertFunction? it's likely a BB
 
@@ -258,6 +280,12 @@ bool PPCScanner::Scan(FunctionInfo* symbol_info, DebugInfo* debug_info) {
     if (end_address && address > end_address) {
       // Hmm....
       LOGPPC("Ran over function bounds! %.8X-%.8X", start_address, end_address);
+      // The end is set to this address below, so it's decoded as well.
+      DecodeInstr(address, &i);
+      instrs_.push_back(i);
+      if (!in_block) {
+        MarkBlockStart((address - start_address) / 4);
+      }
       break;
     }
   }
@@ -272,6 +300,13 @@ bool PPCScanner::Scan(FunctionInfo* symbol_info, DebugInfo* debug_info) {
   }
   symbol_info->set_end_address(address);
 
+  // Local branches also start blocks, now that it's known which are local.
+  for (uint32_t offset : branch_targets_) {
+    if (offset < instrs_.size()) {
+      MarkBlockStart(offset);
+    }
+  }
+
   // If there's spare bits at the end, split the function.
   // TODO(benvanik): splitting?
 
@@ -289,78 +324,28 @@ bool PPCScanner::Scan(FunctionInfo* symbol_info, DebugInfo* debug_info) {
   return true;
 }
 
-std::vector<BlockInfo> PPCScanner::FindBlocks(FunctionInfo* symbol_info) {
-  Memory* memory = frontend_->memory();
-
-  std::map<uint32_t, BlockInfo> block_map;
-
-  uint32_t start_address = symbol_info->address();
-  uint32_t end_address = symbol_info->end_address();
-  bool in_block = false;
-  uint32_t block_start = 0;
-  InstrData i;
-  for (uint32_t address = start_address; address <= end_address; address += 4) {
-    i.address = address;
-    i.code = xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
-    if (!i.code) {
-      continue;
-    }
-
-    // TODO(benvanik): find a way to avoid using the opcode tables.
-    // This lookup is *expensive* and should be avoided when scanning.
-    i.type = GetInstrType(i.code);
-
-    if (!in_block) {
-      in_block = true;
-      block_start = address;
-    }
-
-    bool ends_block = false;
-    if (!i.type) {
-      // Invalid instruction.
-    } else if (i.code == 0x4E800020) {
-      // blr -- unconditional branch to LR.
-      ends_block = true;
-    } else if (i.code == 0x4E800420) {
-      // bctr -- unconditional branch to CTR.
-      // This is almost always a jump table.
-      // TODO(benvanik): decode jump tables.
-      ends_block = true;
-    } else if (i.type->opcode == 0x48000000) {
-      // b/ba/bl/bla
-      // uint32_t target =
-      //    (uint32_t)XEEXTS26(i.I.LI << 2) + (i.I.AA ? 0 : (int32_t)address);
-      ends_block = true;
-    } else if (i.type->opcode == 0x40000000) {
-      // bc/bca/bcl/bcla
-      // uint32_t target =
-      //    (uint32_t)XEEXTS16(i.B.BD << 2) + (i.B.AA ? 0 : (int32_t)address);
-      ends_block = true;
-    } else if (i.type->opcode == 0x4C000020) {
-      // bclr/bclrl
-      ends_block = true;
-    } else if (i.type->opcode == 0x4C000420) {
-      // bcctr/bcctrl
-      ends_block = true;
-    }
-
-    if (ends_block) {
-      in_block = false;
-      block_map[block_start] = {
-          block_start, address,
-      };
-    }
-  }
-
-  if (in_block) {
-    block_map[block_start] = {
-        block_start, end_address,
-    };
-  }
-
+std::vector<BlockInfo> PPCScanner::FindBlocks() const {
   std::vector<BlockInfo> blocks;
-  for (auto it = block_map.begin(); it != block_map.end(); ++it) {
-    blocks.push_back(it->second);
+  if (instrs_.empty()) {
+    return blocks;
+  }
+  uint32_t start_address = instrs_.front().address;
+  uint32_t end_address = instrs_.back().address;
+  for (size_t word = 0; word < block_starts_.size(); ++word) {
+    uint64_t bits = block_starts_[word];
+    uint32_t bit;
+    while (xe::bit_scan_forward(bits, &bit)) {
+      bits &= bits - 1;
+      uint32_t address =
+          start_address + static_cast<uint32_t>(word * 64 + bit) * 4;
+      if (address > end_address) {
+        break;
+      }
+      if (!blocks.empty()) {
+        blocks.back().end_address = address - 4;
+      }
+      blocks.push_back({address, end_address});
+    }
   }
   return blocks;
 }
@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "xenia/cpu/debug_info.h"
+#include "xenia/cpu/frontend/ppc_instr.h"
 #include "xenia/cpu/symbol_info.h"
 
 namespace xe {
@@ -31,15 +32,32 @@ class PPCScanner {
   PPCScanner(PPCFrontend* frontend);
   ~PPCScanner();
 
+  // Finds the extent of the function, decoding each of its instructions once.
+  // The results are kept until the next Scan.
   bool Scan(FunctionInfo* symbol_info, DebugInfo* debug_info);
 
-  std::vector<BlockInfo> FindBlocks(FunctionInfo* symbol_info);
+  // Instructions of the last function scanned, one for each word from its
+  // start address to its end address.
+  const std::vector<InstrData>& instrs() const { return instrs_; }
+
+  // Basic blocks of the last function scanned, in address order.
+  std::vector<BlockInfo> FindBlocks() const;
 
  private:
   bool IsRestGprLr(uint32_t address);
+  void DecodeInstr(uint32_t address, InstrData* i);
+  void MarkBlockStart(uint32_t offset);
 
  private:
   PPCFrontend* frontend_;
+
+  // Reset each Scan:
+  std::vector<InstrData> instrs_;
+  // One bit per instruction, set for the first instruction of each block.
+  std::vector<uint64_t> block_starts_;
+  // Offsets of local branch targets. Whether they fall within the function
+  // isn't known until its end is found.
+  std::vector<uint32_t> branch_targets_;
 };
 
 }  // namespace frontend
@@ -13,10 +13,13 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/reset_scope.h"
+#include "xenia/cpu/backend/interp/interp_assembler.h"
 #include "xenia/cpu/compiler/compiler_passes.h"
 #include "xenia/cpu/cpu-private.h"
+#include "xenia/cpu/frontend/ppc_context.h"
 #include "xenia/cpu/frontend/ppc_disasm.h"
 #include "xenia/cpu/frontend/ppc_frontend.h"
 #include "xenia/cpu/frontend/ppc_hir_builder.h"
@@ -48,6 +51,11 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   compiler_.reset(new Compiler(frontend->processor()));
   assembler_ = std::move(backend->CreateAssembler());
   assembler_->Initialize();
+  if (FLAGS_tiered_compilation && FLAGS_baseline_interpreter) {
+    interpreter_assembler_.reset(
+        new backend::interp::InterpAssembler(backend));
+    interpreter_assembler_->Initialize();
+  }
 
   bool validate = FLAGS_validate_hir;
 
@@ -59,6 +67,8 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   // Passes are executed in the order they are added. Multiple of the same
   // pass type may be used.
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  // Context promotion works across the CFG, so rebuild it after merging.
+  compiler_->AddPass(std::make_unique<passes::ControlFlowAnalysisPass>());
   compiler_->AddPass(std::make_unique<passes::ContextPromotionPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
@@ -73,9 +83,11 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   }
   compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
-  // compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
-  // if (validate)
-  // compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  if (FLAGS_eliminate_dead_guest_stores) {
+    compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>(
+        uint32_t(offsetof(PPCContext, r) + 1 * 8)));
+    if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
   compiler_->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
 
@@ -87,27 +99,82 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   // Will modify the HIR to add loads/stores.
   // This should be the last pass before finalization, as after this all
   // registers are assigned and ready to be emitted.
-  compiler_->AddPass(std::make_unique<passes::RegisterAllocationPass>(
-      backend->machine_info()));
-  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  // Backends without registers (the interpreter) take the HIR as is.
+  bool has_registers = backend->machine_info()->register_sets[0].count != 0;
+  register_allocation_pass_ = nullptr;
+  if (has_registers) {
+    auto register_allocation_pass =
+        std::make_unique<passes::RegisterAllocationPass>(
+            backend->machine_info());
+    register_allocation_pass_ = register_allocation_pass.get();
+    compiler_->AddPass(std::move(register_allocation_pass));
+    if (validate) {
+      compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+    }
+  }
 
   // Must come last. The HIR is not really HIR after this.
   compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
+
+  // The baseline pipeline only runs what the backend requires. Constant
+  // propagation is kept as it folds operations on constants that the backend
+  // sequences don't accept.
+  baseline_compiler_.reset(new Compiler(frontend->processor()));
+  baseline_compiler_->AddPass(
+      std::make_unique<passes::ConstantPropagationPass>());
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_register_allocation_pass_ = nullptr;
+  if (has_registers && !interpreter_assembler_) {
+    auto baseline_register_allocation_pass =
+        std::make_unique<passes::RegisterAllocationPass>(
+            backend->machine_info());
+    baseline_register_allocation_pass_ =
+        baseline_register_allocation_pass.get();
+    baseline_compiler_->AddPass(std::move(baseline_register_allocation_pass));
+    if (validate) {
+      baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+    }
+  }
+  baseline_compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
 }
 
 PPCTranslator::~PPCTranslator() = default;
 
+void PPCTranslator::set_collect_statistics(bool enabled) {
+  compiler_->set_collect_statistics(enabled);
+  baseline_compiler_->set_collect_statistics(enabled);
+}
+
+const std::vector<Compiler::PassStatistics>& PPCTranslator::pass_statistics(
+    TranslationTier tier) const {
+  return tier == TranslationTier::kBaseline
+             ? baseline_compiler_->pass_statistics()
+             : compiler_->pass_statistics();
+}
+
 bool PPCTranslator::Translate(FunctionInfo* symbol_info,
-                              uint32_t debug_info_flags,
+                              uint32_t debug_info_flags, TranslationTier tier,
                               Function** out_function) {
   SCOPE_profile_cpu_f("cpu");
 
+  auto compiler = tier == TranslationTier::kBaseline ? baseline_compiler_.get()
+                                                      : compiler_.get();
+  auto assembler = tier == TranslationTier::kBaseline && interpreter_assembler_
+                       ? interpreter_assembler_.get()
+                       : assembler_.get();
+
   // Reset() all caching when we leave.
   xe::make_reset_scope(builder_);
-  xe::make_reset_scope(compiler_);
-  xe::make_reset_scope(assembler_);
+  xe::make_reset_scope(compiler);
+  xe::make_reset_scope(assembler);
   xe::make_reset_scope(&string_buffer_);
 
+  // Optimized translations run in the background, so the guest code may be
+  // written while it is being read.
+  uint32_t code_generation = symbol_info->code_generation();
+
   // NOTE: we only want to do this when required, as it's expensive to build.
   if (FLAGS_preserve_hir_disasm && frontend_->processor()->debugger() &&
       frontend_->processor()->debugger()->is_attached()) {
@@ -129,6 +196,13 @@ bool PPCTranslator::Translate(FunctionInfo* symbol_info,
   if (FLAGS_trace_function_data) {
     debug_info_flags |= DebugInfoFlags::kDebugInfoTraceFunctionData;
   }
+  if (FLAGS_hot_cold_layout && tier == TranslationTier::kBaseline &&
+      !interpreter_assembler_) {
+    // Coverage counts are the profile for the block layout of the recompile.
+    // The interpreter doesn't keep them.
+    debug_info_flags |= DebugInfoFlags::kDebugInfoTraceFunctions |
+                        DebugInfoFlags::kDebugInfoTraceFunctionCoverage;
+  }
   std::unique_ptr<DebugInfo> debug_info;
   if (debug_info_flags) {
     debug_info.reset(new DebugInfo());
@@ -158,6 +232,8 @@ bool PPCTranslator::Translate(FunctionInfo* symbol_info,
       debug_info->trace_data().Reset(trace_data, trace_data_size,
                                      symbol_info->address(),
                                      symbol_info->end_address());
+    } else {
+      debug_info_flags &= ~DebugInfoFlags::kDebugInfoAllTracing;
     }
   }
 
@@ -177,9 +253,22 @@ bool PPCTranslator::Translate(FunctionInfo* symbol_info,
   if (debug_info) {
     emit_flags |= PPCHIRBuilder::EMIT_DEBUG_COMMENTS;
   }
-  if (!builder_->Emit(symbol_info, emit_flags)) {
+  if (FLAGS_inline_save_restore) {
+    emit_flags |= PPCHIRBuilder::EMIT_INLINE_SAVE_RESTORE;
+  }
+  // Inlined callees would be missing from traces, and aren't worth the
+  // translation time until a function is hot.
+  if (tier == TranslationTier::kOptimized &&
+      !(debug_info_flags & DebugInfoFlags::kDebugInfoAllTracing)) {
+    emit_flags |= PPCHIRBuilder::EMIT_INLINE_LEAF_CALLS;
+  }
+  if (!builder_->Emit(symbol_info, scanner_->instrs(), emit_flags)) {
     return false;
   }
+  if (tier == TranslationTier::kBaseline) {
+    builder_->set_attributes(builder_->attributes() |
+                             hir::FUNCTION_ATTRIB_BASELINE);
+  }
 
   // Stash raw HIR.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmRawHir) {
@@ -189,9 +278,17 @@ bool PPCTranslator::Translate(FunctionInfo* symbol_info,
   }
 
   // Compile/optimize/etc.
-  if (!compiler_->Compile(builder_.get())) {
+  if (!compiler->Compile(builder_.get())) {
     return false;
   }
+  auto register_allocation_pass = tier == TranslationTier::kBaseline
+                                      ? baseline_register_allocation_pass_
+                                      : register_allocation_pass_;
+  if (FLAGS_trace_register_allocation && register_allocation_pass) {
+    XELOGI("Register allocation: %.8X %u spills, %u reloads",
+           symbol_info->address(), register_allocation_pass->spill_count(),
+           register_allocation_pass->reload_count());
+  }
 
   // Stash optimized HIR.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmHir) {
@@ -200,45 +297,42 @@ bool PPCTranslator::Translate(FunctionInfo* symbol_info,
     string_buffer_.Reset();
   }
 
+  // Placing stale code would point callers at it, if only until it is found
+  // stale again and freed.
+  if (tier == TranslationTier::kOptimized &&
+      symbol_info->code_generation() != code_generation) {
+    return false;
+  }
+
   // Assemble to backend machine code.
-  if (!assembler_->Assemble(symbol_info, builder_.get(), debug_info_flags,
-                            std::move(debug_info), out_function)) {
+  if (!assembler->Assemble(symbol_info, builder_.get(), debug_info_flags,
+                           std::move(debug_info), out_function)) {
     return false;
   }
+  (*out_function)->set_inlined_ranges(builder_->inlined_ranges());
 
   return true;
 };
 
 void PPCTranslator::DumpSource(FunctionInfo* symbol_info,
                                StringBuffer* string_buffer) {
-  Memory* memory = frontend_->memory();
-
   string_buffer->AppendFormat(
       "%s fn %.8X-%.8X %s\n", symbol_info->module()->name().c_str(),
       symbol_info->address(), symbol_info->end_address(),
       symbol_info->name().c_str());
 
-  auto blocks = scanner_->FindBlocks(symbol_info);
+  auto blocks = scanner_->FindBlocks();
 
-  uint32_t start_address = symbol_info->address();
-  uint32_t end_address = symbol_info->end_address();
-  InstrData i;
   auto block_it = blocks.begin();
-  for (uint32_t address = start_address, offset = 0; address <= end_address;
-       address += 4, offset++) {
-    i.address = address;
-    i.code = xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
-    // TODO(benvanik): find a way to avoid using the opcode tables.
-    i.type = GetInstrType(i.code);
-
+  for (auto i : scanner_->instrs()) {
     // Check labels.
-    if (block_it != blocks.end() && block_it->start_address == address) {
-      string_buffer->AppendFormat("%.8X          loc_%.8X:\n", address,
-                                  address);
+    if (block_it != blocks.end() && block_it->start_address == i.address) {
+      string_buffer->AppendFormat("%.8X          loc_%.8X:\n", i.address,
+                                  i.address);
       ++block_it;
     }
 
-    string_buffer->AppendFormat("%.8X %.8X   ", address, i.code);
+    string_buffer->AppendFormat("%.8X %.8X   ", i.address, i.code);
     DisasmPPC(i, string_buffer);
     string_buffer->Append('\n');
   }
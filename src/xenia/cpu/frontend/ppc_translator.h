@@ -11,12 +11,23 @@
 #define XENIA_FRONTEND_PPC_TRANSLATOR_H_
 
 #include <memory>
+#include <vector>
 
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/backend/assembler.h"
 #include "xenia/cpu/compiler/compiler.h"
 #include "xenia/cpu/symbol_info.h"
 
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+class RegisterAllocationPass;
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
 namespace xe {
 namespace cpu {
 namespace frontend {
@@ -25,13 +36,26 @@ class PPCFrontend;
 class PPCHIRBuilder;
 class PPCScanner;
 
+// How much effort goes into translating a function. Baseline code is quick to
+// produce and is recompiled at the optimized tier once it gets hot.
+enum class TranslationTier : uint32_t {
+  kBaseline = 0,
+  kOptimized = 1,
+};
+
 class PPCTranslator {
  public:
   PPCTranslator(PPCFrontend* frontend);
   ~PPCTranslator();
 
   bool Translate(FunctionInfo* symbol_info, uint32_t debug_info_flags,
-                 Function** out_function);
+                 TranslationTier tier, Function** out_function);
+
+  // Enables per-pass measurements in both compilers. Used by tooling.
+  void set_collect_statistics(bool enabled);
+  // Per-pass measurements of the last function translated at the given tier.
+  const std::vector<compiler::Compiler::PassStatistics>& pass_statistics(
+      TranslationTier tier) const;
 
  private:
   void DumpSource(FunctionInfo* symbol_info, StringBuffer* string_buffer);
@@ -41,7 +65,13 @@ class PPCTranslator {
   std::unique_ptr<PPCScanner> scanner_;
   std::unique_ptr<PPCHIRBuilder> builder_;
   std::unique_ptr<compiler::Compiler> compiler_;
+  std::unique_ptr<compiler::Compiler> baseline_compiler_;
+  // Owned by the compilers above; kept for their statistics.
+  compiler::passes::RegisterAllocationPass* register_allocation_pass_;
+  compiler::passes::RegisterAllocationPass* baseline_register_allocation_pass_;
   std::unique_ptr<backend::Assembler> assembler_;
+  // Assembles baseline functions instead, with --baseline_interpreter.
+  std::unique_ptr<backend::Assembler> interpreter_assembler_;
 
   StringBuffer string_buffer_;
 };
@@ -0,0 +1,61 @@
+test_dead_store_1:
+  #_ REGISTER_IN r1 0x2000
+  #_ REGISTER_IN r4 0x11
+  #_ REGISTER_IN r5 0x22
+  stw r4, 16(r1)
+  stw r5, 16(r1)
+  blr
+  #_ MEMORY_OUT 00002010 00 00 00 22
+
+test_dead_store_2:
+  #_ REGISTER_IN r1 0x2000
+  #_ REGISTER_IN r4 0x11223344
+  #_ REGISTER_IN r5 0x55
+  stw r4, 16(r1)
+  stb r5, 16(r1)
+  blr
+  #_ MEMORY_OUT 00002010 55 22 33 44
+
+test_dead_store_3:
+  #_ REGISTER_IN r1 0x2000
+  #_ REGISTER_IN r4 0x11
+  #_ REGISTER_IN r5 0x22
+  stw r4, 16(r1)
+  lwz r6, 16(r1)
+  stw r5, 16(r1)
+  blr
+  #_ REGISTER_OUT r6 0x11
+  #_ MEMORY_OUT 00002010 00 00 00 22
+
+test_dead_store_4:
+  #_ REGISTER_IN r1 0x2000
+  #_ REGISTER_IN r4 0x11
+  #_ REGISTER_IN r5 0x22
+  #_ REGISTER_IN r7 0x2010
+  stw r4, 16(r1)
+  lwz r6, 0(r7)
+  stw r5, 16(r1)
+  blr
+  #_ REGISTER_OUT r6 0x11
+  #_ MEMORY_OUT 00002010 00 00 00 22
+
+test_dead_store_5:
+  #_ REGISTER_IN r1 0x2000
+  #_ REGISTER_IN r4 0x11
+  #_ REGISTER_IN r5 0x22
+  stw r4, 20(r1)
+  std r5, 16(r1)
+  blr
+  #_ MEMORY_OUT 00002010 00 00 00 00 00 00 00 22
+
+test_dead_store_6:
+  #_ REGISTER_IN r1 0x2000
+  #_ REGISTER_IN r4 0x11
+  #_ REGISTER_IN r5 0x22
+  stwu r1, -16(r1)
+  stw r4, 8(r1)
+  stw r5, 8(r1)
+  lwz r6, 0x1FF8(0)
+  blr
+  #_ REGISTER_OUT r1 0x1FF0
+  #_ REGISTER_OUT r6 0x22
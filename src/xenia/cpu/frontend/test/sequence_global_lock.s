@@ -0,0 +1,28 @@
+test_global_lock_1:
+  # Nested disable/enable pairs, as kernel-style code does around critical
+  # sections. mfmsr always reads as enabled.
+  mfmsr r12
+  mtmsrd r13, 1
+  mfmsr r11
+  mtmsrd r13, 1
+  li r3, 1
+  mtmsrd r11, 1
+  mtmsrd r12, 1
+  blr
+  #_ REGISTER_OUT r3 1
+  #_ REGISTER_OUT r11 0x8000
+  #_ REGISTER_OUT r12 0x8000
+
+test_global_lock_2:
+  # Enabling interrupts that were never disabled leaves the lock alone, and
+  # it can still be taken afterwards.
+  li r12, 0
+  ori r12, r12, 0x8000
+  mtmsrd r12, 1
+  mtmsrd r13, 1
+  li r3, 2
+  mtmsrd r12, 1
+  mtmsrd r12, 1
+  blr
+  #_ REGISTER_OUT r3 2
+  #_ REGISTER_OUT r12 0x8000
@@ -0,0 +1,63 @@
+inline_clamp:
+  add r3, r3, r4
+  cmpwi r3, 16
+  blt .inline_clamp_done
+  li r3, 16
+.inline_clamp_done:
+  blr
+
+inline_multiply:
+  li r5, 0
+.inline_multiply_next:
+  add r5, r5, r3
+  addic. r4, r4, -1
+  bne .inline_multiply_next
+  mr r3, r5
+  blr
+
+inline_early_return:
+  cmpwi r3, 0
+  beqlr
+  li r3, 1
+  blr
+
+test_inline_calls_1:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 6
+  mfspr r12, lr
+  bl inline_clamp
+  mtspr lr, r12
+  blr
+  #_ REGISTER_OUT r3 11
+
+test_inline_calls_2:
+  #_ REGISTER_IN r3 10
+  #_ REGISTER_IN r4 20
+  mfspr r12, lr
+  bl inline_clamp
+  mtspr lr, r12
+  blr
+  #_ REGISTER_OUT r3 16
+
+test_inline_calls_3:
+  #_ REGISTER_IN r3 3
+  #_ REGISTER_IN r4 4
+  mfspr r12, lr
+  bl inline_multiply
+  mtspr lr, r12
+  blr
+  #_ REGISTER_OUT r3 12
+  #_ REGISTER_OUT r4 0
+
+test_inline_calls_4:
+  #_ REGISTER_IN r3 0
+  #_ REGISTER_IN r4 7
+  mfspr r12, lr
+  bl inline_early_return
+  mr r4, r3
+  li r3, 7
+  bl inline_early_return
+  mtspr lr, r12
+  blr
+  #_ REGISTER_OUT r3 1
+  #_ REGISTER_OUT r4 0
@@ -26,6 +26,8 @@ DEFINE_string(test_path, "src/xenia/cpu/frontend/test/",
 DEFINE_string(test_bin_path, "src/xenia/cpu/frontend/test/bin/",
               "Directory with binary outputs of the test files.");
 
+DECLARE_bool(eliminate_dead_guest_stores);
+
 namespace xe {
 namespace cpu {
 namespace test {
@@ -480,6 +482,10 @@ int main(std::vector<std::wstring>& args) {
     test_name = args[1];
   }
 
+  // Optional passes default to off; the sequence tests for them would pass
+  // without them running, and everything else must hold with them on.
+  FLAGS_eliminate_dead_guest_stores = true;
+
   return RunTests(test_name) ? 0 : 1;
 }
 
@@ -12,6 +12,7 @@
 
 #include <memory>
 #include <mutex>
+#include <utility>
 #include <vector>
 
 #include "xenia/base/mutex.h"
@@ -37,6 +38,15 @@ class Function {
     debug_info_ = std::move(debug_info);
   }
 
+  // Guest code of other functions inlined into this one, as inclusive
+  // address ranges. Writing any of it leaves this function stale too.
+  const std::vector<std::pair<uint32_t, uint32_t>>& inlined_ranges() const {
+    return inlined_ranges_;
+  }
+  void set_inlined_ranges(std::vector<std::pair<uint32_t, uint32_t>> ranges) {
+    inlined_ranges_ = std::move(ranges);
+  }
+
   virtual uint8_t* machine_code() const = 0;
   virtual size_t machine_code_length() const = 0;
 
@@ -55,6 +65,7 @@ class Function {
   uint32_t address_;
   FunctionInfo* symbol_info_;
   std::unique_ptr<DebugInfo> debug_info_;
+  std::vector<std::pair<uint32_t, uint32_t>> inlined_ranges_;
 
   // TODO(benvanik): move elsewhere? DebugData?
   xe::mutex lock_;
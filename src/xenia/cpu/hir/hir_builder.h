@@ -10,6 +10,7 @@
 #ifndef XENIA_HIR_HIR_BUILDER_H_
 #define XENIA_HIR_HIR_BUILDER_H_
 
+#include <utility>
 #include <vector>
 
 #include "xenia/base/arena.h"
@@ -27,6 +28,8 @@ namespace hir {
 
 enum FunctionAttributes {
   FUNCTION_ATTRIB_INLINE = (1 << 1),
+  // Baseline tier code; counts its calls and requests recompilation.
+  FUNCTION_ATTRIB_BASELINE = (1 << 2),
 };
 
 class HIRBuilder {
@@ -47,6 +50,15 @@ class HIRBuilder {
 
   std::vector<Value*>& locals() { return locals_; }
 
+  // Guest code of other functions inlined into this one, as inclusive
+  // address ranges.
+  const std::vector<std::pair<uint32_t, uint32_t>>& inlined_ranges() const {
+    return inlined_ranges_;
+  }
+  void AddInlinedRange(uint32_t start_address, uint32_t end_address) {
+    inlined_ranges_.push_back({start_address, end_address});
+  }
+
   uint32_t max_value_ordinal() const { return next_value_ordinal_; }
 
   Block* first_block() const { return block_head_; }
@@ -265,6 +277,7 @@ class HIRBuilder {
   uint32_t next_value_ordinal_;
 
   std::vector<Value*> locals_;
+  std::vector<std::pair<uint32_t, uint32_t>> inlined_ranges_;
 
   Block* block_head_;
   Block* block_tail_;
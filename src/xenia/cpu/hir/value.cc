@@ -10,6 +10,7 @@
 #include "xenia/cpu/hir/value.h"
 
 #include <cmath>
+#include <type_traits>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
@@ -492,6 +493,10 @@ void Value::And(Value* other) {
     case INT64_TYPE:
       constant.i64 &= other->constant.i64;
       break;
+    case VEC128_TYPE:
+      constant.v128.low &= other->constant.v128.low;
+      constant.v128.high &= other->constant.v128.high;
+      break;
     default:
       assert_unhandled_case(type);
       break;
@@ -513,6 +518,10 @@ void Value::Or(Value* other) {
     case INT64_TYPE:
       constant.i64 |= other->constant.i64;
       break;
+    case VEC128_TYPE:
+      constant.v128.low |= other->constant.v128.low;
+      constant.v128.high |= other->constant.v128.high;
+      break;
     default:
       assert_unhandled_case(type);
       break;
@@ -534,6 +543,10 @@ void Value::Xor(Value* other) {
     case INT64_TYPE:
       constant.i64 ^= other->constant.i64;
       break;
+    case VEC128_TYPE:
+      constant.v128.low ^= other->constant.v128.low;
+      constant.v128.high ^= other->constant.v128.high;
+      break;
     default:
       assert_unhandled_case(type);
       break;
@@ -672,6 +685,401 @@ void Value::CountLeadingZeros(const Value* other) {
   }
 }
 
+namespace {
+
+// Applies fn to each pair of lanes, storing the result in the first.
+// Lane order doesn't matter for these so the host layout is used as-is.
+template <typename T, size_t N, typename F>
+void VectorLaneOp(T (&a)[N], const T (&b)[N], F fn) {
+  for (size_t n = 0; n < N; ++n) {
+    a[n] = fn(a[n], b[n]);
+  }
+}
+
+template <typename T>
+T VectorCompareLane(Opcode opcode, T a, T b) {
+  typedef typename std::make_unsigned<T>::type U;
+  bool result;
+  switch (opcode) {
+    case OPCODE_VECTOR_COMPARE_EQ:
+      result = a == b;
+      break;
+    case OPCODE_VECTOR_COMPARE_SGT:
+      result = a > b;
+      break;
+    case OPCODE_VECTOR_COMPARE_SGE:
+      result = a >= b;
+      break;
+    case OPCODE_VECTOR_COMPARE_UGT:
+      result = U(a) > U(b);
+      break;
+    case OPCODE_VECTOR_COMPARE_UGE:
+      result = U(a) >= U(b);
+      break;
+    default:
+      assert_unhandled_case(opcode);
+      result = false;
+      break;
+  }
+  return result ? T(-1) : T(0);
+}
+
+template <typename T>
+T VectorAddLane(T a, T b) {
+  return T(a + b);
+}
+
+template <typename T>
+T VectorSubLane(T a, T b) {
+  return T(a - b);
+}
+
+// Shift amounts are taken modulo the lane width, as VMX does.
+template <typename T>
+T VectorShlLane(T a, T b) {
+  return T(a << (b & (sizeof(T) * 8 - 1)));
+}
+
+template <typename T>
+T VectorShrLane(T a, T b) {
+  return T(a >> (b & (sizeof(T) * 8 - 1)));
+}
+
+template <typename T>
+T VectorRotateLeftLane(T a, T b) {
+  const uint32_t bits = sizeof(T) * 8;
+  uint32_t n = b & (bits - 1);
+  return n ? T((a << n) | (a >> (bits - n))) : a;
+}
+
+template <typename T>
+T VectorMaxLane(T a, T b) {
+  return a > b ? a : b;
+}
+
+template <typename T>
+T VectorMinLane(T a, T b) {
+  return a < b ? a : b;
+}
+
+// Rounds up, as vavg* does.
+template <typename T>
+T VectorAverageLane(T a, T b) {
+  return T((int64_t(a) + int64_t(b) + 1) >> 1);
+}
+
+}  // namespace
+
+void Value::VectorCompare(Opcode opcode, Value* other, TypeName type) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  auto& a = constant.v128;
+  auto& b = other->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      VectorLaneOp(a.i8, b.i8, [opcode](int8_t x, int8_t y) {
+        return VectorCompareLane(opcode, x, y);
+      });
+      break;
+    case INT16_TYPE:
+      VectorLaneOp(a.i16, b.i16, [opcode](int16_t x, int16_t y) {
+        return VectorCompareLane(opcode, x, y);
+      });
+      break;
+    case INT32_TYPE:
+      VectorLaneOp(a.i32, b.i32, [opcode](int32_t x, int32_t y) {
+        return VectorCompareLane(opcode, x, y);
+      });
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::VectorAdd(Value* other, TypeName type) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  auto& a = constant.v128;
+  auto& b = other->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      VectorLaneOp(a.u8, b.u8, VectorAddLane<uint8_t>);
+      break;
+    case INT16_TYPE:
+      VectorLaneOp(a.u16, b.u16, VectorAddLane<uint16_t>);
+      break;
+    case INT32_TYPE:
+      VectorLaneOp(a.u32, b.u32, VectorAddLane<uint32_t>);
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::VectorSub(Value* other, TypeName type) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  auto& a = constant.v128;
+  auto& b = other->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      VectorLaneOp(a.u8, b.u8, VectorSubLane<uint8_t>);
+      break;
+    case INT16_TYPE:
+      VectorLaneOp(a.u16, b.u16, VectorSubLane<uint16_t>);
+      break;
+    case INT32_TYPE:
+      VectorLaneOp(a.u32, b.u32, VectorSubLane<uint32_t>);
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::VectorShl(Value* other, TypeName type) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  auto& a = constant.v128;
+  auto& b = other->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      VectorLaneOp(a.u8, b.u8, VectorShlLane<uint8_t>);
+      break;
+    case INT16_TYPE:
+      VectorLaneOp(a.u16, b.u16, VectorShlLane<uint16_t>);
+      break;
+    case INT32_TYPE:
+      VectorLaneOp(a.u32, b.u32, VectorShlLane<uint32_t>);
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::VectorShr(Value* other, TypeName type) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  auto& a = constant.v128;
+  auto& b = other->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      VectorLaneOp(a.u8, b.u8, VectorShrLane<uint8_t>);
+      break;
+    case INT16_TYPE:
+      VectorLaneOp(a.u16, b.u16, VectorShrLane<uint16_t>);
+      break;
+    case INT32_TYPE:
+      VectorLaneOp(a.u32, b.u32, VectorShrLane<uint32_t>);
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::VectorSha(Value* other, TypeName type) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  auto& a = constant.v128;
+  auto& b = other->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      VectorLaneOp(a.i8, b.i8, VectorShrLane<int8_t>);
+      break;
+    case INT16_TYPE:
+      VectorLaneOp(a.i16, b.i16, VectorShrLane<int16_t>);
+      break;
+    case INT32_TYPE:
+      VectorLaneOp(a.i32, b.i32, VectorShrLane<int32_t>);
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::VectorRotateLeft(Value* other, TypeName type) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  auto& a = constant.v128;
+  auto& b = other->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      VectorLaneOp(a.u8, b.u8, VectorRotateLeftLane<uint8_t>);
+      break;
+    case INT16_TYPE:
+      VectorLaneOp(a.u16, b.u16, VectorRotateLeftLane<uint16_t>);
+      break;
+    case INT32_TYPE:
+      VectorLaneOp(a.u32, b.u32, VectorRotateLeftLane<uint32_t>);
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::VectorMax(Value* other, TypeName type, bool is_unsigned) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  auto& a = constant.v128;
+  auto& b = other->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      if (is_unsigned) {
+        VectorLaneOp(a.u8, b.u8, VectorMaxLane<uint8_t>);
+      } else {
+        VectorLaneOp(a.i8, b.i8, VectorMaxLane<int8_t>);
+      }
+      break;
+    case INT16_TYPE:
+      if (is_unsigned) {
+        VectorLaneOp(a.u16, b.u16, VectorMaxLane<uint16_t>);
+      } else {
+        VectorLaneOp(a.i16, b.i16, VectorMaxLane<int16_t>);
+      }
+      break;
+    case INT32_TYPE:
+      if (is_unsigned) {
+        VectorLaneOp(a.u32, b.u32, VectorMaxLane<uint32_t>);
+      } else {
+        VectorLaneOp(a.i32, b.i32, VectorMaxLane<int32_t>);
+      }
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::VectorMin(Value* other, TypeName type, bool is_unsigned) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  auto& a = constant.v128;
+  auto& b = other->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      if (is_unsigned) {
+        VectorLaneOp(a.u8, b.u8, VectorMinLane<uint8_t>);
+      } else {
+        VectorLaneOp(a.i8, b.i8, VectorMinLane<int8_t>);
+      }
+      break;
+    case INT16_TYPE:
+      if (is_unsigned) {
+        VectorLaneOp(a.u16, b.u16, VectorMinLane<uint16_t>);
+      } else {
+        VectorLaneOp(a.i16, b.i16, VectorMinLane<int16_t>);
+      }
+      break;
+    case INT32_TYPE:
+      if (is_unsigned) {
+        VectorLaneOp(a.u32, b.u32, VectorMinLane<uint32_t>);
+      } else {
+        VectorLaneOp(a.i32, b.i32, VectorMinLane<int32_t>);
+      }
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::VectorAverage(Value* other, TypeName type, bool is_unsigned) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  auto& a = constant.v128;
+  auto& b = other->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      if (is_unsigned) {
+        VectorLaneOp(a.u8, b.u8, VectorAverageLane<uint8_t>);
+      } else {
+        VectorLaneOp(a.i8, b.i8, VectorAverageLane<int8_t>);
+      }
+      break;
+    case INT16_TYPE:
+      if (is_unsigned) {
+        VectorLaneOp(a.u16, b.u16, VectorAverageLane<uint16_t>);
+      } else {
+        VectorLaneOp(a.i16, b.i16, VectorAverageLane<int16_t>);
+      }
+      break;
+    case INT32_TYPE:
+      if (is_unsigned) {
+        VectorLaneOp(a.u32, b.u32, VectorAverageLane<uint32_t>);
+      } else {
+        VectorLaneOp(a.i32, b.i32, VectorAverageLane<int32_t>);
+      }
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::Splat(const Value* other) {
+  switch (other->type) {
+    case INT8_TYPE:
+      set_constant(vec128b(uint8_t(other->constant.i8)));
+      break;
+    case INT16_TYPE:
+      set_constant(vec128s(uint16_t(other->constant.i16)));
+      break;
+    case INT32_TYPE:
+      set_constant(vec128i(uint32_t(other->constant.i32)));
+      break;
+    case FLOAT32_TYPE:
+      set_constant(vec128f(other->constant.f32));
+      break;
+    default:
+      assert_unhandled_case(other->type);
+      break;
+  }
+}
+
+// Element indices are in guest order; see the layout notes in vec128.h.
+void Value::Insert(const Value* index, const Value* part) {
+  assert_true(type == VEC128_TYPE && index->type == INT8_TYPE);
+  uint8_t n = uint8_t(index->constant.i8);
+  switch (part->type) {
+    case INT8_TYPE:
+      constant.v128.u8[(n ^ 0x3) & 0xF] = uint8_t(part->constant.i8);
+      break;
+    case INT16_TYPE:
+      constant.v128.u16[(n ^ 0x1) & 0x7] = uint16_t(part->constant.i16);
+      break;
+    case INT32_TYPE:
+      constant.v128.u32[n & 0x3] = uint32_t(part->constant.i32);
+      break;
+    default:
+      assert_unhandled_case(part->type);
+      break;
+  }
+}
+
+void Value::Extract(const Value* other, const Value* index) {
+  assert_true(other->type == VEC128_TYPE && index->type == INT8_TYPE);
+  uint8_t n = uint8_t(index->constant.i8);
+  switch (type) {
+    case INT8_TYPE:
+      set_constant(other->constant.v128.u8[(n ^ 0x3) & 0xF]);
+      break;
+    case INT16_TYPE:
+      set_constant(other->constant.v128.u16[(n ^ 0x1) & 0x7]);
+      break;
+    case INT32_TYPE:
+      set_constant(other->constant.v128.u32[n & 0x3]);
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::Swizzle(uint32_t swizzle_mask) {
+  assert_true(type == VEC128_TYPE);
+  vec128_t result;
+  for (int n = 0; n < 4; n++) {
+    result.u32[n] = constant.v128.u32[(swizzle_mask >> (n * 2)) & 0x3];
+  }
+  constant.v128 = result;
+}
+
 bool Value::Compare(Opcode opcode, Value* other) {
   assert_true(type == other->type);
   switch (other->type) {
@@ -498,6 +498,20 @@ class Value {
   void Sha(Value* other);
   void ByteSwap();
   void CountLeadingZeros(const Value* other);
+  void VectorCompare(Opcode opcode, Value* other, TypeName type);
+  void VectorAdd(Value* other, TypeName type);
+  void VectorSub(Value* other, TypeName type);
+  void VectorShl(Value* other, TypeName type);
+  void VectorShr(Value* other, TypeName type);
+  void VectorSha(Value* other, TypeName type);
+  void VectorRotateLeft(Value* other, TypeName type);
+  void VectorMax(Value* other, TypeName type, bool is_unsigned);
+  void VectorMin(Value* other, TypeName type, bool is_unsigned);
+  void VectorAverage(Value* other, TypeName type, bool is_unsigned);
+  void Splat(const Value* other);
+  void Insert(const Value* index, const Value* part);
+  void Extract(const Value* other, const Value* index);
+  void Swizzle(uint32_t swizzle_mask);
   bool Compare(Opcode opcode, Value* other);
 
  private:
@@ -109,6 +109,7 @@ uintptr_t MMIOHandler::AddPhysicalWriteWatch(uint32_t guest_address,
   // Add to table. The slot reservation may evict a previous watch, which
   // could include our target, so we do it first.
   auto entry = new WriteWatchEntry();
+  entry->is_virtual = false;
   entry->address = base_address;
   entry->length = uint32_t(length);
   entry->callback = callback;
@@ -132,8 +133,39 @@ uintptr_t MMIOHandler::AddPhysicalWriteWatch(uint32_t guest_address,
   return reinterpret_cast<uintptr_t>(entry);
 }
 
+uintptr_t MMIOHandler::AddVirtualWriteWatch(uint32_t guest_address,
+                                            size_t length,
+                                            WriteWatchCallback callback,
+                                            void* callback_context,
+                                            void* callback_data) {
+  // Rounded up to the system page size, as above.
+  length = xe::round_up(length, xe::page_size());
+
+  auto entry = new WriteWatchEntry();
+  entry->is_virtual = true;
+  entry->address = guest_address;
+  entry->length = uint32_t(length);
+  entry->callback = callback;
+  entry->callback_context = callback_context;
+  entry->callback_data = callback_data;
+  write_watch_mutex_.lock();
+  write_watches_.push_back(entry);
+  write_watch_mutex_.unlock();
+
+  DWORD old_protect;
+  VirtualProtect(virtual_membase_ + entry->address, entry->length,
+                 PAGE_READONLY, &old_protect);
+
+  return reinterpret_cast<uintptr_t>(entry);
+}
+
 void MMIOHandler::ClearWriteWatch(WriteWatchEntry* entry) {
   DWORD old_protect;
+  if (entry->is_virtual) {
+    VirtualProtect(virtual_membase_ + entry->address, entry->length,
+                   PAGE_READWRITE, &old_protect);
+    return;
+  }
   VirtualProtect(physical_membase_ + entry->address, entry->length,
                  PAGE_READWRITE, &old_protect);
   VirtualProtect(virtual_membase_ + 0xA0000000 + entry->address, entry->length,
@@ -166,12 +198,20 @@ bool MMIOHandler::CheckWriteWatch(void* thread_state, uint64_t fault_address) {
   if (physical_address > 0x1FFFFFFF) {
     physical_address &= 0x1FFFFFFF;
   }
+  // Virtual watches only match faults in the virtual range itself.
+  bool is_virtual_fault = fault_address < uint64_t(physical_membase_);
+  uint32_t virtual_address =
+      uint32_t(fault_address - uint64_t(virtual_membase_));
   std::list<WriteWatchEntry*> pending_invalidates;
   write_watch_mutex_.lock();
   for (auto it = write_watches_.begin(); it != write_watches_.end();) {
     auto entry = *it;
-    if (entry->address <= physical_address &&
-        entry->address + entry->length > physical_address) {
+    if (entry->is_virtual && !is_virtual_fault) {
+      ++it;
+      continue;
+    }
+    uint32_t address = entry->is_virtual ? virtual_address : physical_address;
+    if (entry->address <= address && entry->address + entry->length > address) {
       // Hit!
       pending_invalidates.push_back(entry);
       // TODO(benvanik): outside of lock?
@@ -192,7 +232,7 @@ bool MMIOHandler::CheckWriteWatch(void* thread_state, uint64_t fault_address) {
     auto entry = pending_invalidates.back();
     pending_invalidates.pop_back();
     entry->callback(entry->callback_context, entry->callback_data,
-                    physical_address);
+                    entry->is_virtual ? virtual_address : physical_address);
     delete entry;
   }
   // Range was watched, so lets eat this access violation.
@@ -57,6 +57,11 @@ class MMIOHandler {
   uintptr_t AddPhysicalWriteWatch(uint32_t guest_address, size_t length,
                                   WriteWatchCallback callback,
                                   void* callback_context, void* callback_data);
+  // Watches only the given virtual range, for memory with no physical
+  // backing such as the XEX heap.
+  uintptr_t AddVirtualWriteWatch(uint32_t guest_address, size_t length,
+                                 WriteWatchCallback callback,
+                                 void* callback_context, void* callback_data);
   void CancelWriteWatch(uintptr_t watch_handle);
 
  public:
@@ -64,6 +69,7 @@ class MMIOHandler {
 
  protected:
   struct WriteWatchEntry {
+    bool is_virtual;
     uint32_t address;
     uint32_t length;
     WriteWatchCallback callback;
@@ -20,25 +20,26 @@ namespace xe {
 namespace cpu {
 
 Module::Module(Processor* processor)
-    : processor_(processor), memory_(processor->memory()) {}
+    : processor_(processor), memory_(processor->memory()), code_hash_(0) {}
 
 Module::~Module() = default;
 
 bool Module::ContainsAddress(uint32_t address) { return true; }
 
 SymbolInfo* Module::LookupSymbol(uint32_t address, bool wait) {
-  lock_.lock();
-  const auto it = map_.find(address);
-  SymbolInfo* symbol_info = it != map_.end() ? it->second : nullptr;
+  auto& shard = symbol_shard(address);
+  shard.lock.lock();
+  const auto it = shard.map.find(address);
+  SymbolInfo* symbol_info = it != shard.map.end() ? it->second : nullptr;
   if (symbol_info) {
     if (symbol_info->status() == SymbolStatus::kDeclaring) {
       // Some other thread is declaring the symbol - wait.
       if (wait) {
         do {
-          lock_.unlock();
+          shard.lock.unlock();
           // TODO(benvanik): sleep for less time?
           xe::threading::Sleep(std::chrono::microseconds(100));
-          lock_.lock();
+          shard.lock.lock();
         } while (symbol_info->status() == SymbolStatus::kDeclaring);
       } else {
         // Immediate request, just return.
@@ -46,31 +47,32 @@ SymbolInfo* Module::LookupSymbol(uint32_t address, bool wait) {
       }
     }
   }
-  lock_.unlock();
+  shard.lock.unlock();
   return symbol_info;
 }
 
 SymbolStatus Module::DeclareSymbol(SymbolType type, uint32_t address,
                                    SymbolInfo** out_symbol_info) {
   *out_symbol_info = nullptr;
-  lock_.lock();
-  auto it = map_.find(address);
-  SymbolInfo* symbol_info = it != map_.end() ? it->second : nullptr;
+  auto& shard = symbol_shard(address);
+  shard.lock.lock();
+  auto it = shard.map.find(address);
+  SymbolInfo* symbol_info = it != shard.map.end() ? it->second : nullptr;
   SymbolStatus status;
   if (symbol_info) {
     // If we exist but are the wrong type, die.
     if (symbol_info->type() != type) {
-      lock_.unlock();
+      shard.lock.unlock();
       return SymbolStatus::kFailed;
     }
     // If we aren't ready yet spin and wait.
     if (symbol_info->status() == SymbolStatus::kDeclaring) {
       // Still declaring, so spin.
       do {
-        lock_.unlock();
+        shard.lock.unlock();
         // TODO(benvanik): sleep for less time?
         xe::threading::Sleep(std::chrono::microseconds(100));
-        lock_.lock();
+        shard.lock.lock();
       } while (symbol_info->status() == SymbolStatus::kDeclaring);
     }
     status = symbol_info->status();
@@ -84,11 +86,14 @@ SymbolStatus Module::DeclareSymbol(SymbolType type, uint32_t address,
         symbol_info = new VariableInfo(this, address);
         break;
     }
-    map_[address] = symbol_info;
-    list_.emplace_back(symbol_info);
+    shard.map[address] = symbol_info;
+    {
+      std::lock_guard<xe::mutex> guard(list_lock_);
+      list_.emplace_back(symbol_info);
+    }
     status = SymbolStatus::kNew;
   }
-  lock_.unlock();
+  shard.lock.unlock();
   *out_symbol_info = symbol_info;
 
   // Get debug info from providers, if this is new.
@@ -118,7 +123,8 @@ SymbolStatus Module::DeclareVariable(uint32_t address,
 }
 
 SymbolStatus Module::DefineSymbol(SymbolInfo* symbol_info) {
-  lock_.lock();
+  auto& shard = symbol_shard(symbol_info->address());
+  shard.lock.lock();
   SymbolStatus status;
   if (symbol_info->status() == SymbolStatus::kDeclared) {
     // Declared but undefined, so request caller define it.
@@ -127,16 +133,16 @@ SymbolStatus Module::DefineSymbol(SymbolInfo* symbol_info) {
   } else if (symbol_info->status() == SymbolStatus::kDefining) {
     // Still defining, so spin.
     do {
-      lock_.unlock();
+      shard.lock.unlock();
       // TODO(benvanik): sleep for less time?
       xe::threading::Sleep(std::chrono::microseconds(100));
-      lock_.lock();
+      shard.lock.lock();
     } while (symbol_info->status() == SymbolStatus::kDefining);
     status = symbol_info->status();
   } else {
     status = symbol_info->status();
   }
-  lock_.unlock();
+  shard.lock.unlock();
   return status;
 }
 
@@ -144,12 +150,20 @@ SymbolStatus Module::DefineFunction(FunctionInfo* symbol_info) {
   return DefineSymbol((SymbolInfo*)symbol_info);
 }
 
+void Module::UndefineFunction(FunctionInfo* symbol_info) {
+  auto& shard = symbol_shard(symbol_info->address());
+  std::lock_guard<xe::mutex> guard(shard.lock);
+  if (symbol_info->status() == SymbolStatus::kDefined) {
+    symbol_info->set_status(SymbolStatus::kDeclared);
+  }
+}
+
 SymbolStatus Module::DefineVariable(VariableInfo* symbol_info) {
   return DefineSymbol((SymbolInfo*)symbol_info);
 }
 
 void Module::ForEachFunction(std::function<void(FunctionInfo*)> callback) {
-  std::lock_guard<xe::mutex> guard(lock_);
+  std::lock_guard<xe::mutex> guard(list_lock_);
   for (auto& symbol_info : list_) {
     if (symbol_info->type() == SymbolType::kFunction) {
       FunctionInfo* info = static_cast<FunctionInfo*>(symbol_info.get());
@@ -160,7 +174,7 @@ void Module::ForEachFunction(std::function<void(FunctionInfo*)> callback) {
 
 void Module::ForEachSymbol(size_t start_index, size_t end_index,
                            std::function<void(SymbolInfo*)> callback) {
-  std::lock_guard<xe::mutex> guard(lock_);
+  std::lock_guard<xe::mutex> guard(list_lock_);
   start_index = std::min(start_index, list_.size());
   end_index = std::min(end_index, list_.size());
   for (size_t i = start_index; i <= end_index; ++i) {
@@ -170,7 +184,7 @@ void Module::ForEachSymbol(size_t start_index, size_t end_index,
 }
 
 size_t Module::QuerySymbolCount() {
-  std::lock_guard<xe::mutex> guard(lock_);
+  std::lock_guard<xe::mutex> guard(list_lock_);
   return list_.size();
 }
 
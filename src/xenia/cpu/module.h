@@ -35,7 +35,17 @@ class Module {
 
   virtual const std::string& name() const = 0;
 
+  // Hash of the module code as loaded, used to key persisted data.
+  // Zero if the module has no stable identity.
+  uint64_t code_hash() const { return code_hash_; }
+
   virtual bool ContainsAddress(uint32_t address);
+  // Returns the [low, high) range of all addresses the module may contain, if
+  // it has one. Used to index modules by address.
+  virtual bool QueryAddressRange(uint32_t* out_low_address,
+                                 uint32_t* out_high_address) {
+    return false;
+  }
 
   SymbolInfo* LookupSymbol(uint32_t address, bool wait = true);
   virtual SymbolStatus DeclareFunction(uint32_t address,
@@ -44,6 +54,9 @@ class Module {
                                        VariableInfo** out_symbol_info);
 
   SymbolStatus DefineFunction(FunctionInfo* symbol_info);
+  // Returns a defined function to the declared state, so the next
+  // DefineFunction has the caller define it again.
+  void UndefineFunction(FunctionInfo* symbol_info);
   SymbolStatus DefineVariable(VariableInfo* symbol_info);
 
   void ForEachFunction(std::function<void(FunctionInfo*)> callback);
@@ -61,11 +74,23 @@ class Module {
  protected:
   Processor* processor_;
   Memory* memory_;
+  uint64_t code_hash_;
 
  private:
-  // TODO(benvanik): replace with a better data structure.
-  xe::mutex lock_;
-  std::unordered_map<uint32_t, SymbolInfo*> map_;
+  // Symbols are sharded by address so that threads declaring and defining
+  // different symbols rarely contend.
+  static const size_t kSymbolShardCount = 64;
+  struct SymbolShard {
+    xe::mutex lock;
+    std::unordered_map<uint32_t, SymbolInfo*> map;
+  };
+  SymbolShard& symbol_shard(uint32_t address) {
+    return symbol_shards_[(address >> 2) % kSymbolShardCount];
+  }
+  SymbolShard symbol_shards_[kSymbolShardCount];
+
+  // All symbols in declaration order.
+  xe::mutex list_lock_;
   std::vector<std::unique_ptr<SymbolInfo>> list_;
 };
 
@@ -11,6 +11,8 @@
 
 #include <gflags/gflags.h>
 
+#include <algorithm>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/atomic.h"
 #include "xenia/base/byte_order.h"
@@ -25,6 +27,7 @@
 #include "xenia/profiling.h"
 
 // TODO(benvanik): based on compiler support
+#include "xenia/cpu/backend/interp/interp_backend.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
 
 namespace xe {
@@ -62,7 +65,15 @@ class BuiltinModule : public Module {
   BuiltinModule(Processor* processor) : Module(processor), name_("builtin") {}
   const std::string& name() const override { return name_; }
   bool ContainsAddress(uint32_t address) override {
-    return (address & 0xFFFFFFF0) == 0xFFFFFFF0;
+    return (address & 0xFFFF0000) == 0xFFFF0000;
+  }
+  bool QueryAddressRange(uint32_t* out_low_address,
+                         uint32_t* out_high_address) override {
+    // Builtins are handed out from the top page; the end is exclusive so the
+    // last address is left out.
+    *out_low_address = 0xFFFF0000;
+    *out_high_address = 0xFFFFFFFF;
+    return true;
   }
 
  private:
@@ -76,11 +87,27 @@ Processor::Processor(xe::Memory* memory, ExportResolver* export_resolver,
       debug_info_flags_(0),
       builtin_module_(nullptr),
       next_builtin_address_(0xFFFF0000ul),
-      export_resolver_(export_resolver) {
+      export_resolver_(export_resolver),
+      module_index_(new std::atomic<Module*>[kModuleIndexPageCount]) {
+  for (size_t i = 0; i < kModuleIndexPageCount; ++i) {
+    module_index_[i] = nullptr;
+  }
   InitializeIfNeeded();
 }
 
 Processor::~Processor() {
+  // Stop sampling before the code it looks at goes away.
+  sampling_profiler_.reset();
+
+  if (block_counters_) {
+    // Before the modules go, so blocks still have function names.
+    block_counters_->Dump();
+  }
+
+  if (frontend_) {
+    frontend_->Shutdown();
+  }
+
   {
     std::lock_guard<xe::mutex> guard(modules_lock_);
     modules_.clear();
@@ -88,6 +115,7 @@ Processor::~Processor() {
 
   frontend_.reset();
   backend_.reset();
+  block_counters_.reset();
 }
 
 bool Processor::Setup() {
@@ -102,7 +130,7 @@ bool Processor::Setup() {
 
   std::unique_ptr<Module> builtin_module(new BuiltinModule(this));
   builtin_module_ = builtin_module.get();
-  modules_.push_back(std::move(builtin_module));
+  AddModule(std::move(builtin_module));
 
   if (frontend_ || backend_) {
     return false;
@@ -115,6 +143,9 @@ bool Processor::Setup() {
       backend.reset(new xe::cpu::backend::x64::X64Backend(this));
     }
 #endif  // XENIA_HAS_X64_BACKEND
+    if (FLAGS_cpu == "interp") {
+      backend.reset(new xe::cpu::backend::interp::InterpBackend(this));
+    }
     if (FLAGS_cpu == "any") {
 #if defined(XENIA_HAS_X64_BACKEND) && XENIA_HAS_X64_BACKEND
       if (!backend) {
@@ -137,15 +168,47 @@ bool Processor::Setup() {
   backend_ = std::move(backend);
   frontend_ = std::move(frontend);
 
+  if (FLAGS_block_counters) {
+    block_counters_ = std::make_unique<BlockCounters>(this);
+    if (!block_counters_->Initialize()) {
+      return false;
+    }
+  }
+
+  sampling_profiler_ = std::make_unique<SamplingProfiler>(this);
+  if (!sampling_profiler_->Initialize()) {
+    return false;
+  }
+
   return true;
 }
 
 bool Processor::AddModule(std::unique_ptr<Module> module) {
   std::lock_guard<xe::mutex> guard(modules_lock_);
+  IndexModule(module.get());
   modules_.push_back(std::move(module));
   return true;
 }
 
+void Processor::IndexModule(Module* module) {
+  uint32_t low_address;
+  uint32_t high_address;
+  if (!module->QueryAddressRange(&low_address, &high_address) ||
+      high_address <= low_address) {
+    // Only found by the linear scan in LookupFunctionInfo.
+    return;
+  }
+  // Pages are claimed first-come; a page shared with an earlier module is
+  // left to that module and the lookup falls back to scanning.
+  uint32_t first_page = low_address >> kModuleIndexPageShift;
+  uint32_t last_page = (high_address - 1) >> kModuleIndexPageShift;
+  for (uint32_t page = first_page; page <= last_page; ++page) {
+    Module* expected = nullptr;
+    module_index_[page].compare_exchange_strong(expected, module,
+                                                std::memory_order_release);
+  }
+}
+
 Module* Processor::GetModule(const char* name) {
   std::lock_guard<xe::mutex> guard(modules_lock_);
   for (const auto& module : modules_) {
@@ -186,7 +249,7 @@ Function* Processor::QueryFunction(uint32_t address) {
   if (!entry) {
     return nullptr;
   }
-  return entry->function;
+  return entry->function.load(std::memory_order_acquire);
 }
 
 std::vector<Function*> Processor::FindFunctionsWithAddress(uint32_t address) {
@@ -199,23 +262,30 @@ bool Processor::ResolveFunction(uint32_t address, Function** out_function) {
   Entry::Status status = entry_table_.GetOrCreate(address, &entry);
   if (status == Entry::STATUS_NEW) {
     // Needs to be generated. We have the 'lock' on it and must do so now.
+    // Anyone else resolving the address is blocked until we Finish it.
 
     // Grab symbol declaration.
     FunctionInfo* symbol_info;
     if (!LookupFunctionInfo(address, &symbol_info)) {
+      entry_table_.Finish(entry, Entry::STATUS_FAILED);
       return false;
     }
 
-    if (!DemandFunction(symbol_info, &entry->function)) {
-      entry->status = Entry::STATUS_FAILED;
+    Function* function;
+    if (!DemandFunction(symbol_info, &function)) {
+      entry_table_.Finish(entry, Entry::STATUS_FAILED);
       return false;
     }
+    entry->function.store(function, std::memory_order_release);
     entry->end_address = symbol_info->end_address();
-    status = entry->status = Entry::STATUS_READY;
+    entry_table_.Finish(entry, Entry::STATUS_READY);
+    status = Entry::STATUS_READY;
+  } else if (status == Entry::STATUS_READY) {
+    frontend_->precompiler()->OnFunctionReady();
   }
   if (status == Entry::STATUS_READY) {
     // Ready to use.
-    *out_function = entry->function;
+    *out_function = entry->function.load(std::memory_order_acquire);
     return true;
   } else {
     // Failed or bad state.
@@ -223,18 +293,171 @@ bool Processor::ResolveFunction(uint32_t address, Function** out_function) {
   }
 }
 
+bool Processor::ReplaceFunction(FunctionInfo* symbol_info, Function* function,
+                                uint32_t code_generation) {
+  // The previous function is left alive, as other threads may still be
+  // executing its code or holding on to it. The entry may also have been
+  // invalidated and resolved again while recompiling, so the generation is
+  // what tells whether the new code is stale.
+  if (!entry_table_.Replace(
+          symbol_info->address(), function,
+          [symbol_info, function, code_generation]() {
+            if (symbol_info->code_generation() != code_generation) {
+              return false;
+            }
+            symbol_info->set_function(function);
+            return true;
+          })) {
+    backend_->FreeFunctionCode(function);
+    return false;
+  }
+  // The recompile may have inlined callees the baseline code didn't.
+  if (FLAGS_invalidate_code_on_write) {
+    WatchFunctionCode(symbol_info, function);
+  }
+
+  if (debugger_) {
+    debugger_->OnFunctionDefined(symbol_info, function);
+  }
+  return true;
+}
+
+void Processor::InvalidateFunctions(uint32_t low_address,
+                                    uint32_t high_address) {
+  // The symbols must be undefined before the entries can be claimed again,
+  // or the stale function would be handed right back.
+  auto functions = entry_table_.Invalidate(
+      low_address, high_address, [this](Function* function) {
+        auto symbol_info = function->symbol_info();
+        XELOGCPU("Invalidating modified function %.8X",
+                 symbol_info->address());
+        symbol_info->set_modified(true);
+        symbol_info->bump_code_generation();
+        symbol_info->module()->UndefineFunction(symbol_info);
+        // Its new code starts over at the baseline tier.
+        frontend_->recompiler()->Forget(symbol_info);
+      });
+  for (auto function : functions) {
+    backend_->FreeFunctionCode(function);
+  }
+}
+
+bool Processor::RemoveModule(Module* module) {
+  {
+    std::lock_guard<xe::mutex> guard(modules_lock_);
+    auto it = std::find_if(modules_.begin(), modules_.end(),
+                           [module](const std::unique_ptr<Module>& m) {
+                             return m.get() == module;
+                           });
+    if (it == modules_.end()) {
+      return false;
+    }
+    removed_modules_.push_back(std::move(*it));
+    modules_.erase(it);
+
+    uint32_t low_address;
+    uint32_t high_address;
+    if (module->QueryAddressRange(&low_address, &high_address) &&
+        high_address > low_address) {
+      uint32_t first_page = low_address >> kModuleIndexPageShift;
+      uint32_t last_page = (high_address - 1) >> kModuleIndexPageShift;
+      for (uint32_t page = first_page; page <= last_page; ++page) {
+        Module* expected = module;
+        module_index_[page].compare_exchange_strong(expected, nullptr,
+                                                    std::memory_order_release);
+      }
+    }
+  }
+
+  // Functions may be nested, so gather them all before freeing any.
+  std::unordered_set<Function*> functions;
+  module->ForEachFunction([this, &functions](FunctionInfo* symbol_info) {
+    if (symbol_info->status() != SymbolStatus::kDefined) {
+      return;
+    }
+    for (auto function : entry_table_.Invalidate(
+             symbol_info->address(), symbol_info->address() + 1,
+             [](Function* function) {
+               function->symbol_info()->bump_code_generation();
+             })) {
+      functions.insert(function);
+    }
+  });
+  for (auto function : functions) {
+    backend_->FreeFunctionCode(function);
+  }
+  backend_->ReleaseModule(module);
+  return true;
+}
+
+void Processor::WatchFunctionCode(FunctionInfo* symbol_info,
+                                  Function* function) {
+  uint32_t page_size = uint32_t(xe::page_size());
+  auto watch_pages = [this, page_size](uint32_t start_address,
+                                       uint32_t end_address) {
+    end_address = std::max(start_address, end_address);
+    for (uint32_t page = start_address & ~(page_size - 1); page <= end_address;
+         page += page_size) {
+      if (watched_code_pages_.insert(page).second) {
+        memory_->AddVirtualWriteWatch(page, page_size, OnCodeWrite, this,
+                                      nullptr);
+      }
+    }
+  };
+  std::lock_guard<xe::mutex> guard(code_watch_lock_);
+  watch_pages(symbol_info->address(), symbol_info->end_address());
+  // Inlined callees are copied into the function, so writing them must
+  // invalidate it as well.
+  for (auto& range : function->inlined_ranges()) {
+    watch_pages(range.first, range.second);
+    for (uint32_t page = range.first & ~(page_size - 1); page <= range.second;
+         page += page_size) {
+      inlining_callers_[page].insert(symbol_info->address());
+    }
+  }
+}
+
+void Processor::OnCodeWrite(void* context_ptr, void* data_ptr,
+                            uint32_t address) {
+  // Watches are one-shot; the page is watched again once something on it is
+  // translated again.
+  auto processor = reinterpret_cast<Processor*>(context_ptr);
+  uint32_t page_size = uint32_t(xe::page_size());
+  uint32_t page = address & ~(page_size - 1);
+  std::unordered_set<uint32_t> inlining_callers;
+  {
+    std::lock_guard<xe::mutex> guard(processor->code_watch_lock_);
+    processor->watched_code_pages_.erase(page);
+    auto it = processor->inlining_callers_.find(page);
+    if (it != processor->inlining_callers_.end()) {
+      inlining_callers = std::move(it->second);
+      processor->inlining_callers_.erase(it);
+    }
+  }
+  processor->InvalidateFunctions(page, page + page_size);
+  // Functions holding inlined copies of code on the page, which are
+  // registered again once translated again.
+  for (uint32_t caller_address : inlining_callers) {
+    processor->InvalidateFunctions(caller_address, caller_address + 1);
+  }
+}
+
 bool Processor::LookupFunctionInfo(uint32_t address,
                                    FunctionInfo** out_symbol_info) {
   *out_symbol_info = nullptr;
 
   // TODO(benvanik): fast reject invalid addresses/log errors.
 
-  // Find the module that contains the address.
-  Module* code_module = nullptr;
-  {
+  // Find the module that contains the address. The page index is read
+  // without taking the lock. It may still hold a module being removed, but
+  // removed modules live as long as the processor (see RemoveModule), so
+  // asking it is safe.
+  Module* code_module =
+      module_index_[address >> kModuleIndexPageShift].load(
+          std::memory_order_acquire);
+  if (!code_module || !code_module->ContainsAddress(address)) {
+    code_module = nullptr;
     std::lock_guard<xe::mutex> guard(modules_lock_);
-    // TODO(benvanik): sort by code address (if contiguous) so can bsearch.
-    // TODO(benvanik): cache last module low/high, as likely to be in there.
     for (const auto& module : modules_) {
       if (module->ContainsAddress(address)) {
         code_module = module.get();
@@ -279,8 +502,11 @@ bool Processor::DemandFunction(FunctionInfo* symbol_info,
   SymbolStatus symbol_status = module->DefineFunction(symbol_info);
   if (symbol_status == SymbolStatus::kNew) {
     // Symbol is undefined, so define now.
+    // Previously translated code is used if available.
     Function* function = nullptr;
-    if (!frontend_->DefineFunction(symbol_info, debug_info_flags_, &function)) {
+    if (!backend_->LoadCachedFunction(symbol_info, debug_info_flags_,
+                                      &function) &&
+        !frontend_->DefineFunction(symbol_info, debug_info_flags_, &function)) {
       symbol_info->set_status(SymbolStatus::kFailed);
       return false;
     }
@@ -293,6 +519,10 @@ bool Processor::DemandFunction(FunctionInfo* symbol_info,
 
     symbol_info->set_status(SymbolStatus::kDefined);
     symbol_status = symbol_info->status();
+
+    if (FLAGS_invalidate_code_on_write && module != builtin_module_) {
+      WatchFunctionCode(symbol_info, function);
+    }
   }
 
   if (symbol_status == SymbolStatus::kFailed) {
@@ -316,6 +546,10 @@ bool Processor::Execute(ThreadState* thread_state, uint32_t address) {
     return false;
   }
 
+  if (sampling_profiler_) {
+    sampling_profiler_->RegisterCurrentThread();
+  }
+
   PPCContext* context = thread_state->context();
 
   // Pad out stack a bit, as some games seem to overwrite the caller by about
@@ -10,16 +10,22 @@
 #ifndef XENIA_CPU_PROCESSOR_H_
 #define XENIA_CPU_PROCESSOR_H_
 
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "xenia/base/mutex.h"
 #include "xenia/cpu/backend/backend.h"
+#include "xenia/cpu/block_counters.h"
 #include "xenia/cpu/entry_table.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/frontend/ppc_frontend.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/module.h"
+#include "xenia/cpu/sampling_profiler.h"
 #include "xenia/cpu/thread_state.h"
 #include "xenia/debug/debugger.h"
 #include "xenia/memory.h"
@@ -48,9 +54,14 @@ class Processor {
   frontend::PPCFrontend* frontend() const { return frontend_.get(); }
   backend::Backend* backend() const { return backend_.get(); }
   ExportResolver* export_resolver() const { return export_resolver_; }
+  SamplingProfiler* sampling_profiler() const {
+    return sampling_profiler_.get();
+  }
+  BlockCounters* block_counters() const { return block_counters_.get(); }
 
   bool Setup();
 
+  uint32_t debug_info_flags() const { return debug_info_flags_; }
   void set_debug_info_flags(uint32_t debug_info_flags) {
     debug_info_flags_ = debug_info_flags;
   }
@@ -68,6 +79,22 @@ class Processor {
   Function* QueryFunction(uint32_t address);
   std::vector<Function*> FindFunctionsWithAddress(uint32_t address);
 
+  // Swaps a recompiled function in for the one currently defined for the
+  // symbol. The new code must already be placed by the backend. If the
+  // function was invalidated since code_generation was read, the new code is
+  // stale: it is freed instead and false is returned.
+  bool ReplaceFunction(FunctionInfo* symbol_info, Function* function,
+                       uint32_t code_generation);
+
+  // Throws away the code of all functions overlapping
+  // [low_address, high_address) after their guest code was modified, so they
+  // are translated again the next time they are called.
+  void InvalidateFunctions(uint32_t low_address, uint32_t high_address);
+  // Removes the module and frees the code of its functions. Nothing may be
+  // running in the module anymore. The module itself is kept until the
+  // processor is destroyed, as lookups may still be holding on to it.
+  bool RemoveModule(Module* module);
+
   bool LookupFunctionInfo(uint32_t address, FunctionInfo** out_symbol_info);
   bool LookupFunctionInfo(Module* module, uint32_t address,
                           FunctionInfo** out_symbol_info);
@@ -82,6 +109,9 @@ class Processor {
 
  private:
   bool DemandFunction(FunctionInfo* symbol_info, Function** out_function);
+  void IndexModule(Module* module);
+  void WatchFunctionCode(FunctionInfo* symbol_info, Function* function);
+  static void OnCodeWrite(void* context_ptr, void* data_ptr, uint32_t address);
 
   Memory* memory_;
   debug::Debugger* debugger_;
@@ -91,13 +121,32 @@ class Processor {
   std::unique_ptr<frontend::PPCFrontend> frontend_;
   std::unique_ptr<backend::Backend> backend_;
   ExportResolver* export_resolver_;
+  std::unique_ptr<SamplingProfiler> sampling_profiler_;
+  std::unique_ptr<BlockCounters> block_counters_;
 
   EntryTable entry_table_;
   xe::mutex modules_lock_;
   std::vector<std::unique_ptr<Module>> modules_;
+  // Removed modules, still readable through module_index_ by lookups that
+  // raced with their removal and through the FunctionInfos of functions left
+  // alive.
+  std::vector<std::unique_ptr<Module>> removed_modules_;
   Module* builtin_module_;
   uint32_t next_builtin_address_;
 
+  // Module owning each 64KB page of guest address space, for modules that
+  // report a fixed address range.
+  static const uint32_t kModuleIndexPageShift = 16;
+  static const size_t kModuleIndexPageCount = 1ull
+                                              << (32 - kModuleIndexPageShift);
+  std::unique_ptr<std::atomic<Module*>[]> module_index_;
+
+  // Pages of guest code write-protected by --invalidate_code_on_write.
+  xe::mutex code_watch_lock_;
+  std::unordered_set<uint32_t> watched_code_pages_;
+  // Functions with code inlined from each watched page, by address.
+  std::unordered_map<uint32_t, std::unordered_set<uint32_t>> inlining_callers_;
+
   Irql irql_;
 };
 
@@ -59,5 +59,12 @@ bool RawModule::ContainsAddress(uint32_t address) {
   return address >= low_address_ && address < high_address_;
 }
 
+bool RawModule::QueryAddressRange(uint32_t* out_low_address,
+                                  uint32_t* out_high_address) {
+  *out_low_address = low_address_;
+  *out_high_address = high_address_;
+  return true;
+}
+
 }  // namespace cpu
 }  // namespace xe
@@ -0,0 +1,398 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/sampling_profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/threading.h"
+#include "xenia/cpu/cpu-private.h"
+#include "xenia/cpu/debug_info.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/symbol_info.h"
+#include "xenia/profiling.h"
+
+namespace xe {
+namespace cpu {
+
+// Profiler the current thread is registered with.
+static thread_local SamplingProfiler* registered_profiler_ = nullptr;
+
+SamplingProfiler::SamplingProfiler(Processor* processor)
+    : processor_(processor),
+      running_(false),
+      session_index_(0),
+      sample_count_(0),
+      host_sample_count_(0) {}
+
+SamplingProfiler::~SamplingProfiler() {
+  Shutdown();
+#if XE_PLATFORM_WIN32
+  for (auto& thread : threads_) {
+    CloseHandle(thread.handle);
+  }
+#endif  // XE_PLATFORM_WIN32
+}
+
+bool SamplingProfiler::Initialize() {
+  stack_copy_.resize(kStackCopySize);
+  if (FLAGS_sampling_profiler) {
+    Start();
+  }
+  return true;
+}
+
+void SamplingProfiler::Shutdown() { Stop(); }
+
+void SamplingProfiler::Start() {
+#if XE_PLATFORM_WIN32
+  std::lock_guard<std::mutex> lock(worker_mutex_);
+  if (running_) {
+    return;
+  }
+  sample_count_ = 0;
+  host_sample_count_ = 0;
+  functions_.clear();
+  instructions_.clear();
+  calls_.clear();
+  stacks_.clear();
+  running_ = true;
+  worker_ = std::thread([this]() {
+    xe::threading::set_name("Sampling Profiler");
+    xe::Profiler::ThreadEnter("Sampling Profiler");
+    WorkerMain();
+    xe::Profiler::ThreadExit();
+  });
+  XELOGI("Sampling profiler started");
+#else
+  XELOGW("Sampling profiler not supported on this platform");
+#endif  // XE_PLATFORM_WIN32
+}
+
+void SamplingProfiler::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(worker_mutex_);
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+  }
+  worker_cond_.notify_all();
+  worker_.join();
+  WriteReports();
+}
+
+void SamplingProfiler::Toggle() {
+  if (running_) {
+    Stop();
+  } else {
+    Start();
+  }
+}
+
+void SamplingProfiler::RegisterCurrentThread() {
+  if (registered_profiler_ == this) {
+    return;
+  }
+  registered_profiler_ = this;
+#if XE_PLATFORM_WIN32
+  HANDLE handle = nullptr;
+  if (!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(),
+                       GetCurrentProcess(), &handle,
+                       THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT |
+                           THREAD_QUERY_INFORMATION | SYNCHRONIZE,
+                       FALSE, 0)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(threads_mutex_);
+  // The worker only prunes while sampling, so threads that come and go
+  // between sessions would otherwise pile up here.
+  PruneExitedThreads();
+  threads_.push_back({xe::threading::current_thread_id(), handle});
+#endif  // XE_PLATFORM_WIN32
+}
+
+void SamplingProfiler::PruneExitedThreads() {
+#if XE_PLATFORM_WIN32
+  threads_.erase(std::remove_if(threads_.begin(), threads_.end(),
+                                [](const SampledThread& thread) {
+                                  if (WaitForSingleObject(thread.handle, 0) !=
+                                      WAIT_OBJECT_0) {
+                                    return false;
+                                  }
+                                  CloseHandle(thread.handle);
+                                  return true;
+                                }),
+                 threads_.end());
+#endif  // XE_PLATFORM_WIN32
+}
+
+void SamplingProfiler::WorkerMain() {
+  auto interval = std::chrono::milliseconds(
+      std::max(FLAGS_sampling_profiler_interval_ms, 1));
+  auto backend = processor_->backend();
+  std::vector<SampledThread> threads;
+  backend::GuestStackFrame frames[kMaxFrames];
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(worker_mutex_);
+      if (worker_cond_.wait_for(lock, interval,
+                                [this]() { return !running_; })) {
+        return;
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(threads_mutex_);
+      PruneExitedThreads();
+      threads = threads_;
+    }
+
+    for (auto& thread : threads) {
+      uint64_t pc;
+      uint64_t sp;
+      size_t stack_size;
+      if (!CaptureSample(thread, &pc, &sp, &stack_size)) {
+        continue;
+      }
+      size_t frame_count = backend->UnwindGuestStack(
+          pc, sp, stack_copy_.data(), stack_size, frames, kMaxFrames);
+      if (frame_count) {
+        RecordSample(frames, frame_count);
+      } else {
+        // Waiting, or in the kernel, etc.
+        ++host_sample_count_;
+      }
+    }
+  }
+}
+
+bool SamplingProfiler::CaptureSample(const SampledThread& thread,
+                                     uint64_t* out_pc, uint64_t* out_sp,
+                                     size_t* out_stack_size) {
+#if XE_PLATFORM_WIN32
+  // The thread may be holding any lock (including the heap's), so nothing in
+  // here may take one until it's resumed.
+  if (SuspendThread(thread.handle) == DWORD(-1)) {
+    return false;
+  }
+  CONTEXT context;
+  context.ContextFlags = CONTEXT_CONTROL;
+  bool captured = GetThreadContext(thread.handle, &context) != 0;
+  if (captured) {
+    *out_pc = context.Rip;
+    *out_sp = context.Rsp;
+    // Copy what we can of the stack. It ends at the end of its committed
+    // region.
+    MEMORY_BASIC_INFORMATION memory_info;
+    *out_stack_size = 0;
+    if (VirtualQuery(reinterpret_cast<void*>(context.Rsp), &memory_info,
+                     sizeof(memory_info))) {
+      uint64_t region_end =
+          reinterpret_cast<uint64_t>(memory_info.BaseAddress) +
+          memory_info.RegionSize;
+      *out_stack_size =
+          size_t(std::min(uint64_t(kStackCopySize), region_end - context.Rsp));
+      std::memcpy(stack_copy_.data(), reinterpret_cast<void*>(context.Rsp),
+                  *out_stack_size);
+    }
+  }
+  ResumeThread(thread.handle);
+  return captured;
+#else
+  return false;
+#endif  // XE_PLATFORM_WIN32
+}
+
+void SamplingProfiler::RecordSample(const backend::GuestStackFrame* frames,
+                                    size_t frame_count) {
+  ++sample_count_;
+  ++functions_[frames[0].guest_address].self_count;
+  uint32_t instruction = LookupInstruction(frames[0]);
+  if (instruction) {
+    auto& instruction_statistics = instructions_[instruction];
+    instruction_statistics.function_address = frames[0].guest_address;
+    ++instruction_statistics.count;
+  }
+
+  std::vector<uint32_t> stack(frame_count);
+  for (size_t i = 0; i < frame_count; ++i) {
+    uint32_t address = frames[frame_count - 1 - i].guest_address;
+    stack[i] = address;
+    // Recursive functions only count once per sample.
+    if (std::find(stack.begin(), stack.begin() + i, address) ==
+        stack.begin() + i) {
+      ++functions_[address].total_count;
+    }
+    if (i) {
+      ++calls_[{stack[i - 1], address}];
+    }
+  }
+  ++stacks_[std::move(stack)];
+}
+
+uint32_t SamplingProfiler::LookupInstruction(
+    const backend::GuestStackFrame& frame) {
+  FunctionInfo* symbol_info = nullptr;
+  if (!processor_->LookupFunctionInfo(frame.guest_address, &symbol_info)) {
+    return 0;
+  }
+  Function* function = symbol_info->function();
+  if (!function || !function->debug_info()) {
+    return 0;
+  }
+  // The function may have been recompiled since the sample was taken.
+  auto code_address = reinterpret_cast<uint64_t>(function->machine_code());
+  if (frame.host_pc < code_address ||
+      frame.host_pc >= code_address + function->machine_code_length()) {
+    return 0;
+  }
+  auto entry = function->debug_info()->LookupCodeOffset(
+      uint32_t(frame.host_pc - code_address));
+  return entry ? entry->source_offset : 0;
+}
+
+std::string SamplingProfiler::GetFunctionName(uint32_t address) {
+  FunctionInfo* symbol_info = nullptr;
+  if (processor_->LookupFunctionInfo(address, &symbol_info) &&
+      !symbol_info->name().empty()) {
+    return symbol_info->name();
+  }
+  char name[16];
+  std::snprintf(name, xe::countof(name), "sub_%.8X", address);
+  return name;
+}
+
+void SamplingProfiler::WriteReports() {
+  XELOGI("Sampling profiler: %lld samples in guest code, %lld outside",
+         sample_count_, host_sample_count_);
+  if (!sample_count_) {
+    return;
+  }
+
+  std::string base_path =
+      FLAGS_sampling_profiler_output + "_" + std::to_string(session_index_++);
+
+  // Folded stacks, one per line: outer;...;inner count
+  auto folded_path = base_path + ".folded";
+  FILE* file = std::fopen(folded_path.c_str(), "w");
+  if (!file) {
+    XELOGE("Unable to write sampling profile to %s", folded_path.c_str());
+    return;
+  }
+  std::unordered_map<uint32_t, std::string> names;
+  auto get_name = [&](uint32_t address) -> const std::string& {
+    auto it = names.find(address);
+    if (it == names.end()) {
+      it = names.emplace(address, GetFunctionName(address)).first;
+    }
+    return it->second;
+  };
+  for (auto& it : stacks_) {
+    for (size_t i = 0; i < it.first.size(); ++i) {
+      std::fprintf(file, i ? ";%s" : "%s", get_name(it.first[i]).c_str());
+    }
+    std::fprintf(file, " %lld\n", it.second);
+  }
+  std::fclose(file);
+
+  auto report_path = base_path + ".txt";
+  file = std::fopen(report_path.c_str(), "w");
+  if (!file) {
+    XELOGE("Unable to write sampling profile to %s", report_path.c_str());
+    return;
+  }
+  double percent_scale = 100.0 / sample_count_;
+  std::fprintf(file,
+               "%lld samples in guest code, %lld outside, every %dms per "
+               "thread\n",
+               sample_count_, host_sample_count_,
+               FLAGS_sampling_profiler_interval_ms);
+
+  std::vector<std::pair<uint32_t, FunctionStatistics>> functions(
+      functions_.begin(), functions_.end());
+  std::sort(functions.begin(), functions.end(),
+            [](const std::pair<uint32_t, FunctionStatistics>& a,
+               const std::pair<uint32_t, FunctionStatistics>& b) {
+              return a.second.self_count > b.second.self_count;
+            });
+  std::fprintf(file, "\nFlat profile:\n");
+  std::fprintf(file, "   self%%     self  total%%    total  function\n");
+  for (auto& it : functions) {
+    if (!it.second.self_count) {
+      break;
+    }
+    std::fprintf(file, "%7.2f%% %8lld %6.2f%% %8lld  %s (%.8X)\n",
+                 it.second.self_count * percent_scale, it.second.self_count,
+                 it.second.total_count * percent_scale, it.second.total_count,
+                 get_name(it.first).c_str(), it.first);
+  }
+
+  std::vector<std::pair<uint32_t, InstructionStatistics>> instructions(
+      instructions_.begin(), instructions_.end());
+  std::sort(instructions.begin(), instructions.end(),
+            [](const std::pair<uint32_t, InstructionStatistics>& a,
+               const std::pair<uint32_t, InstructionStatistics>& b) {
+              return a.second.count > b.second.count;
+            });
+  if (instructions.size() > 100) {
+    instructions.resize(100);
+  }
+  std::fprintf(file, "\nHottest instructions:\n");
+  for (auto& it : instructions) {
+    uint32_t function_address = it.second.function_address;
+    std::fprintf(file, "%7.2f%% %8lld  %.8X  %s+%X\n",
+                 it.second.count * percent_scale, it.second.count, it.first,
+                 get_name(function_address).c_str(),
+                 it.first - function_address);
+  }
+
+  // Callers and callees of the functions most time is spent under.
+  std::sort(functions.begin(), functions.end(),
+            [](const std::pair<uint32_t, FunctionStatistics>& a,
+               const std::pair<uint32_t, FunctionStatistics>& b) {
+              return a.second.total_count > b.second.total_count;
+            });
+  if (functions.size() > 50) {
+    functions.resize(50);
+  }
+  std::fprintf(file, "\nCallers and callees:\n");
+  for (auto& it : functions) {
+    std::fprintf(file, "\n%s (%.8X): %.2f%% total, %.2f%% self\n",
+                 get_name(it.first).c_str(), it.first,
+                 it.second.total_count * percent_scale,
+                 it.second.self_count * percent_scale);
+    for (auto& call : calls_) {
+      if (call.first.second == it.first) {
+        std::fprintf(file, "  from %8lld  %s\n", call.second,
+                     get_name(call.first.first).c_str());
+      }
+    }
+    for (auto& call : calls_) {
+      if (call.first.first == it.first) {
+        std::fprintf(file, "  to   %8lld  %s\n", call.second,
+                     get_name(call.first.second).c_str());
+      }
+    }
+  }
+  std::fclose(file);
+
+  XELOGI("Sampling profiler: wrote %s and %s", folded_path.c_str(),
+         report_path.c_str());
+}
+
+}  // namespace cpu
+}  // namespace xe
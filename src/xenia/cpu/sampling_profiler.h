@@ -0,0 +1,112 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_SAMPLING_PROFILER_H_
+#define XENIA_CPU_SAMPLING_PROFILER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "xenia/cpu/backend/backend.h"
+
+namespace xe {
+namespace cpu {
+
+class Processor;
+
+// Periodically stops each thread running guest code and records where it
+// is, without any instrumentation in the generated code. The host stack is
+// walked by the backend and mapped back to guest functions, and the sampled
+// instruction to a PPC address through the function's source map.
+// Samples are aggregated into flat and caller/callee profiles, written as a
+// text report and as folded stacks (for flamegraph.pl and friends) when
+// sampling stops.
+class SamplingProfiler {
+ public:
+  explicit SamplingProfiler(Processor* processor);
+  ~SamplingProfiler();
+
+  bool Initialize();
+  void Shutdown();
+
+  bool is_running() const { return running_; }
+  void Start();
+  // Stops sampling and writes out the reports.
+  void Stop();
+  void Toggle();
+
+  // Makes the calling thread visible to the profiler. Called whenever a host
+  // thread enters guest code; cheap after the first time.
+  void RegisterCurrentThread();
+
+ private:
+  static const size_t kMaxFrames = 64;
+  static const size_t kStackCopySize = 16 * 1024;
+
+  struct SampledThread {
+    uint32_t thread_id;
+    void* handle;
+  };
+
+  struct FunctionStatistics {
+    uint64_t self_count;
+    uint64_t total_count;
+  };
+  struct InstructionStatistics {
+    uint32_t function_address;
+    uint64_t count;
+  };
+
+  void WorkerMain();
+  // Forgets threads that have exited. Requires threads_mutex_.
+  void PruneExitedThreads();
+  // Stops the thread just long enough to grab its registers and stack.
+  bool CaptureSample(const SampledThread& thread, uint64_t* out_pc,
+                     uint64_t* out_sp, size_t* out_stack_size);
+  void RecordSample(const backend::GuestStackFrame* frames,
+                    size_t frame_count);
+  uint32_t LookupInstruction(const backend::GuestStackFrame& frame);
+  std::string GetFunctionName(uint32_t address);
+  void WriteReports();
+
+  Processor* processor_;
+
+  std::mutex threads_mutex_;
+  std::vector<SampledThread> threads_;
+
+  std::mutex worker_mutex_;
+  std::condition_variable worker_cond_;
+  std::thread worker_;
+  std::atomic<bool> running_;
+  uint32_t session_index_;
+
+  // Only touched by the worker while sampling, reset by Start.
+  std::vector<uint8_t> stack_copy_;
+  uint64_t sample_count_;
+  uint64_t host_sample_count_;
+  std::unordered_map<uint32_t, FunctionStatistics> functions_;
+  std::unordered_map<uint32_t, InstructionStatistics> instructions_;
+  // Samples where the first function was running the second.
+  std::map<std::pair<uint32_t, uint32_t>, uint64_t> calls_;
+  // Guest stacks, outermost function first.
+  std::map<std::vector<uint32_t>, uint64_t> stacks_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_SAMPLING_PROFILER_H_
@@ -27,7 +27,10 @@ FunctionInfo::FunctionInfo(Module* module, uint32_t address)
     : SymbolInfo(SymbolType::kFunction, module, address),
       end_address_(0),
       behavior_(FunctionBehavior::kDefault),
-      function_(nullptr) {
+      function_(nullptr),
+      call_countdown_(0),
+      is_modified_(false),
+      code_generation_(0) {
   std::memset(&extern_info_, 0, sizeof(extern_info_));
 }
 
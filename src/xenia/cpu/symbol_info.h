@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_SYMBOL_INFO_H_
 #define XENIA_CPU_SYMBOL_INFO_H_
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 
@@ -82,6 +83,21 @@ class FunctionInfo : public SymbolInfo {
   Function* function() const { return function_; }
   void set_function(Function* value) { function_ = value; }
 
+  // Calls left before baseline code for the function asks to be recompiled.
+  // Decremented in place by the generated code.
+  int32_t* call_countdown() { return &call_countdown_; }
+  void set_call_countdown(int32_t value) { call_countdown_ = value; }
+
+  // Set once the guest code has been written after being translated, after
+  // which it no longer matches the module as loaded.
+  bool is_modified() const { return is_modified_; }
+  void set_modified(bool value) { is_modified_ = value; }
+
+  // Bumped each time the function's code is invalidated, so translations
+  // running in the background can tell the guest code they read went stale.
+  uint32_t code_generation() const { return code_generation_; }
+  void bump_code_generation() { ++code_generation_; }
+
   typedef void (*BuiltinHandler)(frontend::PPCContext* ppc_context, void* arg0,
                                  void* arg1);
   void SetupBuiltin(BuiltinHandler handler, void* arg0, void* arg1);
@@ -98,6 +114,9 @@ class FunctionInfo : public SymbolInfo {
   uint32_t end_address_;
   FunctionBehavior behavior_;
   Function* function_;
+  int32_t call_countdown_;
+  bool is_modified_;
+  std::atomic<uint32_t> code_generation_;
   union {
     struct {
       ExternHandler handler;
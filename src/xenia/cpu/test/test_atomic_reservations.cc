@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/test/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::test;
+using xe::cpu::frontend::PPCContext;
+
+// Guest atomic sequences raced across threads. Any lost update means a
+// conditional store succeeded when it shouldn't have.
+
+const uint32_t kThreadCount = 4;
+const uint32_t kIterationCount = 100000;
+
+TEST_CASE("LWARX_STWCX_INCREMENT", "[atomic]") {
+  TestGuestCode test({
+      0x7CA01828,  // lwarx   r5, 0, r3
+      0x38A50001,  // addi    r5, r5, 1
+      0x7CA0192D,  // stwcx.  r5, 0, r3
+      0x4082FFF4,  // bne     -12
+      0x3484FFFF,  // addic.  r4, r4, -1
+      0x4082FFEC,  // bne     -20
+      0x4E800020,  // blr
+  });
+  test.RunConcurrently(kThreadCount, [](uint32_t i, PPCContext* ctx) {
+    ctx->r[3] = TestGuestCode::kDataAddress;
+    ctx->r[4] = kIterationCount;
+  });
+  REQUIRE(xe::load_and_swap<uint32_t>(test.data()) ==
+          kThreadCount * kIterationCount);
+}
+
+TEST_CASE("LDARX_STDCX_INCREMENT", "[atomic]") {
+  TestGuestCode test({
+      0x7CA018A8,  // ldarx   r5, 0, r3
+      0x38A50001,  // addi    r5, r5, 1
+      0x7CA019AD,  // stdcx.  r5, 0, r3
+      0x4082FFF4,  // bne     -12
+      0x3484FFFF,  // addic.  r4, r4, -1
+      0x4082FFEC,  // bne     -20
+      0x4E800020,  // blr
+  });
+  test.RunConcurrently(kThreadCount, [](uint32_t i, PPCContext* ctx) {
+    ctx->r[3] = TestGuestCode::kDataAddress;
+    ctx->r[4] = kIterationCount;
+  });
+  REQUIRE(xe::load_and_swap<uint64_t>(test.data()) ==
+          kThreadCount * kIterationCount);
+}
+
+// A spinlock taken with lwarx/stwcx. and released with a plain store, guarding
+// a non-atomic increment of the following word.
+TEST_CASE("LWARX_STWCX_SPINLOCK", "[atomic]") {
+  TestGuestCode test({
+      0x7CC01828,  // lwarx   r6, 0, r3
+      0x2C060000,  // cmpwi   r6, 0
+      0x4082FFF8,  // bne     -8
+      0x7DA0192D,  // stwcx.  r13, 0, r3
+      0x4082FFF0,  // bne     -16
+      0x80A30004,  // lwz     r5, 4(r3)
+      0x38A50001,  // addi    r5, r5, 1
+      0x90A30004,  // stw     r5, 4(r3)
+      0x38C00000,  // li      r6, 0
+      0x90C30000,  // stw     r6, 0(r3)
+      0x3484FFFF,  // addic.  r4, r4, -1
+      0x4082FFD4,  // bne     -44
+      0x4E800020,  // blr
+  });
+  test.RunConcurrently(kThreadCount, [](uint32_t i, PPCContext* ctx) {
+    ctx->r[3] = TestGuestCode::kDataAddress;
+    ctx->r[4] = kIterationCount;
+  });
+  REQUIRE(xe::load_and_swap<uint32_t>(test.data()) == 0);
+  REQUIRE(xe::load_and_swap<uint32_t>(test.data() + 4) ==
+          kThreadCount * kIterationCount);
+}
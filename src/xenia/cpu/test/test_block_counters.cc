@@ -0,0 +1,41 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/cpu-private.h"
+#include "xenia/cpu/test/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::test;
+using xe::cpu::frontend::PPCContext;
+
+// Runs a loop on several threads and checks the counts of each block add up
+// across the shards.
+TEST_CASE("BLOCK_COUNTERS", "[block_counters]") {
+  FLAGS_block_counters = true;
+  {
+    TestGuestCode test({
+        0x38800000,  // li      r4, 0
+        0x38840001,  // addi    r4, r4, 1
+        0x2C04000A,  // cmpwi   r4, 10
+        0x4180FFF8,  // blt     -8
+        0x4E800020,  // blr
+    });
+    test.RunConcurrently(4, [](uint32_t i, PPCContext* ctx) {});
+
+    for (auto& processor : test.processors) {
+      REQUIRE(processor->block_counters());
+      auto counts = processor->block_counters()->CollectCounts();
+      REQUIRE(counts[TestGuestCode::kCodeAddress] == 4);
+      REQUIRE(counts[TestGuestCode::kCodeAddress + 4] == 40);
+      REQUIRE(counts[TestGuestCode::kCodeAddress + 16] == 4);
+    }
+  }
+  FLAGS_block_counters = false;
+}
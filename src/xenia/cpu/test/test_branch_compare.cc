@@ -0,0 +1,97 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/test/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::test;
+using xe::cpu::frontend::PPCContext;
+
+// Mirrors what a cmpw + bc pair turns into: the lt/gt/eq compares of one pair
+// of operands stored to a CR field, then a branch on one of them. The branch
+// is emitted as a jcc on the flags of the last compare.
+static void EmitCompareBranch(HIRBuilder& b, Value* lhs, Value* rhs,
+                              Value* (HIRBuilder::*compare)(Value*, Value*),
+                              bool branch_if_true) {
+  size_t cr0 = offsetof(PPCContext, cr0);
+  Value* cond = (b.*compare)(lhs, rhs);
+  b.StoreContext(cr0 + 0, b.CompareSLT(lhs, rhs));
+  b.StoreContext(cr0 + 1, b.CompareSGT(lhs, rhs));
+  b.StoreContext(cr0 + 2, b.CompareEQ(lhs, rhs));
+  b.StoreContext(cr0 + 3, cond);
+  auto taken = b.NewLabel();
+  if (branch_if_true) {
+    b.BranchTrue(cond, taken);
+  } else {
+    b.BranchFalse(cond, taken);
+  }
+  StoreGPR(b, 3, b.LoadConstantUint64(1));
+  b.Return();
+  b.MarkLabel(taken);
+  StoreGPR(b, 3, b.LoadConstantUint64(2));
+  b.Return();
+}
+
+TEST_CASE("BRANCH_TRUE_COMPARE_SLT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    EmitCompareBranch(b, b.Truncate(LoadGPR(b, 4), INT32_TYPE),
+                      b.Truncate(LoadGPR(b, 5), INT32_TYPE),
+                      &HIRBuilder::CompareSLT, true);
+  });
+  test.Run([](PPCContext* ctx) {
+             ctx->r[4] = 1;
+             ctx->r[5] = 2;
+           },
+           [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 2); });
+  test.Run([](PPCContext* ctx) {
+             ctx->r[4] = 2;
+             ctx->r[5] = 2;
+           },
+           [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 1); });
+  test.Run([](PPCContext* ctx) {
+             ctx->r[4] = 0xFFFFFFFF;
+             ctx->r[5] = 2;
+           },
+           [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 2); });
+}
+
+TEST_CASE("BRANCH_FALSE_COMPARE_ULE", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    EmitCompareBranch(b, b.Truncate(LoadGPR(b, 4), INT32_TYPE),
+                      b.Truncate(LoadGPR(b, 5), INT32_TYPE),
+                      &HIRBuilder::CompareULE, false);
+  });
+  test.Run([](PPCContext* ctx) {
+             ctx->r[4] = 2;
+             ctx->r[5] = 2;
+           },
+           [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 1); });
+  test.Run([](PPCContext* ctx) {
+             ctx->r[4] = 0xFFFFFFFF;
+             ctx->r[5] = 2;
+           },
+           [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 2); });
+}
+
+TEST_CASE("BRANCH_TRUE_COMPARE_SGT_CONSTANT_LHS", "[instr]") {
+  // The constant ends up on the right of the cmp, flipping the condition.
+  TestFunction test([](HIRBuilder& b) {
+    EmitCompareBranch(b, b.LoadConstantInt32(5),
+                      b.Truncate(LoadGPR(b, 4), INT32_TYPE),
+                      &HIRBuilder::CompareSGT, true);
+  });
+  test.Run([](PPCContext* ctx) { ctx->r[4] = 4; },
+           [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 2); });
+  test.Run([](PPCContext* ctx) { ctx->r[4] = 5; },
+           [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 1); });
+  test.Run([](PPCContext* ctx) { ctx->r[4] = 0xFFFFFFFB; },
+           [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 2); });
+}
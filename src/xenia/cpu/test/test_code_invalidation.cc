@@ -0,0 +1,83 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/test/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::test;
+using xe::cpu::frontend::PPCContext;
+
+// Rewrites guest code after it has run and checks the new code runs once the
+// function is invalidated.
+TEST_CASE("INVALIDATE_MODIFIED_CODE", "[code_cache]") {
+  TestGuestCode test({
+      0x38800001,  // li      r4, 1
+      0x90830000,  // stw     r4, 0(r3)
+      0x4E800020,  // blr
+  });
+  auto set_address = [](uint32_t i, PPCContext* ctx) {
+    ctx->r[3] = TestGuestCode::kDataAddress;
+  };
+
+  test.RunConcurrently(1, set_address);
+  REQUIRE(xe::load_and_swap<uint32_t>(test.data()) == 1);
+
+  auto code = test.memory->TranslateVirtual(TestGuestCode::kCodeAddress);
+  xe::store_and_swap<uint32_t>(code, 0x38800002);  // li      r4, 2
+  test.RunConcurrently(1, set_address);
+  REQUIRE(xe::load_and_swap<uint32_t>(test.data()) == 1);
+
+  for (auto& processor : test.processors) {
+    processor->InvalidateFunctions(TestGuestCode::kCodeAddress,
+                                   TestGuestCode::kCodeAddress + 4);
+  }
+  test.RunConcurrently(1, set_address);
+  REQUIRE(xe::load_and_swap<uint32_t>(test.data()) == 2);
+
+  // And again, now that the first code has been freed.
+  xe::store_and_swap<uint32_t>(code, 0x38800003);  // li      r4, 3
+  for (auto& processor : test.processors) {
+    processor->InvalidateFunctions(TestGuestCode::kCodeAddress,
+                                   TestGuestCode::kCodeAddress + 4);
+  }
+  test.RunConcurrently(1, set_address);
+  REQUIRE(xe::load_and_swap<uint32_t>(test.data()) == 3);
+}
+
+// Rewrites a leaf function that was only ever run inlined into its caller,
+// and checks the caller is invalidated by the write.
+TEST_CASE("INVALIDATE_INLINED_CALLEE", "[code_cache]") {
+  FLAGS_invalidate_code_on_write = true;
+  {
+    // The callee is on the next page, which nothing else watches.
+    std::vector<uint32_t> code(0x400, 0);
+    code[0] = 0x7D8802A6;        // mflr    r12
+    code[1] = 0x48000FFD;        // bl      +0xFFC
+    code[2] = 0x7D8803A6;        // mtlr    r12
+    code[3] = 0x4E800020;        // blr
+    code.push_back(0x38800001);  // li      r4, 1
+    code.push_back(0x90830000);  // stw     r4, 0(r3)
+    code.push_back(0x4E800020);  // blr
+    TestGuestCode test(code);
+    auto set_address = [](uint32_t i, PPCContext* ctx) {
+      ctx->r[3] = TestGuestCode::kDataAddress;
+    };
+
+    test.RunConcurrently(1, set_address);
+    REQUIRE(xe::load_and_swap<uint32_t>(test.data()) == 1);
+
+    auto callee = test.memory->TranslateVirtual(TestGuestCode::kCodeAddress +
+                                                0x1000);
+    xe::store_and_swap<uint32_t>(callee, 0x38800002);  // li      r4, 2
+    test.RunConcurrently(1, set_address);
+    REQUIRE(xe::load_and_swap<uint32_t>(test.data()) == 2);
+  }
+  FLAGS_invalidate_code_on_write = false;
+}
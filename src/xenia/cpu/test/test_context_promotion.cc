@@ -0,0 +1,37 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/test/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::test;
+using xe::cpu::frontend::PPCContext;
+
+// The shape of stwcx.: cr0.eq is cleared, then set again only on the path
+// that falls through into the join. Once the first two blocks are merged the
+// branch is in the middle of a block, and the value at the end of that block
+// is not the one on the branch.
+TEST_CASE("CONTEXT_PROMOTION_FALL_THROUGH_JOIN", "[context]") {
+  TestFunction test([](HIRBuilder& b) {
+    size_t offset = offsetof(PPCContext, cr0.cr0_eq);
+    b.StoreContext(offset, b.LoadZeroInt8());
+    auto done = b.NewLabel();
+    b.BranchFalse(b.CompareEQ(LoadGPR(b, 4), b.LoadZeroInt64()), done);
+    b.StoreContext(offset, b.LoadConstantUint8(1));
+    b.MarkLabel(done);
+    StoreGPR(b, 3, b.ZeroExtend(b.LoadContext(offset, INT8_TYPE), INT64_TYPE));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) { ctx->r[4] = 0; },
+           [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 1); });
+  test.Run([](PPCContext* ctx) { ctx->r[4] = 1; },
+           [](PPCContext* ctx) { REQUIRE(ctx->r[3] == 0); });
+}
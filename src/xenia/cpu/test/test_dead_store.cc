@@ -0,0 +1,130 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/compiler/passes/dead_store_elimination_pass.h"
+#include "xenia/cpu/test/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::test;
+using xe::cpu::compiler::Compiler;
+using xe::cpu::compiler::passes::DeadStoreEliminationPass;
+using xe::cpu::frontend::PPCContext;
+
+namespace {
+
+// Runs only the dead store pass and returns the values still stored, in
+// order.
+std::vector<Value*> RunDeadStorePass(HIRBuilder& b) {
+  Memory memory;
+  memory.Initialize();
+  Processor processor(&memory, nullptr, nullptr);
+  Compiler compiler(&processor);
+  compiler.AddPass(std::make_unique<DeadStoreEliminationPass>(
+      uint32_t(offsetof(PPCContext, r) + 1 * 8)));
+  REQUIRE(compiler.Compile(&b));
+
+  std::vector<Value*> stored;
+  for (auto block = b.first_block(); block; block = block->next) {
+    for (auto i = block->instr_head; i; i = i->next) {
+      if (i->opcode == &OPCODE_STORE_info) {
+        stored.push_back(i->src2.value);
+      }
+    }
+  }
+  return stored;
+}
+
+Value* OffsetAddress(HIRBuilder& b, Value* base, int64_t offset) {
+  return b.Add(base, b.LoadConstantInt64(offset));
+}
+
+}  // namespace
+
+TEST_CASE("DEAD_STORE_OVERWRITTEN", "[dead_store]") {
+  HIRBuilder b;
+  auto sp = LoadGPR(b, 1);
+  auto v1 = b.LoadConstantUint32(0x11);
+  auto v2 = b.LoadConstantUint32(0x22);
+  b.Store(OffsetAddress(b, sp, 16), v1, LOAD_STORE_BYTE_SWAP);
+  b.Store(OffsetAddress(b, sp, 16), v2, LOAD_STORE_BYTE_SWAP);
+  b.Return();
+  auto stored = RunDeadStorePass(b);
+  REQUIRE(stored.size() == 1);
+  REQUIRE(stored[0] == v2);
+}
+
+TEST_CASE("DEAD_STORE_COVERED_BY_WIDER", "[dead_store]") {
+  HIRBuilder b;
+  auto sp = LoadGPR(b, 1);
+  auto v1 = b.LoadConstantUint32(0x11);
+  auto v2 = b.LoadConstantUint64(0x22);
+  b.Store(OffsetAddress(b, sp, 20), v1, LOAD_STORE_BYTE_SWAP);
+  b.Store(OffsetAddress(b, sp, 16), v2, LOAD_STORE_BYTE_SWAP);
+  b.Return();
+  auto stored = RunDeadStorePass(b);
+  REQUIRE(stored.size() == 1);
+  REQUIRE(stored[0] == v2);
+}
+
+// Only the first byte is overwritten, so the rest of the word must land.
+TEST_CASE("DEAD_STORE_PARTIAL_KEPT", "[dead_store]") {
+  HIRBuilder b;
+  auto sp = LoadGPR(b, 1);
+  auto v1 = b.LoadConstantUint32(0x11223344);
+  auto v2 = b.LoadConstantUint8(0x55);
+  b.Store(OffsetAddress(b, sp, 16), v1, LOAD_STORE_BYTE_SWAP);
+  b.Store(OffsetAddress(b, sp, 16), v2);
+  b.Return();
+  auto stored = RunDeadStorePass(b);
+  REQUIRE(stored.size() == 2);
+  REQUIRE(stored[0] == v1);
+  REQUIRE(stored[1] == v2);
+}
+
+TEST_CASE("DEAD_STORE_OVERLAPPING_KEPT", "[dead_store]") {
+  HIRBuilder b;
+  auto sp = LoadGPR(b, 1);
+  auto v1 = b.LoadConstantUint32(0x11);
+  auto v2 = b.LoadConstantUint32(0x22);
+  b.Store(OffsetAddress(b, sp, 16), v1, LOAD_STORE_BYTE_SWAP);
+  b.Store(OffsetAddress(b, sp, 18), v2, LOAD_STORE_BYTE_SWAP);
+  b.Return();
+  auto stored = RunDeadStorePass(b);
+  REQUIRE(stored.size() == 2);
+}
+
+TEST_CASE("DEAD_STORE_READ_BETWEEN_KEPT", "[dead_store]") {
+  HIRBuilder b;
+  auto sp = LoadGPR(b, 1);
+  auto v1 = b.LoadConstantUint32(0x11);
+  auto v2 = b.LoadConstantUint32(0x22);
+  b.Store(OffsetAddress(b, sp, 16), v1, LOAD_STORE_BYTE_SWAP);
+  auto loaded = b.Load(LoadGPR(b, 7), INT32_TYPE, LOAD_STORE_BYTE_SWAP);
+  StoreGPR(b, 6, b.ZeroExtend(loaded, INT64_TYPE));
+  b.Store(OffsetAddress(b, sp, 16), v2, LOAD_STORE_BYTE_SWAP);
+  b.Return();
+  auto stored = RunDeadStorePass(b);
+  REQUIRE(stored.size() == 2);
+}
+
+// Stores not relative to the stack pointer may be to device memory.
+TEST_CASE("DEAD_STORE_NON_STACK_KEPT", "[dead_store]") {
+  HIRBuilder b;
+  auto base = LoadGPR(b, 3);
+  auto v1 = b.LoadConstantUint32(0x11);
+  auto v2 = b.LoadConstantUint32(0x22);
+  b.Store(OffsetAddress(b, base, 16), v1, LOAD_STORE_BYTE_SWAP);
+  b.Store(OffsetAddress(b, base, 16), v2, LOAD_STORE_BYTE_SWAP);
+  b.Return();
+  auto stored = RunDeadStorePass(b);
+  REQUIRE(stored.size() == 2);
+}
@@ -61,6 +61,25 @@ TEST_CASE("INSERT_INT16", "[instr]") {
   }
 }
 
+TEST_CASE("INSERT_INT16_CONSTANT", "[instr]") {
+  for (int i = 0; i < 8; ++i) {
+    TestFunction test([i](HIRBuilder& b) {
+      StoreVR(b, 3,
+              b.Insert(b.LoadConstantVec128(vec128s(0, 1, 2, 3, 4, 5, 6, 7)),
+                       b.LoadConstantInt32(i),
+                       b.LoadConstantInt16(int16_t(100 + i))));
+      b.Return();
+    });
+    test.Run([](PPCContext* ctx) {},
+             [i](PPCContext* ctx) {
+               auto result = ctx->v[3];
+               auto expected = vec128s(0, 1, 2, 3, 4, 5, 6, 7);
+               expected.i16[i ^ 0x1] = 100 + i;
+               REQUIRE(result == expected);
+             });
+  }
+}
+
 TEST_CASE("INSERT_INT32", "[instr]") {
   for (int i = 0; i < 4; ++i) {
     TestFunction test([i](HIRBuilder& b) {
@@ -0,0 +1,130 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/cpu-private.h"
+#include "xenia/cpu/test/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::test;
+using xe::cpu::frontend::PPCContext;
+
+namespace {
+
+// Sums 1..10 through calls to a leaf function and stores the sum at r5.
+const std::vector<uint32_t> kSumCode = {
+    0x7D8802A6,  // mflr    r12
+    0x38600000,  // li      r3, 0
+    0x38800000,  // li      r4, 0
+    0x38840001,  // addi    r4, r4, 1
+    0x48000021,  // bl      +0x20
+    0x2C04000A,  // cmpwi   r4, 10
+    0x4180FFF4,  // blt     -12
+    0x7D8803A6,  // mtlr    r12
+    0x90650000,  // stw     r3, 0(r5)
+    0x4E800020,  // blr
+    0x60000000,  // nop
+    0x60000000,  // nop
+    0x7C632214,  // add     r3, r3, r4
+    0x4E800020,  // blr
+};
+
+void SetDataAddress(uint32_t i, PPCContext* ctx) {
+  ctx->r[5] = TestGuestCode::kDataAddress;
+}
+
+// Reads a register at a computed address in a mapped range, increments it,
+// writes it back to the next register and stores it at r5.
+const std::vector<uint32_t> kMMIOCode = {
+    0x80830010,  // lwz     r4, 0x10(r3)
+    0x38840001,  // addi    r4, r4, 1
+    0x90830014,  // stw     r4, 0x14(r3)
+    0x90850000,  // stw     r4, 0(r5)
+    0x4E800020,  // blr
+};
+
+const uint32_t kMMIOAddress = 0x7FC80000;
+
+struct MMIORegisters {
+  uint32_t read_address;
+  uint32_t write_address;
+  uint64_t write_value;
+};
+
+uint64_t ReadMMIORegister(void* ppc_context, void* callback_context,
+                          uint32_t addr) {
+  auto registers = reinterpret_cast<MMIORegisters*>(callback_context);
+  registers->read_address = addr;
+  return 0x1234;
+}
+
+void WriteMMIORegister(void* ppc_context, void* callback_context,
+                       uint32_t addr, uint64_t value) {
+  auto registers = reinterpret_cast<MMIORegisters*>(callback_context);
+  registers->write_address = addr;
+  registers->write_value = value;
+}
+
+void SetMMIOAddress(uint32_t i, PPCContext* ctx) {
+  ctx->r[3] = kMMIOAddress;
+  ctx->r[5] = TestGuestCode::kDataAddress;
+}
+
+}  // namespace
+
+TEST_CASE("INTERPRETER_GUEST_CODE", "[interpreter]") {
+  std::string cpu = FLAGS_cpu;
+  FLAGS_cpu = "interp";
+  {
+    TestGuestCode test(kSumCode);
+    test.RunConcurrently(1, SetDataAddress);
+    REQUIRE(xe::load_and_swap<uint32_t>(test.data()) == 55);
+  }
+  FLAGS_cpu = cpu;
+}
+
+// Loads and stores whose address is only known at run time must reach the
+// MMIO callbacks instead of faulting on the no-access mapping.
+TEST_CASE("INTERPRETER_MMIO", "[interpreter]") {
+  std::string cpu = FLAGS_cpu;
+  FLAGS_cpu = "interp";
+  {
+    TestGuestCode test(kMMIOCode);
+    MMIORegisters registers = {0};
+    REQUIRE(test.memory->AddVirtualMappedRange(
+        kMMIOAddress, 0xFFFF0000, 0xFFFF, &registers, ReadMMIORegister,
+        WriteMMIORegister));
+    test.RunConcurrently(1, SetMMIOAddress);
+    REQUIRE(registers.read_address == kMMIOAddress + 0x10);
+    REQUIRE(registers.write_address == kMMIOAddress + 0x14);
+    REQUIRE(registers.write_value == 0x1235);
+    REQUIRE(xe::load_and_swap<uint32_t>(test.data()) == 0x1235);
+  }
+  FLAGS_cpu = cpu;
+}
+
+// Interpreted baseline code calling, and called from, generated code as
+// functions tier up.
+TEST_CASE("INTERPRETER_BASELINE_TIER", "[interpreter]") {
+  FLAGS_tiered_compilation = true;
+  FLAGS_baseline_interpreter = true;
+  int32_t tier_up_threshold = FLAGS_tier_up_threshold;
+  FLAGS_tier_up_threshold = 4;
+  {
+    TestGuestCode test(kSumCode);
+    for (int i = 0; i < 8; ++i) {
+      xe::store_and_swap<uint32_t>(test.data(), 0);
+      test.RunConcurrently(2, SetDataAddress);
+      REQUIRE(xe::load_and_swap<uint32_t>(test.data()) == 55);
+    }
+  }
+  FLAGS_tier_up_threshold = tier_up_threshold;
+  FLAGS_baseline_interpreter = false;
+  FLAGS_tiered_compilation = false;
+}
@@ -141,3 +141,78 @@ TEST_CASE("PERMUTE_V128_BY_V128", "[instr]") {
                                        21, 20, 19, 18, 17, 16));
            });
 }
+
+TEST_CASE("PERMUTE_V128_BY_V128_CONSTANT", "[instr]") {
+  // Whole words from one source: becomes a swizzle.
+  TestFunction([](HIRBuilder& b) {
+                 StoreVR(b, 3, b.Permute(b.LoadConstantVec128(vec128b(
+                                             12, 13, 14, 15, 8, 9, 10, 11, 4,
+                                             5, 6, 7, 0, 1, 2, 3)),
+                                         LoadVR(b, 4), LoadVR(b, 5),
+                                         INT8_TYPE));
+                 b.Return();
+               }).Run([](PPCContext* ctx) {
+                        ctx->v[4] = vec128i(0, 1, 2, 3);
+                        ctx->v[5] = vec128i(4, 5, 6, 7);
+                      },
+                      [](PPCContext* ctx) {
+                        auto result = ctx->v[3];
+                        REQUIRE(result == vec128i(3, 2, 1, 0));
+                      });
+  // Whole words from both sources: becomes a word permute.
+  TestFunction([](HIRBuilder& b) {
+                 StoreVR(b, 3, b.Permute(b.LoadConstantVec128(vec128b(
+                                             0, 1, 2, 3, 16, 17, 18, 19, 4, 5,
+                                             6, 7, 20, 21, 22, 23)),
+                                         LoadVR(b, 4), LoadVR(b, 5),
+                                         INT8_TYPE));
+                 b.Return();
+               }).Run([](PPCContext* ctx) {
+                        ctx->v[4] = vec128i(0, 1, 2, 3);
+                        ctx->v[5] = vec128i(4, 5, 6, 7);
+                      },
+                      [](PPCContext* ctx) {
+                        auto result = ctx->v[3];
+                        REQUIRE(result == vec128i(0, 4, 1, 5));
+                      });
+  // Bytes from the second source only: becomes a shuffle of that source.
+  TestFunction([](HIRBuilder& b) {
+                 StoreVR(b, 3, b.Permute(b.LoadConstantVec128(vec128b(
+                                             17, 18, 19, 20, 21, 22, 23, 24,
+                                             25, 26, 27, 28, 29, 30, 31, 16)),
+                                         LoadVR(b, 4), LoadVR(b, 5),
+                                         INT8_TYPE));
+                 b.Return();
+               }).Run([](PPCContext* ctx) {
+                        ctx->v[4] = vec128b(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                            11, 12, 13, 14, 15);
+                        ctx->v[5] = vec128b(16, 17, 18, 19, 20, 21, 22, 23, 24,
+                                            25, 26, 27, 28, 29, 30, 31);
+                      },
+                      [](PPCContext* ctx) {
+                        auto result = ctx->v[3];
+                        REQUIRE(result == vec128b(17, 18, 19, 20, 21, 22, 23,
+                                                  24, 25, 26, 27, 28, 29, 30,
+                                                  31, 16));
+                      });
+  // Everything constant: folded away.
+  TestFunction([](HIRBuilder& b) {
+                 StoreVR(b, 3,
+                         b.Permute(b.LoadConstantVec128(vec128b(
+                                       31, 0, 30, 1, 29, 2, 28, 3, 27, 4, 26,
+                                       5, 25, 6, 24, 7)),
+                                   b.LoadConstantVec128(vec128b(
+                                       0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+                                       12, 13, 14, 15)),
+                                   b.LoadConstantVec128(vec128b(
+                                       16, 17, 18, 19, 20, 21, 22, 23, 24, 25,
+                                       26, 27, 28, 29, 30, 31)),
+                                   INT8_TYPE));
+                 b.Return();
+               }).Run([](PPCContext* ctx) {},
+                      [](PPCContext* ctx) {
+                        auto result = ctx->v[3];
+                        REQUIRE(result == vec128b(31, 0, 30, 1, 29, 2, 28, 3,
+                                                  27, 4, 26, 5, 25, 6, 24, 7));
+                      });
+}
@@ -0,0 +1,39 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/test/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::test;
+using xe::cpu::frontend::PPCContext;
+
+// r1 and r13 are pinned to host registers by default, and must still be seen
+// in the context on the way in and out.
+TEST_CASE("PINNED_REGISTERS", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    Value* sp = LoadGPR(b, 1);
+    StoreGPR(b, 3, b.Add(sp, LoadGPR(b, 13)));
+    StoreGPR(b, 1, b.Sub(sp, b.LoadConstantUint64(0x60)));
+    StoreGPR(b, 13, b.LoadConstantUint64(0x1234567890ABCDEFull));
+    StoreGPR(b, 4, LoadGPR(b, 1));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) {
+             ctx->r[1] = 0x70000100;
+             ctx->r[13] = 0x7FFF0000;
+           },
+           [](PPCContext* ctx) {
+             REQUIRE(ctx->r[3] == 0xEFFF0100);
+             REQUIRE(ctx->r[1] == 0x700000A0);
+             REQUIRE(ctx->r[4] == 0x700000A0);
+             REQUIRE(ctx->r[13] == 0x1234567890ABCDEFull);
+           });
+}
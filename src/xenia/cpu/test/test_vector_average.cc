@@ -0,0 +1,65 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/test/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::test;
+using xe::cpu::frontend::PPCContext;
+
+TEST_CASE("VECTOR_AVERAGE_U32", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.VectorAverage(LoadVR(b, 4), LoadVR(b, 5), INT32_TYPE,
+                                  ARITHMETIC_UNSIGNED));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) {
+             ctx->v[4] = vec128i(0xFFFFFFFF, 1, 0, 3);
+             ctx->v[5] = vec128i(0x00000001, 2, 0, 4);
+           },
+           [](PPCContext* ctx) {
+             auto result = ctx->v[3];
+             REQUIRE(result == vec128i(0x80000000, 2, 0, 4));
+           });
+}
+
+TEST_CASE("VECTOR_AVERAGE_I32", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.VectorAverage(LoadVR(b, 4), LoadVR(b, 5), INT32_TYPE, 0));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) {
+             ctx->v[4] = vec128i(0xFFFFFFFF, 0xFFFFFFFD, 0x7FFFFFFF,
+                                 0x80000000);
+             ctx->v[5] = vec128i(0x00000000, 0x00000000, 0x7FFFFFFF,
+                                 0x80000000);
+           },
+           [](PPCContext* ctx) {
+             auto result = ctx->v[3];
+             REQUIRE(result ==
+                     vec128i(0x00000000, 0xFFFFFFFF, 0x7FFFFFFF, 0x80000000));
+           });
+}
+
+TEST_CASE("VECTOR_AVERAGE_U32_CONSTANT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.VectorAverage(LoadVR(b, 4),
+                                  b.LoadConstantVec128(vec128i(1, 2, 0, 4)),
+                                  INT32_TYPE, ARITHMETIC_UNSIGNED));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) { ctx->v[4] = vec128i(0xFFFFFFFF, 1, 0, 3); },
+           [](PPCContext* ctx) {
+             auto result = ctx->v[3];
+             REQUIRE(result == vec128i(0x80000000, 2, 0, 4));
+           });
+}
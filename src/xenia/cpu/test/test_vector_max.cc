@@ -69,6 +69,23 @@ TEST_CASE("VECTOR_MAX_I16_SIGNED", "[instr]") {
            });
 }
 
+TEST_CASE("VECTOR_MAX_I16_SIGNED_CONSTANT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.VectorMax(
+                b.LoadConstantVec128(vec128s(0, 1, 2, 3, 4, 5, -6000, 7)),
+                b.LoadConstantVec128(
+                    vec128s(-1000, 1, -2000, 3, 4, SHRT_MAX, 6, 0)),
+                INT16_TYPE));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) {},
+           [](PPCContext* ctx) {
+             auto result = ctx->v[3];
+             REQUIRE(result == vec128s(0, 1, 2, 3, 4, SHRT_MAX, 6, 7));
+           });
+}
+
 TEST_CASE("VECTOR_MAX_I16_UNSIGNED", "[instr]") {
   TestFunction test([](HIRBuilder& b) {
     StoreVR(b, 3, b.VectorMax(LoadVR(b, 4), LoadVR(b, 5), INT16_TYPE,
@@ -10,8 +10,13 @@
 #ifndef XENIA_TEST_UTIL_H_
 #define XENIA_TEST_UTIL_H_
 
+#include <thread>
+#include <vector>
+
 #include "xenia/base/main.h"
+#include "xenia/base/memory.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/cpu-private.h"
 #include "xenia/cpu/cpu.h"
 #include "xenia/cpu/frontend/ppc_context.h"
 #include "xenia/cpu/frontend/ppc_frontend.h"
@@ -21,6 +26,7 @@
 #include "third_party/catch/single_include/catch.hpp"
 
 #define XENIA_TEST_X64 1
+#define XENIA_TEST_INTERP 1
 
 namespace xe {
 namespace cpu {
@@ -44,6 +50,18 @@ class TestFunction {
       processors.emplace_back(std::move(processor));
     }
 #endif  // XENIA_TEST_X64
+#if XENIA_TEST_INTERP
+    {
+      // The interpreter is the reference the other backends are held to.
+      auto processor =
+          std::make_unique<Processor>(memory.get(), nullptr, nullptr);
+      std::string cpu = FLAGS_cpu;
+      FLAGS_cpu = "interp";
+      processor->Setup();
+      FLAGS_cpu = cpu;
+      processors.emplace_back(std::move(processor));
+    }
+#endif  // XENIA_TEST_INTERP
 
     for (auto& processor : processors) {
       auto module = std::make_unique<xe::cpu::TestModule>(
@@ -91,6 +109,109 @@ class TestFunction {
   std::vector<std::unique_ptr<Processor>> processors;
 };
 
+// Runs raw PPC code through the full frontend, from any number of guest
+// threads at once. The code is placed at 0x80000000 and a zeroed data page at
+// kDataAddress.
+class TestGuestCode {
+ public:
+  static const uint32_t kCodeAddress = 0x80000000;
+  static const uint32_t kDataAddress = 0x80010000;
+
+  TestGuestCode(std::vector<uint32_t> code) {
+    memory_size = 16 * 1024 * 1024;
+    memory.reset(new Memory());
+    memory->Initialize();
+    memory->LookupHeap(kCodeAddress)
+        ->AllocFixed(kCodeAddress, 0x20000, 0,
+                     kMemoryAllocationReserve | kMemoryAllocationCommit,
+                     kMemoryProtectRead | kMemoryProtectWrite);
+    auto p = memory->TranslateVirtual<uint32_t*>(kCodeAddress);
+    for (size_t i = 0; i < code.size(); ++i) {
+      xe::store_and_swap<uint32_t>(p + i, code[i]);
+    }
+    code_end = kCodeAddress + uint32_t(code.size() * 4);
+
+#if XENIA_TEST_X64
+    {
+      auto processor =
+          std::make_unique<Processor>(memory.get(), nullptr, nullptr);
+      processor->Setup();
+      processors.emplace_back(std::move(processor));
+    }
+#endif  // XENIA_TEST_X64
+
+    for (auto& processor : processors) {
+      processor->AddModule(
+          std::make_unique<CodeModule>(processor.get(), code_end));
+      processor->backend()->CommitExecutableRange(kCodeAddress, kDataAddress);
+    }
+  }
+
+  ~TestGuestCode() {
+    processors.clear();
+    memory.reset();
+  }
+
+  uint8_t* data() { return memory->TranslateVirtual(kDataAddress); }
+
+  // Calls the code on thread_count threads, all racing each other.
+  void RunConcurrently(uint32_t thread_count,
+                       std::function<void(uint32_t, PPCContext*)> pre_call) {
+    for (auto& processor : processors) {
+      xe::cpu::Function* fn;
+      processor->ResolveFunction(kCodeAddress, &fn);
+
+      std::vector<std::thread> threads;
+      for (uint32_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back([this, &processor, fn, pre_call, i]() {
+          uint32_t stack_size = 64 * 1024;
+          uint32_t stack_address = memory_size - stack_size * (i + 1);
+          uint32_t thread_state_address = stack_address - 0x1000;
+          auto thread_state = std::make_unique<ThreadState>(
+              processor.get(), 0x100 + i, ThreadStackType::kUserStack,
+              stack_address, stack_size, thread_state_address);
+          auto ctx = thread_state->context();
+          ctx->lr = 0xBCBCBCBC;
+
+          pre_call(i, ctx);
+
+          fn->Call(thread_state.get(), uint32_t(ctx->lr));
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    }
+  }
+
+  uint32_t memory_size;
+  uint32_t code_end;
+  std::unique_ptr<Memory> memory;
+  std::vector<std::unique_ptr<Processor>> processors;
+
+ private:
+  class CodeModule : public Module {
+   public:
+    CodeModule(Processor* processor, uint32_t code_end)
+        : Module(processor), name_("TestGuestCode"), code_end_(code_end) {}
+
+    const std::string& name() const override { return name_; }
+    bool ContainsAddress(uint32_t address) override {
+      return address >= kCodeAddress && address < code_end_;
+    }
+    bool QueryAddressRange(uint32_t* out_low_address,
+                           uint32_t* out_high_address) override {
+      *out_low_address = kCodeAddress;
+      *out_high_address = code_end_;
+      return true;
+    }
+
+   private:
+    std::string name_;
+    uint32_t code_end_;
+  };
+};
+
 inline hir::Value* LoadGPR(hir::HIRBuilder& b, int reg) {
   return b.LoadContext(offsetof(PPCContext, r) + reg * 8, hir::INT64_TYPE);
 }
@@ -0,0 +1,460 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2015 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/cpu/cpu.h"
+#include "xenia/cpu/frontend/ppc_frontend.h"
+#include "xenia/cpu/frontend/ppc_context.h"
+#include "xenia/cpu/frontend/ppc_translator.h"
+#include "xenia/cpu/hir/hir_builder.h"
+#include "xenia/cpu/raw_module.h"
+#include "xenia/cpu/test_module.h"
+#include "xenia/cpu/thread_state.h"
+
+#if !XE_PLATFORM_WIN32
+#include <dirent.h>
+#endif  // !WIN32
+#include <gflags/gflags.h>
+
+DEFINE_string(bench_bin_path, "src/xenia/cpu/frontend/test/bin/",
+              "Directory with .bin/.map pairs to translate.");
+DEFINE_int32(bench_iterations, 10, "Times each function is translated.");
+DEFINE_string(bench_tier, "optimized",
+              "Translation tier to measure: baseline or optimized.");
+DEFINE_string(bench_output, "",
+              "File to write JSON results to, or stdout if empty.");
+DEFINE_bool(bench_workloads, false,
+            "Also time generated loops that stress specific x64 sequences.");
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+using xe::cpu::frontend::PPCContext;
+using xe::cpu::frontend::PPCTranslator;
+using xe::cpu::frontend::TranslationTier;
+using xe::cpu::hir::HIRBuilder;
+
+const uint32_t START_ADDRESS = 0x80000000;
+
+struct FunctionResult {
+  std::string name;
+  uint32_t address;
+  uint32_t guest_instr_count;
+  size_t machine_code_length;
+  uint64_t ticks;
+  size_t peak_arena_size;
+};
+
+// Totals for a single pass, matched up by position in the pipeline as the
+// same pass may run more than once.
+struct PassResult {
+  const char* name;
+  uint64_t ticks;
+  uint64_t instr_count_before;
+  uint64_t instr_count_after;
+  uint64_t value_count_before;
+  uint64_t value_count_after;
+};
+
+struct WorkloadResult {
+  const char* name;
+  uint64_t loop_count;
+  uint64_t ticks;
+};
+
+bool DiscoverMaps(const std::wstring& bin_path,
+                  std::vector<std::wstring>& map_files) {
+// TODO(benvanik): use PAL instead of this.
+#if XE_PLATFORM_WIN32
+  std::wstring search_path = bin_path;
+  search_path.append(L"\\*.map");
+  WIN32_FIND_DATA ffd;
+  HANDLE hFind = FindFirstFile(search_path.c_str(), &ffd);
+  if (hFind == INVALID_HANDLE_VALUE) {
+    XELOGE("Unable to find bin path %ls", bin_path.c_str());
+    return false;
+  }
+  do {
+    if (!(ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+      std::wstring file_path = bin_path;
+      if (*(bin_path.end() - 1) != '\\') {
+        file_path += '\\';
+      }
+      file_path += ffd.cFileName;
+      map_files.push_back(file_path);
+    }
+  } while (FindNextFile(hFind, &ffd));
+  FindClose(hFind);
+#else
+  DIR* d = opendir(xe::to_string(bin_path).c_str());
+  if (!d) {
+    XELOGE("Unable to find bin path %ls", bin_path.c_str());
+    return false;
+  }
+  struct dirent* dir;
+  while ((dir = readdir(d))) {
+    if (dir->d_type == DT_REG) {
+      std::wstring file_name = xe::to_wstring(dir->d_name);
+      if (file_name.rfind(L".map") != std::wstring::npos) {
+        std::wstring file_path = bin_path;
+        if (*(bin_path.end() - 1) != '/') {
+          file_path += '/';
+        }
+        file_path += file_name;
+        map_files.push_back(file_path);
+      }
+    }
+  }
+  closedir(d);
+#endif  // WIN32
+  std::sort(map_files.begin(), map_files.end());
+  return true;
+}
+
+// Reads the test_ symbols out of a map produced alongside the binary:
+// 0000000000000000 t test_add1
+bool ReadMap(const std::wstring& map_file_path,
+             std::vector<std::pair<std::string, uint32_t>>& functions) {
+  FILE* f = fopen(xe::to_string(map_file_path).c_str(), "r");
+  if (!f) {
+    return false;
+  }
+  char line_buffer[BUFSIZ];
+  while (fgets(line_buffer, sizeof(line_buffer), f)) {
+    char* newline = strrchr(line_buffer, '\n');
+    if (newline) {
+      *newline = 0;
+    }
+    char* t_test_ = strstr(line_buffer, " t test_");
+    if (!t_test_) {
+      continue;
+    }
+    std::string address(line_buffer, t_test_ - line_buffer);
+    std::string name(t_test_ + strlen(" t "));
+    functions.emplace_back(
+        name, START_ADDRESS + uint32_t(std::stoul(address, 0, 16)));
+  }
+  fclose(f);
+  return true;
+}
+
+bool BenchBinary(const std::wstring& map_file_path, TranslationTier tier,
+                 std::vector<FunctionResult>& function_results,
+                 std::vector<PassResult>& pass_results) {
+  std::wstring bin_file_path = map_file_path;
+  bin_file_path.replace(bin_file_path.find_last_of('.'), std::wstring::npos,
+                        L".bin");
+
+  std::vector<std::pair<std::string, uint32_t>> functions;
+  if (!ReadMap(map_file_path, functions)) {
+    XELOGE("Unable to read map %ls", map_file_path.c_str());
+    return false;
+  }
+
+  auto memory = std::make_unique<Memory>();
+  memory->Initialize();
+  auto processor = std::make_unique<Processor>(memory.get(), nullptr, nullptr);
+  processor->Setup();
+
+  auto module = std::make_unique<xe::cpu::RawModule>(processor.get());
+  if (!module->LoadFile(START_ADDRESS, bin_file_path)) {
+    XELOGE("Unable to load binary %ls", bin_file_path.c_str());
+    return false;
+  }
+  processor->AddModule(std::move(module));
+  processor->backend()->CommitExecutableRange(START_ADDRESS,
+                                              START_ADDRESS + 1024 * 1024);
+
+  // A translator of our own, so that the statistics of each translation can be
+  // read back and nothing is placed in the processor's function tables.
+  PPCTranslator translator(processor->frontend());
+  translator.set_collect_statistics(true);
+
+  // Code is left in the code cache, so the functions must outlive the loop.
+  std::vector<std::unique_ptr<Function>> translated_functions;
+  for (auto& it : functions) {
+    FunctionInfo* symbol_info = nullptr;
+    if (!processor->LookupFunctionInfo(it.second, &symbol_info)) {
+      XELOGE("Unable to declare %s at %.8X", it.first.c_str(), it.second);
+      return false;
+    }
+
+    FunctionResult result = {};
+    result.name = it.first;
+    result.address = it.second;
+    for (int32_t i = 0; i < FLAGS_bench_iterations; ++i) {
+      Function* function = nullptr;
+      uint64_t start_ticks = Clock::QueryHostTickCount();
+      if (!translator.Translate(symbol_info, 0, tier, &function)) {
+        XELOGE("Unable to translate %s at %.8X", it.first.c_str(), it.second);
+        return false;
+      }
+      result.ticks += Clock::QueryHostTickCount() - start_ticks;
+      translated_functions.emplace_back(function);
+      result.guest_instr_count =
+          (symbol_info->end_address() - symbol_info->address()) / 4 + 1;
+      result.machine_code_length = function->machine_code_length();
+
+      auto& pass_statistics = translator.pass_statistics(tier);
+      if (pass_results.size() < pass_statistics.size()) {
+        pass_results.resize(pass_statistics.size(), PassResult());
+      }
+      for (size_t j = 0; j < pass_statistics.size(); ++j) {
+        auto& statistics = pass_statistics[j];
+        auto& pass_result = pass_results[j];
+        pass_result.name = statistics.name;
+        pass_result.ticks += statistics.ticks;
+        pass_result.instr_count_before += statistics.instr_count_before;
+        pass_result.instr_count_after += statistics.instr_count_after;
+        pass_result.value_count_before += statistics.value_count_before;
+        pass_result.value_count_after += statistics.value_count_after;
+        result.peak_arena_size =
+            std::max(result.peak_arena_size, statistics.arena_size);
+      }
+    }
+    function_results.push_back(result);
+  }
+
+  translated_functions.clear();
+  processor.reset();
+  memory.reset();
+  return true;
+}
+
+// Vector shifts and averages with no single x64 instruction: uniform and
+// per-byte shifts, per-word shifts and dword averages. Each pass through the
+// loop feeds the next so none of it can be hoisted.
+bool GenerateVectorShiftWorkload(HIRBuilder& b) {
+  size_t v0_offset = offsetof(PPCContext, v) + 0 * 16;
+  size_t v1_offset = offsetof(PPCContext, v) + 1 * 16;
+  size_t r3_offset = offsetof(PPCContext, r) + 3 * 8;
+  auto loop = b.NewLabel();
+  b.MarkLabel(loop);
+  auto value = b.LoadContext(v0_offset, hir::VEC128_TYPE);
+  auto shamt = b.LoadContext(v1_offset, hir::VEC128_TYPE);
+  value = b.VectorShl(value, shamt, hir::INT8_TYPE);
+  value = b.VectorSha(value, b.LoadConstantVec128(vec128b(3)), hir::INT8_TYPE);
+  value = b.VectorShr(value, shamt, hir::INT16_TYPE);
+  value = b.VectorAverage(value, shamt, hir::INT32_TYPE, 0);
+  value = b.VectorAverage(value, shamt, hir::INT32_TYPE,
+                          hir::ARITHMETIC_UNSIGNED);
+  b.StoreContext(v0_offset, value);
+  auto count = b.Sub(b.LoadContext(r3_offset, hir::INT64_TYPE),
+                     b.LoadConstantUint64(1));
+  b.StoreContext(r3_offset, count);
+  b.BranchTrue(b.CompareNE(count, b.LoadZeroInt64()), loop);
+  b.Return();
+  return true;
+}
+
+bool BenchWorkload(const char* name,
+                   std::function<bool(HIRBuilder&)> generate,
+                   std::vector<WorkloadResult>& workload_results) {
+  const uint32_t kWorkloadAddress = 0x80000000;
+  const uint64_t kLoopCount = 1 << 20;
+
+  uint32_t memory_size = 16 * 1024 * 1024;
+  auto memory = std::make_unique<Memory>();
+  memory->Initialize();
+  auto processor = std::make_unique<Processor>(memory.get(), nullptr, nullptr);
+  processor->Setup();
+  processor->AddModule(std::make_unique<TestModule>(
+      processor.get(), name,
+      [kWorkloadAddress](uint32_t address) {
+        return address == kWorkloadAddress;
+      },
+      generate));
+  processor->backend()->CommitExecutableRange(kWorkloadAddress,
+                                              kWorkloadAddress + 0x10000);
+
+  Function* function = nullptr;
+  if (!processor->ResolveFunction(kWorkloadAddress, &function)) {
+    XELOGE("Unable to generate workload %s", name);
+    return false;
+  }
+
+  uint32_t stack_size = 64 * 1024;
+  uint32_t stack_address = memory_size - stack_size;
+  uint32_t thread_state_address = stack_address - 0x1000;
+  auto thread_state = std::make_unique<ThreadState>(
+      processor.get(), 0x100, ThreadStackType::kUserStack, stack_address,
+      stack_size, thread_state_address);
+  auto ctx = thread_state->context();
+
+  WorkloadResult result = {};
+  result.name = name;
+  for (int32_t i = 0; i < FLAGS_bench_iterations; ++i) {
+    ctx->v[0] = vec128i(0x01234567, 0x89ABCDEF, 0xFEDCBA98, 0x76543210);
+    ctx->v[1] = vec128i(0x00010203, 0x04050607, 0x08090A0B, 0x0C0D0E0F);
+    ctx->r[3] = kLoopCount;
+    ctx->lr = 0xBCBCBCBC;
+    uint64_t start_ticks = Clock::QueryHostTickCount();
+    function->Call(thread_state.get(), uint32_t(ctx->lr));
+    result.ticks += Clock::QueryHostTickCount() - start_ticks;
+    result.loop_count += kLoopCount;
+  }
+  workload_results.push_back(result);
+
+  thread_state.reset();
+  processor.reset();
+  memory.reset();
+  return true;
+}
+
+void WriteResults(FILE* f, TranslationTier tier,
+                  const std::vector<FunctionResult>& function_results,
+                  const std::vector<PassResult>& pass_results,
+                  const std::vector<WorkloadResult>& workload_results) {
+  double frequency = double(Clock::host_tick_frequency());
+  uint32_t iterations = uint32_t(FLAGS_bench_iterations);
+
+  fprintf(f, "{\n");
+  fprintf(f, "  \"tier\": \"%s\",\n",
+          tier == TranslationTier::kBaseline ? "baseline" : "optimized");
+  fprintf(f, "  \"iterations\": %u,\n", iterations);
+
+  uint64_t total_guest_instr_count = 0;
+  uint64_t total_machine_code_length = 0;
+  fprintf(f, "  \"functions\": [\n");
+  for (size_t i = 0; i < function_results.size(); ++i) {
+    auto& result = function_results[i];
+    total_guest_instr_count += result.guest_instr_count;
+    total_machine_code_length += result.machine_code_length;
+    fprintf(f,
+            "    {\"name\": \"%s\", \"address\": \"%.8X\", "
+            "\"guest_instrs\": %u, \"host_bytes\": %llu, "
+            "\"bytes_per_guest_instr\": %.2f, \"seconds\": %.9f, "
+            "\"peak_arena_bytes\": %llu}%s\n",
+            result.name.c_str(), result.address, result.guest_instr_count,
+            uint64_t(result.machine_code_length),
+            double(result.machine_code_length) / result.guest_instr_count,
+            result.ticks / frequency / iterations,
+            uint64_t(result.peak_arena_size),
+            i + 1 < function_results.size() ? "," : "");
+  }
+  fprintf(f, "  ],\n");
+
+  // Pass totals are summed over all functions and averaged over iterations.
+  fprintf(f, "  \"passes\": [\n");
+  for (size_t i = 0; i < pass_results.size(); ++i) {
+    auto& result = pass_results[i];
+    fprintf(f,
+            "    {\"index\": %llu, \"name\": \"%s\", \"seconds\": %.9f, "
+            "\"instrs_before\": %llu, \"instrs_after\": %llu, "
+            "\"values_before\": %llu, \"values_after\": %llu}%s\n",
+            uint64_t(i), result.name, result.ticks / frequency / iterations,
+            result.instr_count_before / iterations,
+            result.instr_count_after / iterations,
+            result.value_count_before / iterations,
+            result.value_count_after / iterations,
+            i + 1 < pass_results.size() ? "," : "");
+  }
+  fprintf(f, "  ],\n");
+
+  fprintf(f,
+          "  \"totals\": {\"functions\": %llu, \"guest_instrs\": %llu, "
+          "\"host_bytes\": %llu, \"bytes_per_guest_instr\": %.2f}%s\n",
+          uint64_t(function_results.size()), total_guest_instr_count,
+          total_machine_code_length,
+          total_guest_instr_count
+              ? double(total_machine_code_length) / total_guest_instr_count
+              : 0.0,
+          workload_results.empty() ? "" : ",");
+
+  // Workload times are per pass through the loop.
+  if (!workload_results.empty()) {
+    fprintf(f, "  \"workloads\": [\n");
+    for (size_t i = 0; i < workload_results.size(); ++i) {
+      auto& result = workload_results[i];
+      fprintf(f,
+              "    {\"name\": \"%s\", \"loops\": %llu, "
+              "\"nanoseconds_per_loop\": %.3f}%s\n",
+              result.name, result.loop_count,
+              result.ticks / frequency * 1e9 / result.loop_count,
+              i + 1 < workload_results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n");
+  }
+  fprintf(f, "}\n");
+}
+
+int main(std::vector<std::wstring>& args) {
+  if (FLAGS_bench_iterations < 1) {
+    XELOGE("Invalid iteration count %d", FLAGS_bench_iterations);
+    return 1;
+  }
+
+  TranslationTier tier;
+  if (FLAGS_bench_tier == "baseline") {
+    tier = TranslationTier::kBaseline;
+  } else if (FLAGS_bench_tier == "optimized") {
+    tier = TranslationTier::kOptimized;
+  } else {
+    XELOGE("Unknown tier %s", FLAGS_bench_tier.c_str());
+    return 1;
+  }
+
+  auto bin_path = xe::fix_path_separators(xe::to_wstring(FLAGS_bench_bin_path));
+  std::vector<std::wstring> map_files;
+  if (!DiscoverMaps(bin_path, map_files)) {
+    return 1;
+  }
+  if (map_files.empty()) {
+    XELOGE("No binaries discovered - invalid path?");
+    return 1;
+  }
+
+  std::vector<FunctionResult> function_results;
+  std::vector<PassResult> pass_results;
+  for (auto& map_file_path : map_files) {
+    if (!BenchBinary(map_file_path, tier, function_results, pass_results)) {
+      return 1;
+    }
+  }
+
+  std::vector<WorkloadResult> workload_results;
+  if (FLAGS_bench_workloads) {
+    if (!BenchWorkload("vector_shift", GenerateVectorShiftWorkload,
+                       workload_results)) {
+      return 1;
+    }
+  }
+
+  FILE* f = stdout;
+  if (!FLAGS_bench_output.empty()) {
+    f = fopen(FLAGS_bench_output.c_str(), "w");
+    if (!f) {
+      XELOGE("Unable to open %s for writing", FLAGS_bench_output.c_str());
+      return 1;
+    }
+  }
+  WriteResults(f, tier, function_results, pass_results, workload_results);
+  if (f != stdout) {
+    fclose(f);
+  }
+  return 0;
+}
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT(L"xe-cpu-jit-bench", L"xe-cpu-jit-bench",
+                   xe::cpu::test::main);
@@ -58,8 +58,12 @@ TestModule::TestModule(Processor* processor, const std::string& name,
   // Will modify the HIR to add loads/stores.
   // This should be the last pass before finalization, as after this all
   // registers are assigned and ready to be emitted.
-  compiler_->AddPass(std::make_unique<passes::RegisterAllocationPass>(
-      processor->backend()->machine_info()));
+  // Backends without registers (the interpreter) take the HIR as is.
+  auto machine_info = processor->backend()->machine_info();
+  if (machine_info->register_sets[0].count) {
+    compiler_->AddPass(
+        std::make_unique<passes::RegisterAllocationPass>(machine_info));
+  }
 
   // Must come last. The HIR is not really HIR after this.
   compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
@@ -85,6 +89,8 @@ SymbolStatus TestModule::DeclareFunction(uint32_t address,
       symbol_info->set_status(SymbolStatus::kFailed);
       return SymbolStatus::kFailed;
     }
+    // Fall-through branches, as the frontend adds.
+    builder_->Finalize();
 
     compiler_->Compile(builder_.get());
 
@@ -95,12 +95,17 @@ ThreadState::ThreadState(Processor* processor, uint32_t thread_id,
   std::memset(context_, 0, sizeof(PPCContext));
 
   // Stash pointers to common structures that callbacks may need.
-  context_->reserve_address = memory_->reserve_address();
+  context_->global_lock_word =
+      processor_->frontend()->builtins()->global_lock.word();
   context_->virtual_membase = memory_->virtual_membase();
   context_->physical_membase = memory_->physical_membase();
   context_->processor = processor_;
   context_->thread_state = this;
+  context_->reserved_address = ~0ull;
   context_->thread_id = thread_id_;
+  if (processor_->block_counters()) {
+    context_->block_counters = processor_->block_counters()->AcquireShard();
+  }
 
   // Set initial registers.
   context_->r[1] = stack_base_;
@@ -11,6 +11,7 @@
 
 #include <algorithm>
 
+#include "third_party/xxhash/xxhash.h"
 #include "xenia/base/byte_order.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
@@ -77,6 +78,13 @@ bool XexModule::Load(const std::string& name, const std::string& path,
     }
   }
 
+  // Hash the code now that imports have been written into it, so that
+  // persisted translations can be matched to it in later runs.
+  if (high_address_ > low_address_) {
+    code_hash_ = XXH64(memory()->TranslateVirtual(low_address_),
+                       high_address_ - low_address_, 0);
+  }
+
   // Find __savegprlr_* and __restgprlr_* and the others.
   // We can flag these for special handling (inlining/etc).
   if (!FindSaveRest()) {
@@ -262,6 +270,13 @@ bool XexModule::ContainsAddress(uint32_t address) {
   return address >= low_address_ && address < high_address_;
 }
 
+bool XexModule::QueryAddressRange(uint32_t* out_low_address,
+                                  uint32_t* out_high_address) {
+  *out_low_address = low_address_;
+  *out_high_address = high_address_;
+  return true;
+}
+
 bool XexModule::FindSaveRest() {
   // Special stack save/restore functions.
   // http://research.microsoft.com/en-us/um/redmond/projects/invisible/src/crt/md/ppc/xxx.s.htm
@@ -36,6 +36,8 @@ class XexModule : public xe::cpu::Module {
   const std::string& name() const override { return name_; }
 
   bool ContainsAddress(uint32_t address) override;
+  bool QueryAddressRange(uint32_t* out_low_address,
+                         uint32_t* out_high_address) override;
 
  private:
   bool SetupImports(xe_xex2_ref xex);
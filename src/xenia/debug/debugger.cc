@@ -212,15 +212,18 @@ void Debugger::OnMessage(std::vector<uint8_t> buffer) {
   auto request = flatbuffers::GetRoot<proto::Request>(buffer.data());
   switch (request->request_data_type()) {
     case proto::RequestData_AttachRequest: {
-      // Send debug info.
+      // Send debug info. There's no code cache when interpreting.
       auto code_cache = emulator()->processor()->backend()->code_cache();
       response_data_type = proto::ResponseData_AttachResponse;
       response_data_offset =
           proto::CreateAttachResponse(
               fbb, fbb.CreateString(
                        xe::to_string(emulator()->memory()->file_name())),
-              fbb.CreateString(xe::to_string(code_cache->file_name())),
-              code_cache->base_address(), code_cache->total_size(),
+              fbb.CreateString(code_cache
+                                   ? xe::to_string(code_cache->file_name())
+                                   : std::string()),
+              code_cache ? code_cache->base_address() : 0,
+              code_cache ? code_cache->total_size() : 0,
               fbb.CreateString(xe::to_string(functions_path_)),
               fbb.CreateString(xe::to_string(functions_trace_path_))).Union();
 
@@ -26,6 +26,12 @@ XUserModule::XUserModule(KernelState* kernel_state, const char* path)
       execution_info_ptr_(0) {}
 
 XUserModule::~XUserModule() {
+  // Frees the module's generated code, so titles loading and unloading DLC
+  // modules don't keep growing the code cache.
+  if (processor_module_) {
+    kernel_state()->processor()->RemoveModule(processor_module_);
+    processor_module_ = nullptr;
+  }
   kernel_state()->memory()->SystemHeapFree(execution_info_ptr_);
   xe_xex2_dealloc(xex_);
 }
@@ -79,7 +79,6 @@ void CrashDump() { active_memory_->DumpMap(); }
 Memory::Memory()
     : virtual_membase_(nullptr),
       physical_membase_(nullptr),
-      reserve_address_(0),
       mapping_(0),
       mapping_base_(nullptr) {
   system_page_size_ = uint32_t(xe::page_size());
@@ -379,6 +378,15 @@ uintptr_t Memory::AddPhysicalWriteWatch(uint32_t physical_address,
       physical_address, length, callback, callback_context, callback_data);
 }
 
+uintptr_t Memory::AddVirtualWriteWatch(uint32_t virtual_address,
+                                       uint32_t length,
+                                       cpu::WriteWatchCallback callback,
+                                       void* callback_context,
+                                       void* callback_data) {
+  return mmio_handler_->AddVirtualWriteWatch(
+      virtual_address, length, callback, callback_context, callback_data);
+}
+
 void Memory::CancelWriteWatch(uintptr_t watch_handle) {
   mmio_handler_->CancelWriteWatch(watch_handle);
 }
@@ -181,8 +181,6 @@ class Memory {
                                (guest_address & 0x1FFFFFFF));
   }
 
-  inline uint64_t* reserve_address() { return &reserve_address_; }
-
   // TODO(benvanik): make poly memory utils for these.
   void Zero(uint32_t address, uint32_t size);
   void Fill(uint32_t address, uint32_t size, uint8_t value);
@@ -199,6 +197,9 @@ class Memory {
   uintptr_t AddPhysicalWriteWatch(uint32_t physical_address, uint32_t length,
                                   cpu::WriteWatchCallback callback,
                                   void* callback_context, void* callback_data);
+  uintptr_t AddVirtualWriteWatch(uint32_t virtual_address, uint32_t length,
+                                 cpu::WriteWatchCallback callback,
+                                 void* callback_context, void* callback_data);
   void CancelWriteWatch(uintptr_t watch_handle);
 
   uint32_t SystemHeapAlloc(uint32_t size, uint32_t alignment = 0x20,
@@ -219,7 +220,6 @@ class Memory {
   uint32_t system_page_size_;
   uint8_t* virtual_membase_;
   uint8_t* physical_membase_;
-  uint64_t reserve_address_;
 
   HANDLE mapping_;
   uint8_t* mapping_base_;
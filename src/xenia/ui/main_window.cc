@@ -12,6 +12,7 @@
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/threading.h"
+#include "xenia/cpu/processor.h"
 #include "xenia/gpu/graphics_system.h"
 #include "xenia/emulator.h"
 #include "xenia/profiling.h"
@@ -64,6 +65,17 @@ bool MainWindow::Initialize() {
         emulator()->graphics_system()->ClearCaches();
         break;
       }
+      case 0x75: {  // VK_F6
+        emulator()->processor()->sampling_profiler()->Toggle();
+        break;
+      }
+      case 0x76: {  // VK_F7
+        auto block_counters = emulator()->processor()->block_counters();
+        if (block_counters) {
+          block_counters->Dump();
+        }
+        break;
+      }
       case 0x7A: { // VK_F11
         ToggleFullscreen();
         break;